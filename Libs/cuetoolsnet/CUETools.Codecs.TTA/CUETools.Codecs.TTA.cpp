@@ -64,7 +64,18 @@ namespace TTA {
 
 			try 
 			{
-				_ttaReader = new TTALib::TTAReader((HANDLE)((FileStream^) _IO)->Handle);
+				HANDLE hFile = (HANDLE)((FileStream^) _IO)->Handle;
+
+				// read through the handle if the file can't be mapped, e.g. when
+				// there's no room for the mapping in the address space
+				try
+				{
+					_ttaInput = new TTALib::TTAMappedInput(hFile);
+				} catch (TTALib::TTAException)
+				{
+					_ttaInput = new TTALib::TTAFileInput(hFile);
+				}
+				_ttaReader = new TTALib::TTAReader(_ttaInput);
 			} catch (TTALib::TTAException ex)
 			{
 				throw gcnew Exception(String::Format("TTA decoder: {0}", gcnew String(TTAErrorsStr[ex.GetErrNo()])));
@@ -125,6 +136,11 @@ namespace TTA {
 				delete _ttaReader;
 				_ttaReader = nullptr;
 			}
+			if (_ttaInput) 
+			{
+				delete _ttaInput;
+				_ttaInput = nullptr;
+			}
 			if (_IO != nullptr) 
 			{
 				_IO->Close ();
@@ -132,20 +148,19 @@ namespace TTA {
 			}
 		}
 
-		void processBlock (long * buffer, int sampleCount)
+		int decodeBlock (Int32 * buffer)
 		{
-			if (_bufferLength > 0)
-				throw gcnew Exception("Received unrequested samples.");
-
-			if ((_sampleBuffer == nullptr) || (_sampleBuffer->GetLength(0) < sampleCount))
-			    _sampleBuffer = gcnew array<Int32, 2>(sampleCount, pcm->ChannelCount);
-
-			interior_ptr<Int32> pMyBuffer = &_sampleBuffer[0, 0];
-			const long *pTTABuffer = buffer;
-			const long *pTTABufferEnd = pTTABuffer + sampleCount * pcm->ChannelCount;
-			while (pTTABuffer < pTTABufferEnd) 
-				*(pMyBuffer++) = *(pTTABuffer++);
-			_bufferLength = sampleCount;
+			int samplesInBuf;
+			try
+			{
+				samplesInBuf = _ttaReader->GetBlock((int32 *) buffer);
+			} catch (TTALib::TTAException ex)
+			{
+				throw gcnew Exception(String::Format("TTA decoder: {0}", gcnew String(TTAErrorsStr[ex.GetErrNo()])));
+			}
+			if (samplesInBuf == 0)
+				throw gcnew Exception("An error occurred while decoding.");
+			return samplesInBuf;
 		}
 
 		virtual int Read(AudioBuffer^ buff, int maxLength)
@@ -159,23 +174,24 @@ namespace TTA {
 			{
 				if (SamplesInBuffer == 0) 
 				{
-					_bufferOffset = 0;
-					_bufferLength = 0;
-					do
+					Int32 frameLength = _ttaReader->GetFrameLength();
+					if (frameLength == 0)
+						throw gcnew Exception("An error occurred while decoding.");
+					if (samplesNeeded >= frameLength)
 					{
-						long * buf;
-						int samplesInBuf;
-						try
-						{
-							samplesInBuf = _ttaReader->GetBlock(&buf);
-						} catch (TTALib::TTAException ex)
-						{
-							throw gcnew Exception(String::Format("TTA decoder: {0}", gcnew String(TTAErrorsStr[ex.GetErrNo()])));
-						}
-						if (samplesInBuf == 0)
-							throw gcnew Exception("An error occurred while decoding.");
-						processBlock (buf, samplesInBuf);
-					} while (_bufferLength == 0);
+						// the whole frame fits, decode it in place
+						pin_ptr<Int32> pSampleBuffer = &buff->Samples[buffOffset, 0];
+						Int32 samplesInBuf = decodeBlock(pSampleBuffer);
+						_sampleOffset += samplesInBuf;
+						samplesNeeded -= samplesInBuf;
+						buffOffset += samplesInBuf;
+						continue;
+					}
+					if ((_sampleBuffer == nullptr) || (_sampleBuffer->GetLength(0) < frameLength))
+						_sampleBuffer = gcnew array<Int32, 2>(frameLength, pcm->ChannelCount);
+					pin_ptr<Int32> pSampleBuffer = &_sampleBuffer[0, 0];
+					_bufferOffset = 0;
+					_bufferLength = decodeBlock(pSampleBuffer);
 					_sampleOffset += _bufferLength;
 				}
 				Int32 copyCount = Math::Min(samplesNeeded, SamplesInBuffer);
@@ -196,6 +212,7 @@ namespace TTA {
 		Stream^ _IO;
 		Int32 _bufferOffset, _bufferLength;
 		TTALib::TTAReader * _ttaReader;
+		TTALib::TTAInput * _ttaInput;
 
 		property Int32 SamplesInBuffer {
 			Int32 get () 
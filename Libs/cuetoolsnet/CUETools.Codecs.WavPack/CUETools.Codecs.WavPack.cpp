@@ -29,21 +29,48 @@
 // 
 // ****************************************************************************
 
+// windows.h has to come before the using directives (IServiceProvider would
+// be ambiguous otherwise)
+#include <windows.h>
+
 using namespace System;
 using namespace System::ComponentModel;
 using namespace System::Runtime::InteropServices;
-using namespace System::Security::Cryptography;
 using namespace System::IO;
 using namespace CUETools::Codecs;
 
 #include <stdio.h>
 #include <memory.h>
+#include <stdlib.h>
 #include "wavpack.h"
 #include <string.h>
 
 namespace CUETools { namespace Codecs { namespace WavPack {
 	int write_block(void *id, void *data, int32_t length);
 
+	// a whole .wv or .wvc file mapped into memory, read by mapped_reader
+	// without going through managed code
+	struct MappedFile {
+		HANDLE hFile, hMapping;
+		const unsigned char *data;
+		uint32_t length, pos;
+		bool failed;
+	};
+	MappedFile *open_mapped_file(const wchar_t *path);
+	void close_mapped_file(MappedFile *file);
+	extern WavpackStreamReader mapped_reader;
+
+	// MD5 of the encoded audio, hashed on a separate thread. The encoding
+	// thread fills a buffer from md5_worker_buffer() and hands it over with
+	// md5_worker_push(); the buffers go round a ring that the two threads
+	// share without locking.
+	struct MD5Worker;
+	MD5Worker *md5_worker_start();
+	unsigned char *md5_worker_buffer(MD5Worker *worker, uint32_t length);
+	void md5_worker_push(MD5Worker *worker, uint32_t length);
+	void md5_worker_finish(MD5Worker *worker, unsigned char digest[16]);
+	void format_samples(const int32_t *samples, int count, int shift, int32_t *shifted, unsigned char *bytes, int bytesPerSample);
+
 	[UnmanagedFunctionPointer(CallingConvention::Cdecl)]
 	public delegate int32_t DecoderReadDelegate(void *id, void *data, int32_t bcount);
 	[UnmanagedFunctionPointer(CallingConvention::Cdecl)]
@@ -99,14 +126,48 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 
 			_path = path;
 
-			_IO = (IO != nullptr) ? IO : gcnew FileStream (path, FileMode::Open, FileAccess::Read, FileShare::Read);
-			_IO_WVC = (IO != nullptr) ? IO_WVC : System::IO::File::Exists (path+"c") ? gcnew FileStream (path+"c", FileMode::Open, FileAccess::Read, FileShare::Read) : nullptr;
+			// files opened by path on local fixed drives are mapped into memory
+			// and read natively, the managed callbacks are only used for streams,
+			// other drives (a network or removable drive can go away under the
+			// mapping) or if mapping fails, e.g. when there's no room for the
+			// file in a 32-bit process
+			if (IO == nullptr && UseMemoryMapping)
+				OpenMapped (path);
+
+			int openFlags = OPEN_WVC | (UseSeekIndex ? OPEN_SEEK_INDEX : 0);
+			if (_mapped != NULL)
+				_wpc = WavpackOpenFileInputEx (&mapped_reader, _mapped, _mappedWVC, errorMessage, openFlags, 0);
+			else
+			{
+				_IO = (IO != nullptr) ? IO : gcnew FileStream (path, FileMode::Open, FileAccess::Read, FileShare::Read);
+				_IO_WVC = (IO != nullptr) ? IO_WVC : System::IO::File::Exists (path+"c") ? gcnew FileStream (path+"c", FileMode::Open, FileAccess::Read, FileShare::Read) : nullptr;
 
-			_wpc = WavpackOpenFileInputEx (ioReader, "v", _IO_WVC != nullptr ? "c" : NULL, errorMessage, OPEN_WVC, 0);
+				_wpc = WavpackOpenFileInputEx (ioReader, "v", _IO_WVC != nullptr ? "c" : NULL, errorMessage, openFlags, 0);
+			}
 			if (_wpc == NULL) {
+				CloseMapped ();
 				throw gcnew Exception("Unable to initialize the decoder.");
 			}
 
+			// with UseSeekIndexFile seeks go straight to the right block using the
+			// index saved beside the file; if there is none (or it no longer
+			// matches) the index is built on the first seek and saved on close,
+			// but only next to a writable file on a local fixed drive
+			String^ indexPath = (IO == nullptr && UseSeekIndex && UseSeekIndexFile) ? path + "i" : nullptr;
+			if (indexPath != nullptr && System::IO::File::Exists (indexPath))
+			{
+				try
+				{
+					array<unsigned char>^ index = System::IO::File::ReadAllBytes (indexPath);
+					pin_ptr<unsigned char> pIndex = &index[0];
+					if (index->Length > 0 && WavpackSetSeekIndex (_wpc, pIndex, index->Length))
+						indexPath = nullptr;
+				}
+				catch (Exception^) {}
+			}
+			if (indexPath != nullptr && IsWritableLocalFile (path))
+				_indexPath = indexPath;
+
 			pcm = gcnew AudioPCMConfig(
 			    WavpackGetBitsPerSample(_wpc), 
 			    WavpackGetNumChannels(_wpc), 
@@ -120,6 +181,24 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 			delete ioReader;
 		}
 
+		static WavPackReader()
+		{
+			UseMemoryMapping = true;
+			UseSeekIndex = false;
+			UseSeekIndexFile = false;
+		}
+
+		// read files opened by path through a memory mapping instead of a FileStream
+		static property bool UseMemoryMapping;
+
+		// keep an index of the block positions (read from the file on the first
+		// seek) so that seeks don't have to search for their block
+		static property bool UseSeekIndex;
+
+		// with UseSeekIndex, load the index from "<file>.wvi" and save it there
+		// on Close (files on network, removable or read-only media are left alone)
+		static property bool UseSeekIndexFile;
+
 		virtual property AudioPCMConfig^ PCM {
 			AudioPCMConfig^ get() {
 				return pcm;
@@ -159,7 +238,11 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 		virtual void Close() 
 		{
 			if (_wpc != NULL)
+			{
+				SaveSeekIndex ();
 				_wpc = WavpackCloseFile(_wpc);
+			}
+			CloseMapped ();
 			if (_IO != nullptr) 
 			{
 				_IO->Close ();
@@ -189,6 +272,7 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 		Int32 _sampleCount, _sampleOffset;
 		AudioPCMConfig^ pcm;
 		String^ _path;
+		String^ _indexPath;
 		Stream^ _IO;
 		Stream^ _IO_WVC;
 		DecoderReadDelegate^ _readDel;
@@ -201,6 +285,57 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 		array<unsigned char>^ _readBuffer;
 		int _IO_ungetc, _IO_WVC_ungetc;
 		WavpackStreamReader* ioReader;
+		MappedFile *_mapped, *_mappedWVC;
+
+		void OpenMapped (String^ path)
+		{
+			IntPtr pathChars = Marshal::StringToHGlobalUni(path);
+			_mapped = open_mapped_file ((const wchar_t*)pathChars.ToPointer());
+			Marshal::FreeHGlobal(pathChars);
+			if (_mapped == NULL || !System::IO::File::Exists (path+"c"))
+				return;
+			pathChars = Marshal::StringToHGlobalUni(path+"c");
+			_mappedWVC = open_mapped_file ((const wchar_t*)pathChars.ToPointer());
+			Marshal::FreeHGlobal(pathChars);
+			if (_mappedWVC == NULL)
+				CloseMapped ();
+		}
+
+		void CloseMapped ()
+		{
+			close_mapped_file (_mapped);
+			close_mapped_file (_mappedWVC);
+			_mapped = _mappedWVC = NULL;
+		}
+
+		// a file that a seek index may be written beside
+		static bool IsWritableLocalFile (String^ path)
+		{
+			try
+			{
+				String^ root = System::IO::Path::GetPathRoot (System::IO::Path::GetFullPath (path));
+				if (String::IsNullOrEmpty (root) || root->StartsWith ("\\\\"))
+					return false;
+				if ((gcnew DriveInfo (root))->DriveType != DriveType::Fixed)
+					return false;
+				return (System::IO::File::GetAttributes (path) & FileAttributes::ReadOnly) != FileAttributes::ReadOnly;
+			}
+			catch (Exception^)
+			{
+				return false;
+			}
+		}
+
+		void SaveSeekIndex ()
+		{
+			uint32_t indexSize = _indexPath != nullptr ? WavpackGetSeekIndex (_wpc, NULL, 0) : 0;
+			if (!indexSize)
+				return;
+			array<unsigned char>^ index = gcnew array<unsigned char>(indexSize);
+			pin_ptr<unsigned char> pIndex = &index[0];
+			WavpackGetSeekIndex (_wpc, pIndex, indexSize);
+			try { System::IO::File::WriteAllBytes (_indexPath, index); } catch (Exception^) {}
+		}
 
 		int32_t ReadCallback (void *id, void *data, int32_t bcount)
 		{
@@ -359,12 +494,29 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 			}
 		}
 
+		~WavPackWriter()
+		{
+			this->!WavPackWriter();
+		}
+
+		// a writer dropped without Close() still has to stop its MD5 thread
+		!WavPackWriter()
+		{
+			if (_md5 != NULL)
+			{
+				unsigned char md5_digest[16];
+				md5_worker_finish (_md5, md5_digest);
+				_md5 = NULL;
+			}
+		}
+
 		virtual void Close() 
 		{
-		    if (_settings->MD5Sum)
+		    if (_md5 != NULL)
 		    {
-			_md5hasher->TransformFinalBlock (gcnew array<unsigned char>(1), 0, 0);
-			pin_ptr<unsigned char> md5_digest = &_md5hasher->Hash[0];
+			unsigned char md5_digest[16];
+			md5_worker_finish (_md5, md5_digest);
+			_md5 = NULL;
 			WavpackStoreMD5Sum (_wpc, md5_digest);
 		    }
 
@@ -417,26 +569,39 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 				Initialize();
 
 			sampleBuffer->Prepare(this);
+			if (sampleBuffer->Length == 0)
+				return;
+
+			// samples that don't fill whole bytes are shifted up for WavPack, and the
+			// MD5 bytes (which are left-justified the same way) are formatted in the
+			// same pass and hashed on the MD5 thread while this one packs
+			int count = sampleBuffer->Length * _pcm->ChannelCount;
+			int shift = (_pcm->BitsPerSample & 7) != 0 ? 8 - (_pcm->BitsPerSample & 7) : 0;
+			int bytesPerSample = _pcm->BlockAlign / _pcm->ChannelCount;
+			pin_ptr<Int32> pSampleBuffer = &sampleBuffer->Samples[0, 0];
+			int32_t *samples = (int32_t*)pSampleBuffer;
+			unsigned char *md5Bytes = _md5 != NULL ? md5_worker_buffer (_md5, count * bytesPerSample) : NULL;
+			if (_md5 != NULL && md5Bytes == NULL)
+				throw gcnew OutOfMemoryException();
 
-			if (_settings->MD5Sum)
-				UpdateHash(sampleBuffer->Bytes, sampleBuffer->ByteLength);
-
-			if ((_pcm->BitsPerSample & 7) != 0)
+			if (shift != 0)
 			{
 				if (_shiftedSampleBuffer == nullptr || _shiftedSampleBuffer.GetLength(0) < sampleBuffer->Length)
 				    _shiftedSampleBuffer = gcnew array<int,2>(sampleBuffer->Length, _pcm->ChannelCount);
-				int shift = 8 - (_pcm->BitsPerSample & 7);
-				int ch = _pcm->ChannelCount;
-				for (int i = 0; i < sampleBuffer->Length; i++)
-					for (int c = 0; c < ch; c++)
-					    _shiftedSampleBuffer[i,c] = sampleBuffer->Samples[i,c] << shift;
-				pin_ptr<Int32> pSampleBuffer = &_shiftedSampleBuffer[0, 0];
-				if (!WavpackPackSamples(_wpc, (int32_t*)pSampleBuffer, sampleBuffer->Length))
+				pin_ptr<Int32> pShiftedSampleBuffer = &_shiftedSampleBuffer[0, 0];
+				format_samples (samples, count, shift, (int32_t*)pShiftedSampleBuffer, md5Bytes, bytesPerSample);
+				if (md5Bytes != NULL)
+					md5_worker_push (_md5, count * bytesPerSample);
+				if (!WavpackPackSamples(_wpc, (int32_t*)pShiftedSampleBuffer, sampleBuffer->Length))
 					throw gcnew Exception("An error occurred while encoding.");
 			} else
 			{
-				pin_ptr<Int32> pSampleBuffer = &sampleBuffer->Samples[0, 0];
-				if (!WavpackPackSamples(_wpc, (int32_t*)pSampleBuffer, sampleBuffer->Length))
+				if (md5Bytes != NULL)
+				{
+					format_samples (samples, count, 0, NULL, md5Bytes, bytesPerSample);
+					md5_worker_push (_md5, count * bytesPerSample);
+				}
+				if (!WavpackPackSamples(_wpc, samples, sampleBuffer->Length))
 					throw gcnew Exception("An error occurred while encoding.");
 			}
 
@@ -488,9 +653,16 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 		{
 			if (!_initialized) Initialize();
 
-			if (!_settings->MD5Sum || !_md5hasher)
+			if (!_settings->MD5Sum || _md5 == NULL)
 				throw gcnew Exception("MD5 not enabled.");
-			_md5hasher->TransformBlock (buff, 0, len,  buff, 0);
+			if (len <= 0)
+				return;
+			pin_ptr<unsigned char> pBuff = &buff[0];
+			unsigned char *md5Bytes = md5_worker_buffer (_md5, len);
+			if (md5Bytes == NULL)
+				throw gcnew OutOfMemoryException();
+			memcpy (md5Bytes, pBuff, len);
+			md5_worker_push (_md5, len);
 		}
 
 	private:
@@ -500,7 +672,7 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 		Int32 _finalSampleCount, _samplesWritten;
 		Int32 _compressionMode, _blockSize;
 		String^ _path;
-		MD5^ _md5hasher;
+		MD5Worker *_md5;
 		array<int,2>^ _shiftedSampleBuffer;
 		AudioPCMConfig^ _pcm;
 		WavPackWriterSettings^ _settings;
@@ -529,7 +701,9 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 			}
 			if (_settings->MD5Sum)
 			{
-			    _md5hasher = gcnew MD5CryptoServiceProvider ();
+			    _md5 = md5_worker_start ();
+			    if (_md5 == NULL)
+				throw gcnew Exception("Unable to start the MD5 thread.");
 			    config.flags |= CONFIG_MD5_CHECKSUM;
 			}
 			config.block_samples = (int)_blockSize;
@@ -552,4 +726,385 @@ namespace CUETools { namespace Codecs { namespace WavPack {
 	int write_block(void *id, void *data, int32_t length) {
 		return (fwrite(data, 1, length, (FILE*)id) == length);
 	}
+
+	MappedFile *open_mapped_file(const wchar_t *path) {
+		wchar_t volume[MAX_PATH + 1];
+		MappedFile *file;
+		LARGE_INTEGER size;
+
+		if (!GetVolumePathNameW(path, volume, MAX_PATH + 1) || GetDriveTypeW(volume) != DRIVE_FIXED)
+			return NULL;
+
+		file = new MappedFile;
+		memset(file, 0, sizeof(MappedFile));
+		file->hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file->hFile != INVALID_HANDLE_VALUE && GetFileSizeEx(file->hFile, &size) && size.QuadPart > 0 && size.QuadPart <= 0xffffffff) {
+			file->length = (uint32_t) size.QuadPart;
+			file->hMapping = CreateFileMappingW(file->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (file->hMapping)
+				file->data = (const unsigned char *) MapViewOfFile(file->hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (!file->data) {
+			close_mapped_file(file);
+			return NULL;
+		}
+		return file;
+	}
+
+	void close_mapped_file(MappedFile *file) {
+		if (!file)
+			return;
+		if (file->data)
+			UnmapViewOfFile(file->data);
+		if (file->hMapping)
+			CloseHandle(file->hMapping);
+		if (file->hFile && file->hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(file->hFile);
+		delete file;
+	}
+
+	// a page of the file that can't be read in (the disk failed, or even a
+	// fixed drive went away) raises EXCEPTION_IN_PAGE_ERROR, which is turned
+	// into a failed read here, and every read after it fails as well
+	static int32_t mapped_read_bytes(void *id, void *data, int32_t bcount) {
+		MappedFile *file = (MappedFile*)id;
+		uint32_t len = file->length - file->pos;
+		if (bcount < 0 || file->failed)
+			return 0;
+		if (len > (uint32_t) bcount)
+			len = bcount;
+		__try {
+			memcpy(data, file->data + file->pos, len);
+		}
+		__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+			file->failed = true;
+			return 0;
+		}
+		file->pos += len;
+		return len;
+	}
+
+	static uint32_t mapped_get_pos(void *id) {
+		return ((MappedFile*)id)->pos;
+	}
+
+	static int mapped_set_pos_abs(void *id, uint32_t pos) {
+		MappedFile *file = (MappedFile*)id;
+		if (pos > file->length)
+			return -1;
+		file->pos = pos;
+		return 0;
+	}
+
+	static int mapped_set_pos_rel(void *id, int32_t delta, int mode) {
+		MappedFile *file = (MappedFile*)id;
+		__int64 pos;
+		switch (mode)
+		{
+		case SEEK_SET:
+			pos = delta;
+			break;
+		case SEEK_END:
+			pos = (__int64) file->length + delta;
+			break;
+		case SEEK_CUR:
+			pos = (__int64) file->pos + delta;
+			break;
+		default:
+			return -1;
+		}
+		if (pos < 0 || pos > file->length)
+			return -1;
+		file->pos = (uint32_t) pos;
+		return 0;
+	}
+
+	// the decoder only pushes back the byte it has just read
+	static int mapped_push_back_byte(void *id, int c) {
+		MappedFile *file = (MappedFile*)id;
+		if (!file->pos)
+			return EOF;
+		file->pos--;
+		return c;
+	}
+
+	static uint32_t mapped_get_length(void *id) {
+		return ((MappedFile*)id)->length;
+	}
+
+	static int mapped_can_seek(void *id) {
+		return 1;
+	}
+
+	WavpackStreamReader mapped_reader = {
+		mapped_read_bytes, mapped_get_pos, mapped_set_pos_abs, mapped_set_pos_rel,
+		mapped_push_back_byte, mapped_get_length, mapped_can_seek, NULL
+	};
+
+	// RFC 1321 MD5, after the public domain version by Colin Plumb
+
+	struct MD5Context {
+		uint32_t state[4];
+		uint32_t bytes[2];
+		unsigned char buffer[64];
+	};
+
+	#define MD5_F1(x, y, z) (z ^ (x & (y ^ z)))
+	#define MD5_F2(x, y, z) MD5_F1(z, x, y)
+	#define MD5_F3(x, y, z) (x ^ y ^ z)
+	#define MD5_F4(x, y, z) (y ^ (x | ~z))
+	#define MD5_STEP(f, w, x, y, z, in, s) (w += f(x, y, z) + in, w = (w << s | w >> (32 - s)) + x)
+
+	static void md5_transform(uint32_t state[4], const unsigned char *block) {
+		uint32_t in[16], a = state[0], b = state[1], c = state[2], d = state[3];
+
+		for (int i = 0; i < 16; i++)
+			in[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((uint32_t) block[i * 4 + 3] << 24);
+
+		MD5_STEP(MD5_F1, a, b, c, d, in[0] + 0xd76aa478, 7);
+		MD5_STEP(MD5_F1, d, a, b, c, in[1] + 0xe8c7b756, 12);
+		MD5_STEP(MD5_F1, c, d, a, b, in[2] + 0x242070db, 17);
+		MD5_STEP(MD5_F1, b, c, d, a, in[3] + 0xc1bdceee, 22);
+		MD5_STEP(MD5_F1, a, b, c, d, in[4] + 0xf57c0faf, 7);
+		MD5_STEP(MD5_F1, d, a, b, c, in[5] + 0x4787c62a, 12);
+		MD5_STEP(MD5_F1, c, d, a, b, in[6] + 0xa8304613, 17);
+		MD5_STEP(MD5_F1, b, c, d, a, in[7] + 0xfd469501, 22);
+		MD5_STEP(MD5_F1, a, b, c, d, in[8] + 0x698098d8, 7);
+		MD5_STEP(MD5_F1, d, a, b, c, in[9] + 0x8b44f7af, 12);
+		MD5_STEP(MD5_F1, c, d, a, b, in[10] + 0xffff5bb1, 17);
+		MD5_STEP(MD5_F1, b, c, d, a, in[11] + 0x895cd7be, 22);
+		MD5_STEP(MD5_F1, a, b, c, d, in[12] + 0x6b901122, 7);
+		MD5_STEP(MD5_F1, d, a, b, c, in[13] + 0xfd987193, 12);
+		MD5_STEP(MD5_F1, c, d, a, b, in[14] + 0xa679438e, 17);
+		MD5_STEP(MD5_F1, b, c, d, a, in[15] + 0x49b40821, 22);
+
+		MD5_STEP(MD5_F2, a, b, c, d, in[1] + 0xf61e2562, 5);
+		MD5_STEP(MD5_F2, d, a, b, c, in[6] + 0xc040b340, 9);
+		MD5_STEP(MD5_F2, c, d, a, b, in[11] + 0x265e5a51, 14);
+		MD5_STEP(MD5_F2, b, c, d, a, in[0] + 0xe9b6c7aa, 20);
+		MD5_STEP(MD5_F2, a, b, c, d, in[5] + 0xd62f105d, 5);
+		MD5_STEP(MD5_F2, d, a, b, c, in[10] + 0x02441453, 9);
+		MD5_STEP(MD5_F2, c, d, a, b, in[15] + 0xd8a1e681, 14);
+		MD5_STEP(MD5_F2, b, c, d, a, in[4] + 0xe7d3fbc8, 20);
+		MD5_STEP(MD5_F2, a, b, c, d, in[9] + 0x21e1cde6, 5);
+		MD5_STEP(MD5_F2, d, a, b, c, in[14] + 0xc33707d6, 9);
+		MD5_STEP(MD5_F2, c, d, a, b, in[3] + 0xf4d50d87, 14);
+		MD5_STEP(MD5_F2, b, c, d, a, in[8] + 0x455a14ed, 20);
+		MD5_STEP(MD5_F2, a, b, c, d, in[13] + 0xa9e3e905, 5);
+		MD5_STEP(MD5_F2, d, a, b, c, in[2] + 0xfcefa3f8, 9);
+		MD5_STEP(MD5_F2, c, d, a, b, in[7] + 0x676f02d9, 14);
+		MD5_STEP(MD5_F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20);
+
+		MD5_STEP(MD5_F3, a, b, c, d, in[5] + 0xfffa3942, 4);
+		MD5_STEP(MD5_F3, d, a, b, c, in[8] + 0x8771f681, 11);
+		MD5_STEP(MD5_F3, c, d, a, b, in[11] + 0x6d9d6122, 16);
+		MD5_STEP(MD5_F3, b, c, d, a, in[14] + 0xfde5380c, 23);
+		MD5_STEP(MD5_F3, a, b, c, d, in[1] + 0xa4beea44, 4);
+		MD5_STEP(MD5_F3, d, a, b, c, in[4] + 0x4bdecfa9, 11);
+		MD5_STEP(MD5_F3, c, d, a, b, in[7] + 0xf6bb4b60, 16);
+		MD5_STEP(MD5_F3, b, c, d, a, in[10] + 0xbebfbc70, 23);
+		MD5_STEP(MD5_F3, a, b, c, d, in[13] + 0x289b7ec6, 4);
+		MD5_STEP(MD5_F3, d, a, b, c, in[0] + 0xeaa127fa, 11);
+		MD5_STEP(MD5_F3, c, d, a, b, in[3] + 0xd4ef3085, 16);
+		MD5_STEP(MD5_F3, b, c, d, a, in[6] + 0x04881d05, 23);
+		MD5_STEP(MD5_F3, a, b, c, d, in[9] + 0xd9d4d039, 4);
+		MD5_STEP(MD5_F3, d, a, b, c, in[12] + 0xe6db99e5, 11);
+		MD5_STEP(MD5_F3, c, d, a, b, in[15] + 0x1fa27cf8, 16);
+		MD5_STEP(MD5_F3, b, c, d, a, in[2] + 0xc4ac5665, 23);
+
+		MD5_STEP(MD5_F4, a, b, c, d, in[0] + 0xf4292244, 6);
+		MD5_STEP(MD5_F4, d, a, b, c, in[7] + 0x432aff97, 10);
+		MD5_STEP(MD5_F4, c, d, a, b, in[14] + 0xab9423a7, 15);
+		MD5_STEP(MD5_F4, b, c, d, a, in[5] + 0xfc93a039, 21);
+		MD5_STEP(MD5_F4, a, b, c, d, in[12] + 0x655b59c3, 6);
+		MD5_STEP(MD5_F4, d, a, b, c, in[3] + 0x8f0ccc92, 10);
+		MD5_STEP(MD5_F4, c, d, a, b, in[10] + 0xffeff47d, 15);
+		MD5_STEP(MD5_F4, b, c, d, a, in[1] + 0x85845dd1, 21);
+		MD5_STEP(MD5_F4, a, b, c, d, in[8] + 0x6fa87e4f, 6);
+		MD5_STEP(MD5_F4, d, a, b, c, in[15] + 0xfe2ce6e0, 10);
+		MD5_STEP(MD5_F4, c, d, a, b, in[6] + 0xa3014314, 15);
+		MD5_STEP(MD5_F4, b, c, d, a, in[13] + 0x4e0811a1, 21);
+		MD5_STEP(MD5_F4, a, b, c, d, in[4] + 0xf7537e82, 6);
+		MD5_STEP(MD5_F4, d, a, b, c, in[11] + 0xbd3af235, 10);
+		MD5_STEP(MD5_F4, c, d, a, b, in[2] + 0x2ad7d2bb, 15);
+		MD5_STEP(MD5_F4, b, c, d, a, in[9] + 0xeb86d391, 21);
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+
+	static void md5_init(MD5Context *ctx) {
+		ctx->state[0] = 0x67452301;
+		ctx->state[1] = 0xefcdab89;
+		ctx->state[2] = 0x98badcfe;
+		ctx->state[3] = 0x10325476;
+		ctx->bytes[0] = ctx->bytes[1] = 0;
+	}
+
+	static void md5_update(MD5Context *ctx, const unsigned char *data, uint32_t length) {
+		uint32_t used = ctx->bytes[0] & 63;
+
+		if ((ctx->bytes[0] += length) < length)
+			ctx->bytes[1]++;
+
+		if (used) {
+			uint32_t fill = 64 - used;
+			if (length < fill) {
+				memcpy(ctx->buffer + used, data, length);
+				return;
+			}
+			memcpy(ctx->buffer + used, data, fill);
+			md5_transform(ctx->state, ctx->buffer);
+			data += fill;
+			length -= fill;
+		}
+
+		for (; length >= 64; data += 64, length -= 64)
+			md5_transform(ctx->state, data);
+
+		memcpy(ctx->buffer, data, length);
+	}
+
+	static void md5_final(MD5Context *ctx, unsigned char digest[16]) {
+		uint32_t used = ctx->bytes[0] & 63;
+		uint32_t bitsLow = ctx->bytes[0] << 3, bitsHigh = (ctx->bytes[1] << 3) | (ctx->bytes[0] >> 29);
+
+		ctx->buffer[used++] = 0x80;
+		if (used > 56) {
+			memset(ctx->buffer + used, 0, 64 - used);
+			md5_transform(ctx->state, ctx->buffer);
+			used = 0;
+		}
+		memset(ctx->buffer + used, 0, 56 - used);
+		for (int i = 0; i < 4; i++) {
+			ctx->buffer[56 + i] = (unsigned char) (bitsLow >> (i * 8));
+			ctx->buffer[60 + i] = (unsigned char) (bitsHigh >> (i * 8));
+		}
+		md5_transform(ctx->state, ctx->buffer);
+
+		for (int i = 0; i < 16; i++)
+			digest[i] = (unsigned char) (ctx->state[i >> 2] >> ((i & 3) * 8));
+	}
+
+	// The ring is only ever written at 'pushed' by the encoding thread and read
+	// at 'hashed' by the MD5 thread, so the two counters are all they share.
+	// The events just wake up a thread that found the ring full (or empty);
+	// being auto-reset, a signal sent before the other thread waits isn't lost.
+
+	#define MD5_WORKER_SLOTS 8
+
+	struct MD5Worker {
+		MD5Context context;
+		HANDLE hThread, hPushed, hHashed;
+		unsigned char *data[MD5_WORKER_SLOTS];
+		uint32_t size[MD5_WORKER_SLOTS], length[MD5_WORKER_SLOTS];
+		volatile LONG pushed, hashed, finished;
+	};
+
+	static DWORD WINAPI md5_worker_thread(LPVOID param) {
+		MD5Worker *worker = (MD5Worker*)param;
+
+		while (true) {
+			// check 'finished' first, everything pushed before it was set is visible
+			LONG finished = worker->finished;
+			if (worker->hashed == worker->pushed) {
+				if (finished)
+					break;
+				WaitForSingleObject(worker->hPushed, INFINITE);
+				continue;
+			}
+			int slot = worker->hashed % MD5_WORKER_SLOTS;
+			md5_update(&worker->context, worker->data[slot], worker->length[slot]);
+			InterlockedIncrement(&worker->hashed);
+			SetEvent(worker->hHashed);
+		}
+
+		return 0;
+	}
+
+	static void md5_worker_free(MD5Worker *worker) {
+		if (worker->hPushed)
+			CloseHandle(worker->hPushed);
+		if (worker->hHashed)
+			CloseHandle(worker->hHashed);
+		for (int i = 0; i < MD5_WORKER_SLOTS; i++)
+			free(worker->data[i]);
+		delete worker;
+	}
+
+	MD5Worker *md5_worker_start() {
+		MD5Worker *worker = new MD5Worker;
+
+		memset(worker, 0, sizeof(MD5Worker));
+		md5_init(&worker->context);
+		worker->hPushed = CreateEvent(NULL, FALSE, FALSE, NULL);
+		worker->hHashed = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (worker->hPushed && worker->hHashed)
+			worker->hThread = CreateThread(NULL, 0, md5_worker_thread, worker, 0, NULL);
+		if (!worker->hThread) {
+			md5_worker_free(worker);
+			return NULL;
+		}
+		return worker;
+	}
+
+	// Returns the next free buffer of the ring (waiting for the MD5 thread if
+	// they are all in use), grown to at least length bytes.
+	unsigned char *md5_worker_buffer(MD5Worker *worker, uint32_t length) {
+		while (worker->pushed - worker->hashed == MD5_WORKER_SLOTS)
+			WaitForSingleObject(worker->hHashed, INFINITE);
+
+		int slot = worker->pushed % MD5_WORKER_SLOTS;
+		if (worker->size[slot] < length) {
+			free(worker->data[slot]);
+			worker->data[slot] = (unsigned char*) malloc(length);
+			worker->size[slot] = worker->data[slot] ? length : 0;
+		}
+		return worker->data[slot];
+	}
+
+	void md5_worker_push(MD5Worker *worker, uint32_t length) {
+		worker->length[worker->pushed % MD5_WORKER_SLOTS] = length;
+		InterlockedIncrement(&worker->pushed);
+		SetEvent(worker->hPushed);
+	}
+
+	void md5_worker_finish(MD5Worker *worker, unsigned char digest[16]) {
+		InterlockedExchange(&worker->finished, TRUE);
+		SetEvent(worker->hPushed);
+		WaitForSingleObject(worker->hThread, INFINITE);
+		CloseHandle(worker->hThread);
+		md5_final(&worker->context, digest);
+		md5_worker_free(worker);
+	}
+
+	// Shifts the samples up by 'shift' bits into 'shifted' (if not NULL) and
+	// writes them as little-endian PCM to 'bytes' (if not NULL), all in one pass.
+	void format_samples(const int32_t *samples, int count, int shift, int32_t *shifted, unsigned char *bytes, int bytesPerSample) {
+		if (!bytes) {
+			for (int i = 0; i < count; i++)
+				shifted[i] = samples[i] << shift;
+		} else if (bytesPerSample == 2) {
+			for (int i = 0; i < count; i++, bytes += 2) {
+				bytes[0] = (unsigned char) samples[i];
+				bytes[1] = (unsigned char) (samples[i] >> 8);
+			}
+		} else if (shifted) {
+			for (int i = 0; i < count; i++, bytes += 3) {
+				int32_t sample = samples[i] << shift;
+				shifted[i] = sample;
+				bytes[0] = (unsigned char) sample;
+				bytes[1] = (unsigned char) (sample >> 8);
+				bytes[2] = (unsigned char) (sample >> 16);
+			}
+		} else {
+			for (int i = 0; i < count; i++, bytes += 3) {
+				bytes[0] = (unsigned char) samples[i];
+				bytes[1] = (unsigned char) (samples[i] >> 8);
+				bytes[2] = (unsigned char) (samples[i] >> 16);
+			}
+		}
+	}
 }}}
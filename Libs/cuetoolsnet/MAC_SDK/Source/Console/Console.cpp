@@ -37,12 +37,14 @@ void DisplayProperUsage(FILE * pFile)
 	fprintf(pFile, "    Compress (insane): '-c5000'\n");
 	fprintf(pFile, "    Decompress: '-d'\n");
 	fprintf(pFile, "    Verify: '-v'\n");
-	fprintf(pFile, "    Convert: '-nXXXX'\n\n");
+	fprintf(pFile, "    Convert: '-nXXXX'\n");
+	fprintf(pFile, "    Convert a list: [EXE] @[List File] -nXXXX (one 'input|output' pair per line)\n\n");
 
 	fprintf(pFile, "Examples:\n");
 	fprintf(pFile, "    Compress: mac.exe \"Metallica - One.wav\" \"Metallica - One.ape\" -c2000\n");
 	fprintf(pFile, "    Decompress: mac.exe \"Metallica - One.ape\" \"Metallica - One.wav\" -d\n");
 	fprintf(pFile, "    Verify: mac.exe \"Metallica - One.ape\" -v\n");
+	fprintf(pFile, "    Convert a list: mac.exe @Files.txt -n4000\n");
 	fprintf(pFile, "    (note: int filenames must be put inside of quotations)\n");
 }
 
@@ -65,6 +67,77 @@ void CALLBACK ProgressCallback(int nPercentageDone)
 		dProgress * 100, dRemaining, dElapsed);
 }
 
+/***************************************************************************************
+Converts every file in a list file (one "input|output" pair per line), several at once
+***************************************************************************************/
+int ConvertFileList(const char * pListFilename, int nCompressionLevel)
+{
+	FILE * pList = fopen(pListFilename, "rt");
+	if (pList == NULL)
+	{
+		fprintf(stderr, "List File Not Found...\n\n");
+		return -1;
+	}
+
+	// count the lines, then read the pairs
+	char cLine[(MAX_PATH * 2) + 8];
+	int nLines = 0;
+	while (fgets(cLine, sizeof(cLine), pList) != NULL)
+		nLines++;
+	rewind(pList);
+
+	CSmartPtr<str_utf16 *> spInputFiles(new str_utf16 * [nLines + 1], TRUE);
+	CSmartPtr<str_utf16 *> spOutputFiles(new str_utf16 * [nLines + 1], TRUE);
+	int nFiles = 0;
+	while ((nFiles < nLines) && (fgets(cLine, sizeof(cLine), pList) != NULL))
+	{
+		int nLength = (int) strlen(cLine);
+		while ((nLength > 0) && ((cLine[nLength - 1] == '\n') || (cLine[nLength - 1] == '\r')))
+			cLine[--nLength] = 0;
+
+		char * pSeparator = strchr(cLine, '|');
+		if (pSeparator == NULL)
+			continue;
+		*pSeparator = 0;
+
+		spInputFiles[nFiles] = GetUTF16FromANSI(cLine);
+		spOutputFiles[nFiles] = GetUTF16FromANSI(pSeparator + 1);
+		nFiles++;
+	}
+	fclose(pList);
+
+	// convert
+	fprintf(stderr, "Converting %d files...\n", nFiles);
+
+	CSmartPtr<int> spResults(new int [nFiles + 1], TRUE);
+	int nPercentageDone = 0;
+	int nKillFlag = 0;
+	int nRetVal = ConvertFilesW((const str_utf16 **) spInputFiles.GetPtr(), (const str_utf16 **) spOutputFiles.GetPtr(), nFiles,
+		nCompressionLevel, spResults, 0, &nPercentageDone, ProgressCallback, &nKillFlag);
+
+	// report the failures
+	int nConverted = 0; int nSkipped = 0; int nFailed = 0;
+	fprintf(stderr, "\n");
+	for (int z = 0; z < nFiles; z++)
+	{
+		if (spResults[z] == ERROR_SUCCESS)
+			nConverted++;
+		else if (spResults[z] == ERROR_SKIPPED)
+			nSkipped++;
+		else
+		{
+			nFailed++;
+			fprintf(stderr, "Error %i: %ls\n", spResults[z], spInputFiles[z]);
+		}
+
+		delete [] spInputFiles[z];
+		delete [] spOutputFiles[z];
+	}
+	fprintf(stderr, "%d converted, %d skipped (already in that format), %d failed\n", nConverted, nSkipped, nFailed);
+
+	return nRetVal;
+}
+
 /***************************************************************************************
 Main (the main function)
 ***************************************************************************************/
@@ -87,6 +160,29 @@ int main(int argc, char * argv[])
 		exit(-1);
 	}
 
+	// convert a list of files
+	if ((argv[1][0] == '@') && (_strnicmp(argv[2], "-n", 2) == 0))
+	{
+		nCompressionLevel = atoi(&argv[2][2]);
+		if (nCompressionLevel != 1000 && nCompressionLevel != 2000 && 
+			nCompressionLevel != 3000 && nCompressionLevel != 4000 &&
+			nCompressionLevel != 5000) 
+		{
+			DisplayProperUsage(stderr);
+			return -1;
+		}
+
+		TICK_COUNT_READ(g_nInitialTickCount);
+		nRetVal = ConvertFileList(&argv[1][1], nCompressionLevel);
+
+		if (nRetVal == ERROR_SUCCESS) 
+			fprintf(stderr, "Success...\n");
+		else 
+			fprintf(stderr, "Error: %i\n", nRetVal);
+
+		return nRetVal;
+	}
+
 	// store the input file
 	spInputFilename.Assign(GetUTF16FromANSI(argv[1]), TRUE);
 	
@@ -178,7 +274,7 @@ int main(int argc, char * argv[])
 	else if (nMode == CONVERT_MODE) 
 	{
 		fprintf(stderr, "Converting...\n");
-		nRetVal = ConvertFileW(spInputFilename, spOutputFilename, nCompressionLevel, &nPercentageDone, ProgressCallback, &nKillFlag);
+		nRetVal = ConvertFileThreadedW(spInputFilename, spOutputFilename, nCompressionLevel, &nPercentageDone, ProgressCallback, &nKillFlag, 0);
 	}
 
 	if (nRetVal == ERROR_SUCCESS) 
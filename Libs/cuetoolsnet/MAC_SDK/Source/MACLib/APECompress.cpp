@@ -147,6 +147,11 @@ int CAPECompress::Kill()
     return ERROR_SUCCESS;
 }
 
+void CAPECompress::SetThreads(int nThreads)
+{
+    m_spAPECompressCreate->SetThreads(nThreads);
+}
+
 int CAPECompress::ProcessBuffer(BOOL bFinalize)
 {
     if (m_pBuffer == NULL) { return ERROR_UNDEFINED; }
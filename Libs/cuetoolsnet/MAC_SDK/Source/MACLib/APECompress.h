@@ -36,6 +36,9 @@ public:
     // finish / kill
     int Finish(unsigned char * pTerminatingData, int nTerminatingBytes, int nWAVTerminatingBytes);
     int Kill();
+
+    // encode frames on worker threads (0 encodes on the calling thread) -- call before starting
+    void SetThreads(int nThreads);
     
 private:
     
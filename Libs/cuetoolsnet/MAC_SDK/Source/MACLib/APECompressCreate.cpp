@@ -3,14 +3,211 @@
 #include "APECompressCreate.h"
 
 #include "APECompressCore.h"
+#include "Thread.h"
 
+// upper bound on the number of encode workers (each holds its own encoder and frame buffers)
+#define MAX_COMPRESS_THREADS            16
+
+/*************************************************************************************************
+CFrameOutputIO - collects the bit array output of one frame in memory
+*************************************************************************************************/
+class CFrameOutputIO : public CIO
+{
+public:
+
+    CFrameOutputIO() { m_nBytes = 0; m_nCapacity = 0; }
+
+    void Empty() { m_nBytes = 0; }
+    const uint32 * GetData() { return (const uint32 *) m_spBuffer.GetPtr(); }
+
+    int Open(const wchar_t * pName, int fReadonly = 0) { return ERROR_UNDEFINED; }
+    int Close() { return ERROR_SUCCESS; }
+
+    int Read(void * pBuffer, unsigned int nBytesToRead, unsigned int * pBytesRead) { return ERROR_IO_READ; }
+    int Write(const void * pBuffer, unsigned int nBytesToWrite, unsigned int * pBytesWritten)
+    {
+        if (m_nBytes + int(nBytesToWrite) > m_nCapacity)
+        {
+            int nCapacity = max(m_nCapacity * 2, m_nBytes + int(nBytesToWrite));
+            unsigned char * pBufferNew = new unsigned char [nCapacity];
+            if (pBufferNew == NULL)
+                return ERROR_INSUFFICIENT_MEMORY;
+
+            memcpy(pBufferNew, m_spBuffer, m_nBytes);
+            m_spBuffer.Assign(pBufferNew, TRUE);
+            m_nCapacity = nCapacity;
+        }
+
+        memcpy(&m_spBuffer[m_nBytes], pBuffer, nBytesToWrite);
+        m_nBytes += nBytesToWrite;
+        *pBytesWritten = nBytesToWrite;
+        return ERROR_SUCCESS;
+    }
+
+    int Seek(int nDistance, unsigned int nMoveMode) { return ERROR_UNDEFINED; }
+
+    int Create(const wchar_t * pName) { return ERROR_UNDEFINED; }
+    int Delete() { return ERROR_UNDEFINED; }
+    int SetEOF() { return ERROR_UNDEFINED; }
+
+    int GetPosition() { return m_nBytes; }
+    int GetSize() { return m_nBytes; }
+    int GetName(wchar_t * pBuffer) { return ERROR_UNDEFINED; }
+
+private:
+
+    CSmartPtr<unsigned char> m_spBuffer;
+    int m_nCapacity;
+    int m_nBytes;
+};
+
+/*************************************************************************************************
+CAPECompressWorker - encodes whole frames on its own thread
+
+Every frame starts from flushed predictors and a flushed range coder, so a frame can be
+encoded at bit 0 of the worker's own bit array, and later appended to the file's bit array
+(it always starts on a byte boundary there).
+*************************************************************************************************/
+class CAPECompressWorker : public CThread
+{
+public:
+
+    CAPECompressWorker(const WAVEFORMATEX * pwfeInput, int nMaxFrameBlocks, int nCompressionLevel)
+    {
+        m_spAPECompressCore.Assign(new CAPECompressCore(&m_Output, pwfeInput, nMaxFrameBlocks, nCompressionLevel));
+        m_nMaxFrameBytes = nMaxFrameBlocks * pwfeInput->nBlockAlign;
+        m_nInputBytes = 0;
+        m_nResult = ERROR_UNDEFINED;
+        m_nBits = 0;
+        m_bBusy = FALSE;
+        m_bExit = FALSE;
+    }
+
+    ~CAPECompressWorker()
+    {
+        Discard();
+        m_bExit = TRUE;
+        m_evStart.Set();
+        Wait();
+    }
+
+    // allocate the input buffer and start the thread
+    int Initialize()
+    {
+        m_spInput.Assign(new unsigned char [m_nMaxFrameBytes], TRUE);
+        if (m_spInput == NULL)
+            return ERROR_INSUFFICIENT_MEMORY;
+
+        return Start();
+    }
+
+    // copies the frame and starts encoding it
+    void EncodeFrame(const void * pInputData, int nInputBytes)
+    {
+        memcpy(m_spInput, pInputData, nInputBytes);
+        m_nInputBytes = nInputBytes;
+        m_bBusy = TRUE;
+        m_evStart.Set();
+    }
+
+    // waits for the frame and gets the encoded bits (valid until the next frame)
+    int GetResult(const uint32 ** ppBitArray, uint32 * pBits)
+    {
+        if (m_bBusy == FALSE)
+            return ERROR_UNDEFINED;
+
+        m_evDone.Wait();
+        m_bBusy = FALSE;
+
+        *ppBitArray = m_Output.GetData();
+        *pBits = m_nBits;
+        return m_nResult;
+    }
+
+    // waits for the frame (if any) and throws it away
+    void Discard()
+    {
+        if (m_bBusy)
+        {
+            m_evDone.Wait();
+            m_bBusy = FALSE;
+        }
+    }
+
+    BOOL GetBusy() { return m_bBusy; }
+    int GetPeakLevel() { return m_spAPECompressCore->GetPeakLevel(); }
+
+protected:
+
+    void Run()
+    {
+        while (TRUE)
+        {
+            m_evStart.Wait();
+            if (m_bExit)
+                break;
+
+            m_nResult = ERROR_UNDEFINED;
+            try
+            {
+                // encode, then flush everything (the bits past the end of the frame are zero)
+                m_Output.Empty();
+                m_nResult = m_spAPECompressCore->EncodeFrame(m_spInput, m_nInputBytes);
+                m_nBits = (m_Output.GetPosition() * 8) + m_spAPECompressCore->GetBitArray()->GetCurrentBitIndex();
+                if (m_nResult == ERROR_SUCCESS)
+                    m_nResult = m_spAPECompressCore->GetBitArray()->OutputBitArray(TRUE);
+            }
+            catch(...)
+            {
+                m_nResult = ERROR_UNDEFINED;
+            }
+
+            m_evDone.Set();
+        }
+    }
+
+private:
+
+    CSmartPtr<CAPECompressCore> m_spAPECompressCore;
+    CFrameOutputIO m_Output;
+    CSmartPtr<unsigned char> m_spInput;
+    int m_nMaxFrameBytes;
+    int m_nInputBytes;
+
+    int m_nResult;
+    uint32 m_nBits;
+    BOOL m_bBusy;
+    volatile BOOL m_bExit;
+
+    CThreadEvent m_evStart;
+    CThreadEvent m_evDone;
+};
+
+/*************************************************************************************************
+CAPECompressCreate
+*************************************************************************************************/
 CAPECompressCreate::CAPECompressCreate()
 {
     m_nMaxFrames = 0;
+    m_nThreads = 0;
+    m_paryWorkers = NULL;
+    m_nFramesWritten = 0;
+    m_nPeakLevel = 0;
 }
 
 CAPECompressCreate::~CAPECompressCreate()
 {
+    if (m_paryWorkers != NULL)
+    {
+        for (int z = 0; z < m_nThreads; z++)
+            SAFE_DELETE(m_paryWorkers[z])
+        SAFE_ARRAY_DELETE(m_paryWorkers)
+    }
+}
+
+void CAPECompressCreate::SetThreads(int nThreads)
+{
+    m_nThreads = min(max(nThreads, 0), MAX_COMPRESS_THREADS);
 }
 
 int CAPECompressCreate::Start(CIO * pioOutput, const WAVEFORMATEX * pwfeInput, int nMaxAudioBytes, int nCompressionLevel, const void * pHeaderData, int nHeaderBytes)
@@ -38,6 +235,30 @@ int CAPECompressCreate::Start(CIO * pioOutput, const WAVEFORMATEX * pwfeInput, i
 
     m_spIO.Assign(pioOutput, FALSE, FALSE);
     m_spAPECompressCore.Assign(new CAPECompressCore(m_spIO, pwfeInput, m_nSamplesPerFrame, nCompressionLevel));
+
+    // create the frame workers (if any fail, encode on the calling thread instead)
+    if (m_nThreads > 0)
+    {
+        m_paryWorkers = new CAPECompressWorker * [m_nThreads];
+        ZeroMemory(m_paryWorkers, m_nThreads * sizeof(CAPECompressWorker *));
+
+        BOOL bWorkersOK = TRUE;
+        for (int z = 0; (z < m_nThreads) && bWorkersOK; z++)
+        {
+            m_paryWorkers[z] = new CAPECompressWorker(pwfeInput, m_nSamplesPerFrame, nCompressionLevel);
+            bWorkersOK = (m_paryWorkers[z]->Initialize() == ERROR_SUCCESS);
+        }
+
+        if (bWorkersOK == FALSE)
+        {
+            for (int z = 0; z < m_nThreads; z++)
+                SAFE_DELETE(m_paryWorkers[z])
+            SAFE_ARRAY_DELETE(m_paryWorkers)
+            m_nThreads = 0;
+        }
+    }
+    m_nFramesWritten = 0;
+    m_nPeakLevel = 0;
     
     // copy the format
     memcpy(&m_wfeInput, pwfeInput, sizeof(WAVEFORMATEX));
@@ -75,6 +296,26 @@ int CAPECompressCreate::EncodeFrame(const void * pInputData, int nInputBytes)
         return -1; // can only pass a smaller frame for the very last time
     }
 
+    // hand the frame to the next worker (its last frame is written first, which keeps the frames in order)
+    if (m_nThreads > 0)
+    {
+        CAPECompressWorker * pWorker = m_paryWorkers[m_nFrameIndex % m_nThreads];
+        if (pWorker->GetBusy())
+        {
+            RETURN_ON_ERROR(WriteFrame(pWorker))
+        }
+
+        if (m_nFrameIndex >= m_nMaxFrames)
+            return ERROR_APE_COMPRESS_TOO_MUCH_DATA;
+
+        pWorker->EncodeFrame(pInputData, nInputBytes);
+
+        m_nLastFrameBlocks = nInputBlocks;
+        m_nFrameIndex++;
+
+        return ERROR_SUCCESS;
+    }
+
     // update the seek table
     m_spAPECompressCore->GetBitArray()->AdvanceToByteBoundary();
     int nRetVal = SetSeekByte(m_nFrameIndex, m_spIO->GetPosition() + (m_spAPECompressCore->GetBitArray()->GetCurrentBitIndex() / 8));
@@ -91,14 +332,39 @@ int CAPECompressCreate::EncodeFrame(const void * pInputData, int nInputBytes)
     return nRetVal;
 }
 
+int CAPECompressCreate::WriteFrame(CAPECompressWorker * pWorker)
+{
+    // get the encoded frame
+    const uint32 * pBitArray = NULL; uint32 nBits = 0;
+    RETURN_ON_ERROR(pWorker->GetResult(&pBitArray, &nBits))
+    m_nPeakLevel = max(m_nPeakLevel, pWorker->GetPeakLevel());
+
+    // update the seek table
+    CBitArray * pFileBitArray = m_spAPECompressCore->GetBitArray();
+    pFileBitArray->AdvanceToByteBoundary();
+    RETURN_ON_ERROR(SetSeekByte(m_nFramesWritten, m_spIO->GetPosition() + (pFileBitArray->GetCurrentBitIndex() / 8)))
+
+    // append the frame
+    RETURN_ON_ERROR(pFileBitArray->EncodeBitArray(pBitArray, nBits))
+
+    m_nFramesWritten++;
+    return ERROR_SUCCESS;
+}
+
 int CAPECompressCreate::Finish(const void * pTerminatingData, int nTerminatingBytes, int nWAVTerminatingBytes)
 {
+    // write the frames still with the workers
+    while ((m_nThreads > 0) && (m_nFramesWritten < m_nFrameIndex))
+    {
+        RETURN_ON_ERROR(WriteFrame(m_paryWorkers[m_nFramesWritten % m_nThreads]))
+    }
+
     // clear the bit array
     RETURN_ON_ERROR(m_spAPECompressCore->GetBitArray()->OutputBitArray(TRUE));
     
     // finalize the file
     RETURN_ON_ERROR(FinalizeFile(m_spIO, m_nFrameIndex, m_nLastFrameBlocks, 
-        pTerminatingData, nTerminatingBytes, nWAVTerminatingBytes, m_spAPECompressCore->GetPeakLevel()));
+        pTerminatingData, nTerminatingBytes, nWAVTerminatingBytes, max(m_spAPECompressCore->GetPeakLevel(), m_nPeakLevel)));
     
     return ERROR_SUCCESS;
 }
@@ -4,6 +4,7 @@
 #include "APECompress.h"
 
 class CAPECompressCore;
+class CAPECompressWorker;
 
 class CAPECompressCreate
 {
@@ -23,8 +24,12 @@ public:
 
     int Finish(const void * pTerminatingData, int nTerminatingBytes, int nWAVTerminatingBytes);
     
+    // encode frames on worker threads (0 encodes on the calling thread) -- call before Start(...)
+    void SetThreads(int nThreads);
 
 private:
+
+    int WriteFrame(CAPECompressWorker * pWorker);
     
     CSmartPtr<uint32> m_spSeekTable;
     int m_nMaxFrames;
@@ -38,6 +43,12 @@ private:
     int                m_nFrameIndex;
     int                m_nLastFrameBlocks;
 
+    // frame workers (frame n is encoded by worker n % m_nThreads, and written in order)
+    int                m_nThreads;
+    CAPECompressWorker ** m_paryWorkers;
+    int                m_nFramesWritten;
+    int                m_nPeakLevel;
+
 };
 
 #endif // #ifndef APE_APECOMPRESSCREATE_H
@@ -8,6 +8,7 @@
 #include "GlobalFunctions.h"
 #include "MD5.h"
 #include "CharacterHelper.h"
+#include "Thread.h"
 
 #define UNMAC_DECODER_OUTPUT_NONE       0
 #define UNMAC_DECODER_OUTPUT_WAV        1
@@ -15,7 +16,10 @@
 
 #define BLOCKS_PER_DECODE               9216
 
-int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nOutputMode, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
+// upper bound on the number of files converted at once by ConvertFilesW(...)
+#define MAX_CONVERT_FILE_THREADS        64
+
+int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nOutputMode, int nCompressionLevel, int nThreads, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
 
 /*****************************************************************************************
 ANSI wrappers
@@ -41,6 +45,30 @@ int __stdcall ConvertFile(const str_ansi * pInputFilename, const str_ansi * pOut
     return ConvertFileW(spInputFile, spOutputFile, nCompressionLevel, pPercentageDone, ProgressCallback, pKillFlag);
 }
 
+int __stdcall ConvertFiles(const str_ansi ** ppInputFilenames, const str_ansi ** ppOutputFilenames, int nFiles, int nCompressionLevel, int * pResults, int nThreads, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag)
+{
+    if ((ppInputFilenames == NULL) || (ppOutputFilenames == NULL) || (nFiles < 0))
+        return ERROR_INVALID_FUNCTION_PARAMETER;
+
+    CSmartPtr<str_utf16 *> spInputFiles(new str_utf16 * [max(nFiles, 1)], TRUE);
+    CSmartPtr<str_utf16 *> spOutputFiles(new str_utf16 * [max(nFiles, 1)], TRUE);
+    for (int z = 0; z < nFiles; z++)
+    {
+        spInputFiles[z] = GetUTF16FromANSI(ppInputFilenames[z]);
+        spOutputFiles[z] = GetUTF16FromANSI(ppOutputFilenames[z]);
+    }
+
+    int nRetVal = ConvertFilesW((const str_utf16 **) spInputFiles.GetPtr(), (const str_utf16 **) spOutputFiles.GetPtr(), nFiles, nCompressionLevel, pResults, nThreads, pPercentageDone, ProgressCallback, pKillFlag);
+
+    for (int z = 0; z < nFiles; z++)
+    {
+        delete [] spInputFiles[z];
+        delete [] spOutputFiles[z];
+    }
+
+    return nRetVal;
+}
+
 int __stdcall VerifyFile(const str_ansi * pInputFilename, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag, BOOL bQuickVerifyIfPossible)
 {
     CSmartPtr<str_utf16> spInputFile(GetUTF16FromANSI(pInputFilename), TRUE);
@@ -238,7 +266,7 @@ int __stdcall VerifyFileW(const str_utf16 * pInputFilename, int * pPercentageDon
     }
     else
     {
-        nRetVal = DecompressCore(pInputFilename, NULL, UNMAC_DECODER_OUTPUT_NONE, -1, pPercentageDone, ProgressCallback, pKillFlag);
+        nRetVal = DecompressCore(pInputFilename, NULL, UNMAC_DECODER_OUTPUT_NONE, -1, 0, pPercentageDone, ProgressCallback, pKillFlag);
     }
 
 
@@ -253,7 +281,7 @@ int __stdcall DecompressFileW(const str_utf16 * pInputFilename, const str_utf16
     if (pOutputFilename == NULL)
         return VerifyFileW(pInputFilename, pPercentageDone, ProgressCallback, pKillFlag);
     else
-        return DecompressCore(pInputFilename, pOutputFilename, UNMAC_DECODER_OUTPUT_WAV, -1, pPercentageDone, ProgressCallback, pKillFlag);
+        return DecompressCore(pInputFilename, pOutputFilename, UNMAC_DECODER_OUTPUT_WAV, -1, 0, pPercentageDone, ProgressCallback, pKillFlag);
 }
 
 /*****************************************************************************************
@@ -261,13 +289,183 @@ Convert file
 *****************************************************************************************/
 int __stdcall ConvertFileW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag) 
 {
-    return DecompressCore(pInputFilename, pOutputFilename, UNMAC_DECODER_OUTPUT_APE, nCompressionLevel, pPercentageDone, ProgressCallback, pKillFlag);
+    return ConvertFileThreadedW(pInputFilename, pOutputFilename, nCompressionLevel, pPercentageDone, ProgressCallback, pKillFlag, 1);
+}
+
+int __stdcall ConvertFileThreadedW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag, int nThreads)
+{
+    // 1 thread converts on the calling thread, 0 uses every processor
+    if (nThreads <= 0)
+        nThreads = GetProcessorCount();
+
+    return DecompressCore(pInputFilename, pOutputFilename, UNMAC_DECODER_OUTPUT_APE, nCompressionLevel, (nThreads > 1) ? nThreads : 0, pPercentageDone, ProgressCallback, pKillFlag);
+}
+
+/*****************************************************************************************
+Convert files (each file is decoded on its own thread while its frames are encoded on
+worker threads, and several files are converted at once)
+*****************************************************************************************/
+class CConvertFilesQueue
+{
+public:
+
+    CConvertFilesQueue(const str_utf16 ** ppInputFilenames, const str_utf16 ** ppOutputFilenames, int nFiles, int nCompressionLevel, int nEncodeThreads, int * pResults, int * pKillFlag)
+    {
+        m_ppInputFilenames = ppInputFilenames;
+        m_ppOutputFilenames = ppOutputFilenames;
+        m_nFiles = nFiles;
+        m_nCompressionLevel = nCompressionLevel;
+        m_nEncodeThreads = nEncodeThreads;
+        m_pResults = pResults;
+        m_pKillFlag = pKillFlag;
+        m_nNextFile = 0;
+        m_nFilesDone = 0;
+    }
+
+    // converts files until there are none left
+    void ConvertFiles()
+    {
+        while (TRUE)
+        {
+            m_Lock.Enter();
+            int nFile = m_nNextFile++;
+            m_Lock.Leave();
+
+            if (nFile >= m_nFiles)
+                break;
+
+            int nResult = ERROR_USER_STOPPED_PROCESSING;
+            if ((m_pKillFlag == NULL) || (*m_pKillFlag == KILL_FLAG_CONTINUE) || (*m_pKillFlag == KILL_FLAG_PAUSE))
+            {
+                nResult = DecompressCore(m_ppInputFilenames[nFile], m_ppOutputFilenames[nFile], UNMAC_DECODER_OUTPUT_APE,
+                    m_nCompressionLevel, m_nEncodeThreads, NULL, NULL, m_pKillFlag);
+            }
+            m_pResults[nFile] = nResult;
+
+            m_Lock.Enter();
+            m_nFilesDone++;
+            m_Lock.Leave();
+            m_evFileDone.Set();
+        }
+    }
+
+    // waits until another file is done (or all of them are), and returns how many are done
+    int WaitForFile()
+    {
+        m_Lock.Enter();
+        int nFilesDone = m_nFilesDone;
+        m_Lock.Leave();
+
+        if (nFilesDone < m_nFiles)
+        {
+            m_evFileDone.Wait();
+
+            m_Lock.Enter();
+            nFilesDone = m_nFilesDone;
+            m_Lock.Leave();
+        }
+
+        return nFilesDone;
+    }
+
+private:
+
+    const str_utf16 ** m_ppInputFilenames;
+    const str_utf16 ** m_ppOutputFilenames;
+    int m_nFiles;
+    int m_nCompressionLevel;
+    int m_nEncodeThreads;
+    int * m_pResults;
+    int * m_pKillFlag;
+
+    CThreadLock m_Lock;
+    CThreadEvent m_evFileDone;
+    int m_nNextFile;
+    int m_nFilesDone;
+};
+
+class CConvertFilesThread : public CThread
+{
+public:
+
+    CConvertFilesThread(CConvertFilesQueue * pQueue) { m_pQueue = pQueue; }
+    ~CConvertFilesThread() { Wait(); }
+
+protected:
+
+    void Run() { m_pQueue->ConvertFiles(); }
+
+private:
+
+    CConvertFilesQueue * m_pQueue;
+};
+
+int __stdcall ConvertFilesW(const str_utf16 ** ppInputFilenames, const str_utf16 ** ppOutputFilenames, int nFiles, int nCompressionLevel, int * pResults, int nThreads, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag)
+{
+    // error check the function parameters
+    if ((ppInputFilenames == NULL) || (ppOutputFilenames == NULL) || (nFiles < 0))
+        return ERROR_INVALID_FUNCTION_PARAMETER;
+
+    // split the threads between files (when there are plenty of files, each one gets a
+    // single encode worker, which still overlaps its encoding with its decoding)
+    if (nThreads <= 0)
+        nThreads = GetProcessorCount();
+    int nFileThreads = min(min(nThreads, nFiles), MAX_CONVERT_FILE_THREADS);
+    int nEncodeThreads = max(nThreads / max(nFileThreads, 1), 1);
+
+    CSmartPtr<int> spResults;
+    if (pResults == NULL)
+    {
+        spResults.Assign(new int [max(nFiles, 1)], TRUE);
+        pResults = spResults;
+    }
+
+    // convert the files (the calling thread only reports progress)
+    CConvertFilesQueue Queue(ppInputFilenames, ppOutputFilenames, nFiles, nCompressionLevel, nEncodeThreads, pResults, pKillFlag);
+    {
+        CSmartPtr<CConvertFilesThread> * paryThreads = new CSmartPtr<CConvertFilesThread> [max(nFileThreads, 1)];
+        int nThreadsStarted = 0;
+        for (int z = 0; z < nFileThreads; z++)
+        {
+            paryThreads[z].Assign(new CConvertFilesThread(&Queue));
+            if (paryThreads[z]->Start() == ERROR_SUCCESS)
+                nThreadsStarted++;
+        }
+
+        // no threads, so convert the files here
+        if (nThreadsStarted == 0)
+            Queue.ConvertFiles();
+
+        CMACProgressHelper MACProgressHelper(nFiles, pPercentageDone, ProgressCallback, NULL);
+        int nFilesDone = 0;
+        while (nFilesDone < nFiles)
+        {
+            nFilesDone = Queue.WaitForFile();
+            MACProgressHelper.UpdateProgress(nFilesDone);
+        }
+        MACProgressHelper.UpdateProgressComplete();
+
+        delete [] paryThreads;
+    }
+
+    // the first failure is returned (skipped files, which are already in the format asked for, are fine)
+    if ((pKillFlag != NULL) && (*pKillFlag != KILL_FLAG_CONTINUE) && (*pKillFlag != KILL_FLAG_PAUSE))
+        return ERROR_USER_STOPPED_PROCESSING;
+
+    for (int z = 0; z < nFiles; z++)
+    {
+        if ((pResults[z] != ERROR_SUCCESS) && (pResults[z] != ERROR_SKIPPED))
+            return pResults[z];
+    }
+
+    return ERROR_SUCCESS;
 }
 
 /*****************************************************************************************
-Decompress a file using the specified output method
+Decompress a file using the specified output method (nThreads is the number of encode workers
+and of threads decoding a file from before 3.93 -- with 0 everything runs on this thread)
 *****************************************************************************************/
-int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nOutputMode, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag) 
+int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nOutputMode, int nCompressionLevel, int nThreads, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag) 
 {
     // error check the function parameters
     if (pInputFilename == NULL) 
@@ -287,7 +485,7 @@ int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFi
     try
     {
         // create the decoder
-        spAPEDecompress.Assign(CreateIAPEDecompress(pInputFilename, &nFunctionRetVal));
+        spAPEDecompress.Assign(CreateIAPEDecompressThreaded(pInputFilename, &nFunctionRetVal, max(nThreads, 1)));
         if (spAPEDecompress == NULL || nFunctionRetVal != ERROR_SUCCESS) throw(nFunctionRetVal);
 
         // get the input format
@@ -315,8 +513,10 @@ int DecompressCore(const str_utf16 * pInputFilename, const str_utf16 * pOutputFi
             if (spAPEDecompress->GetInfo(APE_INFO_FILE_VERSION) == MAC_VERSION_NUMBER && spAPEDecompress->GetInfo(APE_INFO_COMPRESSION_LEVEL) == nCompressionLevel)
                 throw(ERROR_SKIPPED);
 
-            // create and start the compressor
-            spAPECompress.Assign(CreateIAPECompress());
+            // create and start the compressor (encoding frames on nThreads workers)
+            CAPECompress * pAPECompress = new CAPECompress;
+            spAPECompress.Assign(pAPECompress);
+            pAPECompress->SetThreads(nThreads);
             THROW_ON_ERROR(spAPECompress->Start(pOutputFilename, &wfeInput, spAPEDecompress->GetInfo(APE_DECOMPRESS_TOTAL_BLOCKS) * spAPEDecompress->GetInfo(APE_INFO_BLOCK_ALIGN),
                 nCompressionLevel, spTempBuffer, spAPEDecompress->GetInfo(APE_INFO_WAV_HEADER_BYTES)))
         }
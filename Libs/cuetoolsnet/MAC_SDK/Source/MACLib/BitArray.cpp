@@ -82,8 +82,9 @@ int CBitArray::OutputBitArray(BOOL bFinalize)
 
         RETURN_ON_ERROR(m_pIO->Write(m_pBitArray, nBytesToWrite, &nBytesWritten))
 
-        // reset the bit pointer
+        // reset the bit pointer (and clear the memory so the array can be used again)
         m_nCurrentBitIndex = 0;    
+        memset(m_pBitArray, 0, nBytesToWrite);
     }
     else
     {
@@ -193,6 +194,25 @@ int CBitArray::EncodeUnsignedLong(unsigned int n)
     return 0;
 }
 
+/************************************************************************************
+Appends bits encoded by another bit array (a frame encoded on its own, which started
+at bit 0 there, and starts on the current byte boundary here)
+************************************************************************************/
+int CBitArray::EncodeBitArray(const uint32 * pBitArray, uint32 nBits)
+{
+    // copy whole words (anything past nBits in the last word is zero)
+    uint32 nWords = (nBits + 31) >> 5;
+    for (uint32 z = 0; z < nWords; z++)
+    {
+        RETURN_ON_ERROR(EncodeUnsignedLong(pBitArray[z]))
+    }
+
+    // back up to the end of the data
+    m_nCurrentBitIndex -= (nWords * 32) - nBits;
+
+    return 0;
+}
+
 /************************************************************************************
 Advance to a byte boundary (for frame alignment)
 ************************************************************************************/
@@ -32,6 +32,7 @@ public:
     int EncodeUnsignedLong(unsigned int n);
     int EncodeValue(int nEncode, BIT_ARRAY_STATE & BitArrayState);
     int EncodeBits(unsigned int nValue, int nBits);
+    int EncodeBitArray(const uint32 * pBitArray, uint32 nBits);
 
     // output (saving)
     int OutputBitArray(BOOL bFinalize = FALSE);
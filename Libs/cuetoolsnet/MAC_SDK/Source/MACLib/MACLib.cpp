@@ -13,7 +13,7 @@
     #include "Old/APEDecompressOld.h"
 #endif
 
-IAPEDecompress * CreateIAPEDecompressCore(CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int * pErrorCode)
+IAPEDecompress * CreateIAPEDecompressCore(CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int * pErrorCode, int nThreads)
 {
     IAPEDecompress * pAPEDecompress = NULL;
     if (pAPEInfo != NULL && *pErrorCode == ERROR_SUCCESS)
@@ -24,7 +24,7 @@ IAPEDecompress * CreateIAPEDecompressCore(CAPEInfo * pAPEInfo, int nStartBlock,
                 pAPEDecompress = new CAPEDecompress(pErrorCode, pAPEInfo, nStartBlock, nFinishBlock);
 #ifdef BACKWARDS_COMPATIBILITY
             else
-                pAPEDecompress = new CAPEDecompressOld(pErrorCode, pAPEInfo, nStartBlock, nFinishBlock);
+                pAPEDecompress = new CAPEDecompressOld(pErrorCode, pAPEInfo, nStartBlock, nFinishBlock, nThreads);
 #endif
 
             if (pAPEDecompress == NULL || *pErrorCode != ERROR_SUCCESS)
@@ -44,6 +44,11 @@ IAPEDecompress * CreateIAPEDecompressCore(CAPEInfo * pAPEInfo, int nStartBlock,
 
 #ifdef IO_CLASS_NAME
 IAPEDecompress * __stdcall CreateIAPEDecompress(const str_utf16 * pFilename, int * pErrorCode)
+{
+    return CreateIAPEDecompressThreaded(pFilename, pErrorCode, 1);
+}
+
+IAPEDecompress * __stdcall CreateIAPEDecompressThreaded(const str_utf16 * pFilename, int * pErrorCode, int nThreads)
 {
     // error check the parameters
     if ((pFilename == NULL) || (wcslen(pFilename) == 0))
@@ -91,26 +96,36 @@ IAPEDecompress * __stdcall CreateIAPEDecompress(const str_utf16 * pFilename, int
     }
 
     // create and return
-    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, nStartBlock, nFinishBlock, &nErrorCode);
+    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, nStartBlock, nFinishBlock, &nErrorCode, nThreads);
     if (pErrorCode) *pErrorCode = nErrorCode;
     return pAPEDecompress;
 }
 #endif
 
 IAPEDecompress * __stdcall CreateIAPEDecompressEx(CIO * pIO, int * pErrorCode)
+{
+    return CreateIAPEDecompressExThreaded(pIO, pErrorCode, 1);
+}
+
+IAPEDecompress * __stdcall CreateIAPEDecompressExThreaded(CIO * pIO, int * pErrorCode, int nThreads)
 {
     int nErrorCode = ERROR_UNDEFINED;
     CAPEInfo * pAPEInfo = new CAPEInfo(&nErrorCode, pIO);
-    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, -1, -1, &nErrorCode);
+    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, -1, -1, &nErrorCode, nThreads);
     if (pErrorCode) *pErrorCode = nErrorCode;
     return pAPEDecompress;
 }
 
 
 IAPEDecompress * __stdcall CreateIAPEDecompressEx2(CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int * pErrorCode)
+{
+    return CreateIAPEDecompressEx2Threaded(pAPEInfo, nStartBlock, nFinishBlock, pErrorCode, 1);
+}
+
+IAPEDecompress * __stdcall CreateIAPEDecompressEx2Threaded(CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int * pErrorCode, int nThreads)
 {
     int nErrorCode = ERROR_SUCCESS;
-    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, nStartBlock, nFinishBlock, &nErrorCode);
+    IAPEDecompress * pAPEDecompress = CreateIAPEDecompressCore(pAPEInfo, nStartBlock, nFinishBlock, &nErrorCode, nThreads);
     if (pErrorCode) *pErrorCode = nErrorCode;
     return pAPEDecompress;
 }
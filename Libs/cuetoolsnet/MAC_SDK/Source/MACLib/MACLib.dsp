@@ -41,7 +41,7 @@ RSC=rc.exe
 # PROP Intermediate_Dir "Release"
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /W3 /GX /O2 /D "WIN32" /D "NDEBUG" /D "_MBCS" /D "_LIB" /YX /FD /c
-# ADD CPP /nologo /G6 /MT /W3 /GX /Ox /Ot /Og /Oi /Ob2 /I "..\Shared" /D "WIN32" /D "NDEBUG" /D "_LIB" /D "_UNICODE" /D "UNICODE" /FR /YX"all.h" /FD /c
+# ADD CPP /nologo /G6 /MT /W3 /GX /Ox /Ot /Og /Oi /Ob2 /I "..\Shared" /D "WIN32" /D "NDEBUG" /D "_LIB" /D "_UNICODE" /D "UNICODE" /D "BACKWARDS_COMPATIBILITY" /FR /YX"all.h" /FD /c
 # SUBTRACT CPP /Oa
 # ADD BASE RSC /l 0x409 /d "NDEBUG"
 # ADD RSC /l 0x409 /d "NDEBUG"
@@ -71,7 +71,7 @@ PreLink_Cmds=cd $(ProjDir)\Assembly	nasmw -d WIN32 -f win32 -o Assembly.obj Asse
 # PROP Intermediate_Dir "Debug"
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /W3 /Gm /GX /ZI /Od /D "WIN32" /D "_DEBUG" /D "_MBCS" /D "_LIB" /YX /FD /GZ /c
-# ADD CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /I "..\Shared" /D "WIN32" /D "_DEBUG" /D "_LIB" /D "_UNICODE" /D "UNICODE" /FD /GZ /c
+# ADD CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /I "..\Shared" /D "WIN32" /D "_DEBUG" /D "_LIB" /D "_UNICODE" /D "UNICODE" /D "BACKWARDS_COMPATIBILITY" /FD /GZ /c
 # SUBTRACT CPP /YX
 # ADD BASE RSC /l 0x409 /d "_DEBUG"
 # ADD RSC /l 0x409 /d "_DEBUG"
@@ -236,6 +236,10 @@ SOURCE=.\MD5.cpp
 
 SOURCE=.\Prepare.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=..\Shared\Thread.cpp
+# End Source File
 # End Group
 # Begin Group "Prediction"
 
@@ -400,6 +404,10 @@ SOURCE=.\Prepare.h
 
 SOURCE=..\Shared\SmartPtr.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\Shared\Thread.h
+# End Source File
 # End Group
 # Begin Group "Prediction (h)"
 
@@ -411,6 +411,10 @@ Functions to create the interfaces
 Usage:
     Interface creation returns a NULL pointer on failure (and fills error code if it was passed in)
 
+    The ...Threaded versions take nThreads, the number of threads that decode files from before 3.93
+    (1 decodes on the calling thread, 0 uses one per processor) -- newer files are always decoded on
+    the calling thread, and the other versions always use 1
+
 Usage example:
     int nErrorCode;
     IAPEDecompress * pAPEDecompress = CreateIAPEDecompress("c:\\1.ape", &nErrorCode);
@@ -425,6 +429,9 @@ extern "C"
     IAPEDecompress * __stdcall CreateIAPEDecompress(const str_utf16 * pFilename, int * pErrorCode = NULL);
     IAPEDecompress * __stdcall CreateIAPEDecompressEx(CIO * pIO, int * pErrorCode = NULL);
     IAPEDecompress * __stdcall CreateIAPEDecompressEx2(CAPEInfo * pAPEInfo, int nStartBlock = -1, int nFinishBlock = -1, int * pErrorCode = NULL);
+    IAPEDecompress * __stdcall CreateIAPEDecompressThreaded(const str_utf16 * pFilename, int * pErrorCode, int nThreads);
+    IAPEDecompress * __stdcall CreateIAPEDecompressExThreaded(CIO * pIO, int * pErrorCode, int nThreads);
+    IAPEDecompress * __stdcall CreateIAPEDecompressEx2Threaded(CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int * pErrorCode, int nThreads);
     IAPECompress * __stdcall CreateIAPECompress(int * pErrorCode = NULL);
 }
 
@@ -438,12 +445,20 @@ extern "C"
     DLLEXPORT int __stdcall DecompressFile(const str_ansi * pInputFilename, const str_ansi * pOutputFilename, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
     DLLEXPORT int __stdcall ConvertFile(const str_ansi * pInputFilename, const str_ansi * pOutputFilename, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
     DLLEXPORT int __stdcall VerifyFile(const str_ansi * pInputFilename, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag); 
+    DLLEXPORT int __stdcall ConvertFiles(const str_ansi ** ppInputFilenames, const str_ansi ** ppOutputFilenames, int nFiles, int nCompressionLevel, int * pResults = NULL, int nThreads = 0, int * pPercentageDone = NULL, APE_PROGRESS_CALLBACK ProgressCallback = 0, int * pKillFlag = NULL);
 
     DLLEXPORT int __stdcall CompressFileW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nCompressionLevel = COMPRESSION_LEVEL_NORMAL, int * pPercentageDone = NULL, APE_PROGRESS_CALLBACK ProgressCallback = 0, int * pKillFlag = NULL);
     DLLEXPORT int __stdcall DecompressFileW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
     DLLEXPORT int __stdcall ConvertFileW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag);
     DLLEXPORT int __stdcall VerifyFileW(const str_utf16 * pInputFilename, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag, BOOL bQuickVerifyIfPossible = FALSE); 
 
+    // convert one file, encoding its frames on nThreads threads (ConvertFileW(...) uses 1, 0 uses every processor)
+    DLLEXPORT int __stdcall ConvertFileThreadedW(const str_utf16 * pInputFilename, const str_utf16 * pOutputFilename, int nCompressionLevel, int * pPercentageDone, APE_PROGRESS_CALLBACK ProgressCallback, int * pKillFlag, int nThreads);
+
+    // convert many files at once (nThreads = 0 uses every processor) -- each file's result goes in
+    // pResults (ERROR_SKIPPED when it is already in the requested format), and the first failure is returned
+    DLLEXPORT int __stdcall ConvertFilesW(const str_utf16 ** ppInputFilenames, const str_utf16 ** ppOutputFilenames, int nFiles, int nCompressionLevel, int * pResults = NULL, int nThreads = 0, int * pPercentageDone = NULL, APE_PROGRESS_CALLBACK ProgressCallback = 0, int * pKillFlag = NULL);
+
     // helper functions
     DLLEXPORT int __stdcall FillWaveFormatEx(WAVEFORMATEX * pWaveFormatEx, int nSampleRate = 44100, int nBitsPerSample = 16, int nChannels = 2);
     DLLEXPORT int __stdcall FillWaveHeader(WAVE_HEADER * pWAVHeader, int nAudioBytes, WAVEFORMATEX * pWaveFormatEx, int nTerminatingBytes = 0);
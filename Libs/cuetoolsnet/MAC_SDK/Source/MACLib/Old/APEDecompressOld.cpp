@@ -5,11 +5,234 @@
 #include "UnMAC.h"
 #include "APEDecompressOld.h"
 #include "../APEInfo.h"
+#include "IO.h"
+#include "Thread.h"
 
-CAPEDecompressOld::CAPEDecompressOld(int * pErrorCode, CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock)
+// upper bound on the number of decode workers (each holds its own decoder and frame buffers)
+#define MAX_DECOMPRESS_THREADS          16
+
+// extra bytes read past the end of a frame, so the last partial word of the frame is there too
+#define FRAME_READ_SLACK_BYTES          16
+
+/*****************************************************************************************
+CFrameIO - read-only I/O over a copy of one compressed frame (positions are file offsets)
+*****************************************************************************************/
+class CFrameIO : public CIO
+{
+public:
+
+    CFrameIO() { m_nFileOffset = 0; m_nBytes = 0; m_nCapacity = 0; m_nPosition = 0; }
+
+    // get a buffer for at least nBytes, then describe what was read into it
+    unsigned char * GetBuffer(int nBytes)
+    {
+        if (nBytes > m_nCapacity)
+        {
+            m_spBuffer.Assign(new unsigned char [nBytes], TRUE);
+            m_nCapacity = nBytes;
+        }
+        return m_spBuffer;
+    }
+    void SetFrame(int nFileOffset, int nBytes) { m_nFileOffset = nFileOffset; m_nBytes = nBytes; m_nPosition = 0; }
+
+    int Open(const wchar_t * pName, int fReadonly = 0) { return ERROR_UNDEFINED; }
+    int Close() { return ERROR_SUCCESS; }
+
+    int Read(void * pBuffer, unsigned int nBytesToRead, unsigned int * pBytesRead)
+    {
+        int nBytesAvailable = max(m_nBytes - m_nPosition, 0);
+        if (int(nBytesToRead) > nBytesAvailable)
+            nBytesToRead = nBytesAvailable;
+
+        memcpy(pBuffer, &m_spBuffer[m_nPosition], nBytesToRead);
+        m_nPosition += nBytesToRead;
+        *pBytesRead = nBytesToRead;
+        return ERROR_SUCCESS;
+    }
+    int Write(const void * pBuffer, unsigned int nBytesToWrite, unsigned int * pBytesWritten) { return ERROR_IO_WRITE; }
+
+    int Seek(int nDistance, unsigned int nMoveMode)
+    {
+        int nPosition = m_nPosition;
+        if (nMoveMode == FILE_BEGIN)
+            nPosition = nDistance - m_nFileOffset;
+        else if (nMoveMode == FILE_CURRENT)
+            nPosition += nDistance;
+        else if (nMoveMode == FILE_END)
+            nPosition = m_nBytes + nDistance;
+
+        if (nPosition < 0)
+            return ERROR_IO_READ;
+
+        m_nPosition = nPosition;
+        return ERROR_SUCCESS;
+    }
+
+    int Create(const wchar_t * pName) { return ERROR_UNDEFINED; }
+    int Delete() { return ERROR_UNDEFINED; }
+    int SetEOF() { return ERROR_UNDEFINED; }
+
+    int GetPosition() { return m_nFileOffset + m_nPosition; }
+    int GetSize() { return m_nFileOffset + m_nBytes; }
+    int GetName(wchar_t * pBuffer) { return ERROR_UNDEFINED; }
+
+private:
+
+    CSmartPtr<unsigned char> m_spBuffer;
+    int m_nCapacity;
+    int m_nFileOffset;
+    int m_nBytes;
+    int m_nPosition;
+};
+
+/*****************************************************************************************
+CAPEDecompressOldWorker - decodes whole frames on its own thread
+
+The worker is the IAPEDecompress its CUnMAC sees: everything is answered by the owning
+decompressor, except the I/O source (the worker's copy of the frame) and the size of
+the frame being decoded (so the shared I/O object is never touched from the worker).
+*****************************************************************************************/
+class CAPEDecompressOldWorker : public IAPEDecompress, public CThread
+{
+public:
+
+    CAPEDecompressOldWorker(IAPEDecompress * pOwner)
+    {
+        m_pOwner = pOwner;
+        m_nBlockAlign = pOwner->GetInfo(APE_INFO_BLOCK_ALIGN);
+        m_nFrameIndex = -1;
+        m_nFrameBytes = 0;
+        m_nResult = -1;
+        m_bBusy = FALSE;
+        m_bExit = FALSE;
+    }
+
+    ~CAPEDecompressOldWorker()
+    {
+        Discard();
+        m_bExit = TRUE;
+        m_evStart.Set();
+        Wait();
+    }
+
+    // create the decoder and start the thread (call from the owning thread)
+    int Initialize()
+    {
+        RETURN_ON_ERROR(m_UnMAC.Initialize(this))
+
+        m_spOutput.Assign(new unsigned char [m_nBlockAlign * GetInfo(APE_INFO_BLOCKS_PER_FRAME) + 16], TRUE);
+        if (m_spOutput == NULL)
+            return ERROR_INSUFFICIENT_MEMORY;
+
+        return Start();
+    }
+
+    // the compressed frame goes in here before calling DecompressFrame(...)
+    CFrameIO * GetFrameIO() { return &m_FrameIO; }
+
+    void DecompressFrame(int nFrameIndex, int nFrameBytes)
+    {
+        m_nFrameIndex = nFrameIndex;
+        m_nFrameBytes = nFrameBytes;
+        m_bBusy = TRUE;
+        m_evStart.Set();
+    }
+
+    // waits for the frame and copies it out (same return values as CUnMAC::DecompressFrame)
+    int GetResult(unsigned char * pOutputData)
+    {
+        if (m_bBusy == FALSE)
+            return -1;
+
+        m_evDone.Wait();
+        m_bBusy = FALSE;
+
+        if (m_nResult > 0)
+            memcpy(pOutputData, m_spOutput, m_nResult * m_nBlockAlign);
+        return m_nResult;
+    }
+
+    // waits for the frame (if any) and throws it away
+    void Discard()
+    {
+        if (m_bBusy)
+        {
+            m_evDone.Wait();
+            m_bBusy = FALSE;
+        }
+    }
+
+    // IAPEDecompress
+    int GetData(char * pBuffer, int nBlocks, int * pBlocksRetrieved) { return ERROR_UNDEFINED; }
+    int Seek(int nBlockOffset) { return ERROR_UNDEFINED; }
+
+    int GetInfo(APE_DECOMPRESS_FIELDS Field, int nParam1 = 0, int nParam2 = 0)
+    {
+        if (Field == APE_INFO_IO_SOURCE)
+            return (int) &m_FrameIO;
+        if ((Field == APE_INFO_FRAME_BYTES) && (nParam1 == m_nFrameIndex))
+            return m_nFrameBytes;
+
+        return m_pOwner->GetInfo(Field, nParam1, nParam2);
+    }
+
+protected:
+
+    void Run()
+    {
+        while (TRUE)
+        {
+            m_evStart.Wait();
+            if (m_bExit)
+                break;
+
+            // every frame is read from its seek position, since the frame I/O only holds that frame
+            m_nResult = -1;
+            try
+            {
+                m_UnMAC.ResetFramePosition();
+                m_nResult = m_UnMAC.DecompressFrame(m_spOutput, m_nFrameIndex, 0);
+            }
+            catch(...)
+            {
+                m_nResult = -1;
+            }
+
+            m_evDone.Set();
+        }
+    }
+
+private:
+
+    IAPEDecompress * m_pOwner;
+    CUnMAC m_UnMAC;
+    CFrameIO m_FrameIO;
+    CSmartPtr<unsigned char> m_spOutput;
+    int m_nBlockAlign;
+
+    // the current job (only touched by the owner while the worker is idle)
+    int m_nFrameIndex;
+    int m_nFrameBytes;
+    int m_nResult;
+    BOOL m_bBusy;
+    BOOL m_bExit;
+
+    CThreadEvent m_evStart;
+    CThreadEvent m_evDone;
+};
+
+CAPEDecompressOld::CAPEDecompressOld(int * pErrorCode, CAPEInfo * pAPEInfo, int nStartBlock, int nFinishBlock, int nThreads)
 {
     *pErrorCode = ERROR_SUCCESS;
 
+    // the worker pool is created with the decoder (1 thread decodes on the calling thread, 0 uses every processor)
+    if (nThreads <= 0)
+        nThreads = GetProcessorCount();
+    m_nThreads = min(nThreads, MAX_DECOMPRESS_THREADS);
+    m_paryWorkers = NULL;
+    m_nNextQueuedFrame = 0;
+    m_nNextResultFrame = 0;
+
     // open / analyze the file
     m_spAPEInfo.Assign(pAPEInfo);
 
@@ -37,7 +260,12 @@ CAPEDecompressOld::CAPEDecompressOld(int * pErrorCode, CAPEInfo * pAPEInfo, int
 
 CAPEDecompressOld::~CAPEDecompressOld()
 {
-
+    if (m_paryWorkers)
+    {
+        for (int z = 0; z < m_nThreads; z++)
+            SAFE_DELETE(m_paryWorkers[z])
+        SAFE_ARRAY_DELETE(m_paryWorkers)
+    }
 }
 
 int CAPEDecompressOld::InitializeDecompressor()
@@ -46,8 +274,29 @@ int CAPEDecompressOld::InitializeDecompressor()
     if (m_bDecompressorInitialized)
         return ERROR_SUCCESS;
 
-    // initialize the decoder
-    RETURN_ON_ERROR(m_UnMAC.Initialize(this))
+    // initialize the decoder (a pool of them, one per thread, or a single one on this thread)
+    if (m_nThreads > 1)
+    {
+        m_paryWorkers = new CAPEDecompressOldWorker * [m_nThreads];
+        for (int z = 0; z < m_nThreads; z++)
+            m_paryWorkers[z] = new CAPEDecompressOldWorker(this);
+
+        for (int z = 0; z < m_nThreads; z++)
+        {
+            if (m_paryWorkers[z]->Initialize() != ERROR_SUCCESS)
+            {
+                // fall back to decoding on this thread
+                for (int y = 0; y < m_nThreads; y++)
+                    SAFE_DELETE(m_paryWorkers[y])
+                SAFE_ARRAY_DELETE(m_paryWorkers)
+                m_nThreads = 1;
+                break;
+            }
+        }
+    }
+
+    if (m_paryWorkers == NULL)
+        RETURN_ON_ERROR(m_UnMAC.Initialize(this))
 
     int nMaximumDecompressedFrameBytes = m_nBlockAlign * GetInfo(APE_INFO_BLOCKS_PER_FRAME);
     int nTotalBufferBytes = max(65536, (nMaximumDecompressedFrameBytes + 16) * 2);
@@ -99,7 +348,7 @@ int CAPEDecompressOld::GetData(char * pBuffer, int nBlocks, int * pBlocksRetriev
         // decode more
         if (nBytesLeft > 0)
         {
-            nBlocksDecoded = m_UnMAC.DecompressFrame((unsigned char *) &m_spBuffer[m_nBufferTail], m_nCurrentFrame++, 0);
+            nBlocksDecoded = DecompressFrame((unsigned char *) &m_spBuffer[m_nBufferTail], m_nCurrentFrame++);
             if (nBlocksDecoded == -1)
             {
                 return -1;
@@ -146,7 +395,7 @@ int CAPEDecompressOld::Seek(int nBlockOffset)
     
     m_nCurrentFrame = nBaseFrame;
 
-    int nBlocksDecoded = m_UnMAC.DecompressFrame((unsigned char *) pTempBuffer, m_nCurrentFrame++, 0);
+    int nBlocksDecoded = DecompressFrame((unsigned char *) pTempBuffer, m_nCurrentFrame++);
     
     if (nBlocksDecoded == -1)
     {
@@ -165,6 +414,84 @@ int CAPEDecompressOld::Seek(int nBlockOffset)
     return ERROR_SUCCESS;
 }
 
+int CAPEDecompressOld::DecompressFrame(unsigned char * pOutputData, int nFrameIndex)
+{
+    if (m_paryWorkers == NULL)
+        return m_UnMAC.DecompressFrame(pOutputData, nFrameIndex, 0);
+
+    // anything but the next frame (i.e. a seek) throws away the frames in flight
+    if (nFrameIndex != m_nNextResultFrame)
+    {
+        DrainWorkers();
+        m_nNextQueuedFrame = nFrameIndex;
+        m_nNextResultFrame = nFrameIndex;
+    }
+
+    // past the end (same as CUnMAC::DecompressFrame)
+    if (nFrameIndex >= GetInfo(APE_INFO_TOTAL_FRAMES))
+        return ERROR_SUCCESS;
+
+    // keep every worker busy with the frames that follow, up to the end of the range
+    const int nBlocksPerFrame = GetInfo(APE_INFO_BLOCKS_PER_FRAME);
+    const int nEndFrame = min(GetInfo(APE_INFO_TOTAL_FRAMES), (m_nFinishBlock + nBlocksPerFrame - 1) / nBlocksPerFrame);
+    while ((m_nNextQueuedFrame < nEndFrame) && (m_nNextQueuedFrame < nFrameIndex + m_nThreads))
+    {
+        if (QueueFrame(m_nNextQueuedFrame) != ERROR_SUCCESS)
+            return -1;
+        m_nNextQueuedFrame++;
+    }
+
+    // a frame outside the range that was asked for anyway
+    if (nFrameIndex >= m_nNextQueuedFrame)
+    {
+        if (QueueFrame(nFrameIndex) != ERROR_SUCCESS)
+            return -1;
+        m_nNextQueuedFrame = nFrameIndex + 1;
+    }
+
+    m_nNextResultFrame = nFrameIndex + 1;
+    return m_paryWorkers[nFrameIndex % m_nThreads]->GetResult(pOutputData);
+}
+
+int CAPEDecompressOld::QueueFrame(int nFrameIndex)
+{
+    CAPEDecompressOldWorker * pWorker = m_paryWorkers[nFrameIndex % m_nThreads];
+
+    // read from where CUnMAC::SeekToFrame(...) would start reading
+    int nSeekByte = GetInfo(APE_INFO_SEEK_BYTE, nFrameIndex);
+    int nStartByte = nSeekByte;
+    if (GET_FRAMES_START_ON_BYTES_BOUNDARIES(this))
+        nStartByte -= (nSeekByte - GetInfo(APE_INFO_SEEK_BYTE, 0)) % 4;
+
+    int nFrameBytes = GetInfo(APE_INFO_FRAME_BYTES, nFrameIndex);
+    if (nFrameBytes < 0)
+        return ERROR_INVALID_INPUT_FILE;
+
+    // copy the frame out of the shared I/O object (only this thread touches it)
+    int nBytesToRead = (nSeekByte - nStartByte) + nFrameBytes + FRAME_READ_SLACK_BYTES;
+    unsigned char * pBuffer = pWorker->GetFrameIO()->GetBuffer(nBytesToRead);
+    unsigned int nBytesRead = 0;
+
+    CIO * pIO = GET_IO(this);
+    if (pIO->Seek(nStartByte, FILE_BEGIN) != 0)
+        return ERROR_IO_READ;
+    if (pIO->Read(pBuffer, nBytesToRead, &nBytesRead) != 0)
+        return ERROR_IO_READ;
+
+    pWorker->GetFrameIO()->SetFrame(nStartByte, nBytesRead);
+    pWorker->DecompressFrame(nFrameIndex, nFrameBytes);
+    return ERROR_SUCCESS;
+}
+
+void CAPEDecompressOld::DrainWorkers()
+{
+    if (m_paryWorkers == NULL)
+        return;
+
+    for (int z = 0; z < m_nThreads; z++)
+        m_paryWorkers[z]->Discard();
+}
+
 int CAPEDecompressOld::GetInfo(APE_DECOMPRESS_FIELDS Field, int nParam1, int nParam2)
 {
     int nRetVal = 0;
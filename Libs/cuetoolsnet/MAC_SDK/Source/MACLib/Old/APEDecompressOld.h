@@ -4,10 +4,12 @@
 #include "../APEDecompress.h"
 #include "UnMAC.h"
 
+class CAPEDecompressOldWorker;
+
 class CAPEDecompressOld : public IAPEDecompress
 {
 public:
-    CAPEDecompressOld(int * pErrorCode, CAPEInfo * pAPEInfo, int nStartBlock = -1, int nFinishBlock = -1);
+    CAPEDecompressOld(int * pErrorCode, CAPEInfo * pAPEInfo, int nStartBlock = -1, int nFinishBlock = -1, int nThreads = 1);
     ~CAPEDecompressOld();
 
     int GetData(char * pBuffer, int nBlocks, int * pBlocksRetrieved);
@@ -37,6 +39,16 @@ protected:
     
     BOOL m_bDecompressorInitialized;
     int InitializeDecompressor();
+
+    // frame-level worker pool (frame n is always decoded by worker n % m_nThreads, none when m_nThreads is 1)
+    int m_nThreads;
+    CAPEDecompressOldWorker ** m_paryWorkers;
+    int m_nNextQueuedFrame;
+    int m_nNextResultFrame;
+
+    int DecompressFrame(unsigned char * pOutputData, int nFrameIndex);
+    int QueueFrame(int nFrameIndex);
+    void DrainWorkers();
 };
 
 #endif //_apedecompressold_h_
@@ -389,6 +389,43 @@ LBL_SUBTRACT_AGAIN:
 
 #endif // #ifdef ENABLE_ASSEMBLY
 
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+
+int CAntiPredictorExtraHighHelper::SSE2DotProduct(short *bip, short *bbm, short *pIPAdaptFactor, int op, int nNumberOfIterations) 
+{
+    // same as ConventionalDotProduct(...), 16 taps at a time (pmaddwd wraps just like the int sum)
+    __m128i nSum0 = _mm_setzero_si128();
+    __m128i nSum1 = _mm_setzero_si128();
+
+    for (int z = 0; z < nNumberOfIterations; z += 16)
+    {
+        __m128i nM0 = _mm_loadu_si128((__m128i *) &bbm[z]);
+        __m128i nM1 = _mm_loadu_si128((__m128i *) &bbm[z + 8]);
+        
+        nSum0 = _mm_add_epi32(nSum0, _mm_madd_epi16(_mm_loadu_si128((__m128i *) &bip[z]), nM0));
+        nSum1 = _mm_add_epi32(nSum1, _mm_madd_epi16(_mm_loadu_si128((__m128i *) &bip[z + 8]), nM1));
+
+        if (op > 0)
+        {
+            _mm_storeu_si128((__m128i *) &bbm[z], _mm_add_epi16(nM0, _mm_loadu_si128((__m128i *) &pIPAdaptFactor[z])));
+            _mm_storeu_si128((__m128i *) &bbm[z + 8], _mm_add_epi16(nM1, _mm_loadu_si128((__m128i *) &pIPAdaptFactor[z + 8])));
+        }
+        else if (op < 0)
+        {
+            _mm_storeu_si128((__m128i *) &bbm[z], _mm_sub_epi16(nM0, _mm_loadu_si128((__m128i *) &pIPAdaptFactor[z])));
+            _mm_storeu_si128((__m128i *) &bbm[z + 8], _mm_sub_epi16(nM1, _mm_loadu_si128((__m128i *) &pIPAdaptFactor[z + 8])));
+        }
+    }
+
+    // add the four partial sums
+    nSum0 = _mm_add_epi32(nSum0, nSum1);
+    nSum0 = _mm_add_epi32(nSum0, _mm_shuffle_epi32(nSum0, _MM_SHUFFLE(1, 0, 3, 2)));
+    nSum0 = _mm_add_epi32(nSum0, _mm_shuffle_epi32(nSum0, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(nSum0);
+}
+
+#endif // #ifdef ENABLE_SSE2_ANTI_PREDICTOR
+
 #endif // #ifdef ENABLE_COMPRESSION_MODE_EXTRA_HIGH
 
 #endif // #ifdef BACKWARDS_COMPATIBILITY
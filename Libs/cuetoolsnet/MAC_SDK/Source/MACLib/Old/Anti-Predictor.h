@@ -3,6 +3,12 @@
 
 class CAntiPredictor;
 
+// SSE2 versions of the adaptive filters (x64, or x86 built with /arch:SSE2)
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define ENABLE_SSE2_ANTI_PREDICTOR
+    #include <emmintrin.h>
+#endif
+
 CAntiPredictor * CreateAntiPredictor(int nCompressionLevel, int nVersion);
 
 /*****************************************************************************************
@@ -156,9 +162,18 @@ class CAntiPredictorHigh3800ToCurrent : public CAntiPredictor {
 
 public:
 
+    // construction
+    CAntiPredictorHigh3800ToCurrent() { m_bSSE2Available = TRUE; }
+
     // functions
     void AntiPredict(int *pInputArray, int *pOutputArray, int NumberOfElements);
 
+    // FALSE runs the C filter even when the SSE2 one is built in (it's what the SSE2 one has to match)
+    void SetSSE2Available(BOOL bAvailable) { m_bSSE2Available = bAvailable; }
+
+private:
+
+    BOOL m_bSSE2Available;
 };
 
 #endif // #ifdef ENABLE_COMPRESSION_MODE_HIGH
@@ -176,6 +191,10 @@ public:
 #ifdef ENABLE_ASSEMBLY
     int MMXDotProduct(short *bip, short *bbm, short *pIPAdaptFactor, int op, int nNumberOfIterations);
 #endif // #ifdef ENABLE_ASSEMBLY
+
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+    int SSE2DotProduct(short *bip, short *bbm, short *pIPAdaptFactor, int op, int nNumberOfIterations);
+#endif // #ifdef ENABLE_SSE2_ANTI_PREDICTOR
 };
 
 
@@ -244,8 +263,18 @@ class CAntiPredictorExtraHigh3800ToCurrent : public CAntiPredictor {
 
 public:
 
+    // construction
+    CAntiPredictorExtraHigh3800ToCurrent() { m_bSSE2Available = TRUE; }
+
     // functions
     void AntiPredict(int *pInputArray, int *pOutputArray, int NumberOfElements, BOOL bMMXAvailable, int CPULoadBalancingFactor, int nVersion);
+
+    // FALSE runs the MMX or C filter even when the SSE2 one is built in
+    void SetSSE2Available(BOOL bAvailable) { m_bSSE2Available = bAvailable; }
+
+private:
+
+    BOOL m_bSSE2Available;
 };
 
 #endif // #ifdef ENABLE_COMPRESSION_MODE_EXTRA_HIGH
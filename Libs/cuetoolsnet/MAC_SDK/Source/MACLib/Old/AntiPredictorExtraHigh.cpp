@@ -213,6 +213,9 @@ void CAntiPredictorExtraHigh3800ToCurrent::AntiPredict(int *pInputArray, int *pO
     int opp = op[-1];
     int Original;
     CAntiPredictorExtraHighHelper Helper;
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+    const BOOL bSSE2Available = m_bSSE2Available;
+#endif
     
     //undo the initial prediction stuff
     int q; // loop variable
@@ -265,18 +268,23 @@ void CAntiPredictorExtraHigh3800ToCurrent::AntiPredict(int *pInputArray, int *pO
         IPShort[q] = short(*ip);
         IPAdaptFactor[q] = ((ip[0] >> 30) & 2) - 1;
 
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+        if (bSSE2Available)
+        {
+            *ip -= (Helper.SSE2DotProduct(&IPShort[q-nFirstElement], &bm[0], &IPAdaptFactor[q-nFirstElement], Original, nFilterStageElements) >> nFilterStageShift);
+        }
+        else
+#endif
 #ifdef ENABLE_ASSEMBLY
         if (bMMXAvailable && (Original != 0))
         {
             *ip -= (Helper.MMXDotProduct(&IPShort[q-nFirstElement], &bm[0], &IPAdaptFactor[q-nFirstElement], Original, nFilterStageElements) >> nFilterStageShift);
         }
         else
+#endif
         {
             *ip -= (Helper.ConventionalDotProduct(&IPShort[q-nFirstElement], &bm[0], &IPAdaptFactor[q-nFirstElement], Original, nFilterStageElements) >> nFilterStageShift);
         }
-#else
-        *ip -= (Helper.ConventionalDotProduct(&IPShort[q-nFirstElement], &bm[0], &IPAdaptFactor[q-nFirstElement], Original, nFilterStageElements) >> nFilterStageShift);
-#endif
 
         IPShort[q] = short(*ip);
         IPAdaptFactor[q] = ((ip[0] >> 30) & 2) - 1;
@@ -5,6 +5,18 @@
 
 #ifdef ENABLE_COMPRESSION_MODE_HIGH
 
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+
+// low 32 bits of each product (pmulld is SSE4.1, so do the even and odd lanes with pmuludq)
+static __inline __m128i MultiplyLow(__m128i nA, __m128i nB)
+{
+    __m128i nEven = _mm_mul_epu32(nA, nB);
+    __m128i nOdd = _mm_mul_epu32(_mm_srli_epi64(nA, 32), _mm_srli_epi64(nB, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(nEven, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(nOdd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+#endif // #ifdef ENABLE_SSE2_ANTI_PREDICTOR
+
 void CAntiPredictorHigh0000To3320::AntiPredict(int *pInputArray, int *pOutputArray, int NumberOfElements) 
 {
     // variable declares
@@ -302,40 +314,40 @@ void CAntiPredictorHigh3700To3800::AntiPredict(int *pInputArray, int *pOutputArr
         if (Original > 0) 
         {
             bm[0] -= ip[-1] > 0 ? 1 : -1;
-            bm[1] += ((unsigned int(ip[-2]) >> 30) & 2) - 1;
+            bm[1] += (((unsigned int) ip[-2] >> 30) & 2) - 1;
             bm[2] -= ip[-3] > 0 ? 1 : -1;
-            bm[3] += ((unsigned int(ip[-4]) >> 30) & 2) - 1;
+            bm[3] += (((unsigned int) ip[-4] >> 30) & 2) - 1;
             bm[4] -= ip[-5] > 0 ? 1 : -1;
-            bm[5] += ((unsigned int(ip[-6]) >> 30) & 2) - 1;
+            bm[5] += (((unsigned int) ip[-6] >> 30) & 2) - 1;
             bm[6] -= ip[-7] > 0 ? 1 : -1;
-            bm[7] += ((unsigned int(ip[-8]) >> 30) & 2) - 1;
+            bm[7] += (((unsigned int) ip[-8] >> 30) & 2) - 1;
             bm[8] -= ip[-9] > 0 ? 1 : -1;
-            bm[9] += ((unsigned int(ip[-10]) >> 30) & 2) - 1;
+            bm[9] += (((unsigned int) ip[-10] >> 30) & 2) - 1;
             bm[10] -= ip[-11] > 0 ? 1 : -1;
-            bm[11] += ((unsigned int(ip[-12]) >> 30) & 2) - 1;
+            bm[11] += (((unsigned int) ip[-12] >> 30) & 2) - 1;
             bm[12] -= ip[-13] > 0 ? 1 : -1;
-            bm[13] += ((unsigned int(ip[-14]) >> 30) & 2) - 1;
+            bm[13] += (((unsigned int) ip[-14] >> 30) & 2) - 1;
             bm[14] -= ip[-15] > 0 ? 1 : -1;
-            bm[15] += ((unsigned int(ip[-16]) >> 30) & 2) - 1;
+            bm[15] += (((unsigned int) ip[-16] >> 30) & 2) - 1;
         }
         else if (Original < 0) 
         {
             bm[0] -= ip[-1] <= 0 ? 1 : -1;
-            bm[1] -= ((unsigned int(ip[-2]) >> 30) & 2) - 1;
+            bm[1] -= (((unsigned int) ip[-2] >> 30) & 2) - 1;
             bm[2] -= ip[-3] <= 0 ? 1 : -1;
-            bm[3] -= ((unsigned int(ip[-4]) >> 30) & 2) - 1;
+            bm[3] -= (((unsigned int) ip[-4] >> 30) & 2) - 1;
             bm[4] -= ip[-5] <= 0 ? 1 : -1;
-            bm[5] -= ((unsigned int(ip[-6]) >> 30) & 2) - 1;
+            bm[5] -= (((unsigned int) ip[-6] >> 30) & 2) - 1;
             bm[6] -= ip[-7] <= 0 ? 1 : -1;
-            bm[7] -= ((unsigned int(ip[-8]) >> 30) & 2) - 1;
+            bm[7] -= (((unsigned int) ip[-8] >> 30) & 2) - 1;
             bm[8] -= ip[-9] <= 0 ? 1 : -1;
-            bm[9] -= ((unsigned int(ip[-10]) >> 30) & 2) - 1;
+            bm[9] -= (((unsigned int) ip[-10] >> 30) & 2) - 1;
             bm[10] -= ip[-11] <= 0 ? 1 : -1;
-            bm[11] -= ((unsigned int(ip[-12]) >> 30) & 2) - 1;
+            bm[11] -= (((unsigned int) ip[-12] >> 30) & 2) - 1;
             bm[12] -= ip[-13] <= 0 ? 1 : -1;
-            bm[13] -= ((unsigned int(ip[-14]) >> 30) & 2) - 1;
+            bm[13] -= (((unsigned int) ip[-14] >> 30) & 2) - 1;
             bm[14] -= ip[-15] <= 0 ? 1 : -1;
-            bm[15] -= ((unsigned int(ip[-16]) >> 30) & 2) - 1;
+            bm[15] -= (((unsigned int) ip[-16] >> 30) & 2) - 1;
         }
 
         /////////////////////////////////////////////
@@ -392,6 +404,11 @@ void CAntiPredictorHigh3800ToCurrent::AntiPredict(int *pInputArray, int *pOutput
     
     // variable declares and initializations
     int bm[FIRST_ELEMENT]; memset(bm, 0, FIRST_ELEMENT * 4);
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+    __m128i bm0 = _mm_setzero_si128(), bm1 = _mm_setzero_si128(), bm2 = _mm_setzero_si128(), bm3 = _mm_setzero_si128();
+    const __m128i nOne = _mm_set1_epi32(1);
+    const BOOL bSSE2Available = m_bSSE2Available;
+#endif
     int m2 = 64, m3 = 115, m4 = 64, m5 = 740, m6 = 0;
     int p4 = pInputArray[FIRST_ELEMENT - 1];
     int p3 = (pInputArray[FIRST_ELEMENT - 1] - pInputArray[FIRST_ELEMENT - 2]) << 1;
@@ -412,22 +429,57 @@ void CAntiPredictorHigh3800ToCurrent::AntiPredict(int *pInputArray, int *pOutput
     // pump the primary loop
     for (;op < &pOutputArray[NumberOfElements]; op++, ip++) 
     {
-
-        unsigned int *pip = (unsigned int *) &ip[-FIRST_ELEMENT];
-        int *pbm = &bm[0];
         int nDotProduct = 0;
-        
-        if (*ip > 0) 
-        {
-            EXPAND_16_TIMES(nDotProduct += *pip * *pbm; *pbm++ += ((*pip++ >> 30) & 2) - 1;)
-        }
-        else if (*ip < 0) 
+
+#ifdef ENABLE_SSE2_ANTI_PREDICTOR
+        if (bSSE2Available)
         {
-            EXPAND_16_TIMES(nDotProduct += *pip * *pbm; *pbm++ -= ((*pip++ >> 30) & 2) - 1;)
+            // the same 16 tap filter, four taps at a time -- ((x >> 31) | 1) is -1 for negative
+            // inputs and 1 otherwise, i.e. minus the ((x >> 30) & 2) - 1 adapt step below
+            __m128i ip0 = _mm_loadu_si128((__m128i *) &ip[-16]);
+            __m128i ip1 = _mm_loadu_si128((__m128i *) &ip[-12]);
+            __m128i ip2 = _mm_loadu_si128((__m128i *) &ip[-8]);
+            __m128i ip3 = _mm_loadu_si128((__m128i *) &ip[-4]);
+
+            __m128i nSum = _mm_add_epi32(_mm_add_epi32(MultiplyLow(ip0, bm0), MultiplyLow(ip1, bm1)), 
+                _mm_add_epi32(MultiplyLow(ip2, bm2), MultiplyLow(ip3, bm3)));
+            nSum = _mm_add_epi32(nSum, _mm_shuffle_epi32(nSum, _MM_SHUFFLE(1, 0, 3, 2)));
+            nSum = _mm_add_epi32(nSum, _mm_shuffle_epi32(nSum, _MM_SHUFFLE(2, 3, 0, 1)));
+            nDotProduct = _mm_cvtsi128_si32(nSum);
+
+            if (*ip > 0) 
+            {
+                bm0 = _mm_sub_epi32(bm0, _mm_or_si128(_mm_srai_epi32(ip0, 31), nOne));
+                bm1 = _mm_sub_epi32(bm1, _mm_or_si128(_mm_srai_epi32(ip1, 31), nOne));
+                bm2 = _mm_sub_epi32(bm2, _mm_or_si128(_mm_srai_epi32(ip2, 31), nOne));
+                bm3 = _mm_sub_epi32(bm3, _mm_or_si128(_mm_srai_epi32(ip3, 31), nOne));
+            }
+            else if (*ip < 0) 
+            {
+                bm0 = _mm_add_epi32(bm0, _mm_or_si128(_mm_srai_epi32(ip0, 31), nOne));
+                bm1 = _mm_add_epi32(bm1, _mm_or_si128(_mm_srai_epi32(ip1, 31), nOne));
+                bm2 = _mm_add_epi32(bm2, _mm_or_si128(_mm_srai_epi32(ip2, 31), nOne));
+                bm3 = _mm_add_epi32(bm3, _mm_or_si128(_mm_srai_epi32(ip3, 31), nOne));
+            }
         }
         else
+#endif
         {
-            EXPAND_16_TIMES(nDotProduct += *pip++ * *pbm++;)
+            unsigned int *pip = (unsigned int *) &ip[-FIRST_ELEMENT];
+            int *pbm = &bm[0];
+            
+            if (*ip > 0) 
+            {
+                EXPAND_16_TIMES(nDotProduct += *pip * *pbm; *pbm++ += ((*pip++ >> 30) & 2) - 1;)
+            }
+            else if (*ip < 0) 
+            {
+                EXPAND_16_TIMES(nDotProduct += *pip * *pbm; *pbm++ -= ((*pip++ >> 30) & 2) - 1;)
+            }
+            else
+            {
+                EXPAND_16_TIMES(nDotProduct += *pip++ * *pbm++;)
+            }
         }
 
         *ip -= (nDotProduct >> 9);
@@ -2,7 +2,7 @@
 #ifdef BACKWARDS_COMPATIBILITY
 
 #include "../APEInfo.h"
-#include "UnBitarrayOld.h"
+#include "UnBitArrayOld.h"
 #include "../BitArray.h"
 
 const uint32 K_SUM_MIN_BOUNDARY_OLD[32] = {0,128,256,512,1024,2048,4096,8192,16384,32768,65536,131072,262144,524288,1048576,2097152,4194304,8388608,16777216,33554432,67108864,134217728,268435456,536870912,1073741824,2147483648,0,0,0,0,0,0};
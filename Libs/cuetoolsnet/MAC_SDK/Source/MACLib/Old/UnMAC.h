@@ -38,6 +38,9 @@ public:
     int DecompressFrame(unsigned char *pOutputData, int32 FrameIndex, int CPULoadBalancingFactor = 0);
 
     int SeekToFrame(int FrameIndex);
+
+    // forget the last decoded frame, so the next one is read from its seek position
+    void ResetFramePosition() { m_LastDecodedFrameIndex = -1; }
     
 private:
 
@@ -0,0 +1,204 @@
+#include "All.h"
+#include "Thread.h"
+
+/*************************************************************************************************
+CThreadEvent
+*************************************************************************************************/
+#ifdef _WIN32
+
+CThreadEvent::CThreadEvent()
+{
+    m_hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+CThreadEvent::~CThreadEvent()
+{
+    CloseHandle(m_hEvent);
+}
+
+void CThreadEvent::Set()
+{
+    SetEvent(m_hEvent);
+}
+
+void CThreadEvent::Wait()
+{
+    WaitForSingleObject(m_hEvent, INFINITE);
+}
+
+#else
+
+CThreadEvent::CThreadEvent()
+{
+    pthread_mutex_init(&m_Mutex, NULL);
+    pthread_cond_init(&m_Condition, NULL);
+    m_bSignaled = FALSE;
+}
+
+CThreadEvent::~CThreadEvent()
+{
+    pthread_cond_destroy(&m_Condition);
+    pthread_mutex_destroy(&m_Mutex);
+}
+
+void CThreadEvent::Set()
+{
+    pthread_mutex_lock(&m_Mutex);
+    m_bSignaled = TRUE;
+    pthread_cond_signal(&m_Condition);
+    pthread_mutex_unlock(&m_Mutex);
+}
+
+void CThreadEvent::Wait()
+{
+    pthread_mutex_lock(&m_Mutex);
+    while (!m_bSignaled)
+        pthread_cond_wait(&m_Condition, &m_Mutex);
+    m_bSignaled = FALSE;
+    pthread_mutex_unlock(&m_Mutex);
+}
+
+#endif
+
+/*************************************************************************************************
+CThreadLock
+*************************************************************************************************/
+#ifdef _WIN32
+
+CThreadLock::CThreadLock()
+{
+    InitializeCriticalSection(&m_CriticalSection);
+}
+
+CThreadLock::~CThreadLock()
+{
+    DeleteCriticalSection(&m_CriticalSection);
+}
+
+void CThreadLock::Enter()
+{
+    EnterCriticalSection(&m_CriticalSection);
+}
+
+void CThreadLock::Leave()
+{
+    LeaveCriticalSection(&m_CriticalSection);
+}
+
+#else
+
+CThreadLock::CThreadLock()
+{
+    pthread_mutex_init(&m_Mutex, NULL);
+}
+
+CThreadLock::~CThreadLock()
+{
+    pthread_mutex_destroy(&m_Mutex);
+}
+
+void CThreadLock::Enter()
+{
+    pthread_mutex_lock(&m_Mutex);
+}
+
+void CThreadLock::Leave()
+{
+    pthread_mutex_unlock(&m_Mutex);
+}
+
+#endif
+
+/*************************************************************************************************
+CThread
+*************************************************************************************************/
+#ifdef _WIN32
+
+CThread::CThread()
+{
+    m_hThread = NULL;
+}
+
+CThread::~CThread()
+{
+    Wait();
+}
+
+int CThread::Start()
+{
+    if (m_hThread != NULL)
+        return ERROR_UNDEFINED;
+
+    DWORD nThreadID = 0;
+    m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, &nThreadID);
+    return (m_hThread != NULL) ? ERROR_SUCCESS : ERROR_UNDEFINED;
+}
+
+void CThread::Wait()
+{
+    if (m_hThread != NULL)
+    {
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = NULL;
+    }
+}
+
+DWORD WINAPI CThread::ThreadProc(LPVOID pParameter)
+{
+    ((CThread *) pParameter)->Run();
+    return 0;
+}
+
+int GetProcessorCount()
+{
+    SYSTEM_INFO SystemInfo; GetSystemInfo(&SystemInfo);
+    return max(int(SystemInfo.dwNumberOfProcessors), 1);
+}
+
+#else
+
+CThread::CThread()
+{
+    m_bStarted = FALSE;
+}
+
+CThread::~CThread()
+{
+    Wait();
+}
+
+int CThread::Start()
+{
+    if (m_bStarted)
+        return ERROR_UNDEFINED;
+
+    if (pthread_create(&m_Thread, NULL, ThreadProc, this) != 0)
+        return ERROR_UNDEFINED;
+
+    m_bStarted = TRUE;
+    return ERROR_SUCCESS;
+}
+
+void CThread::Wait()
+{
+    if (m_bStarted)
+    {
+        pthread_join(m_Thread, NULL);
+        m_bStarted = FALSE;
+    }
+}
+
+void * CThread::ThreadProc(void * pParameter)
+{
+    ((CThread *) pParameter)->Run();
+    return NULL;
+}
+
+int GetProcessorCount()
+{
+    long nProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+    return (nProcessors > 1) ? int(nProcessors) : 1;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef APE_THREAD_H
+#define APE_THREAD_H
+
+#ifndef _WIN32
+    #include <pthread.h>
+#endif
+
+/*************************************************************************************************
+CThreadEvent - an auto-reset event (a waiter consumes the signal)
+*************************************************************************************************/
+class CThreadEvent
+{
+public:
+
+    // construction / destruction
+    CThreadEvent();
+    ~CThreadEvent();
+
+    // signal / wait
+    void Set();
+    void Wait();
+
+private:
+
+#ifdef _WIN32
+    HANDLE m_hEvent;
+#else
+    pthread_mutex_t m_Mutex;
+    pthread_cond_t m_Condition;
+    BOOL m_bSignaled;
+#endif
+};
+
+/*************************************************************************************************
+CThreadLock - a mutual exclusion lock (Enter / Leave)
+*************************************************************************************************/
+class CThreadLock
+{
+public:
+
+    // construction / destruction
+    CThreadLock();
+    ~CThreadLock();
+
+    // lock / unlock
+    void Enter();
+    void Leave();
+
+private:
+
+#ifdef _WIN32
+    CRITICAL_SECTION m_CriticalSection;
+#else
+    pthread_mutex_t m_Mutex;
+#endif
+};
+
+/*************************************************************************************************
+CThread - a worker thread that calls Run() once it is started
+*************************************************************************************************/
+class CThread
+{
+public:
+
+    // construction / destruction
+    CThread();
+    virtual ~CThread();
+
+    // start the thread / wait for Run() to return
+    int Start();
+    void Wait();
+
+protected:
+
+    // the thread body
+    virtual void Run() = 0;
+
+private:
+
+#ifdef _WIN32
+    static DWORD WINAPI ThreadProc(LPVOID pParameter);
+    HANDLE m_hThread;
+#else
+    static void * ThreadProc(void * pParameter);
+    pthread_t m_Thread;
+    BOOL m_bStarted;
+#endif
+};
+
+/*************************************************************************************************
+Gets the number of logical processors (at least 1)
+*************************************************************************************************/
+int GetProcessorCount();
+
+#endif // #ifndef APE_THREAD_H
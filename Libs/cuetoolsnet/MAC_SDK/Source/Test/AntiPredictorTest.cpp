@@ -0,0 +1,144 @@
+/*****************************************************************************************
+AntiPredictorTest - checks that the SSE2 anti-predictors decode exactly like the C ones
+
+Every case runs the same input through a predictor with SSE2 on and with it off and compares
+both the output and the (filtered in place) input.  Returns 0 when everything matches.
+*****************************************************************************************/
+#include "All.h"
+#include "Old/Anti-Predictor.h"
+
+#define MAX_TEST_ELEMENTS       20000
+
+// the kinds of input every predictor is run on
+enum TEST_INPUT
+{
+    TEST_INPUT_RANDOM_SMALL,            // typical residuals
+    TEST_INPUT_RANDOM_LARGE,            // full range (the adapt steps look at bit 30 and 31)
+    TEST_INPUT_ZERO,                    // the filters don't adapt on zero
+    TEST_INPUT_EXTREMES,                // alternating INT_MAX / INT_MIN
+    TEST_INPUT_SHORT_RANGE,             // values at the edge of (and just past) 16 bits
+    TEST_INPUT_COUNT
+};
+
+static const char * s_aryInputNames[TEST_INPUT_COUNT] = { "random small", "random large", "zero", "extremes", "16 bit edge" };
+
+static unsigned int s_nRandom = 1;
+
+static int GetRandom()
+{
+    // fixed sequence, so a failure can be reproduced
+    s_nRandom = s_nRandom * 1664525 + 1013904223;
+    return int(s_nRandom);
+}
+
+static void FillInput(int * pInput, int nElements, int nInput)
+{
+    for (int z = 0; z < nElements; z++)
+    {
+        switch (nInput)
+        {
+        case TEST_INPUT_RANDOM_SMALL: pInput[z] = GetRandom() >> 20; break;
+        case TEST_INPUT_RANDOM_LARGE: pInput[z] = GetRandom(); break;
+        case TEST_INPUT_ZERO: pInput[z] = 0; break;
+        case TEST_INPUT_EXTREMES: pInput[z] = (z & 1) ? 0x7FFFFFFF : int(0x80000000); break;
+        case TEST_INPUT_SHORT_RANGE: pInput[z] = (GetRandom() & 1) ? 32767 + (z % 3) : -32768 - (z % 3); break;
+        }
+    }
+}
+
+// the two predictors with SSE2 (and any other assembly) turned on and off
+class CPredictorPair
+{
+public:
+
+    virtual ~CPredictorPair() {}
+    virtual const char * GetName() = 0;
+    virtual void AntiPredict(BOOL bSSE2, int * pInput, int * pOutput, int nElements) = 0;
+};
+
+class CHighPair : public CPredictorPair
+{
+public:
+
+    const char * GetName() { return "high 3800+"; }
+    void AntiPredict(BOOL bSSE2, int * pInput, int * pOutput, int nElements)
+    {
+        CAntiPredictorHigh3800ToCurrent AntiPredictor;
+        AntiPredictor.SetSSE2Available(bSSE2);
+        AntiPredictor.AntiPredict(pInput, pOutput, nElements);
+    }
+};
+
+class CExtraHighPair : public CPredictorPair
+{
+public:
+
+    CExtraHighPair(int nVersion, const char * pName) { m_nVersion = nVersion; m_pName = pName; }
+    const char * GetName() { return m_pName; }
+    void AntiPredict(BOOL bSSE2, int * pInput, int * pOutput, int nElements)
+    {
+        CAntiPredictorExtraHigh3800ToCurrent AntiPredictor;
+        AntiPredictor.SetSSE2Available(bSSE2);
+        AntiPredictor.AntiPredict(pInput, pOutput, nElements, FALSE, 0, m_nVersion);
+    }
+
+private:
+
+    int m_nVersion;
+    const char * m_pName;
+};
+
+int main(int argc, char * argv[])
+{
+#ifndef ENABLE_SSE2_ANTI_PREDICTOR
+    printf("SSE2 anti-predictors are not built in (nothing to test)\n");
+    return 0;
+#else
+    CHighPair High;
+    CExtraHighPair ExtraHigh3800(3800, "extra high 3800");
+    CExtraHighPair ExtraHigh3830(3830, "extra high 3830+");
+    CPredictorPair * aryPairs[] = { &High, &ExtraHigh3800, &ExtraHigh3830 };
+
+    // around the short frame cut-offs (20, 134 and 262) and a couple of real frame sizes
+    const int aryElements[] = { 1, 19, 20, 21, 133, 134, 135, 261, 262, 263, 4096, MAX_TEST_ELEMENTS };
+
+    CSmartPtr<int> spOriginal(new int [MAX_TEST_ELEMENTS], TRUE);
+    CSmartPtr<int> spInputC(new int [MAX_TEST_ELEMENTS], TRUE);
+    CSmartPtr<int> spInputSSE2(new int [MAX_TEST_ELEMENTS], TRUE);
+    CSmartPtr<int> spOutputC(new int [MAX_TEST_ELEMENTS], TRUE);
+    CSmartPtr<int> spOutputSSE2(new int [MAX_TEST_ELEMENTS], TRUE);
+
+    int nFailures = 0;
+    int nTests = 0;
+    for (int nPair = 0; nPair < int(sizeof(aryPairs) / sizeof(aryPairs[0])); nPair++)
+    {
+        for (int nInput = 0; nInput < TEST_INPUT_COUNT; nInput++)
+        {
+            for (int nSize = 0; nSize < int(sizeof(aryElements) / sizeof(aryElements[0])); nSize++)
+            {
+                const int nElements = aryElements[nSize];
+                FillInput(spOriginal, nElements, nInput);
+
+                memcpy(spInputC, spOriginal, nElements * sizeof(int));
+                memcpy(spInputSSE2, spOriginal, nElements * sizeof(int));
+                memset(spOutputC, 0, MAX_TEST_ELEMENTS * sizeof(int));
+                memset(spOutputSSE2, 0, MAX_TEST_ELEMENTS * sizeof(int));
+
+                aryPairs[nPair]->AntiPredict(FALSE, spInputC, spOutputC, nElements);
+                aryPairs[nPair]->AntiPredict(TRUE, spInputSSE2, spOutputSSE2, nElements);
+
+                nTests++;
+                if ((memcmp(spInputC, spInputSSE2, nElements * sizeof(int)) != 0) ||
+                    (memcmp(spOutputC, spOutputSSE2, nElements * sizeof(int)) != 0))
+                {
+                    printf("FAILED: %s, %s input, %d elements\n", aryPairs[nPair]->GetName(), s_aryInputNames[nInput], nElements);
+                    nFailures++;
+                }
+            }
+        }
+    }
+
+    printf("%d of %d anti-predictor tests passed\n", nTests - nFailures, nTests);
+    return (nFailures == 0) ? 0 : 1;
+#endif
+}
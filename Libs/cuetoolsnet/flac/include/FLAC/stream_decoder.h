@@ -809,6 +809,42 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_md5_checking(FLAC__StreamDecoder *d
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_set_disable_asm(FLAC__StreamDecoder *decoder, FLAC__bool value);
 
+/** Set the number of threads used to decode frames.  With \a value >
+ *  \c 1, FLAC__stream_decoder_process_until_end_of_stream() cuts the
+ *  input at frame boundaries into runs of frames and hands each run to
+ *  one of \a value worker threads; the calling thread passes the
+ *  decoded frames on to the write callback in order, so all the
+ *  callbacks are still made from the calling thread, and the audio (and
+ *  the MD5 check) is the same as when decoding with a single thread.
+ *  The MD5 check itself is then done on a helper thread of its own, with
+ *  any of the process functions.
+ *
+ *  This only applies to FLAC__stream_decoder_process_until_end_of_stream()
+ *  on a seekable native FLAC stream with a STREAMINFO block; otherwise,
+ *  and from the first run that does not decode cleanly on, the stream is
+ *  decoded by the calling thread as usual, so errors are reported just as
+ *  they would be without threads.
+ *
+ * \note
+ * While the worker threads are in use, only \a frame->header and
+ * \a frame->footer are set when the write callback is called
+ * (\a frame->subframes is zeroed), and
+ * FLAC__stream_decoder_get_decode_position() does not return the
+ * position of the frame, since the input has been read ahead.
+ *
+ * \default \c 1
+ * \param  decoder  A decoder instance to set.
+ * \param  value    The number of decoding threads; \c 0 or \c 1 decodes
+ *                  everything on the calling thread.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, or if \a value is
+ *    more than \c 64 (or more than \c 1 if libFLAC was built without
+ *    thread support), else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value);
+
 /** Direct the decoder to pass on all metadata blocks of type \a type.
  *
  * \default By default, only the \c STREAMINFO block is returned via the
@@ -925,6 +961,16 @@ FLAC_API const char *FLAC__stream_decoder_get_resolved_state_string(const FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDecoder *decoder);
 
+/** Get the number of decoding threads setting.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_decoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder);
+
 /** Get the total number of samples in the stream being decoded.
  *  Will only be valid after decoding has started and will contain the
  *  value from the \c STREAMINFO block.  A value of \c 0 means "unknown".
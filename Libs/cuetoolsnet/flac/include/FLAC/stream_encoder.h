@@ -731,6 +731,10 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_ogg_serial_number(FLAC__StreamEncod
  *  the original signal against the decoded signal.  If a mismatch occurs,
  *  the process call will return \c false.  Note that this will slow the
  *  encoding process by the extra time required for decoding and comparison.
+ *  With FLAC__stream_encoder_set_num_threads() set to more than \c 1 the
+ *  audio frames are decoded and compared on a thread of their own, so a
+ *  mismatch may only be reported by a later process call or by
+ *  FLAC__stream_encoder_finish().
  *
  * \default \c false
  * \param  encoder  An encoder instance to set.
@@ -1083,6 +1087,63 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_max_residual_partition_order(FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_rice_parameter_search_dist(FLAC__StreamEncoder *encoder, unsigned value);
 
+/** Set the number of threads used to encode frames.  FLAC frames are
+ *  independent of each other, so with \a value > \c 1 each full block
+ *  is handed to one of \a value worker threads while the calling thread
+ *  goes on reading input; the frames are still written in order by the
+ *  calling thread, from inside FLAC__stream_encoder_process(),
+ *  FLAC__stream_encoder_process_interleaved() and
+ *  FLAC__stream_encoder_finish(), so all the callbacks are made from
+ *  there as usual.  The encoded stream is identical to the one encoded
+ *  with a single thread.  The MD5 signature of the input (see
+ *  FLAC__stream_encoder_set_do_md5()) is then also computed on a helper
+ *  thread of its own, and so is the verification of the frames (see
+ *  FLAC__stream_encoder_set_verify()).
+ *
+ * \note
+ * Loose mid-side stereo chooses the channel assignment of each frame
+ * from the frames before it, so with
+ * FLAC__stream_encoder_set_loose_mid_side_stereo() the frames are always
+ * encoded by the calling thread, unless
+ * FLAC__stream_encoder_set_subframe_threads() is used.
+ *
+ * \default \c 1
+ * \param  encoder  An encoder instance to set.
+ * \param  value    The number of encoding threads; \c 0 or \c 1 encodes
+ *                  everything on the calling thread.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, or if \a value is
+ *    more than \c 64 (or more than \c 1 if libFLAC was built without
+ *    thread support), else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value);
+
+/** Set whether the threads from FLAC__stream_encoder_set_num_threads()
+ *  work on one frame at a time.  Normally each thread encodes whole
+ *  frames, which keeps every thread busy but means a frame is only
+ *  written some blocks after its samples were passed in.  With subframe
+ *  threads, the subframe searches of each frame (one per channel, plus
+ *  the mid and side signals with mid-side stereo) are shared between
+ *  the calling thread and the other threads, and the frame is written
+ *  before the call that completed its block returns.  This
+ *  gives lower latency for live encoding, at the cost of throughput:
+ *  at most as many threads as there are subframe searches are used,
+ *  and the calling thread waits for the slowest one.  Loose mid-side
+ *  stereo works in this mode.  The encoded stream is the same either
+ *  way.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_subframe_threads(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
 /** Set an estimate of the total samples that will be encoded.
  *  This is merely an estimate and may be set to \c 0 if unknown.
  *  This value will be written to the STREAMINFO block before encoding,
@@ -1396,6 +1457,26 @@ FLAC_API unsigned FLAC__stream_encoder_get_max_residual_partition_order(const FL
  */
 FLAC_API unsigned FLAC__stream_encoder_get_rice_parameter_search_dist(const FLAC__StreamEncoder *encoder);
 
+/** Get the number of encoding threads.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_encoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder);
+
+/** Get the "subframe threads" flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_subframe_threads().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_subframe_threads(const FLAC__StreamEncoder *encoder);
+
 /** Get the previously set estimate of the total samples to be encoded.
  *  The encoder merely mimics back the value given to
  *  FLAC__stream_encoder_set_total_samples_estimate() since it has no
@@ -75,6 +75,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_set_md5_checking(decoder_, value);
 		}
 
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_num_threads(decoder_, value);
+		}
+
 		bool Stream::set_metadata_respond(::FLAC__MetadataType type)
 		{
 			FLAC__ASSERT(is_valid());
@@ -123,6 +129,12 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_get_md5_checking(decoder_);
 		}
 
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_num_threads(decoder_);
+		}
+
 		FLAC__uint64 Stream::get_total_samples() const
 		{
 			FLAC__ASSERT(is_valid());
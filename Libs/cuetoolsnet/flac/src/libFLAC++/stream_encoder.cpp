@@ -178,6 +178,18 @@ namespace FLAC {
 			return (bool)::FLAC__stream_encoder_set_rice_parameter_search_dist(encoder_, value);
 		}
 
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_num_threads(encoder_, value);
+		}
+
+		bool Stream::set_subframe_threads(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_subframe_threads(encoder_, value);
+		}
+
 		bool Stream::set_total_samples_estimate(FLAC__uint64 value)
 		{
 			FLAC__ASSERT(is_valid());
@@ -329,6 +341,18 @@ namespace FLAC {
 			return ::FLAC__stream_encoder_get_rice_parameter_search_dist(encoder_);
 		}
 
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_encoder_get_num_threads(encoder_);
+		}
+
+		bool Stream::get_subframe_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_subframe_threads(encoder_);
+		}
+
 		FLAC__uint64 Stream::get_total_samples_estimate() const
 		{
 			FLAC__ASSERT(is_valid());
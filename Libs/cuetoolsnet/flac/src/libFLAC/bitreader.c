@@ -48,11 +48,56 @@
 #include "private/bitreader.h"
 #include "private/crc.h"
 #include "FLAC/assert.h"
+#if defined FLAC__CPU_IA64
+#if defined _MSC_VER
+#include <intrin.h> /* for _BitScanReverse64() */
+#endif
+#ifdef FLAC__BMI2_SUPPORTED
+#include <immintrin.h> /* for _lzcnt_u64(), _bzhi_u64() */
+#endif
+#endif
+
+/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
+#ifdef _MSC_VER
+#define FLAC__U64L(x) x
+#else
+#define FLAC__U64L(x) x##LLU
+#endif
 
 /* Things should be fastest when this matches the machine word size */
 /* WATCHOUT: if you change this you must also change the following #defines down to COUNT_ZERO_MSBS below to match */
 /* WATCHOUT: there are a few places where the code will not work unless brword is >= 32 bits wide */
 /*           also, some sections currently only have fast versions for 4 or 8 bytes per word */
+/* x86-64 builds use 64-bit words; ia32 keeps 32-bit ones because the asm routines depend on it */
+#if defined FLAC__CPU_IA64
+typedef FLAC__uint64 brword;
+#define FLAC__BYTES_PER_WORD 8
+#define FLAC__BITS_PER_WORD 64
+#define FLAC__WORD_ALL_ONES ((FLAC__uint64)FLAC__U64L(0xffffffffffffffff))
+/* SWAP_BE_WORD_TO_HOST swaps bytes in a brword (which is always big-endian) if necessary to match host byte order */
+#if WORDS_BIGENDIAN
+#define SWAP_BE_WORD_TO_HOST(x) (x)
+#elif defined _MSC_VER
+#define SWAP_BE_WORD_TO_HOST(x) _byteswap_uint64(x)
+#elif defined __GNUC__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+#define SWAP_BE_WORD_TO_HOST(x) __builtin_bswap64(x)
+#else
+#define SWAP_BE_WORD_TO_HOST(x) (((FLAC__uint64)ntohl((FLAC__uint32)(x)) << 32) | ntohl((FLAC__uint32)((x) >> 32)))
+#endif
+/* counts the # of zero MSBs in a word; the word must not be 0 */
+#if defined _MSC_VER
+#define COUNT_ZERO_MSBS(word) local_clz64_(word)
+#elif defined __GNUC__
+#define COUNT_ZERO_MSBS(word) ((unsigned)__builtin_clzll(word))
+#else
+#define COUNT_ZERO_MSBS(word) ( \
+	(word) <= 0xffffffff ? \
+		COUNT_ZERO_MSBS32((FLAC__uint32)(word)) + 32 : \
+		COUNT_ZERO_MSBS32((FLAC__uint32)((word) >> 32)) \
+)
+#define FLAC__BITREADER_UNARY_TABLE
+#endif
+#else
 typedef FLAC__uint32 brword;
 #define FLAC__BYTES_PER_WORD 4
 #define FLAC__BITS_PER_WORD 32
@@ -68,14 +113,18 @@ typedef FLAC__uint32 brword;
 #endif
 #endif
 /* counts the # of zero MSBs in a word */
-#define COUNT_ZERO_MSBS(word) ( \
+#define COUNT_ZERO_MSBS(word) COUNT_ZERO_MSBS32(word)
+#define FLAC__BITREADER_UNARY_TABLE
+#endif
+#ifdef FLAC__BITREADER_UNARY_TABLE
+#define COUNT_ZERO_MSBS32(word) ( \
 	(word) <= 0xffff ? \
 		( (word) <= 0xff? byte_to_unary_table[word] + 24 : byte_to_unary_table[(word) >> 8] + 16 ) : \
 		( (word) <= 0xffffff? byte_to_unary_table[word >> 16] + 8 : byte_to_unary_table[(word) >> 24] ) \
 )
 /* this alternate might be slightly faster on some systems/compilers: */
 #define COUNT_ZERO_MSBS2(word) ( (word) <= 0xff ? byte_to_unary_table[word] + 24 : ((word) <= 0xffff ? byte_to_unary_table[(word) >> 8] + 16 : ((word) <= 0xffffff ? byte_to_unary_table[(word) >> 16] + 8 : byte_to_unary_table[(word) >> 24])) )
-
+#endif
 
 /*
  * This should be at least twice as large as the largest number of words
@@ -93,6 +142,7 @@ typedef FLAC__uint32 brword;
  */
 static const unsigned FLAC__BITREADER_DEFAULT_CAPACITY = 65536u / FLAC__BITS_PER_WORD; /* in words */
 
+#ifdef FLAC__BITREADER_UNARY_TABLE
 static const unsigned char byte_to_unary_table[] = {
 	8, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
 	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
@@ -111,6 +161,7 @@ static const unsigned char byte_to_unary_table[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
+#endif
 
 #ifdef min
 #undef min
@@ -121,13 +172,6 @@ static const unsigned char byte_to_unary_table[] = {
 #endif
 #define max(x,y) ((x)>(y)?(x):(y))
 
-/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
-#ifdef _MSC_VER
-#define FLAC__U64L(x) x
-#else
-#define FLAC__U64L(x) x##LLU
-#endif
-
 #ifndef FLaC__INLINE
 #define FLaC__INLINE
 #endif
@@ -157,7 +201,15 @@ static _inline FLAC__uint32 local_swap32_(FLAC__uint32 x)
 	x = ((x<<8)&0xFF00FF00) | ((x>>8)&0x00FF00FF);
 	return (x>>16) | (x<<16);
 }
-#ifdef _WIN64
+#if defined FLAC__CPU_IA64
+static _inline unsigned local_clz64_(FLAC__uint64 x)
+{
+	unsigned long idx;
+	_BitScanReverse64(&idx, x);
+	return 63 - (unsigned)idx;
+}
+#endif
+#if defined _WIN64 || FLAC__BYTES_PER_WORD != 4
 #else
 static void local_swap32_block_(FLAC__uint32 *start, FLAC__uint32 len)
 {
@@ -183,15 +235,27 @@ static FLaC__INLINE void crc16_update_word_(FLAC__BitReader *br, brword word)
 {
 	register unsigned crc = br->read_crc16;
 #if FLAC__BYTES_PER_WORD == 4
-	switch(br->crc16_align) {
-		case  0: crc = FLAC__CRC16_UPDATE((unsigned)(word >> 24), crc);
+	if(br->crc16_align == 0) { /* the usual case: look up all 4 bytes at once */
+		crc ^= (unsigned)(word >> 16);
+		br->read_crc16 =
+			FLAC__crc16_slice8_table[3][crc >> 8] ^ FLAC__crc16_slice8_table[2][crc & 0xff] ^
+			FLAC__crc16_slice8_table[1][(word >> 8) & 0xff] ^ FLAC__crc16_slice8_table[0][word & 0xff];
+	}
+	else switch(br->crc16_align) {
 		case  8: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 16) & 0xff), crc);
 		case 16: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 8) & 0xff), crc);
 		case 24: br->read_crc16 = FLAC__CRC16_UPDATE((unsigned)(word & 0xff), crc);
 	}
 #elif FLAC__BYTES_PER_WORD == 8
-	switch(br->crc16_align) {
-		case  0: crc = FLAC__CRC16_UPDATE((unsigned)(word >> 56), crc);
+	if(br->crc16_align == 0) { /* the usual case: look up all 8 bytes at once */
+		crc ^= (unsigned)(word >> 48);
+		br->read_crc16 =
+			FLAC__crc16_slice8_table[7][crc >> 8] ^ FLAC__crc16_slice8_table[6][crc & 0xff] ^
+			FLAC__crc16_slice8_table[5][(word >> 40) & 0xff] ^ FLAC__crc16_slice8_table[4][(word >> 32) & 0xff] ^
+			FLAC__crc16_slice8_table[3][(word >> 24) & 0xff] ^ FLAC__crc16_slice8_table[2][(word >> 16) & 0xff] ^
+			FLAC__crc16_slice8_table[1][(word >> 8) & 0xff] ^ FLAC__crc16_slice8_table[0][word & 0xff];
+	}
+	else switch(br->crc16_align) {
 		case  8: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 48) & 0xff), crc);
 		case 16: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 40) & 0xff), crc);
 		case 24: crc = FLAC__CRC16_UPDATE((unsigned)((word >> 32) & 0xff), crc);
@@ -380,7 +444,7 @@ void FLAC__bitreader_dump(const FLAC__BitReader *br, FILE *out)
 				if(i < br->consumed_words || (i == br->consumed_words && j < br->consumed_bits))
 					fprintf(out, ".");
 				else
-					fprintf(out, "%01u", br->buffer[i] & (1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
+					fprintf(out, "%01u", br->buffer[i] & ((brword)1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 		if(br->bytes > 0) {
@@ -389,7 +453,7 @@ void FLAC__bitreader_dump(const FLAC__BitReader *br, FILE *out)
 				if(i < br->consumed_words || (i == br->consumed_words && j < br->consumed_bits))
 					fprintf(out, ".");
 				else
-					fprintf(out, "%01u", br->buffer[i] & (1 << (br->bytes*8-j-1)) ? 1:0);
+					fprintf(out, "%01u", br->buffer[i] & ((brword)1 << (br->bytes*8-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 	}
@@ -464,18 +528,18 @@ FLaC__INLINE FLAC__bool FLAC__bitreader_read_raw_uint32(FLAC__BitReader *br, FLA
 			const unsigned n = FLAC__BITS_PER_WORD - br->consumed_bits;
 			const brword word = br->buffer[br->consumed_words];
 			if(bits < n) {
-				*val = (word & (FLAC__WORD_ALL_ONES >> br->consumed_bits)) >> (n-bits);
+				*val = (FLAC__uint32)((word & (FLAC__WORD_ALL_ONES >> br->consumed_bits)) >> (n-bits));
 				br->consumed_bits += bits;
 				return true;
 			}
-			*val = word & (FLAC__WORD_ALL_ONES >> br->consumed_bits);
+			*val = (FLAC__uint32)(word & (FLAC__WORD_ALL_ONES >> br->consumed_bits));
 			bits -= n;
 			crc16_update_word_(br, word);
 			br->consumed_words++;
 			br->consumed_bits = 0;
 			if(bits) { /* if there are still bits left to read, there have to be less than 32 so they will all be in the next word */
 				*val <<= bits;
-				*val |= (br->buffer[br->consumed_words] >> (FLAC__BITS_PER_WORD-bits));
+				*val |= (FLAC__uint32)(br->buffer[br->consumed_words] >> (FLAC__BITS_PER_WORD-bits));
 				br->consumed_bits = bits;
 			}
 			return true;
@@ -483,12 +547,12 @@ FLaC__INLINE FLAC__bool FLAC__bitreader_read_raw_uint32(FLAC__BitReader *br, FLA
 		else {
 			const brword word = br->buffer[br->consumed_words];
 			if(bits < FLAC__BITS_PER_WORD) {
-				*val = word >> (FLAC__BITS_PER_WORD-bits);
+				*val = (FLAC__uint32)(word >> (FLAC__BITS_PER_WORD-bits));
 				br->consumed_bits = bits;
 				return true;
 			}
 			/* at this point 'bits' must be == FLAC__BITS_PER_WORD; because of previous assertions, it can't be larger */
-			*val = word;
+			*val = (FLAC__uint32)word;
 			crc16_update_word_(br, word);
 			br->consumed_words++;
 			return true;
@@ -503,12 +567,12 @@ FLaC__INLINE FLAC__bool FLAC__bitreader_read_raw_uint32(FLAC__BitReader *br, FLA
 		if(br->consumed_bits) {
 			/* this also works when consumed_bits==0, it's just a little slower than necessary for that case */
 			FLAC__ASSERT(br->consumed_bits + bits <= br->bytes*8);
-			*val = (br->buffer[br->consumed_words] & (FLAC__WORD_ALL_ONES >> br->consumed_bits)) >> (FLAC__BITS_PER_WORD-br->consumed_bits-bits);
+			*val = (FLAC__uint32)((br->buffer[br->consumed_words] & (FLAC__WORD_ALL_ONES >> br->consumed_bits)) >> (FLAC__BITS_PER_WORD-br->consumed_bits-bits));
 			br->consumed_bits += bits;
 			return true;
 		}
 		else {
-			*val = br->buffer[br->consumed_words] >> (FLAC__BITS_PER_WORD-bits);
+			*val = (FLAC__uint32)(br->buffer[br->consumed_words] >> (FLAC__BITS_PER_WORD-bits));
 			br->consumed_bits += bits;
 			return true;
 		}
@@ -768,7 +832,7 @@ FLaC__INLINE FLAC__bool FLAC__bitreader_read_unary_unsigned(FLAC__BitReader *br,
 			}
 			else {
 				*val += end - br->consumed_bits;
-				br->consumed_bits += end;
+				br->consumed_bits = end;
 				FLAC__ASSERT(br->consumed_bits < FLAC__BITS_PER_WORD);
 				/* didn't find stop bit yet, have to keep going... */
 			}
@@ -892,7 +956,7 @@ FLAC__bool FLAC__bitreader_read_rice_signed_block(FLAC__BitReader *br, int vals[
 				}
 				else {
 					uval += end - cbits;
-					cbits += end;
+					cbits = end;
 					FLAC__ASSERT(cbits < FLAC__BITS_PER_WORD);
 					/* didn't find stop bit yet, have to keep going... */
 				}
@@ -930,19 +994,19 @@ break1:
 					const brword word = br->buffer[cwords];
 					if(bits < n) {
 						uval <<= bits;
-						uval |= (word & (FLAC__WORD_ALL_ONES >> cbits)) >> (n-bits);
+						uval |= (unsigned)((word & (FLAC__WORD_ALL_ONES >> cbits)) >> (n-bits));
 						cbits += bits;
 						goto break2;
 					}
 					uval <<= n;
-					uval |= word & (FLAC__WORD_ALL_ONES >> cbits);
+					uval |= (unsigned)(word & (FLAC__WORD_ALL_ONES >> cbits));
 					bits -= n;
 					crc16_update_word_(br, word);
 					cwords++;
 					cbits = 0;
 					if(bits) { /* if there are still bits left to read, there have to be less than 32 so they will all be in the next word */
 						uval <<= bits;
-						uval |= (br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits));
+						uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits));
 						cbits = bits;
 					}
 					goto break2;
@@ -950,7 +1014,7 @@ break1:
 				else {
 					FLAC__ASSERT(bits < FLAC__BITS_PER_WORD);
 					uval <<= bits;
-					uval |= br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits);
+					uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits));
 					cbits = bits;
 					goto break2;
 				}
@@ -964,12 +1028,12 @@ break1:
 				if(cbits) {
 					/* this also works when consumed_bits==0, it's just a little slower than necessary for that case */
 					FLAC__ASSERT(cbits + bits <= br->bytes*8);
-					uval |= (br->buffer[cwords] & (FLAC__WORD_ALL_ONES >> cbits)) >> (FLAC__BITS_PER_WORD-cbits-bits);
+					uval |= (unsigned)((br->buffer[cwords] & (FLAC__WORD_ALL_ONES >> cbits)) >> (FLAC__BITS_PER_WORD-cbits-bits));
 					cbits += bits;
 					goto break2;
 				}
 				else {
-					uval |= br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits);
+					uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-bits));
 					cbits += bits;
 					goto break2;
 				}
@@ -1074,7 +1138,7 @@ break2:
 				}
 				else {
 					uval += end - cbits;
-					cbits += end;
+					cbits = end;
 					FLAC__ASSERT(cbits < FLAC__BITS_PER_WORD);
 					/* didn't find stop bit yet, have to keep going... */
 				}
@@ -1121,25 +1185,25 @@ break1:
 					const brword word = br->buffer[cwords];
 					if(parameter < n) {
 						uval <<= parameter;
-						uval |= (word & (FLAC__WORD_ALL_ONES >> cbits)) >> (n-parameter);
+						uval |= (unsigned)((word & (FLAC__WORD_ALL_ONES >> cbits)) >> (n-parameter));
 						cbits += parameter;
 					}
 					else {
 						uval <<= n;
-						uval |= word & (FLAC__WORD_ALL_ONES >> cbits);
+						uval |= (unsigned)(word & (FLAC__WORD_ALL_ONES >> cbits));
 						crc16_update_word_(br, word);
 						cwords++;
 						cbits = parameter - n;
 						if(cbits) { /* parameter > n, i.e. if there are still bits left to read, there have to be less than 32 so they will all be in the next word */
 							uval <<= cbits;
-							uval |= (br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits));
+							uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits));
 						}
 					}
 				}
 				else {
 					cbits = parameter;
 					uval <<= parameter;
-					uval |= br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits);
+					uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits));
 				}
 			}
 			else {
@@ -1151,12 +1215,12 @@ break1:
 				if(cbits) {
 					/* this also works when consumed_bits==0, it's just a little slower than necessary for that case */
 					FLAC__ASSERT(cbits + parameter <= br->bytes*8);
-					uval |= (br->buffer[cwords] & (FLAC__WORD_ALL_ONES >> cbits)) >> (FLAC__BITS_PER_WORD-cbits-parameter);
+					uval |= (unsigned)((br->buffer[cwords] & (FLAC__WORD_ALL_ONES >> cbits)) >> (FLAC__BITS_PER_WORD-cbits-parameter));
 					cbits += parameter;
 				}
 				else {
 					cbits = parameter;
-					uval |= br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits);
+					uval |= (unsigned)(br->buffer[cwords] >> (FLAC__BITS_PER_WORD-cbits));
 				}
 			}
 		}
@@ -1181,6 +1245,86 @@ break1:
 }
 #endif
 
+#if defined FLAC__CPU_IA64 && defined FLAC__BMI2_SUPPORTED
+/* a version of FLAC__bitreader_read_rice_signed_block() for 64-bit words
+ * using LZCNT for the unary part and BZHI for the binary part.  the
+ * current word is kept shifted in a register so that codewords ending in
+ * it cost one LZCNT and a couple of shifts each; a codeword running into
+ * the next whole word is put together from both.  anything else (long
+ * unary runs, the tail of the buffer) is left to the generic version, one
+ * codeword at a time.
+ */
+FLAC__SSE_TARGET("lzcnt,bmi,bmi2")
+FLAC__bool FLAC__bitreader_read_rice_signed_block_intrin_bmi2(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter)
+{
+	const brword *buffer;
+	brword b;
+	unsigned msbs, n, uval;
+	unsigned cwords, cbits, words;
+
+	FLAC__ASSERT(0 != br);
+	FLAC__ASSERT(0 != br->buffer);
+	FLAC__ASSERT(FLAC__BITS_PER_WORD == 64);
+	FLAC__ASSERT(parameter < 32);
+
+	if(nvals == 0)
+		return true;
+
+	buffer = br->buffer;
+	cwords = br->consumed_words;
+	cbits = br->consumed_bits;
+	words = br->words;
+
+	while(1) {
+		if(cwords < words) {
+			b = buffer[cwords] << cbits;
+			/* codewords that end before the end of the word */
+			while(1) {
+				msbs = (unsigned)_lzcnt_u64(b); /* 64 if the rest of the word is all zeroes */
+				n = msbs + 1 + parameter;
+				if(cbits + n >= FLAC__BITS_PER_WORD)
+					break;
+				uval = (unsigned)_bzhi_u64(b >> (FLAC__BITS_PER_WORD - n), parameter) | msbs << parameter;
+				b <<= n;
+				cbits += n;
+				*vals++ = (int)(uval >> 1 ^ -(int)(uval & 1));
+				if(--nvals == 0) {
+					br->consumed_bits = cbits;
+					br->consumed_words = cwords;
+					return true;
+				}
+			}
+			/* a codeword with its stop bit in this word that ends at or after the end of it */
+			if(b && cwords + 1 < words) {
+				n = cbits + n - FLAC__BITS_PER_WORD; /* the # of binary LSBs in the next word */
+				uval = (unsigned)(_bzhi_u64(buffer[cwords], parameter - n) << n) | (unsigned)((buffer[cwords+1] >> 1) >> (FLAC__BITS_PER_WORD - 1 - n)) | msbs << parameter;
+				crc16_update_word_(br, buffer[cwords]);
+				cwords++;
+				cbits = n;
+				*vals++ = (int)(uval >> 1 ^ -(int)(uval & 1));
+				if(--nvals == 0)
+					break;
+				continue;
+			}
+		}
+		br->consumed_bits = cbits;
+		br->consumed_words = cwords;
+		if(!FLAC__bitreader_read_rice_signed_block(br, vals, 1, parameter))
+			return false;
+		cwords = br->consumed_words;
+		cbits = br->consumed_bits;
+		words = br->words;
+		vals++;
+		if(--nvals == 0)
+			break;
+	}
+
+	br->consumed_bits = cbits;
+	br->consumed_words = cwords;
+	return true;
+}
+#endif
+
 #if 0 /* UNUSED */
 FLAC__bool FLAC__bitreader_read_golomb_signed(FLAC__BitReader *br, int *val, unsigned parameter)
 {
@@ -52,9 +52,33 @@
 #include "FLAC/assert.h"
 #include "share/alloc.h"
 
+/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
+#ifdef _MSC_VER
+#define FLAC__U64L(x) x
+#else
+#define FLAC__U64L(x) x##LLU
+#endif
+
 /* Things should be fastest when this matches the machine word size */
 /* WATCHOUT: if you change this you must also change the following #defines down to SWAP_BE_WORD_TO_HOST below to match */
 /* WATCHOUT: there are a few places where the code will not work unless bwword is >= 32 bits wide */
+/* x86-64 builds use 64-bit words to match the bitreader */
+#if defined FLAC__CPU_IA64
+typedef FLAC__uint64 bwword;
+#define FLAC__BYTES_PER_WORD 8
+#define FLAC__BITS_PER_WORD 64
+#define FLAC__WORD_ALL_ONES ((FLAC__uint64)FLAC__U64L(0xffffffffffffffff))
+/* SWAP_BE_WORD_TO_HOST swaps bytes in a bwword (which is always big-endian) if necessary to match host byte order */
+#if WORDS_BIGENDIAN
+#define SWAP_BE_WORD_TO_HOST(x) (x)
+#elif defined _MSC_VER
+#define SWAP_BE_WORD_TO_HOST(x) _byteswap_uint64(x)
+#elif defined __GNUC__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+#define SWAP_BE_WORD_TO_HOST(x) __builtin_bswap64(x)
+#else
+#define SWAP_BE_WORD_TO_HOST(x) (((FLAC__uint64)ntohl((FLAC__uint32)(x)) << 32) | ntohl((FLAC__uint32)((x) >> 32)))
+#endif
+#else
 typedef FLAC__uint32 bwword;
 #define FLAC__BYTES_PER_WORD 4
 #define FLAC__BITS_PER_WORD 32
@@ -69,6 +93,7 @@ typedef FLAC__uint32 bwword;
 #define SWAP_BE_WORD_TO_HOST(x) ntohl(x)
 #endif
 #endif
+#endif
 
 /*
  * The default capacity here doesn't matter too much.  The buffer always grows
@@ -88,13 +113,6 @@ static const unsigned FLAC__BITWRITER_DEFAULT_INCREMENT = 4096u / sizeof(bwword)
 #endif
 #define min(x,y) ((x)<(y)?(x):(y))
 
-/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
-#ifdef _MSC_VER
-#define FLAC__U64L(x) x
-#else
-#define FLAC__U64L(x) x##LLU
-#endif
-
 #ifndef FLaC__INLINE
 #define FLaC__INLINE
 #endif
@@ -107,7 +125,7 @@ struct FLAC__BitWriter {
 	unsigned bits; /* # of used bits in accum */
 };
 
-#ifdef _MSC_VER
+#if defined _MSC_VER && FLAC__BYTES_PER_WORD == 4
 /* OPT: an MSVC built-in would be better */
 static _inline FLAC__uint32 local_swap32_(FLAC__uint32 x)
 {
@@ -219,13 +237,13 @@ void FLAC__bitwriter_dump(const FLAC__BitWriter *bw, FILE *out)
 		for(i = 0; i < bw->words; i++) {
 			fprintf(out, "%08X: ", i);
 			for(j = 0; j < FLAC__BITS_PER_WORD; j++)
-				fprintf(out, "%01u", bw->buffer[i] & (1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
+				fprintf(out, "%01u", bw->buffer[i] & ((bwword)1 << (FLAC__BITS_PER_WORD-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 		if(bw->bits > 0) {
 			fprintf(out, "%08X: ", i);
 			for(j = 0; j < bw->bits; j++)
-				fprintf(out, "%01u", bw->accum & (1 << (bw->bits-j-1)) ? 1:0);
+				fprintf(out, "%01u", bw->accum & ((bwword)1 << (bw->bits-j-1)) ? 1:0);
 			fprintf(out, "\n");
 		}
 	}
@@ -538,6 +556,81 @@ FLAC__bool FLAC__bitwriter_write_rice_signed(FLAC__BitWriter *bw, FLAC__int32 va
 			FLAC__bitwriter_write_raw_uint32(bw, pattern, interesting_bits); /* write the unary end bit and binary LSBs */
 }
 
+#if FLAC__BITS_PER_WORD == 64
+FLAC__bool FLAC__bitwriter_write_rice_signed_block(FLAC__BitWriter *bw, const FLAC__int32 *vals, unsigned nvals, unsigned parameter)
+{
+	const FLAC__uint32 mask1 = (FLAC__uint32)0xffffffff << parameter; /* we val|=mask1 to set the stop bit above it... */
+	const FLAC__uint32 mask2 = (FLAC__uint32)0xffffffff >> (31-parameter); /* ...then mask off the bits above the stop bit with val&=mask2*/
+	const unsigned lsbits = 1 + parameter;
+	const unsigned max_msbits = 31 - parameter; /* longest unary part for which the whole code fits in 32 bits */
+	FLAC__uint32 uval = 0;
+	bwword accum, *buffer;
+	unsigned bits, words, left, total, msbits = 0;
+
+	FLAC__ASSERT(0 != bw);
+	FLAC__ASSERT(0 != bw->buffer);
+	FLAC__ASSERT(parameter < 32);
+
+	while(nvals) {
+		/* every value that takes the fast path below is at most 32 bits,
+		 * so this one check covers all the words the loop can complete
+		 */
+		if(bw->capacity <= bw->words + nvals/2 + 1 && !bitwriter_grow_(bw, nvals*32))
+			return false;
+
+		/* keep the writer state in locals so the loop does no bookkeeping
+		 * through bw; each code is shifted into the accumulator whole and
+		 * a complete word is emitted once it fills up
+		 */
+		accum = bw->accum;
+		bits = bw->bits;
+		words = bw->words;
+		buffer = bw->buffer;
+		while(nvals) {
+			/* fold signed to unsigned; actual formula is: negative(v)? -2v-1 : 2v */
+			uval = (*vals<<1) ^ (*vals>>31);
+
+			msbits = uval >> parameter;
+			if(msbits > max_msbits)
+				break;
+
+			uval |= mask1; /* set stop bit */
+			uval &= mask2; /* mask off unused top bits */
+			total = msbits + lsbits;
+
+			if(bits + total < FLAC__BITS_PER_WORD) {
+				accum <<= total;
+				accum |= uval;
+				bits += total;
+			}
+			else {
+				/* bits can't be 0 here since total <= 32, so 0 < left <= total */
+				left = FLAC__BITS_PER_WORD - bits;
+				accum <<= left;
+				accum |= uval >> (bits = total - left);
+				buffer[words++] = SWAP_BE_WORD_TO_HOST(accum);
+				accum = uval;
+			}
+			vals++;
+			nvals--;
+		}
+		bw->accum = accum;
+		bw->bits = bits;
+		bw->words = words;
+
+		if(nvals) {
+			/* long unary part: write the zero run a word at a time, then the stop bit and LSBs */
+			uval |= mask1;
+			uval &= mask2;
+			if(!FLAC__bitwriter_write_zeroes(bw, msbits) || !FLAC__bitwriter_write_raw_uint32(bw, uval, lsbits))
+				return false;
+			vals++;
+			nvals--;
+		}
+	}
+	return true;
+}
+#else
 FLAC__bool FLAC__bitwriter_write_rice_signed_block(FLAC__BitWriter *bw, const FLAC__int32 *vals, unsigned nvals, unsigned parameter)
 {
 	const FLAC__uint32 mask1 = FLAC__WORD_ALL_ONES << parameter; /* we val|=mask1 to set the stop bit above it... */
@@ -653,6 +746,7 @@ break1:
 	}
 	return true;
 }
+#endif
 
 #if 0 /* UNUSED */
 FLAC__bool FLAC__bitwriter_write_golomb_signed(FLAC__BitWriter *bw, int val, unsigned parameter)
@@ -39,6 +39,14 @@
 
 #if defined FLAC__CPU_IA32
 # include <signal.h>
+#elif defined FLAC__CPU_IA64
+# if !defined FLAC__NO_ASM
+#  if defined _MSC_VER
+#   include <intrin.h>
+#  else
+#   include <cpuid.h>
+#  endif
+# endif
 #elif defined FLAC__CPU_PPC
 # if !defined FLAC__NO_ASM
 #  if defined FLAC__SYS_DARWIN
@@ -99,6 +107,17 @@ static const unsigned FLAC__CPUINFO_IA32_CPUID_SSSE3 = 0x00000200;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_3DNOW = 0x80000000;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_EXT3DNOW = 0x40000000;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_EXTMMX = 0x00400000;
+/* these are flags in ECX of CPUID AX=00000001 */
+static const unsigned FLAC__CPUINFO_IA64_CPUID_PCLMUL = 0x00000002;
+static const unsigned FLAC__CPUINFO_IA64_CPUID_SSE41 = 0x00080000;
+static const unsigned FLAC__CPUINFO_IA64_CPUID_OSXSAVE = 0x08000000;
+static const unsigned FLAC__CPUINFO_IA64_CPUID_AVX = 0x10000000;
+/* these are flags in EBX of CPUID AX=00000007 */
+static const unsigned FLAC__CPUINFO_IA64_CPUID_BMI1 = 0x00000008;
+static const unsigned FLAC__CPUINFO_IA64_CPUID_AVX2 = 0x00000020;
+static const unsigned FLAC__CPUINFO_IA64_CPUID_BMI2 = 0x00000100;
+/* these are flags in ECX of CPUID AX=80000001 */
+static const unsigned FLAC__CPUINFO_IA64_CPUID_EXTENDED_LZCNT = 0x00000020;
 
 
 /*
@@ -151,6 +170,45 @@ static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_AMD_EXTMMX = 0x00400000;
 # endif
 #endif
 
+#if defined FLAC__CPU_IA64 && !defined FLAC__NO_ASM
+/* regs[] gets EAX, EBX, ECX and EDX of CPUID for the leaf (subleaf 0), or zeros if the leaf is not supported */
+static void cpuid_ia64_(FLAC__uint32 leaf, FLAC__uint32 regs[4])
+{
+#if defined _MSC_VER
+	int r[4];
+	__cpuid(r, (int)(leaf & 0x80000000));
+	if((FLAC__uint32)r[0] >= leaf)
+#if _MSC_VER >= 1600
+		__cpuidex(r, (int)leaf, 0);
+#else
+		__cpuid(r, (int)leaf); /* only leaf 1 is asked for without AVX2 support */
+#endif
+	else
+		r[0] = r[1] = r[2] = r[3] = 0;
+	regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+#else
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+	if(__get_cpuid_max(leaf & 0x80000000, 0) >= leaf)
+		__cpuid_count(leaf, 0, eax, ebx, ecx, edx);
+	regs[0] = eax; regs[1] = ebx; regs[2] = ecx; regs[3] = edx;
+#endif
+}
+
+#ifdef FLAC__AVX2_SUPPORTED
+/* AVX2 also needs the OS to save the YMM registers on a context switch */
+static FLAC__bool os_saves_ymm_ia64_(void)
+{
+#if defined _MSC_VER
+	return (_xgetbv(0) & 6) == 6;
+#else
+	FLAC__uint32 xcr0;
+	__asm__ ("xgetbv" : "=a" (xcr0) : "c" (0) : "%edx");
+	return (xcr0 & 6) == 6;
+#endif
+}
+#endif
+#endif
+
 
 void FLAC__cpu_info(FLAC__CPUInfo *info)
 {
@@ -159,8 +217,45 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
  */
 #if defined FLAC__CPU_IA64
 	info->type = FLAC__CPUINFO_TYPE_IA64;
-#if !defined FLAC__NO_ASM && defined FLAC__HAS_NASM
-	info->use_asm = true;
+#if !defined FLAC__NO_ASM
+	info->use_asm = true; /* x86-64 always has SSE2 */
+	info->data.ia64.sse41 = false;
+	info->data.ia64.pclmul = false;
+	info->data.ia64.avx2 = false;
+	info->data.ia64.bmi2 = false;
+	{
+		FLAC__uint32 regs[4];
+		cpuid_ia64_(1, regs);
+#ifdef FLAC__SSE4_1_SUPPORTED
+		info->data.ia64.sse41 = (regs[2] & FLAC__CPUINFO_IA64_CPUID_SSE41)? true : false;
+#endif
+#ifdef FLAC__PCLMUL_SUPPORTED
+		info->data.ia64.pclmul = (regs[2] & FLAC__CPUINFO_IA64_CPUID_PCLMUL)? true : false;
+#endif
+#ifdef FLAC__AVX2_SUPPORTED
+		if((regs[2] & FLAC__CPUINFO_IA64_CPUID_OSXSAVE) && (regs[2] & FLAC__CPUINFO_IA64_CPUID_AVX) && os_saves_ymm_ia64_()) {
+			cpuid_ia64_(7, regs);
+			info->data.ia64.avx2 = (regs[1] & FLAC__CPUINFO_IA64_CPUID_AVX2)? true : false;
+		}
+#endif
+#ifdef FLAC__BMI2_SUPPORTED
+		/* BMI needs no OS support; LZCNT is a separate (AMD ABM) flag */
+		cpuid_ia64_(7, regs);
+		if((regs[1] & FLAC__CPUINFO_IA64_CPUID_BMI1) && (regs[1] & FLAC__CPUINFO_IA64_CPUID_BMI2)) {
+			cpuid_ia64_(0x80000001, regs);
+			info->data.ia64.bmi2 = (regs[2] & FLAC__CPUINFO_IA64_CPUID_EXTENDED_LZCNT)? true : false;
+		}
+#endif
+	}
+#ifdef DEBUG
+	fprintf(stderr, "CPU info (x86-64):\n");
+	fprintf(stderr, "  SSE4.1 ..... %c\n", info->data.ia64.sse41 ? 'Y' : 'n');
+	fprintf(stderr, "  PCLMUL ..... %c\n", info->data.ia64.pclmul ? 'Y' : 'n');
+	fprintf(stderr, "  AVX2 ....... %c\n", info->data.ia64.avx2  ? 'Y' : 'n');
+	fprintf(stderr, "  BMI2 ....... %c\n", info->data.ia64.bmi2  ? 'Y' : 'n');
+#endif
+#else
+	info->use_asm = false;
 #endif
 
 #elif defined FLAC__CPU_IA32
@@ -0,0 +1,109 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2006,2007,2008  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifndef FLAC__NO_ASM
+#if defined FLAC__CPU_IA64 && defined FLAC__PCLMUL_SUPPORTED
+
+#include "private/crc.h"
+#include "FLAC/assert.h"
+
+#include <smmintrin.h> /* SSE4.1 */
+#include <wmmintrin.h> /* PCLMUL */
+
+/*
+ * The data is read in 16-byte blocks, byte-swapped so that each block is a
+ * 128-bit polynomial with the first bit of the stream as its highest term.
+ * An accumulator A = H*x^64 + L that is followed by n more bits of data can
+ * be carried over them as H*(x^(64+n) mod P) + L*(x^n mod P): both products
+ * are at most 80 bits wide and the CRC is unchanged.  Four accumulators are
+ * carried over 64 bytes at a time, then folded into one.  The CRC of what is
+ * left in the accumulator and of the last bytes is done with the tables.
+ *
+ * The constants are x^n mod P for P = x^16 + x^15 + x^2 + 1.
+ */
+
+#define FOLD_(acc, k, next) \
+	_mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128((acc), (k), 0x01), _mm_clmulepi64_si128((acc), (k), 0x10)), (next))
+
+FLAC__SSE_TARGET("sse4.1,pclmul")
+unsigned FLAC__crc16_update_block_intrin_pclmul(const FLAC__byte *data, unsigned len, unsigned crc)
+{
+	const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k128 = _mm_set_epi64x(0x0106, 0x1666); /* x^128, x^192 */
+	const __m128i k512 = _mm_set_epi64x(0x8107, 0x1446); /* x^512, x^576 */
+	__m128i a0, a1, a2, a3;
+	FLAC__byte tail[16];
+
+	FLAC__ASSERT(crc <= 0xffff);
+
+	if(len < 64)
+		return FLAC__crc16_update_block(data, len, crc);
+
+	a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), swap);
+	a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), swap);
+	a2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), swap);
+	a3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), swap);
+	/* a starting CRC is the same as XORing it into the first 16 bits */
+	a0 = _mm_xor_si128(a0, _mm_set_epi64x((FLAC__int64)((FLAC__uint64)crc << 48), 0));
+	data += 64;
+	len -= 64;
+
+	while(len >= 64) {
+		a0 = FOLD_(a0, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), swap));
+		a1 = FOLD_(a1, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), swap));
+		a2 = FOLD_(a2, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), swap));
+		a3 = FOLD_(a3, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), swap));
+		data += 64;
+		len -= 64;
+	}
+
+	a0 = FOLD_(a0, k128, a1);
+	a0 = FOLD_(a0, k128, a2);
+	a0 = FOLD_(a0, k128, a3);
+	while(len >= 16) {
+		a0 = FOLD_(a0, k128, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), swap));
+		data += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i*)tail, _mm_shuffle_epi8(a0, swap));
+	crc = FLAC__crc16_update_block(tail, 16, 0);
+	return FLAC__crc16_update_block(data, len, crc);
+}
+
+#endif /* FLAC__CPU_IA64 && FLAC__PCLMUL_SUPPORTED */
+#endif /* !FLAC__NO_ASM */
@@ -60,6 +60,13 @@ typedef struct {
 	FLAC__bool extmmx;
 } FLAC__CPUInfo_IA32;
 
+typedef struct {
+	FLAC__bool sse41;
+	FLAC__bool pclmul; /* PCLMULQDQ */
+	FLAC__bool avx2;
+	FLAC__bool bmi2; /* BMI1, BMI2 and LZCNT */
+} FLAC__CPUInfo_IA64;
+
 typedef struct {
 	FLAC__bool altivec;
 	FLAC__bool ppc64;
@@ -70,12 +77,44 @@ typedef struct {
 	FLAC__CPUInfo_Type type;
 	union {
 		FLAC__CPUInfo_IA32 ia32;
+		FLAC__CPUInfo_IA64 ia64;
 		FLAC__CPUInfo_PPC ppc;
 	} data;
 } FLAC__CPUInfo;
 
 void FLAC__cpu_info(FLAC__CPUInfo *info);
 
+/*
+ * FLAC__CPU_IA64 builds are x86-64 ones; there the SSE4.1, PCLMUL, AVX2 and
+ * BMI2 routines are written with compiler intrinsics instead of NASM, and
+ * FLAC__SSE_TARGET() lets GCC compile them without -msse4.1/-mpclmul/-mavx2/
+ * -mbmi2 for the whole library.  They are only called if FLAC__cpu_info() says the
+ * processor can run them.
+ */
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_IA64
+#  if defined _MSC_VER
+#    if _MSC_VER >= 1500
+#      define FLAC__SSE4_1_SUPPORTED 1
+#      define FLAC__PCLMUL_SUPPORTED 1
+#    endif
+#    if _MSC_VER >= 1700
+#      define FLAC__AVX2_SUPPORTED 1
+#      define FLAC__BMI2_SUPPORTED 1
+#    endif
+#  elif defined __clang__ || (defined __GNUC__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#    define FLAC__SSE4_1_SUPPORTED 1
+#    define FLAC__PCLMUL_SUPPORTED 1
+#    define FLAC__AVX2_SUPPORTED 1
+#    define FLAC__BMI2_SUPPORTED 1
+#  endif
+#endif
+
+#if defined __GNUC__
+#  define FLAC__SSE_TARGET(x) __attribute__ ((__target__ (x)))
+#else
+#  define FLAC__SSE_TARGET(x)
+#endif
+
 #ifndef FLAC__NO_ASM
 #ifdef FLAC__CPU_IA32
 #ifdef FLAC__HAS_NASM
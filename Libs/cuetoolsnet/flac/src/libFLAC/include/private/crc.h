@@ -33,6 +33,7 @@
 #define FLAC__PRIVATE__CRC_H
 
 #include "FLAC/ordinals.h"
+#include "private/cpu.h"
 
 /* 8 bit CRC generator, MSB shifted first
 ** polynomial = x^8 + x^2 + x^1 + x^0
@@ -56,6 +57,16 @@ extern unsigned const FLAC__crc16_table[256];
 #define FLAC__CRC16_UPDATE(data, crc) ((((crc)<<8) ^ FLAC__crc16_table[((crc)>>8) ^ (data)]) & 0xffff)
 #endif
 
+/* slice-by-8 tables; see crc.c */
+extern FLAC__uint16 const FLAC__crc16_slice8_table[8][256];
+
+unsigned FLAC__crc16_update_block(const FLAC__byte *data, unsigned len, unsigned crc);
 unsigned FLAC__crc16(const FLAC__byte *data, unsigned len);
 
+#ifndef FLAC__NO_ASM
+#  if defined FLAC__CPU_IA64 && defined FLAC__PCLMUL_SUPPORTED
+unsigned FLAC__crc16_update_block_intrin_pclmul(const FLAC__byte *data, unsigned len, unsigned crc);
+#  endif
+#endif
+
 #endif
@@ -86,6 +86,37 @@ void FLAC__lpc_compute_autocorrelation_asm_ia64_sse_lag_12(const FLAC__real data
 #  endif
 #endif
 
+/*
+ *	FLAC__lpc_compute_autocorrelation_windows()
+ *	--------------------------------------------------------------------
+ *	Applies each of the given windows to the data and computes the
+ *	autocorrelation of the result, giving the same values as
+ *	FLAC__lpc_window_data() followed by FLAC__lpc_compute_autocorrelation()
+ *	for every window.  The data is gone through once, in pieces of
+ *	FLAC__LPC_AUTOCORRELATION_BLOCK samples that stay in cache while all
+ *	the windows are applied to them.
+ *	Asserts that lag > 0.
+ *
+ *	IN data[0,data_len-1]
+ *	IN window[0,num_windows-1][0,data_len-1]
+ *	IN num_windows
+ *	IN data_len
+ *	IN 0 < lag <= data_len
+ *	OUT autoc[0,num_windows-1][0,lag-1]
+ */
+#define FLAC__LPC_AUTOCORRELATION_BLOCK 1024
+void FLAC__lpc_compute_autocorrelation_windows(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1]);
+#ifndef FLAC__NO_ASM
+#  ifdef FLAC__CPU_IA64
+#    ifdef FLAC__SSE4_1_SUPPORTED
+void FLAC__lpc_compute_autocorrelation_windows_intrin_sse41(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1]);
+#    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+void FLAC__lpc_compute_autocorrelation_windows_intrin_avx2(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1]);
+#    endif
+#  endif
+#endif
+
 /*
  *	FLAC__lpc_compute_lp_coefficients()
  *	--------------------------------------------------------------------
@@ -153,6 +184,16 @@ void FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32(const FLAC__int32
 void FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32_mmx(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 #    endif
 #  endif
+#  ifdef FLAC__CPU_IA64
+#    ifdef FLAC__SSE4_1_SUPPORTED
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+#    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+#    endif
+#  endif
 #endif
 
 #endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
@@ -183,7 +224,14 @@ void FLAC__lpc_restore_signal_asm_ia32_mmx(const FLAC__int32 residual[], unsigne
 #  elif defined FLAC__CPU_PPC
 void FLAC__lpc_restore_signal_asm_ppc_altivec_16(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
 void FLAC__lpc_restore_signal_asm_ppc_altivec_16_order8(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
-#  endif/* FLAC__CPU_IA32 || FLAC__CPU_PPC */
+#  elif defined FLAC__CPU_IA64
+#    ifdef FLAC__SSE4_1_SUPPORTED
+void FLAC__lpc_restore_signal_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+#    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+void FLAC__lpc_restore_signal_wide_intrin_avx2(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+#    endif
+#  endif/* FLAC__CPU_IA32 || FLAC__CPU_PPC || FLAC__CPU_IA64 */
 #endif /* FLAC__NO_ASM */
 
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
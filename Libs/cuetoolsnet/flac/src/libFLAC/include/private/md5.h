@@ -26,19 +26,33 @@
  * Still in the public domain, with no warranty.
  */
 
+#include <stddef.h> /* for size_t */
 #include "FLAC/ordinals.h"
 
+typedef struct FLAC__MD5Pipeline FLAC__MD5Pipeline;
+
 typedef struct {
 	FLAC__uint32 in[16];
 	FLAC__uint32 buf[4];
 	FLAC__uint32 bytes[2];
 	FLAC__byte *internal_buf;
 	size_t capacity;
+	FLAC__bool use_thread;
+	FLAC__MD5Pipeline *pipeline; /* the helper thread and its buffer queue, 0 while not running */
 } FLAC__MD5Context;
 
 void FLAC__MD5Init(FLAC__MD5Context *context);
 void FLAC__MD5Final(FLAC__byte digest[16], FLAC__MD5Context *context);
 
+/*
+ * With use_thread set, FLAC__MD5Accumulate() only converts the signal to
+ * bytes and queues them; the MD5 itself is updated on a helper thread that
+ * is started on the first call and stopped by FLAC__MD5Final() (or by
+ * FLAC__MD5Init(), which discards what was queued).  Call it after
+ * FLAC__MD5Init(); it does nothing when built with FLAC__NO_THREADS.
+ */
+void FLAC__MD5UseThread(FLAC__MD5Context *context, FLAC__bool use_thread);
+
 FLAC__bool FLAC__MD5Accumulate(FLAC__MD5Context *ctx, const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bytes_per_sample);
 
 #endif
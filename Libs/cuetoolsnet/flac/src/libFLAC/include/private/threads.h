@@ -0,0 +1,75 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2006,2007,2008  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAC__PRIVATE__THREADS_H
+#define FLAC__PRIVATE__THREADS_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "FLAC/ordinals.h"
+
+#ifndef FLAC__NO_THREADS
+
+/*
+ *	Just enough to hand a job to a thread and wait for it to come
+ *	back: a joinable thread and an auto-reset event.  Building with
+ *	FLAC__NO_THREADS leaves all of this out and the codecs always
+ *	work on the calling thread.
+ */
+
+#ifdef _WIN32
+typedef void *FLAC__Thread; /* HANDLE */
+typedef void *FLAC__Event; /* HANDLE */
+#else
+#include <pthread.h>
+typedef pthread_t FLAC__Thread;
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	FLAC__bool signaled;
+} FLAC__Event;
+#endif
+
+typedef void (*FLAC__ThreadRoutine)(void *arg);
+
+FLAC__bool FLAC__thread_create(FLAC__Thread *thread, FLAC__ThreadRoutine routine, void *arg);
+void FLAC__thread_join(FLAC__Thread *thread);
+
+FLAC__bool FLAC__event_init(FLAC__Event *event);
+void FLAC__event_signal(FLAC__Event *event);
+void FLAC__event_wait(FLAC__Event *event);
+void FLAC__event_free(FLAC__Event *event);
+
+#endif /* !defined FLAC__NO_THREADS */
+
+#endif
@@ -45,6 +45,7 @@ typedef struct FLAC__StreamDecoderProtected {
 	unsigned sample_rate; /* in Hz */
 	unsigned blocksize; /* in samples (per channel) */
 	FLAC__bool md5_checking; /* if true, generate MD5 signature of decoded data and compare against signature in the STREAMINFO metadata block */
+	unsigned num_threads; /* if > 1, FLAC__stream_decoder_process_until_end_of_stream() decodes frames on that many worker threads where it can */
 #if FLAC__HAS_OGG
 	FLAC__OggDecoderAspect ogg_decoder_aspect;
 #endif
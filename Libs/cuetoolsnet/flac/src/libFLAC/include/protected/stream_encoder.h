@@ -98,6 +98,8 @@ typedef struct FLAC__StreamEncoderProtected {
 	unsigned min_residual_partition_order;
 	unsigned max_residual_partition_order;
 	unsigned rice_parameter_search_dist;
+	unsigned num_threads;
+	FLAC__bool subframe_threads;
 	FLAC__uint64 total_samples_estimate;
 	FLAC__StreamMetadata **metadata;
 	unsigned num_metadata_blocks;
@@ -265,6 +265,10 @@ SOURCE=.\crc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\crc_intrin_pclmul.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\fixed.c
 # End Source File
 # Begin Source File
@@ -281,6 +285,14 @@ SOURCE=.\lpc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lpc_intrin_avx2.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lpc_intrin_sse41.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\md5.c
 # End Source File
 # Begin Source File
@@ -325,6 +337,10 @@ SOURCE=.\stream_encoder_framing.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\threads.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\window.c
 # End Source File
 # End Group
@@ -405,6 +421,10 @@ SOURCE=.\include\private\stream_encoder_framing.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\private\threads.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\private\window.h
 # End Source File
 # End Group
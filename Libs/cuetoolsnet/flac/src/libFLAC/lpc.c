@@ -42,6 +42,11 @@
 #include <stdio.h>
 #endif
 
+#ifdef min
+#undef min
+#endif
+#define min(x,y) ((x)<(y)?(x):(y))
+
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 
 #ifndef M_LN2
@@ -109,6 +114,49 @@ void FLAC__lpc_compute_autocorrelation(const FLAC__real data[], unsigned data_le
 	}
 }
 
+void FLAC__lpc_compute_autocorrelation_windows(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1])
+{
+	/* the windowed piece, plus the lag-1 samples after it that its products reach */
+	FLAC__real windowed[FLAC__LPC_AUTOCORRELATION_BLOCK + FLAC__MAX_LPC_ORDER];
+	FLAC__real d;
+	unsigned start, end, ext, limit, sample, coeff, a;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= data_len);
+	FLAC__ASSERT(lag <= FLAC__MAX_LPC_ORDER+1);
+
+	for(a = 0; a < num_windows; a++)
+		for(coeff = 0; coeff < lag; coeff++)
+			autoc[a][coeff] = 0.0;
+
+	/*
+	 * each lag is summed over the samples in the same order as in
+	 * FLAC__lpc_compute_autocorrelation(), so the results match it exactly
+	 */
+	for(start = 0; start < data_len; start = end) {
+		end = min(start + FLAC__LPC_AUTOCORRELATION_BLOCK, data_len);
+		ext = min(end + lag - 1, data_len);
+		/* samples before limit have all the lags inside the data */
+		limit = min(end, data_len - lag + 1);
+		limit = limit > start? limit - start : 0;
+		for(a = 0; a < num_windows; a++) {
+			FLAC__real *ac = autoc[a];
+			for(sample = start; sample < ext; sample++)
+				windowed[sample-start] = data[sample] * window[a][sample];
+			for(sample = 0; sample < limit; sample++) {
+				d = windowed[sample];
+				for(coeff = 0; coeff < lag; coeff++)
+					ac[coeff] += d * windowed[sample+coeff];
+			}
+			for(; sample < end - start; sample++) {
+				d = windowed[sample];
+				for(coeff = 0; coeff < ext - start - sample; coeff++)
+					ac[coeff] += d * windowed[sample+coeff];
+			}
+		}
+	}
+}
+
 void FLAC__lpc_compute_lp_coefficients(const FLAC__real autoc[], unsigned *max_order, FLAC__real lp_coeff[][FLAC__MAX_LPC_ORDER], FLAC__double error[])
 {
 	unsigned i, j;
@@ -0,0 +1,278 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2006,2007,2008  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifndef FLAC__NO_ASM
+#if defined FLAC__CPU_IA64 && defined FLAC__AVX2_SUPPORTED
+
+#include "private/lpc.h"
+#include "FLAC/assert.h"
+
+#include <immintrin.h> /* AVX2 */
+
+/*
+ * The same as the SSE4.1 versions (see lpc_intrin_sse41.c) with twice as
+ * many lanes.  There is no AVX2 version of the 32-bit restore: a group of 8
+ * samples leaves 7 taps to the serial part, and it came out no faster than
+ * the SSE4.1 one.  The 64-bit restore works on groups of 4 like the 32-bit
+ * SSE4.1 one, which 4 lanes of 64-bit sums need AVX2 for.
+ */
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	__m256i q[FLAC__MAX_LPC_ORDER];
+	__m128i cnt;
+	const FLAC__int32 *d;
+	FLAC__int32 sum;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(lp_quantization < 0) {
+		FLAC__lpc_compute_residual_from_qlp_coefficients(data, data_len, qlp_coeff, order, lp_quantization, residual);
+		return;
+	}
+
+	cnt = _mm_cvtsi32_si128(lp_quantization);
+	for(j = 0; j < order; j++)
+		q[j] = _mm256_set1_epi32(qlp_coeff[j]);
+
+	for(i = 0; i + 16 <= data_len; i += 16) {
+		__m256i sum0, sum1;
+		d = data + i;
+		sum0 = _mm256_mullo_epi32(q[0], _mm256_loadu_si256((const __m256i*)(d-1)));
+		sum1 = _mm256_mullo_epi32(q[0], _mm256_loadu_si256((const __m256i*)(d+7)));
+		for(j = 1; j < order; j++) {
+			sum0 = _mm256_add_epi32(sum0, _mm256_mullo_epi32(q[j], _mm256_loadu_si256((const __m256i*)(d-j-1))));
+			sum1 = _mm256_add_epi32(sum1, _mm256_mullo_epi32(q[j], _mm256_loadu_si256((const __m256i*)(d-j+7))));
+		}
+		_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)d), _mm256_sra_epi32(sum0, cnt)));
+		_mm256_storeu_si256((__m256i*)(residual+i+8), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(d+8)), _mm256_sra_epi32(sum1, cnt)));
+	}
+	if(i + 8 <= data_len) {
+		__m256i sum0;
+		d = data + i;
+		sum0 = _mm256_mullo_epi32(q[0], _mm256_loadu_si256((const __m256i*)(d-1)));
+		for(j = 1; j < order; j++)
+			sum0 = _mm256_add_epi32(sum0, _mm256_mullo_epi32(q[j], _mm256_loadu_si256((const __m256i*)(d-j-1))));
+		_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)d), _mm256_sra_epi32(sum0, cnt)));
+		i += 8;
+	}
+	for(; i < data_len; i++) {
+		d = data + i;
+		sum = 0;
+		for(j = 0; j < order; j++)
+			sum += qlp_coeff[j] * d[-(int)j-1];
+		residual[i] = d[0] - (sum >> lp_quantization);
+	}
+	_mm256_zeroupper();
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	__m256i q[FLAC__MAX_LPC_ORDER];
+	__m128i cnt;
+	const FLAC__int32 *d;
+	FLAC__int64 sum;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(lp_quantization < 0) {
+		FLAC__lpc_compute_residual_from_qlp_coefficients_wide(data, data_len, qlp_coeff, order, lp_quantization, residual);
+		return;
+	}
+
+	cnt = _mm_cvtsi32_si128(lp_quantization);
+	for(j = 0; j < order; j++)
+		q[j] = _mm256_set1_epi32(qlp_coeff[j]);
+
+	for(i = 0; i + 8 <= data_len; i += 8) {
+		__m256i even = _mm256_setzero_si256(), odd = _mm256_setzero_si256(), x;
+		d = data + i;
+		for(j = 0; j < order; j++) {
+			x = _mm256_loadu_si256((const __m256i*)(d-j-1));
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(x, q[j]));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(_mm256_srli_epi64(x, 32), q[j]));
+		}
+		x = _mm256_blend_epi32(_mm256_srl_epi64(even, cnt), _mm256_slli_epi64(_mm256_srl_epi64(odd, cnt), 32), 0xaa);
+		_mm256_storeu_si256((__m256i*)(residual+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)d), x));
+	}
+	for(; i < data_len; i++) {
+		d = data + i;
+		sum = 0;
+		for(j = 0; j < order; j++)
+			sum += qlp_coeff[j] * (FLAC__int64)d[-(int)j-1];
+		residual[i] = d[0] - (FLAC__int32)(sum >> lp_quantization);
+	}
+	_mm256_zeroupper();
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_windows_intrin_avx2(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1])
+{
+	FLAC__real windowed[FLAC__LPC_AUTOCORRELATION_BLOCK + FLAC__MAX_LPC_ORDER + 8];
+	FLAC__real acc[FLAC__MAX_LPC_ORDER + 8];
+	__m256 s0, s1, s2, s3, s4;
+	const unsigned nvec = (lag + 7) / 8;
+	unsigned start, end, ext, n, a, i;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= data_len);
+	FLAC__ASSERT(lag <= FLAC__MAX_LPC_ORDER+1);
+
+	for(a = 0; a < num_windows; a++)
+		for(i = 0; i < lag; i++)
+			autoc[a][i] = 0.0;
+
+	for(start = 0; start < data_len; start = end) {
+		end = start + FLAC__LPC_AUTOCORRELATION_BLOCK < data_len? start + FLAC__LPC_AUTOCORRELATION_BLOCK : data_len;
+		ext = end + lag - 1 < data_len? end + lag - 1 : data_len;
+		n = end - start;
+		for(a = 0; a < num_windows; a++) {
+			const FLAC__int32 *in = data + start;
+			const FLAC__real *w = window[a] + start;
+			for(i = 0; i + 8 <= ext - start; i += 8)
+				_mm256_storeu_ps(windowed+i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(in+i))), _mm256_loadu_ps(w+i)));
+			for(; i < ext - start; i++)
+				windowed[i] = in[i] * w[i];
+			for(; i < n + FLAC__MAX_LPC_ORDER + 8; i++)
+				windowed[i] = 0.0;
+
+			for(i = 0; i < lag; i++)
+				acc[i] = autoc[a][i];
+			for(; i < FLAC__MAX_LPC_ORDER + 8; i++)
+				acc[i] = 0.0;
+			s0 = _mm256_loadu_ps(acc);
+			s1 = _mm256_loadu_ps(acc+8);
+			s2 = _mm256_loadu_ps(acc+16);
+			s3 = _mm256_loadu_ps(acc+24);
+			s4 = _mm256_loadu_ps(acc+32);
+			for(i = 0; i < n; i++) {
+				const FLAC__real *p = windowed + i;
+				const __m256 d = _mm256_set1_ps(windowed[i]);
+				switch(nvec) {
+					case 5: s4 = _mm256_add_ps(s4, _mm256_mul_ps(d, _mm256_loadu_ps(p+32))); /* fall through */
+					case 4: s3 = _mm256_add_ps(s3, _mm256_mul_ps(d, _mm256_loadu_ps(p+24))); /* fall through */
+					case 3: s2 = _mm256_add_ps(s2, _mm256_mul_ps(d, _mm256_loadu_ps(p+16))); /* fall through */
+					case 2: s1 = _mm256_add_ps(s1, _mm256_mul_ps(d, _mm256_loadu_ps(p+8))); /* fall through */
+					default: s0 = _mm256_add_ps(s0, _mm256_mul_ps(d, _mm256_loadu_ps(p)));
+				}
+			}
+			_mm256_storeu_ps(acc, s0);
+			_mm256_storeu_ps(acc+8, s1);
+			_mm256_storeu_ps(acc+16, s2);
+			_mm256_storeu_ps(acc+24, s3);
+			_mm256_storeu_ps(acc+32, s4);
+			for(i = 0; i < lag; i++)
+				autoc[a][i] = acc[i];
+		}
+	}
+	_mm256_zeroupper();
+}
+
+#endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_restore_signal_wide_intrin_avx2(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	__m256i q[FLAC__MAX_LPC_ORDER], sum;
+	__m128i prev, prev2;
+	FLAC__int32 *d, p1, p2, p3, d0, d1, d2, d3;
+	FLAC__int64 s[4], c0, c1, c2;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(order < 12 || lp_quantization < 0) {
+		FLAC__lpc_restore_signal_wide(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	for(j = 3; j < 7; j++)
+		q[j] = _mm256_setzero_si256();
+	for(j = 3; j < order; j++)
+		q[j] = _mm256_set1_epi64x(qlp_coeff[j]);
+	c0 = qlp_coeff[0];
+	c1 = qlp_coeff[1];
+	c2 = qlp_coeff[2];
+
+	/* kept in registers as in the SSE4.1 32-bit version */
+	prev = _mm_loadu_si128((const __m128i*)(data-4));
+	prev2 = _mm_loadu_si128((const __m128i*)(data-8));
+	p1 = data[-1];
+	p2 = data[-2];
+	p3 = data[-3];
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		d = data + i;
+		sum = _mm256_mul_epi32(_mm256_cvtepi32_epi64(prev), q[3]);
+		sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm_alignr_epi8(prev, prev2, 12)), q[4]));
+		sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm_alignr_epi8(prev, prev2, 8)), q[5]));
+		sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm_alignr_epi8(prev, prev2, 4)), q[6]));
+		for(j = 7; j < order; j++)
+			sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(d-j-1))), q[j]));
+		_mm256_storeu_si256((__m256i*)s, sum);
+		d0 = residual[i  ] + (FLAC__int32)((s[0] + c2 * p3 + c1 * p2 + c0 * p1) >> lp_quantization);
+		d1 = residual[i+1] + (FLAC__int32)((s[1] + c2 * p2 + c1 * p1 + c0 * d0) >> lp_quantization);
+		d2 = residual[i+2] + (FLAC__int32)((s[2] + c2 * p1 + c1 * d0 + c0 * d1) >> lp_quantization);
+		d3 = residual[i+3] + (FLAC__int32)((s[3] + c2 * d0 + c1 * d1 + c0 * d2) >> lp_quantization);
+		p1 = d3;
+		p2 = d2;
+		p3 = d1;
+		prev2 = prev;
+		prev = _mm_setr_epi32(d0, d1, d2, d3);
+		_mm_storeu_si128((__m128i*)d, prev);
+	}
+	_mm256_zeroupper();
+	for(; i < data_len; i++) {
+		d = data + i;
+		s[0] = 0;
+		for(j = 0; j < order; j++)
+			s[0] += qlp_coeff[j] * (FLAC__int64)d[-(int)j-1];
+		d[0] = residual[i] + (FLAC__int32)(s[0] >> lp_quantization);
+	}
+}
+
+#endif /* FLAC__CPU_IA64 && FLAC__AVX2_SUPPORTED */
+#endif /* !FLAC__NO_ASM */
@@ -0,0 +1,305 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2006,2007,2008  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h"
+
+#ifndef FLAC__NO_ASM
+#if defined FLAC__CPU_IA64 && defined FLAC__SSE4_1_SUPPORTED
+
+#include "private/lpc.h"
+#include "FLAC/assert.h"
+
+#include <smmintrin.h> /* SSE4.1 */
+
+/*
+ * The residual is computed for 4 samples at a time (2 with 64-bit sums),
+ * which gives the same result as the C code: the 32-bit sums wrap the same
+ * way in any order, and the low 32 bits of a 64-bit sum shifted right by
+ * 0..32 bits do not depend on whether the shift is arithmetic or logical.
+ *
+ * Restoring the signal cannot be done that way, since every sample is
+ * predicted from the ones just before it.  So the prediction for a group of
+ * 4 samples is split in two: the taps that only reach samples from before
+ * the group are summed for the whole group at once, and coefficients 0-2
+ * are added one sample at a time as the samples are restored.  The serial
+ * part still bounds the speed, so this only beats the C version from about
+ * order 12 on; below that, and for 64-bit sums (which would get only 2
+ * lanes), the C version is used.
+ */
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	__m128i q[FLAC__MAX_LPC_ORDER], cnt;
+	const FLAC__int32 *d;
+	FLAC__int32 sum;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(lp_quantization < 0) {
+		FLAC__lpc_compute_residual_from_qlp_coefficients(data, data_len, qlp_coeff, order, lp_quantization, residual);
+		return;
+	}
+
+	cnt = _mm_cvtsi32_si128(lp_quantization);
+	for(j = 0; j < order; j++)
+		q[j] = _mm_set1_epi32(qlp_coeff[j]);
+
+	for(i = 0; i + 8 <= data_len; i += 8) {
+		__m128i sum0, sum1;
+		d = data + i;
+		sum0 = _mm_mullo_epi32(q[0], _mm_loadu_si128((const __m128i*)(d-1)));
+		sum1 = _mm_mullo_epi32(q[0], _mm_loadu_si128((const __m128i*)(d+3)));
+		for(j = 1; j < order; j++) {
+			sum0 = _mm_add_epi32(sum0, _mm_mullo_epi32(q[j], _mm_loadu_si128((const __m128i*)(d-j-1))));
+			sum1 = _mm_add_epi32(sum1, _mm_mullo_epi32(q[j], _mm_loadu_si128((const __m128i*)(d-j+3))));
+		}
+		_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)d), _mm_sra_epi32(sum0, cnt)));
+		_mm_storeu_si128((__m128i*)(residual+i+4), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(d+4)), _mm_sra_epi32(sum1, cnt)));
+	}
+	if(i + 4 <= data_len) {
+		__m128i sum0;
+		d = data + i;
+		sum0 = _mm_mullo_epi32(q[0], _mm_loadu_si128((const __m128i*)(d-1)));
+		for(j = 1; j < order; j++)
+			sum0 = _mm_add_epi32(sum0, _mm_mullo_epi32(q[j], _mm_loadu_si128((const __m128i*)(d-j-1))));
+		_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)d), _mm_sra_epi32(sum0, cnt)));
+		i += 4;
+	}
+	for(; i < data_len; i++) {
+		d = data + i;
+		sum = 0;
+		for(j = 0; j < order; j++)
+			sum += qlp_coeff[j] * d[-(int)j-1];
+		residual[i] = d[0] - (sum >> lp_quantization);
+	}
+}
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
+{
+	__m128i q[FLAC__MAX_LPC_ORDER], cnt;
+	const FLAC__int32 *d;
+	FLAC__int64 sum;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(lp_quantization < 0) {
+		FLAC__lpc_compute_residual_from_qlp_coefficients_wide(data, data_len, qlp_coeff, order, lp_quantization, residual);
+		return;
+	}
+
+	cnt = _mm_cvtsi32_si128(lp_quantization);
+	for(j = 0; j < order; j++)
+		q[j] = _mm_set1_epi32(qlp_coeff[j]);
+
+	/* the even samples of each group of 4 are summed in one vector, the odd ones in another */
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		__m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128(), x;
+		d = data + i;
+		for(j = 0; j < order; j++) {
+			x = _mm_loadu_si128((const __m128i*)(d-j-1));
+			even = _mm_add_epi64(even, _mm_mul_epi32(x, q[j]));
+			odd = _mm_add_epi64(odd, _mm_mul_epi32(_mm_srli_epi64(x, 32), q[j]));
+		}
+		x = _mm_blend_epi16(_mm_srl_epi64(even, cnt), _mm_slli_epi64(_mm_srl_epi64(odd, cnt), 32), 0xcc);
+		_mm_storeu_si128((__m128i*)(residual+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)d), x));
+	}
+	for(; i < data_len; i++) {
+		d = data + i;
+		sum = 0;
+		for(j = 0; j < order; j++)
+			sum += qlp_coeff[j] * (FLAC__int64)d[-(int)j-1];
+		residual[i] = d[0] - (FLAC__int32)(sum >> lp_quantization);
+	}
+}
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_compute_autocorrelation_windows_intrin_sse41(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1])
+{
+	/*
+	 * All the lags are summed together, 4 to a vector, for all the samples
+	 * of a piece; past the end of the data the windowed piece is padded
+	 * with zeros, which leave the sums as they are.  Each lag still gets
+	 * its products added in sample order, so the results match the C code.
+	 * That makes every lag a chain of dependent additions, so the more of
+	 * them are kept going at once the better.
+	 */
+	FLAC__real windowed[FLAC__LPC_AUTOCORRELATION_BLOCK + FLAC__MAX_LPC_ORDER + 4];
+	FLAC__real acc[FLAC__MAX_LPC_ORDER + 4];
+	__m128 s0, s1, s2, s3, s4, s5, s6, s7, s8;
+	const unsigned nvec = (lag + 3) / 4;
+	unsigned start, end, ext, n, a, i;
+
+	FLAC__ASSERT(lag > 0);
+	FLAC__ASSERT(lag <= data_len);
+	FLAC__ASSERT(lag <= FLAC__MAX_LPC_ORDER+1);
+
+	for(a = 0; a < num_windows; a++)
+		for(i = 0; i < lag; i++)
+			autoc[a][i] = 0.0;
+
+	for(start = 0; start < data_len; start = end) {
+		end = start + FLAC__LPC_AUTOCORRELATION_BLOCK < data_len? start + FLAC__LPC_AUTOCORRELATION_BLOCK : data_len;
+		ext = end + lag - 1 < data_len? end + lag - 1 : data_len;
+		n = end - start;
+		for(a = 0; a < num_windows; a++) {
+			const FLAC__int32 *in = data + start;
+			const FLAC__real *w = window[a] + start;
+			for(i = 0; i + 4 <= ext - start; i += 4)
+				_mm_storeu_ps(windowed+i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(in+i))), _mm_loadu_ps(w+i)));
+			for(; i < ext - start; i++)
+				windowed[i] = in[i] * w[i];
+			for(; i < n + FLAC__MAX_LPC_ORDER + 4; i++)
+				windowed[i] = 0.0;
+
+			for(i = 0; i < lag; i++)
+				acc[i] = autoc[a][i];
+			for(; i < FLAC__MAX_LPC_ORDER + 4; i++)
+				acc[i] = 0.0;
+			s0 = _mm_loadu_ps(acc);
+			s1 = _mm_loadu_ps(acc+4);
+			s2 = _mm_loadu_ps(acc+8);
+			s3 = _mm_loadu_ps(acc+12);
+			s4 = _mm_loadu_ps(acc+16);
+			s5 = _mm_loadu_ps(acc+20);
+			s6 = _mm_loadu_ps(acc+24);
+			s7 = _mm_loadu_ps(acc+28);
+			s8 = _mm_loadu_ps(acc+32);
+			for(i = 0; i < n; i++) {
+				const FLAC__real *p = windowed + i;
+				const __m128 d = _mm_set1_ps(windowed[i]);
+				switch(nvec) {
+					case 9: s8 = _mm_add_ps(s8, _mm_mul_ps(d, _mm_loadu_ps(p+32))); /* fall through */
+					case 8: s7 = _mm_add_ps(s7, _mm_mul_ps(d, _mm_loadu_ps(p+28))); /* fall through */
+					case 7: s6 = _mm_add_ps(s6, _mm_mul_ps(d, _mm_loadu_ps(p+24))); /* fall through */
+					case 6: s5 = _mm_add_ps(s5, _mm_mul_ps(d, _mm_loadu_ps(p+20))); /* fall through */
+					case 5: s4 = _mm_add_ps(s4, _mm_mul_ps(d, _mm_loadu_ps(p+16))); /* fall through */
+					case 4: s3 = _mm_add_ps(s3, _mm_mul_ps(d, _mm_loadu_ps(p+12))); /* fall through */
+					case 3: s2 = _mm_add_ps(s2, _mm_mul_ps(d, _mm_loadu_ps(p+8))); /* fall through */
+					case 2: s1 = _mm_add_ps(s1, _mm_mul_ps(d, _mm_loadu_ps(p+4))); /* fall through */
+					default: s0 = _mm_add_ps(s0, _mm_mul_ps(d, _mm_loadu_ps(p)));
+				}
+			}
+			_mm_storeu_ps(acc, s0);
+			_mm_storeu_ps(acc+4, s1);
+			_mm_storeu_ps(acc+8, s2);
+			_mm_storeu_ps(acc+12, s3);
+			_mm_storeu_ps(acc+16, s4);
+			_mm_storeu_ps(acc+20, s5);
+			_mm_storeu_ps(acc+24, s6);
+			_mm_storeu_ps(acc+28, s7);
+			_mm_storeu_ps(acc+32, s8);
+			for(i = 0; i < lag; i++)
+				autoc[a][i] = acc[i];
+		}
+	}
+}
+
+#endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_restore_signal_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	__m128i q[FLAC__MAX_LPC_ORDER], sum, prev, prev2;
+	FLAC__int32 *d, s[4], c0, c1, c2, p1, p2, p3, d0, d1, d2, d3;
+	unsigned i, j;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= FLAC__MAX_LPC_ORDER);
+
+	if(order < 12 || lp_quantization < 0) {
+		FLAC__lpc_restore_signal(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	for(j = 3; j < 7; j++)
+		q[j] = _mm_setzero_si128();
+	for(j = 3; j < order; j++)
+		q[j] = _mm_set1_epi32(qlp_coeff[j]);
+	c0 = qlp_coeff[0];
+	c1 = qlp_coeff[1];
+	c2 = qlp_coeff[2];
+
+	/*
+	 * The last 8 samples are kept in registers: taps 3-6 read samples that
+	 * were only just written one at a time, and loading them back as a
+	 * vector would stall on the stores.  With order >= 12 there are always
+	 * 8 warm-up samples to start from.
+	 */
+	prev = _mm_loadu_si128((const __m128i*)(data-4));
+	prev2 = _mm_loadu_si128((const __m128i*)(data-8));
+	p1 = data[-1];
+	p2 = data[-2];
+	p3 = data[-3];
+	for(i = 0; i + 4 <= data_len; i += 4) {
+		d = data + i;
+		sum = _mm_mullo_epi32(q[3], prev);
+		sum = _mm_add_epi32(sum, _mm_mullo_epi32(q[4], _mm_alignr_epi8(prev, prev2, 12)));
+		sum = _mm_add_epi32(sum, _mm_mullo_epi32(q[5], _mm_alignr_epi8(prev, prev2, 8)));
+		sum = _mm_add_epi32(sum, _mm_mullo_epi32(q[6], _mm_alignr_epi8(prev, prev2, 4)));
+		for(j = 7; j < order; j++)
+			sum = _mm_add_epi32(sum, _mm_mullo_epi32(q[j], _mm_loadu_si128((const __m128i*)(d-j-1))));
+		_mm_storeu_si128((__m128i*)s, sum);
+		/* the term on the sample just restored goes last, to keep it off the critical path */
+		d0 = residual[i  ] + ((s[0] + c2 * p3 + c1 * p2 + c0 * p1) >> lp_quantization);
+		d1 = residual[i+1] + ((s[1] + c2 * p2 + c1 * p1 + c0 * d0) >> lp_quantization);
+		d2 = residual[i+2] + ((s[2] + c2 * p1 + c1 * d0 + c0 * d1) >> lp_quantization);
+		d3 = residual[i+3] + ((s[3] + c2 * d0 + c1 * d1 + c0 * d2) >> lp_quantization);
+		p1 = d3;
+		p2 = d2;
+		p3 = d1;
+		prev2 = prev;
+		prev = _mm_setr_epi32(d0, d1, d2, d3);
+		_mm_storeu_si128((__m128i*)d, prev);
+	}
+	for(; i < data_len; i++) {
+		d = data + i;
+		s[0] = 0;
+		for(j = 0; j < order; j++)
+			s[0] += qlp_coeff[j] * d[-(int)j-1];
+		d[0] = residual[i] + (s[0] >> lp_quantization);
+	}
+}
+
+#endif /* FLAC__CPU_IA64 && FLAC__SSE4_1_SUPPORTED */
+#endif /* !FLAC__NO_ASM */
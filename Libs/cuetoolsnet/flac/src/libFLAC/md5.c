@@ -6,8 +6,14 @@
 #include <string.h>		/* for memcpy() */
 
 #include "private/md5.h"
+#include "private/threads.h"
+#include "FLAC/assert.h"
 #include "share/alloc.h"
 
+#if defined FLAC__CPU_IA64 && !defined FLAC__NO_ASM
+#include <emmintrin.h> /* SSE2, which every x86-64 processor has */
+#endif
+
 #ifndef FLaC__INLINE
 #define FLaC__INLINE
 #endif
@@ -213,12 +219,112 @@ static void FLAC__MD5Update(FLAC__MD5Context *ctx, FLAC__byte const *buf, unsign
 	memcpy(ctx->in, buf, len);
 }
 
+#ifndef FLAC__NO_THREADS
+/*
+ * The helper thread takes the formatted bytes through a small ring of
+ * buffers.  Each slot has an event the producer signals when the slot is
+ * filled and one the helper signals when it has hashed it, so the two
+ * sides hand slots back and forth in order without a lock.  A slot with
+ * 0 bytes tells the helper to stop.
+ */
+#define FLAC__MD5_PIPELINE_SLOTS 4
+
+typedef struct {
+	FLAC__byte *data;
+	size_t capacity;
+	size_t bytes;
+	FLAC__Event filled;
+	FLAC__Event hashed;
+} md5_slot_;
+
+struct FLAC__MD5Pipeline {
+	FLAC__MD5Context *ctx;
+	FLAC__Thread thread;
+	md5_slot_ slots[FLAC__MD5_PIPELINE_SLOTS];
+	unsigned next; /* the slot the producer fills next */
+};
+
+static void md5_thread_main_(void *arg)
+{
+	FLAC__MD5Pipeline *pipeline = (FLAC__MD5Pipeline*)arg;
+	unsigned i = 0;
+
+	for(;;) {
+		md5_slot_ *slot = &pipeline->slots[i];
+		FLAC__event_wait(&slot->filled);
+		if(slot->bytes == 0)
+			break;
+		FLAC__MD5Update(pipeline->ctx, slot->data, (unsigned)slot->bytes);
+		FLAC__event_signal(&slot->hashed);
+		i = (i + 1) % FLAC__MD5_PIPELINE_SLOTS;
+	}
+}
+
+static void free_pipeline_(FLAC__MD5Pipeline *pipeline, unsigned events)
+{
+	unsigned i;
+
+	for(i = 0; i < FLAC__MD5_PIPELINE_SLOTS; i++) {
+		if(i < events) {
+			FLAC__event_free(&pipeline->slots[i].filled);
+			FLAC__event_free(&pipeline->slots[i].hashed);
+		}
+		if(0 != pipeline->slots[i].data)
+			free(pipeline->slots[i].data);
+	}
+	free(pipeline);
+}
+
+static FLAC__MD5Pipeline *start_pipeline_(FLAC__MD5Context *ctx)
+{
+	FLAC__MD5Pipeline *pipeline;
+	unsigned i;
+
+	if(0 == (pipeline = (FLAC__MD5Pipeline*)calloc(1, sizeof(FLAC__MD5Pipeline))))
+		return 0;
+	pipeline->ctx = ctx;
+	for(i = 0; i < FLAC__MD5_PIPELINE_SLOTS; i++) {
+		if(!FLAC__event_init(&pipeline->slots[i].filled))
+			break;
+		if(!FLAC__event_init(&pipeline->slots[i].hashed)) {
+			FLAC__event_free(&pipeline->slots[i].filled);
+			break;
+		}
+		FLAC__event_signal(&pipeline->slots[i].hashed); /* every slot starts out free */
+	}
+	if(i < FLAC__MD5_PIPELINE_SLOTS || !FLAC__thread_create(&pipeline->thread, md5_thread_main_, pipeline)) {
+		free_pipeline_(pipeline, i);
+		return 0;
+	}
+	return pipeline;
+}
+
+/* waits for everything queued to be hashed, then stops the helper */
+static void stop_pipeline_(FLAC__MD5Pipeline *pipeline)
+{
+	md5_slot_ *slot = &pipeline->slots[pipeline->next];
+
+	FLAC__event_wait(&slot->hashed);
+	slot->bytes = 0;
+	FLAC__event_signal(&slot->filled);
+	FLAC__thread_join(&pipeline->thread);
+	free_pipeline_(pipeline, FLAC__MD5_PIPELINE_SLOTS);
+}
+#endif
+
 /*
  * Start MD5 accumulation.  Set bit count to 0 and buffer to mysterious
  * initialization constants.
  */
 void FLAC__MD5Init(FLAC__MD5Context *ctx)
 {
+#ifndef FLAC__NO_THREADS
+	if(0 != ctx->pipeline)
+		stop_pipeline_(ctx->pipeline);
+#endif
+	ctx->use_thread = false;
+	ctx->pipeline = 0;
+
 	ctx->buf[0] = 0x67452301;
 	ctx->buf[1] = 0xefcdab89;
 	ctx->buf[2] = 0x98badcfe;
@@ -237,8 +343,17 @@ void FLAC__MD5Init(FLAC__MD5Context *ctx)
  */
 void FLAC__MD5Final(FLAC__byte digest[16], FLAC__MD5Context *ctx)
 {
-	int count = ctx->bytes[0] & 0x3f;	/* Number of bytes in ctx->in */
-	FLAC__byte *p = (FLAC__byte *)ctx->in + count;
+	int count;
+	FLAC__byte *p;
+
+#ifndef FLAC__NO_THREADS
+	if(0 != ctx->pipeline) {
+		stop_pipeline_(ctx->pipeline);
+		ctx->pipeline = 0;
+	}
+#endif
+	count = ctx->bytes[0] & 0x3f;	/* Number of bytes in ctx->in */
+	p = (FLAC__byte *)ctx->in + count;
 
 	/* Set the first char of padding to 0x80.  There is always room. */
 	*p++ = 0x80;
@@ -271,6 +386,52 @@ void FLAC__MD5Final(FLAC__byte digest[16], FLAC__MD5Context *ctx)
 	}
 }
 
+#if defined FLAC__CPU_IA64 && !defined FLAC__NO_ASM
+/*
+ * Stereo interleaving with SSE2 for the common formats; the samples are
+ * truncated to 16 or 24 bits exactly like the byte-by-byte code does.
+ * Both return the number of samples done; the caller does the rest.
+ */
+static unsigned format_input_stereo16_sse2_(FLAC__byte *buf, const FLAC__int32 *left, const FLAC__int32 *right, unsigned samples)
+{
+	const __m128i low16 = _mm_set1_epi32(0xffff);
+	unsigned sample;
+
+	for(sample = 0; sample + 4 <= samples; sample += 4, buf += 16) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + sample));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + sample));
+		/* each 32-bit lane is one little-endian left/right pair */
+		_mm_storeu_si128((__m128i*)buf, _mm_or_si128(_mm_and_si128(l, low16), _mm_slli_epi32(r, 16)));
+	}
+	return sample;
+}
+
+static unsigned format_input_stereo24_sse2_(FLAC__byte *buf, const FLAC__int32 *left, const FLAC__int32 *right, unsigned samples)
+{
+	const __m128i low24 = _mm_set1_epi32(0xffffff);
+	const __m128i left24 = _mm_set_epi32(0, 0xffffff, 0, 0xffffff);
+	const __m128i high24 = _mm_set_epi32(0xffff, (int)0xff000000, 0xffff, (int)0xff000000);
+	const __m128i pair0 = _mm_set_epi32(0, 0, 0xffff, -1); /* bytes 0-5 */
+	const __m128i pair1 = _mm_set_epi32(0, -1, (int)0xffff0000, 0); /* bytes 6-11 */
+	unsigned sample;
+
+	for(sample = 0; sample + 4 <= samples; sample += 4, buf += 24) {
+		__m128i l = _mm_and_si128(_mm_loadu_si128((const __m128i*)(left + sample)), low24);
+		__m128i r = _mm_and_si128(_mm_loadu_si128((const __m128i*)(right + sample)), low24);
+		__m128i a = _mm_unpacklo_epi32(l, r), b = _mm_unpackhi_epi32(l, r);
+		/* move each right sample down next to its left one: 6 bytes in each 64-bit lane... */
+		a = _mm_or_si128(_mm_and_si128(a, left24), _mm_and_si128(_mm_srli_epi64(a, 8), high24));
+		b = _mm_or_si128(_mm_and_si128(b, left24), _mm_and_si128(_mm_srli_epi64(b, 8), high24));
+		/* ...then close the 2-byte gap between the lanes, giving 12 bytes per register */
+		a = _mm_or_si128(_mm_and_si128(a, pair0), _mm_and_si128(_mm_srli_si128(a, 2), pair1));
+		b = _mm_or_si128(_mm_and_si128(b, pair0), _mm_and_si128(_mm_srli_si128(b, 2), pair1));
+		_mm_storeu_si128((__m128i*)buf, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storel_epi64((__m128i*)(buf + 16), _mm_srli_si128(b, 4));
+	}
+	return sample;
+}
+#endif
+
 /*
  * Convert the incoming audio signal to a byte stream
  */
@@ -280,6 +441,35 @@ static void format_input_(FLAC__byte *buf, const FLAC__int32 * const signal[], u
 	register FLAC__int32 a_word;
 	register FLAC__byte *buf_ = buf;
 
+#if defined FLAC__CPU_IA64 && !defined FLAC__NO_ASM
+	if(channels == 2 && bytes_per_sample == 2) {
+		sample = format_input_stereo16_sse2_(buf_, signal[0], signal[1], samples);
+		for(buf_ += 4 * sample; sample < samples; sample++) {
+			a_word = signal[0][sample];
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word;
+			a_word = signal[1][sample];
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word;
+		}
+		return;
+	}
+	if(channels == 2 && bytes_per_sample == 3) {
+		sample = format_input_stereo24_sse2_(buf_, signal[0], signal[1], samples);
+		for(buf_ += 6 * sample; sample < samples; sample++) {
+			a_word = signal[0][sample];
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word;
+			a_word = signal[1][sample];
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word; a_word >>= 8;
+			*buf_++ = (FLAC__byte)a_word;
+		}
+		return;
+	}
+#endif
+
 #if WORDS_BIGENDIAN
 #else
 	if(channels == 2 && bytes_per_sample == 2) {
@@ -392,6 +582,15 @@ static void format_input_(FLAC__byte *buf, const FLAC__int32 * const signal[], u
 	}
 }
 
+void FLAC__MD5UseThread(FLAC__MD5Context *ctx, FLAC__bool use_thread)
+{
+#ifndef FLAC__NO_THREADS
+	ctx->use_thread = use_thread;
+#else
+	(void)ctx, (void)use_thread;
+#endif
+}
+
 /*
  * Convert the incoming audio signal to a byte stream and FLAC__MD5Update it.
  */
@@ -405,6 +604,33 @@ FLAC__bool FLAC__MD5Accumulate(FLAC__MD5Context *ctx, const FLAC__int32 * const
 	if((size_t)channels * (size_t)bytes_per_sample > SIZE_MAX / (size_t)samples)
 		return false;
 
+#ifndef FLAC__NO_THREADS
+	if(ctx->use_thread && bytes_needed > 0) {
+		md5_slot_ *slot;
+
+		if(0 == ctx->pipeline && 0 == (ctx->pipeline = start_pipeline_(ctx)))
+			ctx->use_thread = false; /* no thread; just hash the data here */
+		else {
+			slot = &ctx->pipeline->slots[ctx->pipeline->next];
+			FLAC__event_wait(&slot->hashed);
+			if(slot->capacity < bytes_needed) {
+				FLAC__byte *tmp = (FLAC__byte*)realloc(slot->data, bytes_needed);
+				if(0 == tmp) {
+					FLAC__event_signal(&slot->hashed); /* the slot is still free */
+					return false;
+				}
+				slot->data = tmp;
+				slot->capacity = bytes_needed;
+			}
+			format_input_(slot->data, signal, channels, samples, bytes_per_sample);
+			slot->bytes = bytes_needed;
+			FLAC__event_signal(&slot->filled);
+			ctx->pipeline->next = (ctx->pipeline->next + 1) % FLAC__MD5_PIPELINE_SLOTS;
+			return true;
+		}
+	}
+#endif
+
 	if(ctx->capacity < bytes_needed) {
 		FLAC__byte *tmp = (FLAC__byte*)realloc(ctx->internal_buf, bytes_needed);
 		if(0 == tmp) {
@@ -64,6 +64,7 @@
 #include "private/lpc.h"
 #include "private/md5.h"
 #include "private/memory.h"
+#include "private/threads.h"
 
 #ifdef max
 #undef max
@@ -96,6 +97,49 @@ FLAC_API int FLAC_API_SUPPORTS_OGG_FLAC =
 
 static FLAC__byte ID3V2_TAG_[3] = { 'I', 'D', '3' };
 
+/* Upper limit for FLAC__stream_decoder_set_num_threads(). */
+#define FLAC__STREAM_DECODER_MAX_THREADS 64
+
+#ifndef FLAC__NO_THREADS
+/* With worker threads, the input is cut into runs of about RUN_BYTES_,
+ * read READ_AHEAD_BYTES_ at a time.  If no frame starts within
+ * MAX_RUN_SCAN_BYTES_ past that, the rest of the stream is decoded
+ * without the workers.
+ */
+static const size_t RUN_BYTES_ = 256*1024;
+static const size_t READ_AHEAD_BYTES_ = 64*1024;
+static const size_t MAX_RUN_SCAN_BYTES_ = 4*1024*1024;
+
+/* A frame decoding thread.  The calling thread reads the input and cuts it
+ * into runs of whole frames; each worker decodes a run with its own decoder
+ * (a copy of our STREAMINFO, its own bitreader and output buffers, and
+ * callbacks that stay inside libFLAC), and the calling thread passes the
+ * frames on to the client in order.
+ */
+typedef struct {
+	FLAC__StreamDecoder *decoder;
+	FLAC__Thread thread;
+	FLAC__Event go;           /* set by the calling thread when a run has been handed over or quit is set */
+	FLAC__Event done;         /* set by the worker when the run is decoded */
+	FLAC__bool started;
+	FLAC__bool busy;          /* a run was handed over and its frames have not been written yet */
+	FLAC__bool quit;
+	/* the run: */
+	FLAC__uint64 position;    /* stream offset of data[0] */
+	FLAC__byte *data;
+	size_t bytes, capacity;
+	size_t bytes_read;        /* how much of data[] the worker's decoder has read so far */
+	/* the result: */
+	FLAC__bool ok;            /* the run decoded to the end, one whole frame after another, with no errors */
+	FLAC__bool end_of_stream; /* the last sample of the stream was in the run */
+	FLAC__FrameHeader *headers;
+	FLAC__FrameFooter *footers;
+	unsigned num_frames, frames_capacity;
+	FLAC__int32 *output[FLAC__MAX_CHANNELS];
+	unsigned output_samples, output_capacity;
+} decoder_worker;
+#endif
+
 /***********************************************************************
  *
  * Private class method prototypes
@@ -131,6 +175,23 @@ static FLAC__OggDecoderAspectReadStatus read_callback_proxy_(const void *void_de
 #endif
 static FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
 static void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status);
+static FLAC__bool process_frames_threaded_(FLAC__StreamDecoder *decoder);
+static void stop_workers_(FLAC__StreamDecoder *decoder);
+#ifndef FLAC__NO_THREADS
+static FLAC__bool start_workers_(FLAC__StreamDecoder *decoder);
+static void worker_main_(void *arg);
+static void decode_run_(decoder_worker *worker);
+static FLAC__StreamDecoderReadStatus worker_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+static FLAC__StreamDecoderWriteStatus worker_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static void worker_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__bool read_ahead_(FLAC__StreamDecoder *decoder, size_t bytes);
+static FLAC__bool cut_run_(FLAC__StreamDecoder *decoder, size_t *run_bytes);
+static unsigned check_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte data[], size_t bytes);
+static FLAC__bool queue_run_(FLAC__StreamDecoder *decoder, size_t run_bytes);
+static FLAC__bool write_run_frames_(FLAC__StreamDecoder *decoder, decoder_worker *worker, FLAC__bool *in_sync);
+static void discard_runs_(FLAC__StreamDecoder *decoder);
+static FLAC__bool resync_(FLAC__StreamDecoder *decoder, FLAC__uint64 position);
+#endif
 static FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample);
 #if FLAC__HAS_OGG
 static FLAC__bool seek_to_absolute_sample_ogg_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample);
@@ -204,6 +265,16 @@ typedef struct FLAC__StreamDecoderPrivate {
 #if FLAC__HAS_OGG
 	FLAC__bool got_a_frame; /* hack needed in Ogg FLAC seek routine to check when process_single() actually writes a frame */
 #endif
+#ifndef FLAC__NO_THREADS
+	decoder_worker *workers; /* frame decoding threads, started the first time FLAC__stream_decoder_process_until_end_of_stream() can use them */
+	unsigned num_workers;
+	unsigned next_worker; /* the worker that gets the next run */
+	unsigned runs_in_flight; /* runs handed to the workers whose frames have not been written yet */
+	FLAC__byte *input_ahead; /* input read by the calling thread but not handed to a worker yet; it always starts on a frame boundary */
+	size_t input_ahead_bytes, input_ahead_capacity;
+	FLAC__uint64 input_ahead_position; /* stream offset of input_ahead[0] */
+	FLAC__bool input_ahead_eof;
+#endif
 } FLAC__StreamDecoderPrivate;
 
 /***********************************************************************
@@ -448,6 +519,23 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_asm_ppc_altivec_16;
 			decoder->private_->local_lpc_restore_signal_16bit_order8 = FLAC__lpc_restore_signal_asm_ppc_altivec_16_order8;
 		}
+#elif defined FLAC__CPU_IA64
+		FLAC__ASSERT(decoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_IA64);
+#ifdef FLAC__BMI2_SUPPORTED
+		if(decoder->private_->cpuinfo.data.ia64.bmi2)
+			decoder->private_->local_bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block_intrin_bmi2;
+#endif
+#ifdef FLAC__SSE4_1_SUPPORTED
+		/* low orders are left to the C version, so _16bit_order8 is too */
+		if(decoder->private_->cpuinfo.data.ia64.sse41) {
+			decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal_intrin_sse41;
+			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_intrin_sse41;
+		}
+#endif
+#ifdef FLAC__AVX2_SUPPORTED
+		if(decoder->private_->cpuinfo.data.ia64.avx2)
+			decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide_intrin_avx2;
+#endif
 #endif
 	}
 #endif
@@ -678,6 +766,8 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 	if(decoder->protected_->state == FLAC__STREAM_DECODER_UNINITIALIZED)
 		return true;
 
+	stop_workers_(decoder);
+
 	/* see the comment in FLAC__seekable_stream_decoder_reset() as to why we
 	 * always call FLAC__MD5Final()
 	 */
@@ -769,6 +859,23 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_disable_asm(FLAC__StreamDecoder *de
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__NO_THREADS
+	if(value > 1)
+		return false;
+#else
+	if(value > FLAC__STREAM_DECODER_MAX_THREADS)
+		return false;
+#endif
+	decoder->protected_->num_threads = value;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_decoder_set_metadata_respond(FLAC__StreamDecoder *decoder, FLAC__MetadataType type)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -904,6 +1011,13 @@ FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDeco
 	return decoder->protected_->md5_checking;
 }
 
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->num_threads;
+}
+
 FLAC_API FLAC__uint64 FLAC__stream_decoder_get_total_samples(const FLAC__StreamDecoder *decoder)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -1044,6 +1158,7 @@ FLAC_API FLAC__bool FLAC__stream_decoder_reset(FLAC__StreamDecoder *decoder)
 	 * properly.
 	 */
 	FLAC__MD5Init(&decoder->private_->md5context);
+	FLAC__MD5UseThread(&decoder->private_->md5context, decoder->protected_->num_threads > 1);
 
 	decoder->private_->first_frame_offset = 0;
 	decoder->private_->unparseable_frame_count = 0;
@@ -1118,9 +1233,12 @@ FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_metadata(FLAC__Str
 FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_stream(FLAC__StreamDecoder *decoder)
 {
 	FLAC__bool dummy;
+	FLAC__bool try_threads;
 	FLAC__ASSERT(0 != decoder);
 	FLAC__ASSERT(0 != decoder->protected_);
 
+	try_threads = decoder->protected_->num_threads > 1;
+
 	while(1) {
 		switch(decoder->protected_->state) {
 			case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
@@ -1132,6 +1250,13 @@ FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_stream(FLAC__Strea
 					return false; /* above function sets the status for us */
 				break;
 			case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+				if(try_threads) {
+					/* if the workers stop short of the end, the rest is decoded here as usual */
+					try_threads = false;
+					if(!process_frames_threaded_(decoder))
+						return false; /* above function sets the status for us */
+					break;
+				}
 				if(!frame_sync_(decoder))
 					return true; /* above function sets the status for us */
 				break;
@@ -1287,6 +1412,7 @@ void set_defaults_(FLAC__StreamDecoder *decoder)
 	decoder->private_->metadata_filter_ids_count = 0;
 
 	decoder->protected_->md5_checking = false;
+	decoder->protected_->num_threads = 1;
 
 #if FLAC__HAS_OGG
 	FLAC__ogg_decoder_aspect_set_defaults(&decoder->protected_->ogg_decoder_aspect);
@@ -2985,6 +3111,644 @@ void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecod
 		decoder->private_->unparseable_frame_count++;
 }
 
+/* Decodes the rest of the stream on the worker threads, if there are any
+ * and the stream allows it: it must be seekable, not Ogg, and have a
+ * STREAMINFO block.  Returns false on a fatal error, with the state set.
+ * Otherwise returns true with the state set to END_OF_STREAM, or left at
+ * SEARCH_FOR_FRAME_SYNC with the input rewound to the first frame that was
+ * not written, if the workers did not get to the end (a damaged stream, or
+ * no frame boundary to split the input at); the caller decodes the rest of
+ * the stream itself, so any errors are reported just as without threads.
+ */
+FLAC__bool process_frames_threaded_(FLAC__StreamDecoder *decoder)
+{
+#ifndef FLAC__NO_THREADS
+	FLAC__uint64 position;
+	decoder_worker *worker;
+	size_t run_bytes;
+	FLAC__bool in_sync = true;
+	unsigned i;
+
+	FLAC__ASSERT(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC);
+
+	if(
+#if FLAC__HAS_OGG
+		decoder->private_->is_ogg ||
+#endif
+		!decoder->private_->has_stream_info ||
+		0 == decoder->private_->seek_callback ||
+		decoder->private_->is_seeking ||
+		decoder->private_->cached
+	)
+		return true;
+	if(FLAC__stream_decoder_get_total_samples(decoder) > 0 && decoder->private_->samples_decoded >= FLAC__stream_decoder_get_total_samples(decoder))
+		return true;
+	if(!FLAC__stream_decoder_get_decode_position(decoder, &position))
+		return true;
+
+	if(0 == decoder->private_->workers && !start_workers_(decoder))
+		return false; /* above function sets the status for us */
+	if(0 == decoder->private_->num_workers)
+		return true;
+	for(i = 0; i < decoder->private_->num_workers; i++) {
+		decoder->private_->workers[i].decoder->private_->has_stream_info = true;
+		decoder->private_->workers[i].decoder->private_->stream_info = decoder->private_->stream_info;
+		decoder->private_->workers[i].decoder->private_->fixed_block_size = decoder->private_->fixed_block_size;
+	}
+
+	/* from here on we read the input ourselves, from the start of the next frame */
+	if(decoder->private_->seek_callback(decoder, position, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+		return false;
+	}
+	if(!FLAC__bitreader_clear(decoder->private_->input)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	decoder->private_->input_ahead_bytes = 0;
+	decoder->private_->input_ahead_position = position;
+	decoder->private_->input_ahead_eof = false;
+
+	while(1) {
+		if(!cut_run_(decoder, &run_bytes)) {
+			discard_runs_(decoder);
+			return false; /* above function sets the status for us */
+		}
+		if(run_bytes == 0)
+			break;
+		worker = &decoder->private_->workers[decoder->private_->next_worker];
+		if(worker->busy) {
+			if(!write_run_frames_(decoder, worker, &in_sync)) {
+				discard_runs_(decoder);
+				return false; /* above function sets the status for us */
+			}
+			if(!in_sync)
+				return resync_(decoder, worker->position);
+			if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+				discard_runs_(decoder);
+				return true;
+			}
+		}
+		if(!queue_run_(decoder, run_bytes)) {
+			discard_runs_(decoder);
+			return false; /* above function sets the status for us */
+		}
+	}
+
+	/* write the frames of the runs still out with the workers, oldest first */
+	while(decoder->private_->runs_in_flight > 0) {
+		worker = &decoder->private_->workers[(decoder->private_->next_worker + decoder->private_->num_workers - decoder->private_->runs_in_flight) % decoder->private_->num_workers];
+		if(!write_run_frames_(decoder, worker, &in_sync)) {
+			discard_runs_(decoder);
+			return false; /* above function sets the status for us */
+		}
+		if(!in_sync)
+			return resync_(decoder, worker->position);
+		if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+			discard_runs_(decoder);
+			return true;
+		}
+	}
+
+	if(decoder->private_->input_ahead_eof && decoder->private_->input_ahead_bytes == 0) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+		return true;
+	}
+	/* the rest of the input could not be cut into runs */
+	return resync_(decoder, decoder->private_->input_ahead_position);
+#else
+	(void)decoder;
+	return true;
+#endif
+}
+
+void stop_workers_(FLAC__StreamDecoder *decoder)
+{
+#ifndef FLAC__NO_THREADS
+	unsigned i, channel;
+
+	if(0 != decoder->private_->workers) {
+		for(i = 0; i < decoder->private_->num_workers; i++) {
+			decoder_worker *worker = &decoder->private_->workers[i];
+			if(worker->started) {
+				/* a worker that is still decoding a run sees this once it is done with it */
+				worker->quit = true;
+				FLAC__event_signal(&worker->go);
+				FLAC__thread_join(&worker->thread);
+				FLAC__event_free(&worker->go);
+				FLAC__event_free(&worker->done);
+			}
+			if(0 != worker->decoder)
+				FLAC__stream_decoder_delete(worker->decoder);
+			if(0 != worker->data)
+				free(worker->data);
+			if(0 != worker->headers)
+				free(worker->headers);
+			if(0 != worker->footers)
+				free(worker->footers);
+			for(channel = 0; channel < FLAC__MAX_CHANNELS; channel++) {
+				if(0 != worker->output[channel])
+					free(worker->output[channel]);
+			}
+		}
+		free(decoder->private_->workers);
+		decoder->private_->workers = 0;
+	}
+	decoder->private_->num_workers = 0;
+	decoder->private_->next_worker = 0;
+	decoder->private_->runs_in_flight = 0;
+
+	if(0 != decoder->private_->input_ahead) {
+		free(decoder->private_->input_ahead);
+		decoder->private_->input_ahead = 0;
+	}
+	decoder->private_->input_ahead_bytes = decoder->private_->input_ahead_capacity = 0;
+#else
+	(void)decoder;
+#endif
+}
+
+#ifndef FLAC__NO_THREADS
+FLAC__bool start_workers_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	FLAC__ASSERT(0 == decoder->private_->workers);
+	FLAC__ASSERT(decoder->protected_->num_threads > 1);
+
+	if(0 == (decoder->private_->workers = (decoder_worker*)safe_calloc_(decoder->protected_->num_threads, sizeof(decoder_worker)))) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	decoder->private_->num_workers = decoder->protected_->num_threads;
+	decoder->private_->next_worker = 0;
+	decoder->private_->runs_in_flight = 0;
+
+	for(i = 0; i < decoder->private_->num_workers; i++) {
+		decoder_worker *worker = &decoder->private_->workers[i];
+		if(0 == (worker->decoder = FLAC__stream_decoder_new())) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		worker->decoder->private_->disable_asm = decoder->private_->disable_asm;
+		if(FLAC__stream_decoder_init_stream(worker->decoder, worker_read_callback_, 0, 0, 0, 0, worker_write_callback_, 0, worker_error_callback_, worker) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!FLAC__event_init(&worker->go)) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!FLAC__event_init(&worker->done)) {
+			FLAC__event_free(&worker->go);
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!FLAC__thread_create(&worker->thread, worker_main_, worker)) {
+			FLAC__event_free(&worker->go);
+			FLAC__event_free(&worker->done);
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		worker->started = true;
+	}
+
+	return true;
+}
+
+void worker_main_(void *arg)
+{
+	decoder_worker *worker = (decoder_worker*)arg;
+
+	for(;;) {
+		FLAC__event_wait(&worker->go);
+		if(worker->quit)
+			break;
+		decode_run_(worker);
+		FLAC__event_signal(&worker->done);
+	}
+}
+
+/* Decodes the frames in worker->data[] into the worker's output buffers.
+ * The run must be whole frames from the first byte to the last, unless it
+ * holds the end of the stream, in which case anything after the last
+ * sample is left alone just as frame_sync_() would.
+ */
+void decode_run_(decoder_worker *worker)
+{
+	FLAC__StreamDecoder *decoder = worker->decoder;
+	const FLAC__uint64 total_samples = FLAC__stream_decoder_get_total_samples(decoder);
+	unsigned num_frames;
+
+	worker->ok = true;
+	worker->end_of_stream = false;
+	worker->bytes_read = 0;
+	worker->num_frames = 0;
+	worker->output_samples = 0;
+
+	if(!FLAC__stream_decoder_flush(decoder)) {
+		worker->ok = false;
+		return;
+	}
+
+	while(worker->ok && worker->bytes_read - FLAC__stream_decoder_get_input_bytes_unconsumed(decoder) < worker->bytes) {
+		num_frames = worker->num_frames;
+		if(!FLAC__stream_decoder_process_single(decoder))
+			worker->ok = false;
+		else if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+			if(total_samples > 0 && decoder->private_->samples_decoded >= total_samples)
+				worker->end_of_stream = true;
+			else
+				worker->ok = false;
+			break;
+		}
+		else if(worker->num_frames != num_frames + 1)
+			worker->ok = false;
+	}
+}
+
+FLAC__StreamDecoderReadStatus worker_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	decoder_worker *worker = (decoder_worker*)client_data;
+	const size_t left = worker->bytes - worker->bytes_read;
+
+	(void)decoder;
+	if(*bytes > left)
+		*bytes = left;
+	if(*bytes == 0)
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	memcpy(buffer, worker->data + worker->bytes_read, *bytes);
+	worker->bytes_read += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus worker_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	decoder_worker *worker = (decoder_worker*)client_data;
+	const unsigned channels = frame->header.channels, blocksize = frame->header.blocksize;
+	unsigned channel;
+
+	/* the output buffers hold the same channels from one frame to the next */
+	if(channels != decoder->private_->stream_info.data.stream_info.channels) {
+		worker->ok = false;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	if(worker->num_frames == worker->frames_capacity) {
+		const unsigned capacity = worker->frames_capacity? worker->frames_capacity * 2 : 64;
+		FLAC__FrameHeader *headers;
+		FLAC__FrameFooter *footers;
+		if(0 == (headers = (FLAC__FrameHeader*)safe_realloc_mul_2op_(worker->headers, sizeof(FLAC__FrameHeader), /*times*/capacity))) {
+			worker->ok = false;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		worker->headers = headers;
+		if(0 == (footers = (FLAC__FrameFooter*)safe_realloc_mul_2op_(worker->footers, sizeof(FLAC__FrameFooter), /*times*/capacity))) {
+			worker->ok = false;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		worker->footers = footers;
+		worker->frames_capacity = capacity;
+	}
+	if(worker->output_samples + blocksize > worker->output_capacity) {
+		const unsigned capacity = max(worker->output_capacity * 2, worker->output_samples + blocksize);
+		for(channel = 0; channel < channels; channel++) {
+			FLAC__int32 *output;
+			if(0 == (output = (FLAC__int32*)safe_realloc_mul_2op_(worker->output[channel], sizeof(FLAC__int32), /*times*/capacity))) {
+				worker->ok = false;
+				return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+			}
+			worker->output[channel] = output;
+		}
+		worker->output_capacity = capacity;
+	}
+
+	for(channel = 0; channel < channels; channel++)
+		memcpy(worker->output[channel] + worker->output_samples, buffer[channel], sizeof(FLAC__int32) * blocksize);
+	worker->output_samples += blocksize;
+	worker->headers[worker->num_frames] = frame->header;
+	worker->footers[worker->num_frames] = frame->footer;
+	worker->num_frames++;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void worker_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	/* the calling thread decodes this part again itself and reports the error then */
+	(void)decoder, (void)status;
+	((decoder_worker*)client_data)->ok = false;
+}
+
+/* Reads until there are at least 'bytes' bytes of input ahead, or up to the
+ * end of the input.
+ */
+FLAC__bool read_ahead_(FLAC__StreamDecoder *decoder, size_t bytes)
+{
+	FLAC__StreamDecoderPrivate *private_ = decoder->private_;
+
+	if(bytes > private_->input_ahead_capacity) {
+		FLAC__byte *input_ahead;
+		if(0 == (input_ahead = (FLAC__byte*)realloc(private_->input_ahead, bytes))) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		private_->input_ahead = input_ahead;
+		private_->input_ahead_capacity = bytes;
+	}
+
+	while(private_->input_ahead_bytes < bytes && !private_->input_ahead_eof) {
+		size_t n = bytes - private_->input_ahead_bytes;
+		FLAC__StreamDecoderReadStatus status;
+		if(private_->eof_callback && private_->eof_callback(decoder, private_->client_data)) {
+			private_->input_ahead_eof = true;
+			break;
+		}
+		status = private_->read_callback(decoder, private_->input_ahead + private_->input_ahead_bytes, &n, private_->client_data);
+		if(status == FLAC__STREAM_DECODER_READ_STATUS_ABORT) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
+			return false;
+		}
+		private_->input_ahead_bytes += n;
+		if(status == FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM)
+			private_->input_ahead_eof = true;
+	}
+
+	return true;
+}
+
+/* Finds where the next run ends: at the first frame header at least
+ * RUN_BYTES_ into the input ahead, or at the end of the input.  A seek
+ * point at or past that is tried first, since it lands on a frame without
+ * a search.  Sets *run_bytes to 0 if there is no more input or no frame
+ * was found.
+ */
+FLAC__bool cut_run_(FLAC__StreamDecoder *decoder, size_t *run_bytes)
+{
+	FLAC__StreamDecoderPrivate *private_ = decoder->private_;
+	size_t wanted = RUN_BYTES_ + READ_AHEAD_BYTES_, from = RUN_BYTES_, i;
+	FLAC__bool seek_point_tried = false;
+
+	*run_bytes = 0;
+
+	while(1) {
+		if(!read_ahead_(decoder, wanted))
+			return false; /* above function sets the status for us */
+
+		if(private_->input_ahead_bytes <= RUN_BYTES_) {
+			FLAC__ASSERT(private_->input_ahead_eof);
+			*run_bytes = private_->input_ahead_bytes;
+			return true;
+		}
+
+		if(!seek_point_tried && private_->has_seek_table && private_->first_frame_offset > 0) {
+			const FLAC__StreamMetadata_SeekTable *seek_table = &private_->seek_table.data.seek_table;
+			const FLAC__uint64 target = private_->input_ahead_position + RUN_BYTES_;
+			unsigned p;
+			for(p = 0; p < seek_table->num_points; p++) {
+				const FLAC__uint64 offset = private_->first_frame_offset + seek_table->points[p].stream_offset;
+				if(seek_table->points[p].sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER || offset < target)
+					continue;
+				if(offset - private_->input_ahead_position >= private_->input_ahead_bytes)
+					break;
+				i = (size_t)(offset - private_->input_ahead_position);
+				if(check_frame_header_(decoder, private_->input_ahead + i, private_->input_ahead_bytes - i)) {
+					*run_bytes = i;
+					return true;
+				}
+				break;
+			}
+			seek_point_tried = true;
+		}
+
+		for(i = from; i < private_->input_ahead_bytes; i++) {
+			if(private_->input_ahead[i] == 0xff && check_frame_header_(decoder, private_->input_ahead + i, private_->input_ahead_bytes - i)) {
+				*run_bytes = i;
+				return true;
+			}
+		}
+
+		if(private_->input_ahead_eof) {
+			*run_bytes = private_->input_ahead_bytes;
+			return true;
+		}
+		if(wanted >= RUN_BYTES_ + MAX_RUN_SCAN_BYTES_)
+			return true;
+		/* a header cut off at the end gets another look once there is more input */
+		from = max(from, private_->input_ahead_bytes - 16);
+		wanted += READ_AHEAD_BYTES_;
+	}
+}
+
+/* Returns the length of the frame header at data[0], CRC-8 included, if
+ * one fits in 'bytes' and it could be a frame of this stream; otherwise 0.
+ */
+unsigned check_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte data[], size_t bytes)
+{
+	static const unsigned bits_per_sample_[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+	const FLAC__StreamMetadata_StreamInfo *stream_info = &decoder->private_->stream_info.data.stream_info;
+	unsigned blocksize = 0, blocksize_bytes = 0, sample_rate_bytes = 0, number_bytes, len, x;
+
+	if(bytes < 5)
+		return 0;
+	/* sync code and reserved bit */
+	if(data[0] != 0xff || (data[1] & 0xfe) != 0xf8)
+		return 0;
+
+	x = data[2] >> 4;
+	if(x == 0)
+		return 0;
+	else if(x == 1)
+		blocksize = 192;
+	else if(x <= 5)
+		blocksize = 576 << (x-2);
+	else if(x <= 7)
+		blocksize_bytes = x - 5;
+	else
+		blocksize = 256 << (x-8);
+
+	x = data[2] & 0x0f;
+	if(x == 15)
+		return 0;
+	else if(x == 12)
+		sample_rate_bytes = 1;
+	else if(x > 12)
+		sample_rate_bytes = 2;
+
+	x = data[3] >> 4;
+	if(x > 10 || (x & 8? 2 : x + 1) != stream_info->channels)
+		return 0;
+	x = (data[3] >> 1) & 7;
+	if(x == 3 || x == 7 || (x != 0 && bits_per_sample_[x] != stream_info->bits_per_sample))
+		return 0;
+	if(data[3] & 1)
+		return 0;
+
+	/* the frame or sample number, UTF-8 coded */
+	x = data[4];
+	if(!(x & 0x80))
+		number_bytes = 1;
+	else if((x & 0xe0) == 0xc0)
+		number_bytes = 2;
+	else if((x & 0xf0) == 0xe0)
+		number_bytes = 3;
+	else if((x & 0xf8) == 0xf0)
+		number_bytes = 4;
+	else if((x & 0xfc) == 0xf8)
+		number_bytes = 5;
+	else if((x & 0xfe) == 0xfc)
+		number_bytes = 6;
+	else if(x == 0xfe)
+		number_bytes = 7;
+	else
+		return 0;
+	len = 4 + number_bytes + blocksize_bytes + sample_rate_bytes;
+	if(bytes < len + 1)
+		return 0;
+	for(x = 5; x < 4 + number_bytes; x++) {
+		if((data[x] & 0xc0) != 0x80)
+			return 0;
+	}
+
+	if(blocksize_bytes == 1)
+		blocksize = data[4 + number_bytes] + 1;
+	else if(blocksize_bytes == 2)
+		blocksize = ((unsigned)data[4 + number_bytes] << 8 | data[5 + number_bytes]) + 1;
+	if(stream_info->max_blocksize > 0 && blocksize > stream_info->max_blocksize)
+		return 0;
+
+	if(FLAC__crc8(data, len) != data[len])
+		return 0;
+
+	return len + 1;
+}
+
+/* Hands the next run_bytes of the input ahead to the next worker. */
+FLAC__bool queue_run_(FLAC__StreamDecoder *decoder, size_t run_bytes)
+{
+	FLAC__StreamDecoderPrivate *private_ = decoder->private_;
+	decoder_worker *worker = &private_->workers[private_->next_worker];
+
+	FLAC__ASSERT(!worker->busy);
+	FLAC__ASSERT(run_bytes > 0 && run_bytes <= private_->input_ahead_bytes);
+
+	if(run_bytes > worker->capacity) {
+		FLAC__byte *data;
+		if(0 == (data = (FLAC__byte*)realloc(worker->data, run_bytes))) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		worker->data = data;
+		worker->capacity = run_bytes;
+	}
+	memcpy(worker->data, private_->input_ahead, run_bytes);
+	worker->bytes = run_bytes;
+	worker->position = private_->input_ahead_position;
+
+	private_->input_ahead_bytes -= run_bytes;
+	memmove(private_->input_ahead, private_->input_ahead + run_bytes, private_->input_ahead_bytes);
+	private_->input_ahead_position += run_bytes;
+
+	worker->busy = true;
+	FLAC__event_signal(&worker->go);
+
+	private_->runs_in_flight++;
+	private_->next_worker = (private_->next_worker + 1) % private_->num_workers;
+
+	return true;
+}
+
+/* Waits for the worker to finish its run and passes the frames on to the
+ * client just as read_frame_() would have.  If the run could not be
+ * decoded cleanly, nothing is written and *in_sync is set to false.
+ */
+FLAC__bool write_run_frames_(FLAC__StreamDecoder *decoder, decoder_worker *worker, FLAC__bool *in_sync)
+{
+	const FLAC__int32 *buffer[FLAC__MAX_CHANNELS];
+	unsigned i, channel, offset = 0;
+
+	FLAC__ASSERT(worker->busy);
+	FLAC__ASSERT(decoder->private_->runs_in_flight > 0);
+
+	FLAC__event_wait(&worker->done);
+	worker->busy = false;
+	decoder->private_->runs_in_flight--;
+
+	if(!worker->ok) {
+		*in_sync = false;
+		return true;
+	}
+
+	/* the subframes were decoded by the worker and are not passed on; don't
+	 * leave the client those of whatever frame this decoder read last
+	 */
+	memset(decoder->private_->frame.subframes, 0, sizeof(decoder->private_->frame.subframes));
+
+	for(i = 0; i < worker->num_frames; i++) {
+		decoder->private_->frame.header = worker->headers[i];
+		decoder->private_->frame.footer = worker->footers[i];
+		for(channel = 0; channel < decoder->private_->frame.header.channels; channel++)
+			buffer[channel] = worker->output[channel] + offset;
+		offset += decoder->private_->frame.header.blocksize;
+
+		decoder->protected_->channels = decoder->private_->frame.header.channels;
+		decoder->protected_->channel_assignment = decoder->private_->frame.header.channel_assignment;
+		decoder->protected_->bits_per_sample = decoder->private_->frame.header.bits_per_sample;
+		decoder->protected_->sample_rate = decoder->private_->frame.header.sample_rate;
+		decoder->protected_->blocksize = decoder->private_->frame.header.blocksize;
+		decoder->private_->samples_decoded = decoder->private_->frame.header.number.sample_number + decoder->private_->frame.header.blocksize;
+
+		if(write_audio_frame_to_client_(decoder, &decoder->private_->frame, buffer) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+			/* the state read_frame_() leaves behind on an abort */
+			decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+			return false;
+		}
+	}
+
+	if(worker->end_of_stream)
+		decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+
+	return true;
+}
+
+/* Waits for the runs still out with the workers and drops them. */
+void discard_runs_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	for(i = 0; i < decoder->private_->num_workers; i++) {
+		decoder_worker *worker = &decoder->private_->workers[i];
+		if(worker->busy) {
+			FLAC__event_wait(&worker->done);
+			worker->busy = false;
+		}
+	}
+	decoder->private_->runs_in_flight = 0;
+	decoder->private_->next_worker = 0;
+	decoder->private_->input_ahead_bytes = 0;
+}
+
+/* Drops everything read ahead and puts the input back at 'position', the
+ * start of the first frame not written yet, for the caller to go on from.
+ */
+FLAC__bool resync_(FLAC__StreamDecoder *decoder, FLAC__uint64 position)
+{
+	discard_runs_(decoder);
+
+	if(decoder->private_->seek_callback(decoder, position, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+		return false;
+	}
+	if(!FLAC__bitreader_clear(decoder->private_->input)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+
+	return true;
+}
+#endif
+
 FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample)
 {
 	FLAC__uint64 first_frame_offset = decoder->private_->first_frame_offset, lower_bound, upper_bound, lower_bound_sample, upper_bound_sample, this_frame_sample;
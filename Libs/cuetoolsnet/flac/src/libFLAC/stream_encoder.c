@@ -70,6 +70,7 @@
 #include "private/ogg_mapping.h"
 #endif
 #include "private/stream_encoder_framing.h"
+#include "private/threads.h"
 #include "private/window.h"
 
 #ifndef FLaC__INLINE
@@ -99,10 +100,15 @@
 #undef ENABLE_RICE_PARAMETER_SEARCH 
 
 
+/* A ring buffer of the original signal: samples are appended at tail as
+ * they come in and compared and dropped at head as frames are verified.
+ */
 typedef struct {
 	FLAC__int32 *data[FLAC__MAX_CHANNELS];
 	unsigned size; /* of each data[] in samples */
+	unsigned head;
 	unsigned tail;
+	unsigned unverified; /* samples appended and not yet known to be verified; only touched by the calling thread */
 } verify_input_fifo;
 
 typedef struct {
@@ -117,6 +123,75 @@ typedef enum {
 	ENCODER_IN_AUDIO = 2
 } EncoderStateHint;
 
+/* The arguments of one process_subframe_() call: the search for the best
+ * subframe of one channel (or of the mid or side signal) of the frame.
+ * The searches of a frame only share the frame header, so they can run
+ * side by side.
+ */
+typedef struct {
+	unsigned subframe_bps;
+	const FLAC__int32 *integer_signal;
+	FLAC__Subframe **subframe;
+	FLAC__EntropyCodingMethod_PartitionedRiceContents **partitioned_rice_contents;
+	FLAC__int32 **residual;
+	unsigned *best_subframe;
+	unsigned *best_bits;
+} subframe_task;
+
+#ifndef FLAC__NO_THREADS
+/* A frame encoding thread.  Each worker owns a forked copy of the encoder
+ * (same settings and function pointers, but its own signal, residual and
+ * subframe workspaces and its own frame bitwriter), so while it encodes a
+ * block it never touches anything the calling thread uses.
+ *
+ * With FLAC__stream_encoder_set_subframe_threads() the worker gets some of
+ * the subframe searches of the calling thread's frame instead; those work
+ * on the calling thread's per-channel workspaces, and the forked encoder
+ * only lends its windowed signal, LP coefficient and partition scratch.
+ */
+typedef struct {
+	FLAC__StreamEncoder *encoder;
+	FLAC__Thread thread;
+	FLAC__Event go;        /* set by the calling thread when a block has been handed over or quit is set */
+	FLAC__Event done;      /* set by the worker when the frame is complete in encoder->private_->frame */
+	FLAC__bool started;
+	FLAC__bool busy;       /* a block was handed over and its frame has not been written yet */
+	FLAC__bool ok;         /* result of encode_frame_() for the last block */
+	FLAC__bool quit;
+	/* subframe mode: the worker runs tasks[first_task], tasks[first_task+task_stride], ... */
+	const FLAC__FrameHeader *frame_header;
+	const subframe_task *tasks;
+	unsigned num_tasks, first_task, task_stride;
+	unsigned min_partition_order, max_partition_order;
+} encoder_worker;
+
+/* The verify decoder's thread takes the audio frames through a small ring
+ * of copies.  Each slot has an event the calling thread signals when the
+ * frame is in it and one the verify thread signals when it is done with
+ * it, so the two sides pass the slots back and forth in order without a
+ * lock.  A slot with 0 bytes tells the verify thread to stop.
+ */
+#define FLAC__VERIFY_QUEUE_FRAMES 4
+
+typedef struct {
+	FLAC__byte *data;
+	size_t capacity;
+	size_t bytes;
+	unsigned samples; /* in the frame; taken off input_fifo.unverified when the slot comes back */
+	FLAC__StreamEncoderState state; /* the verify result up to and including this frame */
+	FLAC__Event filled;
+	FLAC__Event verified;
+} verify_frame;
+
+typedef struct {
+	FLAC__StreamEncoder *encoder;
+	FLAC__Thread thread;
+	verify_frame frames[FLAC__VERIFY_QUEUE_FRAMES];
+	unsigned next;                  /* the slot the calling thread fills next */
+	FLAC__StreamEncoderState state; /* only touched by the verify thread until it is stopped */
+} verify_thread;
+#endif
+
 static struct CompressionLevels {
 	FLAC__bool do_mid_side_stereo;
 	FLAC__bool loose_mid_side_stereo;
@@ -157,7 +232,24 @@ static void update_metadata_(const FLAC__StreamEncoder *encoder);
 static void update_ogg_metadata_(FLAC__StreamEncoder *encoder);
 #endif
 static FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block);
+static FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block);
 static FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block);
+static FLAC__bool process_subframe_tasks_(FLAC__StreamEncoder *encoder, unsigned min_partition_order, unsigned max_partition_order, const FLAC__FrameHeader *frame_header, const subframe_task tasks[], unsigned num_tasks);
+static FLAC__bool run_subframe_tasks_(FLAC__StreamEncoder *encoder, unsigned min_partition_order, unsigned max_partition_order, const FLAC__FrameHeader *frame_header, const subframe_task tasks[], unsigned num_tasks, unsigned first_task, unsigned task_stride);
+static FLAC__bool start_workers_(FLAC__StreamEncoder *encoder);
+static void stop_workers_(FLAC__StreamEncoder *encoder);
+static FLAC__bool write_queued_frames_(FLAC__StreamEncoder *encoder);
+#ifndef FLAC__NO_THREADS
+static void worker_main_(void *arg);
+static FLAC__StreamEncoder *fork_encoder_(const FLAC__StreamEncoder *encoder);
+static FLAC__bool queue_frame_(FLAC__StreamEncoder *encoder);
+static FLAC__bool write_worker_frame_(FLAC__StreamEncoder *encoder, encoder_worker *worker);
+static void verify_thread_main_(void *arg);
+static void free_verify_thread_(verify_thread *thread, unsigned events);
+static FLAC__bool queue_verify_frame_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples);
+static FLAC__bool start_verify_thread_(FLAC__StreamEncoder *encoder);
+#endif
+static FLAC__StreamEncoderState stop_verify_thread_(FLAC__StreamEncoder *encoder);
 
 static FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
@@ -315,6 +407,7 @@ static FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDec
 static FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void verify_metadata_callback_(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static void set_verify_state_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderState state);
 
 static FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 static FLAC__StreamEncoderSeekStatus file_seek_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -366,6 +459,12 @@ typedef struct FLAC__StreamEncoderPrivate {
 	FLAC__StreamMetadata_SeekTable *seek_table;       /* pointer into encoder->protected_->metadata_ where the seek table is */
 	unsigned current_sample_number;
 	unsigned current_frame_number;
+#ifndef FLAC__NO_THREADS
+	encoder_worker *workers;                          /* frame encoding threads, or 0 if all frames are encoded by the calling thread */
+	unsigned num_workers;
+	unsigned next_worker;                             /* the worker that gets the next full block */
+	unsigned frames_in_flight;                        /* blocks handed to the workers whose frames have not been written yet */
+#endif
 	FLAC__MD5Context md5context;
 	FLAC__CPUInfo cpuinfo;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
@@ -375,10 +474,12 @@ typedef struct FLAC__StreamEncoderPrivate {
 #endif
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	void (*local_lpc_compute_autocorrelation)(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[]);
+	void (*local_lpc_compute_autocorrelation_windows)(const FLAC__int32 data[], FLAC__real * const window[], unsigned num_windows, unsigned data_len, unsigned lag, FLAC__real autoc[][FLAC__MAX_LPC_ORDER+1]); /* 0 to use local_lpc_compute_autocorrelation on one window at a time */
 	void (*local_lpc_compute_residual_from_qlp_coefficients)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 	void (*local_lpc_compute_residual_from_qlp_coefficients_64bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 	void (*local_lpc_compute_residual_from_qlp_coefficients_16bit)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
 #endif
+	unsigned (*local_crc16_update_block)(const FLAC__byte *data, unsigned len, unsigned crc);
 	FLAC__bool use_wide_by_block;          /* use slow 64-bit versions of some functions because of the block size */
 	FLAC__bool use_wide_by_partition;      /* use slow 64-bit versions of some functions because of the min partition order and blocksize */
 	FLAC__bool use_wide_by_order;          /* use slow 64-bit versions of some functions because of the lpc order */
@@ -431,6 +532,9 @@ typedef struct FLAC__StreamEncoderPrivate {
 		FLAC__bool needs_magic_hack;
 		verify_input_fifo input_fifo;
 		verify_output output;
+#ifndef FLAC__NO_THREADS
+		verify_thread *thread;                        /* decodes the audio frames off the calling thread, or 0 */
+#endif
 		struct {
 			FLAC__uint64 absolute_sample;
 			unsigned frame_number;
@@ -515,6 +619,9 @@ FLAC_API const char * const FLAC__StreamEncoderTellStatusString[] = {
  */
 static const unsigned OVERREAD_ = 1;
 
+/* Upper limit for FLAC__stream_encoder_set_num_threads(). */
+#define FLAC__STREAM_ENCODER_MAX_THREADS 64
+
 /***********************************************************************
  *
  * Class constructor/destructor
@@ -901,8 +1008,10 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	/* first default to the non-asm routines */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation;
+	encoder->private_->local_lpc_compute_autocorrelation_windows = FLAC__lpc_compute_autocorrelation_windows;
 #endif
 	encoder->private_->local_fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor;
+	encoder->private_->local_crc16_update_block = FLAC__crc16_update_block;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients;
 	encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide;
@@ -929,6 +1038,8 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32_3dnow;
 		else
 			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia32;
+		/* the asm autocorrelation works on one window at a time */
+		encoder->private_->local_lpc_compute_autocorrelation_windows = 0;
 		if(encoder->private_->cpuinfo.data.ia32.mmx) {
 			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32;
 			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_asm_ia32_mmx;
@@ -944,17 +1055,41 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 #  ifdef FLAC__CPU_IA64
 		FLAC__ASSERT(encoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_IA64);
 #   ifdef FLAC__HAS_NASM
-		if(encoder->protected_->max_lpc_order < 4)
+		if(encoder->protected_->max_lpc_order < 4) {
 			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia64_sse_lag_4;
-		else if(encoder->protected_->max_lpc_order < 8)
+			encoder->private_->local_lpc_compute_autocorrelation_windows = 0;
+		}
+		else if(encoder->protected_->max_lpc_order < 8) {
 			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia64_sse_lag_8;
+			encoder->private_->local_lpc_compute_autocorrelation_windows = 0;
+		}
 		//else if(encoder->protected_->max_lpc_order < 12)
 		//	encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_asm_ia64_sse_lag_12;
 #   endif /* FLAC__HAS_NASM */
+#   ifdef FLAC__SSE4_1_SUPPORTED
+		if(encoder->private_->cpuinfo.data.ia64.sse41) {
+			encoder->private_->local_lpc_compute_autocorrelation_windows = FLAC__lpc_compute_autocorrelation_windows_intrin_sse41;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41;
+		}
+#   endif
+#   ifdef FLAC__AVX2_SUPPORTED
+		if(encoder->private_->cpuinfo.data.ia64.avx2) {
+			encoder->private_->local_lpc_compute_autocorrelation_windows = FLAC__lpc_compute_autocorrelation_windows_intrin_avx2;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2;
+			encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2;
+		}
+#   endif
 #  endif /* FLAC__CPU_IA64 */
 	}
 # endif /* !FLAC__NO_ASM */
 #endif /* !FLAC__INTEGER_ONLY_LIBRARY */
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_IA64 && defined FLAC__PCLMUL_SUPPORTED
+	if(encoder->private_->cpuinfo.use_asm && encoder->private_->cpuinfo.data.ia64.sse41 && encoder->private_->cpuinfo.data.ia64.pclmul)
+		encoder->private_->local_crc16_update_block = FLAC__crc16_update_block_intrin_pclmul;
+#endif
 	/* finally override based on wide-ness if necessary */
 	if(encoder->private_->use_wide_by_block) {
 		encoder->private_->local_fixed_compute_best_predictor = FLAC__fixed_compute_best_predictor_wide;
@@ -988,22 +1123,37 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
 
+	if(!start_workers_(encoder)) {
+		/* the above function sets the state for us in case of an error */
+		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+	}
+
 	/*
 	 * Set up the verify stuff if necessary
 	 */
 	if(encoder->protected_->verify) {
 		/*
 		 * First, set up the fifo which will hold the
-		 * original signal to compare against
+		 * original signal to compare against; the blocks
+		 * still out with the workers and the frames queued
+		 * for the verify thread stay in it too
 		 */
 		encoder->private_->verify.input_fifo.size = encoder->protected_->blocksize+OVERREAD_;
+#ifndef FLAC__NO_THREADS
+		if(!encoder->protected_->subframe_threads)
+			encoder->private_->verify.input_fifo.size += encoder->protected_->blocksize * encoder->private_->num_workers;
+		if(start_verify_thread_(encoder))
+			encoder->private_->verify.input_fifo.size += encoder->protected_->blocksize * FLAC__VERIFY_QUEUE_FRAMES;
+#endif
 		for(i = 0; i < encoder->protected_->channels; i++) {
 			if(0 == (encoder->private_->verify.input_fifo.data[i] = (FLAC__int32*)safe_malloc_mul_2op_(sizeof(FLAC__int32), /*times*/encoder->private_->verify.input_fifo.size))) {
 				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
 				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 			}
 		}
+		encoder->private_->verify.input_fifo.head = 0;
 		encoder->private_->verify.input_fifo.tail = 0;
+		encoder->private_->verify.input_fifo.unverified = 0;
 
 		/*
 		 * Now set up a stream decoder for verification
@@ -1067,8 +1217,10 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.data.stream_info.bits_per_sample = encoder->protected_->bits_per_sample;
 	encoder->private_->streaminfo.data.stream_info.total_samples = encoder->protected_->total_samples_estimate; /* we will replace this later with the real total */
 	memset(encoder->private_->streaminfo.data.stream_info.md5sum, 0, 16); /* we don't know this yet; have to fill it in later */
-	if(encoder->protected_->do_md5)
+	if(encoder->protected_->do_md5) {
 		FLAC__MD5Init(&encoder->private_->md5context);
+		FLAC__MD5UseThread(&encoder->private_->md5context, encoder->protected_->num_threads > 1);
+	}
 	if(!FLAC__add_metadata_block(&encoder->private_->streaminfo, encoder->private_->frame)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
@@ -1329,12 +1481,23 @@ FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
 		return true;
 
 	if(encoder->protected_->state == FLAC__STREAM_ENCODER_OK && !encoder->private_->is_being_deleted) {
-		if(encoder->private_->current_sample_number != 0) {
+		/* the frames still being encoded by the workers come before the last block */
+		if(!write_queued_frames_(encoder))
+			error = true;
+		else if(encoder->private_->current_sample_number != 0) {
 			const FLAC__bool is_fractional_block = encoder->protected_->blocksize != encoder->private_->current_sample_number;
 			encoder->protected_->blocksize = encoder->private_->current_sample_number;
 			if(!process_frame_(encoder, is_fractional_block, /*is_last_block=*/true))
 				error = true;
 		}
+		/* wait for the verify thread to get through the frames still queued for it */
+		if(!error && encoder->protected_->verify) {
+			const FLAC__StreamEncoderState verify_state = stop_verify_thread_(encoder);
+			if(verify_state != FLAC__STREAM_ENCODER_OK) {
+				encoder->protected_->state = verify_state;
+				error = true;
+			}
+		}
 	}
 
 	if(encoder->protected_->do_md5)
@@ -1717,6 +1880,35 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_rice_parameter_search_dist(FLAC__St
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__NO_THREADS
+	if(value > 1)
+		return false;
+#else
+	if(value > FLAC__STREAM_ENCODER_MAX_THREADS)
+		return false;
+#endif
+	encoder->protected_->num_threads = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_set_subframe_threads(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->subframe_threads = value;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_set_total_samples_estimate(FLAC__StreamEncoder *encoder, FLAC__uint64 value)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -1982,6 +2174,22 @@ FLAC_API unsigned FLAC__stream_encoder_get_rice_parameter_search_dist(const FLAC
 	return encoder->protected_->rice_parameter_search_dist;
 }
 
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->num_threads;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_subframe_threads(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->subframe_threads;
+}
+
 FLAC_API FLAC__uint64 FLAC__stream_encoder_get_total_samples_estimate(const FLAC__StreamEncoder *encoder)
 {
 	FLAC__ASSERT(0 != encoder);
@@ -2160,6 +2368,8 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 	encoder->protected_->min_residual_partition_order = 0;
 	encoder->protected_->max_residual_partition_order = 0;
 	encoder->protected_->rice_parameter_search_dist = 0;
+	encoder->protected_->num_threads = 1;
+	encoder->protected_->subframe_threads = false;
 	encoder->protected_->total_samples_estimate = 0;
 	encoder->protected_->metadata = 0;
 	encoder->protected_->num_metadata_blocks = 0;
@@ -2189,6 +2399,7 @@ void free_(FLAC__StreamEncoder *encoder)
 	unsigned i, channel;
 
 	FLAC__ASSERT(0 != encoder);
+	stop_workers_(encoder);
 	if(encoder->protected_->metadata) {
 		free(encoder->protected_->metadata);
 		encoder->protected_->metadata = 0;
@@ -2255,6 +2466,7 @@ void free_(FLAC__StreamEncoder *encoder)
 		encoder->private_->raw_bits_per_partition_unaligned = 0;
 	}
 	if(encoder->protected_->verify) {
+		(void)stop_verify_thread_(encoder);
 		for(i = 0; i < encoder->protected_->channels; i++) {
 			if(0 != encoder->private_->verify.input_fifo.data[i]) {
 				free(encoder->private_->verify.input_fifo.data[i]);
@@ -2411,6 +2623,18 @@ FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, unsigned samples, FLAC
 		return false;
 	}
 
+#ifndef FLAC__NO_THREADS
+	/* the magic and the metadata are always verified here, before any audio frame is queued */
+	if(encoder->protected_->verify && 0 != encoder->private_->verify.thread && encoder->private_->verify.state_hint == ENCODER_IN_AUDIO) {
+		if(!queue_verify_frame_(encoder, buffer, bytes, samples)) {
+			/* the above function sets the state for us in case of an error */
+			FLAC__bitwriter_release_buffer(encoder->private_->frame);
+			FLAC__bitwriter_clear(encoder->private_->frame);
+			return false;
+		}
+	}
+	else
+#endif
 	if(encoder->protected_->verify) {
 		encoder->private_->verify.output.data = buffer;
 		encoder->private_->verify.output.bytes = bytes;
@@ -2883,7 +3107,6 @@ void update_ogg_metadata_(FLAC__StreamEncoder *encoder)
 
 FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block)
 {
-	FLAC__uint16 crc;
 	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
 
 	/*
@@ -2894,9 +3117,53 @@ FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional
 		return false;
 	}
 
+#ifndef FLAC__NO_THREADS
+	/*
+	 * With worker threads, full blocks are handed to the next worker;
+	 * the last block is always encoded here after the queue is drained
+	 */
+	if(encoder->private_->num_workers > 0 && !encoder->protected_->subframe_threads && !is_last_block) {
+		FLAC__ASSERT(!is_fractional_block);
+		return queue_frame_(encoder);
+	}
+#endif
+
 	/*
 	 * Process the frame header and subframes into the frame bitbuffer
 	 */
+	if(!encode_frame_(encoder, is_fractional_block)) {
+		/* the above function sets the state for us in case of an error */
+		return false;
+	}
+
+	/*
+	 * Write it
+	 */
+	if(!write_bitbuffer_(encoder, encoder->protected_->blocksize, is_last_block)) {
+		/* the above function sets the state for us in case of an error */
+		return false;
+	}
+
+	/*
+	 * Get ready for the next frame
+	 */
+	encoder->private_->current_sample_number = 0;
+	encoder->private_->current_frame_number++;
+	encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)encoder->protected_->blocksize;
+
+	return true;
+}
+
+/* Encodes the current block into encoder->private_->frame: the frame
+ * header and subframes, the padding and the CRC.  This is all a worker
+ * thread does with a block, so it only uses the encoder's own buffers.
+ */
+FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block)
+{
+	const FLAC__byte *buffer;
+	size_t bytes;
+	FLAC__uint16 crc;
+
 	if(!process_subframes_(encoder, is_fractional_block)) {
 		/* the above function sets the state for us in case of an error */
 		return false;
@@ -2914,36 +3181,432 @@ FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional
 	 * CRC-16 the whole thing
 	 */
 	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(encoder->private_->frame));
-	if(
-		!FLAC__bitwriter_get_write_crc16(encoder->private_->frame, &crc) ||
-		!FLAC__bitwriter_write_raw_uint32(encoder->private_->frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)
-	) {
+	if(!FLAC__bitwriter_get_buffer(encoder->private_->frame, &buffer, &bytes)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	crc = (FLAC__uint16)encoder->private_->local_crc16_update_block(buffer, (unsigned)bytes, 0);
+	FLAC__bitwriter_release_buffer(encoder->private_->frame);
+	if(!FLAC__bitwriter_write_raw_uint32(encoder->private_->frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
 		return false;
 	}
 
+	return true;
+}
+
+#ifndef FLAC__NO_THREADS
+void worker_main_(void *arg)
+{
+	encoder_worker *worker = (encoder_worker*)arg;
+
+	for(;;) {
+		FLAC__event_wait(&worker->go);
+		if(worker->quit)
+			break;
+		if(0 != worker->tasks)
+			worker->ok = run_subframe_tasks_(worker->encoder, worker->min_partition_order, worker->max_partition_order, worker->frame_header, worker->tasks, worker->num_tasks, worker->first_task, worker->task_stride);
+		else
+			worker->ok = encode_frame_(worker->encoder, /*is_fractional_block=*/false);
+		FLAC__event_signal(&worker->done);
+	}
+}
+
+/* Makes a copy of an initialized encoder that can encode full blocks on
+ * its own: same settings and function pointers, separate buffers, and no
+ * callbacks, metadata, MD5 or verify.
+ */
+FLAC__StreamEncoder *fork_encoder_(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__StreamEncoder *fork = FLAC__stream_encoder_new();
+
+	if(0 == fork)
+		return 0;
+
+	*fork->protected_ = *encoder->protected_;
+	fork->protected_->verify = false;
+	fork->protected_->do_md5 = false;
+	fork->protected_->num_threads = 1;
+	fork->protected_->metadata = 0;
+	fork->protected_->num_metadata_blocks = 0;
+
+	fork->private_->disable_asm = encoder->private_->disable_asm;
+	fork->private_->cpuinfo = encoder->private_->cpuinfo;
+	fork->private_->local_fixed_compute_best_predictor = encoder->private_->local_fixed_compute_best_predictor;
+	fork->private_->local_crc16_update_block = encoder->private_->local_crc16_update_block;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	fork->private_->local_lpc_compute_autocorrelation = encoder->private_->local_lpc_compute_autocorrelation;
+	fork->private_->local_lpc_compute_autocorrelation_windows = encoder->private_->local_lpc_compute_autocorrelation_windows;
+	fork->private_->local_lpc_compute_residual_from_qlp_coefficients = encoder->private_->local_lpc_compute_residual_from_qlp_coefficients;
+	fork->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit = encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_64bit;
+	fork->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit;
+#endif
+	fork->private_->use_wide_by_block = encoder->private_->use_wide_by_block;
+	fork->private_->use_wide_by_partition = encoder->private_->use_wide_by_partition;
+	fork->private_->use_wide_by_order = encoder->private_->use_wide_by_order;
+	fork->private_->disable_constant_subframes = encoder->private_->disable_constant_subframes;
+	fork->private_->disable_fixed_subframes = encoder->private_->disable_fixed_subframes;
+	fork->private_->disable_verbatim_subframes = encoder->private_->disable_verbatim_subframes;
+
+	if(!resize_buffers_(fork, encoder->protected_->blocksize) || !FLAC__bitwriter_init(fork->private_->frame)) {
+		FLAC__stream_encoder_delete(fork);
+		return 0;
+	}
+
+	return fork;
+}
+
+/* Hands the current full block to the next worker.  The workers take
+ * turns, so if that one is still busy it has the oldest block in the
+ * queue and its frame is written first.  The MD5 has already been
+ * updated by process_frame_(); the frame number, the STREAMINFO
+ * statistics and the seek points are updated as each frame is written,
+ * in order, by write_worker_frame_().
+ */
+FLAC__bool queue_frame_(FLAC__StreamEncoder *encoder)
+{
+	encoder_worker *worker = &encoder->private_->workers[encoder->private_->next_worker];
+	FLAC__StreamEncoderPrivate *worker_private = worker->encoder->private_;
+	const unsigned blocksize = encoder->protected_->blocksize;
+	FLAC__int32 *signal;
+	unsigned channel;
+
+	if(worker->busy && !write_worker_frame_(encoder, worker))
+		return false;
+
 	/*
-	 * Write it
+	 * Trade signal buffers with the worker instead of copying the block.
+	 * The caller moves the overread sample to the front of our arrays
+	 * when we return, so it has to come along.
 	 */
-	if(!write_bitbuffer_(encoder, encoder->protected_->blocksize, is_last_block)) {
+	for(channel = 0; channel < encoder->protected_->channels; channel++) {
+		signal = worker_private->integer_signal[channel];
+		worker_private->integer_signal[channel] = encoder->private_->integer_signal[channel];
+		encoder->private_->integer_signal[channel] = signal;
+		signal = worker_private->integer_signal_unaligned[channel];
+		worker_private->integer_signal_unaligned[channel] = encoder->private_->integer_signal_unaligned[channel];
+		encoder->private_->integer_signal_unaligned[channel] = signal;
+		encoder->private_->integer_signal[channel][blocksize] = worker_private->integer_signal[channel][blocksize];
+	}
+	if(encoder->protected_->do_mid_side_stereo) {
+		for(channel = 0; channel < 2; channel++) {
+			signal = worker_private->integer_signal_mid_side[channel];
+			worker_private->integer_signal_mid_side[channel] = encoder->private_->integer_signal_mid_side[channel];
+			encoder->private_->integer_signal_mid_side[channel] = signal;
+			signal = worker_private->integer_signal_mid_side_unaligned[channel];
+			worker_private->integer_signal_mid_side_unaligned[channel] = encoder->private_->integer_signal_mid_side_unaligned[channel];
+			encoder->private_->integer_signal_mid_side_unaligned[channel] = signal;
+			encoder->private_->integer_signal_mid_side[channel][blocksize] = worker_private->integer_signal_mid_side[channel][blocksize];
+		}
+	}
+
+	worker_private->current_frame_number = encoder->private_->current_frame_number + encoder->private_->frames_in_flight;
+	worker->busy = true;
+	FLAC__event_signal(&worker->go);
+
+	encoder->private_->frames_in_flight++;
+	encoder->private_->next_worker = (encoder->private_->next_worker + 1) % encoder->private_->num_workers;
+	encoder->private_->current_sample_number = 0;
+
+	return true;
+}
+
+/* Waits for the worker to finish its block and writes the frame out just
+ * as process_frame_() would have.
+ */
+FLAC__bool write_worker_frame_(FLAC__StreamEncoder *encoder, encoder_worker *worker)
+{
+	FLAC__BitWriter *frame;
+
+	FLAC__ASSERT(worker->busy);
+	FLAC__ASSERT(encoder->private_->frames_in_flight > 0);
+
+	FLAC__event_wait(&worker->done);
+	worker->busy = false;
+	encoder->private_->frames_in_flight--;
+
+	if(!worker->ok) {
+		encoder->protected_->state = worker->encoder->protected_->state;
+		return false;
+	}
+
+	/* the finished frame becomes the one write_bitbuffer_() writes, and the worker gets our empty one */
+	frame = encoder->private_->frame;
+	encoder->private_->frame = worker->encoder->private_->frame;
+	worker->encoder->private_->frame = frame;
+
+	if(!write_bitbuffer_(encoder, encoder->protected_->blocksize, /*is_last_block=*/false)) {
 		/* the above function sets the state for us in case of an error */
 		return false;
 	}
 
-	/*
-	 * Get ready for the next frame
-	 */
-	encoder->private_->current_sample_number = 0;
 	encoder->private_->current_frame_number++;
 	encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)encoder->protected_->blocksize;
 
 	return true;
 }
+#endif
+
+/* Starts the frame encoding threads if more than one thread was asked for.
+ * Loose mid-side stereo picks the channel assignment from the frames before
+ * it, so in frame mode it is always encoded on the calling thread.  In
+ * subframe mode the calling thread is one of the threads, and there is no
+ * use for more threads than subframe searches in a frame.
+ */
+FLAC__bool start_workers_(FLAC__StreamEncoder *encoder)
+{
+#ifndef FLAC__NO_THREADS
+	unsigned i, num_workers;
+
+	encoder->private_->workers = 0;
+	encoder->private_->num_workers = 0;
+	encoder->private_->next_worker = 0;
+	encoder->private_->frames_in_flight = 0;
+
+	if(encoder->protected_->num_threads <= 1)
+		return true;
+
+	if(encoder->protected_->subframe_threads) {
+		const unsigned num_tasks = encoder->protected_->channels + (encoder->protected_->do_mid_side_stereo? 2 : 0);
+		num_workers = min(encoder->protected_->num_threads, num_tasks) - 1;
+	}
+	else if(encoder->protected_->do_mid_side_stereo && encoder->protected_->loose_mid_side_stereo)
+		num_workers = 0;
+	else
+		num_workers = encoder->protected_->num_threads;
+
+	if(num_workers == 0)
+		return true;
+
+	if(0 == (encoder->private_->workers = (encoder_worker*)safe_calloc_(num_workers, sizeof(encoder_worker)))) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+	encoder->private_->num_workers = num_workers;
+
+	for(i = 0; i < encoder->private_->num_workers; i++) {
+		encoder_worker *worker = &encoder->private_->workers[i];
+		if(0 == (worker->encoder = fork_encoder_(encoder)) || !FLAC__event_init(&worker->go)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!FLAC__event_init(&worker->done)) {
+			FLAC__event_free(&worker->go);
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		if(!FLAC__thread_create(&worker->thread, worker_main_, worker)) {
+			FLAC__event_free(&worker->go);
+			FLAC__event_free(&worker->done);
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		worker->started = true;
+	}
+#else
+	(void)encoder;
+#endif
+	return true;
+}
+
+void stop_workers_(FLAC__StreamEncoder *encoder)
+{
+#ifndef FLAC__NO_THREADS
+	unsigned i;
+
+	if(0 == encoder->private_->workers)
+		return;
+
+	for(i = 0; i < encoder->private_->num_workers; i++) {
+		encoder_worker *worker = &encoder->private_->workers[i];
+		if(worker->started) {
+			/* let a worker still encoding a block finish it (its frame is dropped) before telling it to quit */
+			if(worker->busy) {
+				FLAC__event_wait(&worker->done);
+				worker->busy = false;
+			}
+			worker->quit = true;
+			FLAC__event_signal(&worker->go);
+			FLAC__thread_join(&worker->thread);
+			FLAC__event_free(&worker->go);
+			FLAC__event_free(&worker->done);
+		}
+		if(0 != worker->encoder)
+			FLAC__stream_encoder_delete(worker->encoder);
+	}
+	free(encoder->private_->workers);
+	encoder->private_->workers = 0;
+	encoder->private_->num_workers = 0;
+	encoder->private_->frames_in_flight = 0;
+#else
+	(void)encoder;
+#endif
+}
+
+/* Writes the frames of all the blocks still out with the workers, oldest first. */
+FLAC__bool write_queued_frames_(FLAC__StreamEncoder *encoder)
+{
+#ifndef FLAC__NO_THREADS
+	while(encoder->private_->frames_in_flight > 0) {
+		const unsigned oldest = (encoder->private_->next_worker + encoder->private_->num_workers - encoder->private_->frames_in_flight) % encoder->private_->num_workers;
+		if(!write_worker_frame_(encoder, &encoder->private_->workers[oldest]))
+			return false;
+	}
+#else
+	(void)encoder;
+#endif
+	return true;
+}
+
+#ifndef FLAC__NO_THREADS
+void verify_thread_main_(void *arg)
+{
+	verify_thread *thread = (verify_thread*)arg;
+	FLAC__StreamEncoderPrivate *private_ = thread->encoder->private_;
+	unsigned i = 0;
+
+	for(;;) {
+		verify_frame *frame = &thread->frames[i];
+		FLAC__event_wait(&frame->filled);
+		if(frame->bytes == 0)
+			break;
+		/* after a failure the rest of the frames are just handed back */
+		if(thread->state == FLAC__STREAM_ENCODER_OK) {
+			private_->verify.output.data = frame->data;
+			private_->verify.output.bytes = (unsigned)frame->bytes;
+			if(!FLAC__stream_decoder_process_single(private_->verify.decoder) && thread->state == FLAC__STREAM_ENCODER_OK)
+				thread->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+		}
+		frame->state = thread->state;
+		FLAC__event_signal(&frame->verified);
+		i = (i + 1) % FLAC__VERIFY_QUEUE_FRAMES;
+	}
+}
+
+void free_verify_thread_(verify_thread *thread, unsigned events)
+{
+	unsigned i;
+
+	for(i = 0; i < FLAC__VERIFY_QUEUE_FRAMES; i++) {
+		if(i < events) {
+			FLAC__event_free(&thread->frames[i].filled);
+			FLAC__event_free(&thread->frames[i].verified);
+		}
+		if(0 != thread->frames[i].data)
+			free(thread->frames[i].data);
+	}
+	free(thread);
+}
+
+/* Starts the verify decoder's thread if more than one thread was asked
+ * for.  If it can't be started the frames are just verified in line by
+ * write_bitbuffer_(), so this only says whether there is a thread.
+ */
+FLAC__bool start_verify_thread_(FLAC__StreamEncoder *encoder)
+{
+	verify_thread *thread;
+	unsigned i;
+
+	encoder->private_->verify.thread = 0;
+
+	if(encoder->protected_->num_threads <= 1)
+		return false;
+
+	if(0 == (thread = (verify_thread*)safe_calloc_(1, sizeof(verify_thread))))
+		return false;
+	thread->encoder = encoder;
+	thread->state = FLAC__STREAM_ENCODER_OK;
+	for(i = 0; i < FLAC__VERIFY_QUEUE_FRAMES; i++) {
+		if(!FLAC__event_init(&thread->frames[i].filled))
+			break;
+		if(!FLAC__event_init(&thread->frames[i].verified)) {
+			FLAC__event_free(&thread->frames[i].filled);
+			break;
+		}
+		FLAC__event_signal(&thread->frames[i].verified); /* every slot starts out free */
+	}
+	if(i < FLAC__VERIFY_QUEUE_FRAMES || !FLAC__thread_create(&thread->thread, verify_thread_main_, thread)) {
+		free_verify_thread_(thread, i);
+		return false;
+	}
+
+	encoder->private_->verify.thread = thread;
+	return true;
+}
+
+/* Copies the frame into the next slot for the verify thread.  Waiting for
+ * the slot is also where a mismatch found in an earlier frame turns up, and
+ * where the calling thread learns that the frame last in it was verified.
+ */
+FLAC__bool queue_verify_frame_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples)
+{
+	verify_thread *thread = encoder->private_->verify.thread;
+	verify_frame *frame = &thread->frames[thread->next];
+
+	FLAC__ASSERT(bytes > 0);
+
+	FLAC__event_wait(&frame->verified);
+	if(frame->state != FLAC__STREAM_ENCODER_OK) {
+		encoder->protected_->state = frame->state;
+		FLAC__event_signal(&frame->verified); /* the slot is still free */
+		return false;
+	}
+	FLAC__ASSERT(frame->samples <= encoder->private_->verify.input_fifo.unverified);
+	encoder->private_->verify.input_fifo.unverified -= frame->samples;
+	frame->samples = 0;
+	if(frame->capacity < bytes) {
+		FLAC__byte *tmp = (FLAC__byte*)realloc(frame->data, bytes);
+		if(0 == tmp) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			FLAC__event_signal(&frame->verified);
+			return false;
+		}
+		frame->data = tmp;
+		frame->capacity = bytes;
+	}
+	memcpy(frame->data, buffer, bytes);
+	frame->bytes = bytes;
+	frame->samples = samples;
+	FLAC__event_signal(&frame->filled);
+	thread->next = (thread->next + 1) % FLAC__VERIFY_QUEUE_FRAMES;
+
+	return true;
+}
+#endif
+
+/* Waits for the verify thread to get through everything queued, stops it,
+ * and returns how verification went (FLAC__STREAM_ENCODER_OK if there is
+ * no thread).
+ */
+FLAC__StreamEncoderState stop_verify_thread_(FLAC__StreamEncoder *encoder)
+{
+	FLAC__StreamEncoderState state = FLAC__STREAM_ENCODER_OK;
+#ifndef FLAC__NO_THREADS
+	verify_thread *thread = encoder->private_->verify.thread;
+	verify_frame *frame;
+
+	if(0 == thread)
+		return state;
+
+	frame = &thread->frames[thread->next];
+	FLAC__event_wait(&frame->verified);
+	frame->bytes = 0;
+	FLAC__event_signal(&frame->filled);
+	FLAC__thread_join(&thread->thread);
+	state = thread->state;
+	free_verify_thread_(thread, FLAC__VERIFY_QUEUE_FRAMES);
+	encoder->private_->verify.thread = 0;
+#else
+	(void)encoder;
+#endif
+	return state;
+}
 
 FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block)
 {
 	FLAC__FrameHeader frame_header;
-	unsigned channel, min_partition_order = encoder->protected_->min_residual_partition_order, max_partition_order;
+	subframe_task tasks[FLAC__MAX_CHANNELS+2];
+	unsigned channel, num_tasks, min_partition_order = encoder->protected_->min_residual_partition_order, max_partition_order;
 	FLAC__bool do_independent, do_mid_side;
 
 	/*
@@ -3017,24 +3680,17 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	/*
 	 * First do a normal encoding pass of each independent channel
 	 */
+	num_tasks = 0;
 	if(do_independent) {
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			if(!
-				process_subframe_(
-					encoder,
-					min_partition_order,
-					max_partition_order,
-					&frame_header,
-					encoder->private_->subframe_bps[channel],
-					encoder->private_->integer_signal[channel],
-					encoder->private_->subframe_workspace_ptr[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr[channel],
-					encoder->private_->residual_workspace[channel],
-					encoder->private_->best_subframe+channel,
-					encoder->private_->best_subframe_bits+channel
-				)
-			)
-				return false;
+			subframe_task *task = &tasks[num_tasks++];
+			task->subframe_bps = encoder->private_->subframe_bps[channel];
+			task->integer_signal = encoder->private_->integer_signal[channel];
+			task->subframe = encoder->private_->subframe_workspace_ptr[channel];
+			task->partitioned_rice_contents = encoder->private_->partitioned_rice_contents_workspace_ptr[channel];
+			task->residual = encoder->private_->residual_workspace[channel];
+			task->best_subframe = encoder->private_->best_subframe+channel;
+			task->best_bits = encoder->private_->best_subframe_bits+channel;
 		}
 	}
 
@@ -3045,25 +3701,22 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 		FLAC__ASSERT(encoder->protected_->channels == 2);
 
 		for(channel = 0; channel < 2; channel++) {
-			if(!
-				process_subframe_(
-					encoder,
-					min_partition_order,
-					max_partition_order,
-					&frame_header,
-					encoder->private_->subframe_bps_mid_side[channel],
-					encoder->private_->integer_signal_mid_side[channel],
-					encoder->private_->subframe_workspace_ptr_mid_side[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[channel],
-					encoder->private_->residual_workspace_mid_side[channel],
-					encoder->private_->best_subframe_mid_side+channel,
-					encoder->private_->best_subframe_bits_mid_side+channel
-				)
-			)
-				return false;
+			subframe_task *task = &tasks[num_tasks++];
+			task->subframe_bps = encoder->private_->subframe_bps_mid_side[channel];
+			task->integer_signal = encoder->private_->integer_signal_mid_side[channel];
+			task->subframe = encoder->private_->subframe_workspace_ptr_mid_side[channel];
+			task->partitioned_rice_contents = encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[channel];
+			task->residual = encoder->private_->residual_workspace_mid_side[channel];
+			task->best_subframe = encoder->private_->best_subframe_mid_side+channel;
+			task->best_bits = encoder->private_->best_subframe_bits_mid_side+channel;
 		}
 	}
 
+	if(!process_subframe_tasks_(encoder, min_partition_order, max_partition_order, &frame_header, tasks, num_tasks)) {
+		/* the above function sets the state for us in case of an error */
+		return false;
+	}
+
 	/*
 	 * Compose the frame bitbuffer
 	 */
@@ -3184,6 +3837,78 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	return true;
 }
 
+/* Runs the subframe searches of the frame.  In subframe mode they are
+ * spread over the calling thread and the workers: the calling thread
+ * takes task 0 and every (num_workers+1)th task after it, and worker i
+ * does the same starting from task i+1.
+ */
+FLAC__bool process_subframe_tasks_(FLAC__StreamEncoder *encoder, unsigned min_partition_order, unsigned max_partition_order, const FLAC__FrameHeader *frame_header, const subframe_task tasks[], unsigned num_tasks)
+{
+	FLAC__ASSERT(num_tasks > 0);
+
+#ifndef FLAC__NO_THREADS
+	if(encoder->protected_->subframe_threads && encoder->private_->num_workers > 0) {
+		const unsigned task_stride = encoder->private_->num_workers + 1;
+		const unsigned num_busy = min(encoder->private_->num_workers, num_tasks - 1);
+		FLAC__bool ok;
+		unsigned i;
+
+		for(i = 0; i < num_busy; i++) {
+			encoder_worker *worker = &encoder->private_->workers[i];
+			worker->frame_header = frame_header;
+			worker->tasks = tasks;
+			worker->num_tasks = num_tasks;
+			worker->first_task = i + 1;
+			worker->task_stride = task_stride;
+			worker->min_partition_order = min_partition_order;
+			worker->max_partition_order = max_partition_order;
+			FLAC__event_signal(&worker->go);
+		}
+
+		ok = run_subframe_tasks_(encoder, min_partition_order, max_partition_order, frame_header, tasks, num_tasks, 0, task_stride);
+
+		/* the tasks point into our workspaces, so every worker has to be done before we go on, even after an error */
+		for(i = 0; i < num_busy; i++) {
+			encoder_worker *worker = &encoder->private_->workers[i];
+			FLAC__event_wait(&worker->done);
+			if(ok && !worker->ok) {
+				encoder->protected_->state = worker->encoder->protected_->state;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+#endif
+
+	return run_subframe_tasks_(encoder, min_partition_order, max_partition_order, frame_header, tasks, num_tasks, 0, 1);
+}
+
+FLAC__bool run_subframe_tasks_(FLAC__StreamEncoder *encoder, unsigned min_partition_order, unsigned max_partition_order, const FLAC__FrameHeader *frame_header, const subframe_task tasks[], unsigned num_tasks, unsigned first_task, unsigned task_stride)
+{
+	unsigned i;
+
+	for(i = first_task; i < num_tasks; i += task_stride) {
+		if(!
+			process_subframe_(
+				encoder,
+				min_partition_order,
+				max_partition_order,
+				frame_header,
+				tasks[i].subframe_bps,
+				tasks[i].integer_signal,
+				tasks[i].subframe,
+				tasks[i].partitioned_rice_contents,
+				tasks[i].residual,
+				tasks[i].best_subframe,
+				tasks[i].best_bits
+			)
+		)
+			return false;
+	}
+
+	return true;
+}
+
 FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
 	unsigned min_partition_order,
@@ -3205,7 +3930,7 @@ FLAC__bool process_subframe_(
 #endif
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	FLAC__double lpc_residual_bits_per_sample;
-	FLAC__real autoc[FLAC__MAX_LPC_ORDER+1]; /* WATCHOUT: the size is important even though encoder->protected_->max_lpc_order might be less; some asm routines need all the space */
+	FLAC__real autoc[FLAC__MAX_APODIZATION_FUNCTIONS][FLAC__MAX_LPC_ORDER+1]; /* WATCHOUT: the size is important even though encoder->protected_->max_lpc_order might be less; some asm routines need all the space */
 	FLAC__double lpc_error[FLAC__MAX_LPC_ORDER];
 	unsigned min_lpc_order, max_lpc_order, lpc_order;
 	unsigned min_qlp_coeff_precision, max_qlp_coeff_precision, qlp_coeff_precision;
@@ -3319,12 +4044,19 @@ FLAC__bool process_subframe_(
 					max_lpc_order = encoder->protected_->max_lpc_order;
 				if(max_lpc_order > 0) {
 					unsigned a;
+					/* the autocorrelation for every window first, in one pass over the signal when possible */
+					if(0 != encoder->private_->local_lpc_compute_autocorrelation_windows)
+						encoder->private_->local_lpc_compute_autocorrelation_windows(integer_signal, encoder->private_->window, encoder->protected_->num_apodizations, frame_header->blocksize, max_lpc_order+1, autoc);
+					else {
+						for (a = 0; a < encoder->protected_->num_apodizations; a++) {
+							FLAC__lpc_window_data(integer_signal, encoder->private_->window[a], encoder->private_->windowed_signal, frame_header->blocksize);
+							encoder->private_->local_lpc_compute_autocorrelation(encoder->private_->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc[a]);
+						}
+					}
 					for (a = 0; a < encoder->protected_->num_apodizations; a++) {
-						FLAC__lpc_window_data(integer_signal, encoder->private_->window[a], encoder->private_->windowed_signal, frame_header->blocksize);
-						encoder->private_->local_lpc_compute_autocorrelation(encoder->private_->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc);
 						/* if autoc[0] == 0.0, the signal is constant and we usually won't get here, but it can happen */
-						if(autoc[0] != 0.0) {
-							FLAC__lpc_compute_lp_coefficients(autoc, &max_lpc_order, encoder->private_->lp_coeff, lpc_error);
+						if(autoc[a][0] != 0.0) {
+							FLAC__lpc_compute_lp_coefficients(autoc[a], &max_lpc_order, encoder->private_->lp_coeff, lpc_error);
 							if(encoder->protected_->do_exhaustive_model_search) {
 								min_lpc_order = 1;
 							}
@@ -4154,14 +4886,22 @@ unsigned get_wasted_bits_(FLAC__int32 signal[], unsigned samples)
 
 void append_to_verify_fifo_(verify_input_fifo *fifo, const FLAC__int32 * const input[], unsigned input_offset, unsigned channels, unsigned wide_samples)
 {
+	/* the part up to the end of the ring, then the rest from the start */
+	const unsigned first = min(wide_samples, fifo->size - fifo->tail);
 	unsigned channel;
 
-	for(channel = 0; channel < channels; channel++)
-		memcpy(&fifo->data[channel][fifo->tail], &input[channel][input_offset], sizeof(FLAC__int32) * wide_samples);
+	/* what isn't verified yet must never be overwritten */
+	FLAC__ASSERT(fifo->unverified + wide_samples <= fifo->size);
+	fifo->unverified += wide_samples;
 
-	fifo->tail += wide_samples;
+	for(channel = 0; channel < channels; channel++) {
+		memcpy(&fifo->data[channel][fifo->tail], &input[channel][input_offset], sizeof(FLAC__int32) * first);
+		memcpy(&fifo->data[channel][0], &input[channel][input_offset + first], sizeof(FLAC__int32) * (wide_samples - first));
+	}
 
-	FLAC__ASSERT(fifo->tail <= fifo->size);
+	fifo->tail += wide_samples;
+	if(fifo->tail >= fifo->size)
+		fifo->tail -= fifo->size;
 }
 
 void append_to_verify_fifo_interleaved_(verify_input_fifo *fifo, const FLAC__int32 input[], unsigned input_offset, unsigned channels, unsigned wide_samples)
@@ -4170,15 +4910,18 @@ void append_to_verify_fifo_interleaved_(verify_input_fifo *fifo, const FLAC__int
 	unsigned sample, wide_sample;
 	unsigned tail = fifo->tail;
 
+	/* what isn't verified yet must never be overwritten */
+	FLAC__ASSERT(fifo->unverified + wide_samples <= fifo->size);
+	fifo->unverified += wide_samples;
+
 	sample = input_offset * channels;
 	for(wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
 		for(channel = 0; channel < channels; channel++)
 			fifo->data[channel][tail] = input[sample++];
-		tail++;
+		if(++tail == fifo->size)
+			tail = 0;
 	}
 	fifo->tail = tail;
-
-	FLAC__ASSERT(fifo->tail <= fifo->size);
 }
 
 FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
@@ -4218,19 +4961,24 @@ FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder
 	unsigned channel;
 	const unsigned channels = frame->header.channels;
 	const unsigned blocksize = frame->header.blocksize;
-	const unsigned bytes_per_block = sizeof(FLAC__int32) * blocksize;
+	verify_input_fifo *fifo = &encoder->private_->verify.input_fifo;
+	/* the part of the block up to the end of the ring; the rest is at the start */
+	const unsigned first = min(blocksize, fifo->size - fifo->head);
 
 	(void)decoder;
 
+	FLAC__ASSERT(blocksize <= fifo->size);
+
 	for(channel = 0; channel < channels; channel++) {
-		if(0 != memcmp(buffer[channel], encoder->private_->verify.input_fifo.data[channel], bytes_per_block)) {
+		if(0 != memcmp(buffer[channel], &fifo->data[channel][fifo->head], sizeof(FLAC__int32) * first) || 0 != memcmp(buffer[channel] + first, &fifo->data[channel][0], sizeof(FLAC__int32) * (blocksize - first))) {
 			unsigned i, sample = 0;
 			FLAC__int32 expect = 0, got = 0;
 
 			for(i = 0; i < blocksize; i++) {
-				if(buffer[channel][i] != encoder->private_->verify.input_fifo.data[channel][i]) {
+				const FLAC__int32 expected = fifo->data[channel][i < first? fifo->head + i : i - first];
+				if(buffer[channel][i] != expected) {
 					sample = i;
-					expect = (FLAC__int32)encoder->private_->verify.input_fifo.data[channel][i];
+					expect = expected;
 					got = (FLAC__int32)buffer[channel][i];
 					break;
 				}
@@ -4243,15 +4991,18 @@ FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder
 			encoder->private_->verify.error_stats.sample = sample;
 			encoder->private_->verify.error_stats.expected = expect;
 			encoder->private_->verify.error_stats.got = got;
-			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA;
+			set_verify_state_(encoder, FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA);
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
 	}
-	/* dequeue the frame from the fifo */
-	encoder->private_->verify.input_fifo.tail -= blocksize;
-	FLAC__ASSERT(encoder->private_->verify.input_fifo.tail <= OVERREAD_);
-	for(channel = 0; channel < channels; channel++)
-		memmove(&encoder->private_->verify.input_fifo.data[channel][0], &encoder->private_->verify.input_fifo.data[channel][blocksize], encoder->private_->verify.input_fifo.tail * sizeof(encoder->private_->verify.input_fifo.data[0][0]));
+	/* dequeue the frame from the fifo; with a verify thread the calling thread counts it when it gets the slot back */
+	fifo->head += blocksize;
+	if(fifo->head >= fifo->size)
+		fifo->head -= fifo->size;
+#ifndef FLAC__NO_THREADS
+	if(0 == encoder->private_->verify.thread || encoder->private_->verify.state_hint != ENCODER_IN_AUDIO)
+#endif
+		fifo->unverified -= blocksize;
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -4264,7 +5015,22 @@ void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 {
 	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)client_data;
 	(void)decoder, (void)status;
-	encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+	set_verify_state_(encoder, FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR);
+}
+
+/* The audio frames are decoded on the verify thread when there is one, so
+ * a failure there is kept with the thread until the calling thread picks
+ * it up with the frame instead of being set in the encoder state under it.
+ */
+void set_verify_state_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderState state)
+{
+#ifndef FLAC__NO_THREADS
+	if(0 != encoder->private_->verify.thread && encoder->private_->verify.state_hint == ENCODER_IN_AUDIO) {
+		encoder->private_->verify.thread->state = state;
+		return;
+	}
+#endif
+	encoder->protected_->state = state;
 }
 
 FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
@@ -0,0 +1,155 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2006,2007,2008  Josh Coalson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/threads.h"
+
+#ifndef FLAC__NO_THREADS
+
+#include <stdlib.h> /* for malloc() */
+#include "FLAC/assert.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* the routine and its argument, passed through the native start routine */
+typedef struct {
+	FLAC__ThreadRoutine routine;
+	void *arg;
+} thread_start_;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_main_(LPVOID param)
+#else
+static void *thread_main_(void *param)
+#endif
+{
+	thread_start_ start = *(thread_start_*)param;
+
+	free(param);
+	start.routine(start.arg);
+	return 0;
+}
+
+FLAC__bool FLAC__thread_create(FLAC__Thread *thread, FLAC__ThreadRoutine routine, void *arg)
+{
+	thread_start_ *start;
+
+	FLAC__ASSERT(0 != thread);
+	FLAC__ASSERT(0 != routine);
+
+	if(0 == (start = (thread_start_*)malloc(sizeof(thread_start_))))
+		return false;
+	start->routine = routine;
+	start->arg = arg;
+
+#ifdef _WIN32
+	if(0 == (*thread = CreateThread(NULL, 0, thread_main_, start, 0, NULL))) {
+#else
+	if(0 != pthread_create(thread, NULL, thread_main_, start)) {
+#endif
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void FLAC__thread_join(FLAC__Thread *thread)
+{
+	FLAC__ASSERT(0 != thread);
+#ifdef _WIN32
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+#else
+	pthread_join(*thread, NULL);
+#endif
+}
+
+FLAC__bool FLAC__event_init(FLAC__Event *event)
+{
+	FLAC__ASSERT(0 != event);
+#ifdef _WIN32
+	return 0 != (*event = CreateEvent(NULL, FALSE, FALSE, NULL));
+#else
+	event->signaled = false;
+	if(0 != pthread_mutex_init(&event->mutex, NULL))
+		return false;
+	if(0 != pthread_cond_init(&event->cond, NULL)) {
+		pthread_mutex_destroy(&event->mutex);
+		return false;
+	}
+	return true;
+#endif
+}
+
+void FLAC__event_signal(FLAC__Event *event)
+{
+	FLAC__ASSERT(0 != event);
+#ifdef _WIN32
+	SetEvent(*event);
+#else
+	pthread_mutex_lock(&event->mutex);
+	event->signaled = true;
+	pthread_cond_signal(&event->cond);
+	pthread_mutex_unlock(&event->mutex);
+#endif
+}
+
+void FLAC__event_wait(FLAC__Event *event)
+{
+	FLAC__ASSERT(0 != event);
+#ifdef _WIN32
+	WaitForSingleObject(*event, INFINITE);
+#else
+	pthread_mutex_lock(&event->mutex);
+	while(!event->signaled)
+		pthread_cond_wait(&event->cond, &event->mutex);
+	event->signaled = false; /* auto-reset, like the Win32 event */
+	pthread_mutex_unlock(&event->mutex);
+#endif
+}
+
+void FLAC__event_free(FLAC__Event *event)
+{
+	FLAC__ASSERT(0 != event);
+#ifdef _WIN32
+	CloseHandle(*event);
+#else
+	pthread_cond_destroy(&event->cond);
+	pthread_mutex_destroy(&event->mutex);
+#endif
+}
+
+#endif /* !defined FLAC__NO_THREADS */
@@ -63,6 +63,12 @@ static ::FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_,
 static ::FLAC__StreamMetadata *expected_metadata_sequence_[9];
 static unsigned num_expected_;
 static off_t flacfilesize_;
+/* decode with worker threads where libFLAC has them, to cover the threaded paths */
+#ifdef FLAC__NO_THREADS
+static const unsigned num_threads_ = 1;
+#else
+static const unsigned num_threads_ = 2;
+#endif
 
 static const char *flacfilename(bool is_ogg)
 {
@@ -547,6 +553,11 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		return false;
 	}
 
+	printf("testing set_num_threads()... ");
+	if(!decoder->set_num_threads(num_threads_))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
 	switch(layer) {
 		case LAYER_STREAM:
 		case LAYER_SEEKABLE_STREAM:
@@ -606,6 +617,13 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_num_threads()... ");
+	if(decoder->get_num_threads() != num_threads_) {
+		printf("FAILED, expected %u, got %u\n", num_threads_, decoder->get_num_threads());
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing process_until_end_of_metadata()... ");
 	if(!decoder->process_until_end_of_metadata())
 		return die_s_("returned false", decoder);
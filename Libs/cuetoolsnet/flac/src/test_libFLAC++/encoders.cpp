@@ -16,6 +16,10 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include "encoders.h"
 #include "FLAC/assert.h"
 #include "FLAC++/encoder.h"
@@ -46,6 +50,12 @@ static const char * const LayerString[] = {
 static ::FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, application2_, vorbiscomment_, cuesheet_, picture_, unknown_;
 static ::FLAC__StreamMetadata *metadata_sequence_[] = { &vorbiscomment_, &padding_, &seektable_, &application1_, &application2_, &cuesheet_, &picture_, &unknown_ };
 static const unsigned num_metadata_ = sizeof(metadata_sequence_) / sizeof(metadata_sequence_[0]);
+/* encode with worker threads where libFLAC has them, to cover the threaded paths */
+#ifdef FLAC__NO_THREADS
+static const unsigned num_threads_ = 1;
+#else
+static const unsigned num_threads_ = 2;
+#endif
 
 static const char *flacfilename(bool is_ogg)
 {
@@ -179,6 +189,154 @@ static FLAC::Encoder::Stream *new_by_layer(Layer layer)
 		return new FileEncoder(layer);
 }
 
+#ifndef FLAC__NO_THREADS
+/*
+ * The threaded encoder must write exactly what the single-threaded one
+ * does, so the same input is encoded into memory both ways and the two
+ * streams (including the STREAMINFO rewritten on finish) are compared.
+ * Both the frame threads and the subframe threads are checked.
+ */
+
+#define THREADED_NUM_THREADS 4
+#define THREADED_CHANNELS 2
+/* enough for a few blocks per thread at every compression level, plus a short last block */
+#define THREADED_SAMPLES (4 * THREADED_NUM_THREADS * 4608 + 1234)
+
+static FLAC__int32 threaded_input_[THREADED_SAMPLES * THREADED_CHANNELS];
+
+static void init_threaded_input_()
+{
+	FLAC__uint32 seed = 0x12345678;
+
+	/* a slow sweep plus noise, with a silent stretch and a full-scale stretch so the frames differ */
+	for(unsigned i = 0; i < THREADED_SAMPLES; i++) {
+		for(unsigned ch = 0; ch < THREADED_CHANNELS; ch++) {
+			seed = seed * 1664525 + 1013904223;
+			FLAC__int32 x = (FLAC__int32)((i * (i + 1 + 7 * ch) / 64) & 0x3fff) - 0x2000 + ((FLAC__int32)(seed >> 16) & 0xff) - 0x80;
+			if(i >= 3 * 4608 && i < 5 * 4608)
+				x = 0;
+			else if(i >= 9 * 4608 && i < 10 * 4608)
+				x = (FLAC__int32)(seed >> 16) - 32768;
+			threaded_input_[i * THREADED_CHANNELS + ch] = x;
+		}
+	}
+}
+
+class MemoryEncoder : public FLAC::Encoder::Stream {
+public:
+	FLAC__byte *data_;
+	size_t size_, capacity_, pos_;
+
+	MemoryEncoder(): FLAC::Encoder::Stream(), data_(0), size_(0), capacity_(0), pos_(0) { }
+	~MemoryEncoder() { free(data_); }
+
+	// from FLAC::Encoder::Stream
+	::FLAC__StreamEncoderWriteStatus write_callback(const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame);
+	::FLAC__StreamEncoderSeekStatus seek_callback(FLAC__uint64 absolute_byte_offset);
+	::FLAC__StreamEncoderTellStatus tell_callback(FLAC__uint64 *absolute_byte_offset);
+};
+
+::FLAC__StreamEncoderWriteStatus MemoryEncoder::write_callback(const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame)
+{
+	(void)samples, (void)current_frame;
+
+	if(pos_ + bytes > capacity_) {
+		size_t capacity = capacity_? capacity_ : 65536;
+		while(pos_ + bytes > capacity)
+			capacity *= 2;
+		FLAC__byte *data = (FLAC__byte*)realloc(data_, capacity);
+		if(0 == data)
+			return ::FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		data_ = data;
+		capacity_ = capacity;
+	}
+	memcpy(data_ + pos_, buffer, bytes);
+	pos_ += bytes;
+	if(pos_ > size_)
+		size_ = pos_;
+	return ::FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+::FLAC__StreamEncoderSeekStatus MemoryEncoder::seek_callback(FLAC__uint64 absolute_byte_offset)
+{
+	if(absolute_byte_offset > size_)
+		return ::FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	pos_ = (size_t)absolute_byte_offset;
+	return ::FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+}
+
+::FLAC__StreamEncoderTellStatus MemoryEncoder::tell_callback(FLAC__uint64 *absolute_byte_offset)
+{
+	*absolute_byte_offset = (FLAC__uint64)pos_;
+	return ::FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+}
+
+static bool encode_to_memory_(MemoryEncoder *encoder, unsigned level, unsigned num_threads, bool subframe_threads, bool verify)
+{
+	// odd chunk sizes, so blocks are handed to the workers from partly filled and overfull buffers
+	static const unsigned chunks[] = { 1, 1000, 4095, 4097, 9000, 3, 17000 };
+	bool ok = true;
+
+	ok &= encoder->set_verify(verify);
+	ok &= encoder->set_channels(THREADED_CHANNELS);
+	ok &= encoder->set_bits_per_sample(16);
+	ok &= encoder->set_sample_rate(44100);
+	ok &= encoder->set_compression_level(level);
+	ok &= encoder->set_total_samples_estimate(THREADED_SAMPLES);
+	ok &= encoder->set_num_threads(num_threads);
+	ok &= encoder->set_subframe_threads(subframe_threads);
+	if(!ok)
+		return die_("setting up the encoder failed");
+
+	if(encoder->init() != ::FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+		return die_("init() failed");
+
+	unsigned n = 0;
+	for(unsigned i = 0; ok && i < THREADED_SAMPLES; i += n, n++) {
+		n = chunks[n % (sizeof(chunks) / sizeof(chunks[0]))];
+		if(n > THREADED_SAMPLES - i)
+			n = THREADED_SAMPLES - i;
+		ok = encoder->process_interleaved(threaded_input_ + i * THREADED_CHANNELS, n);
+	}
+	if(ok)
+		ok = encoder->finish();
+	if(!ok)
+		return die_s_("encoding failed", encoder);
+	return true;
+}
+
+static bool test_threaded_output_()
+{
+	static const unsigned levels[] = { 1, 5, 8 };
+
+	printf("\n+++ libFLAC++ unit test: FLAC::Encoder::Stream (%u threads against 1 thread)\n\n", THREADED_NUM_THREADS);
+
+	init_threaded_input_();
+
+	for(unsigned subframe_threads = 0; subframe_threads <= 1; subframe_threads++) {
+		for(unsigned l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+			for(unsigned verify = 0; verify <= 1; verify++) {
+				MemoryEncoder serial, threaded;
+
+				printf("testing %s threads, compression level %u%s... ", subframe_threads? "subframe" : "frame", levels[l], verify? " with verify" : "");
+				if(!encode_to_memory_(&serial, levels[l], 1, false, verify != 0))
+					return false;
+				if(!encode_to_memory_(&threaded, levels[l], THREADED_NUM_THREADS, subframe_threads != 0, verify != 0))
+					return false;
+				if(serial.size_ != threaded.size_ || 0 != memcmp(serial.data_, threaded.data_, serial.size_)) {
+					printf("FAILED, %u threads wrote %u bytes that differ from the %u written by 1 thread\n", THREADED_NUM_THREADS, (unsigned)threaded.size_, (unsigned)serial.size_);
+					return false;
+				}
+				printf("OK\n");
+			}
+		}
+	}
+
+	printf("\nPASSED!\n");
+	return true;
+}
+#endif
+
 static bool test_stream_encoder(Layer layer, bool is_ogg)
 {
 	FLAC::Encoder::Stream *encoder;
@@ -297,6 +455,17 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing set_num_threads()... ");
+	if(!encoder->set_num_threads(num_threads_))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	/* the last layer asks for subframe threads instead of frame threads */
+	printf("testing set_subframe_threads()... ");
+	if(!encoder->set_subframe_threads(layer == LAYER_FILENAME))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing set_total_samples_estimate()... ");
 	if(!encoder->set_total_samples_estimate(streaminfo_.data.stream_info.total_samples))
 		return die_s_("returned false", encoder);
@@ -476,6 +645,20 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_num_threads()... ");
+	if(encoder->get_num_threads() != num_threads_) {
+		printf("FAILED, expected %u, got %u\n", num_threads_, encoder->get_num_threads());
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_subframe_threads()... ");
+	if(encoder->get_subframe_threads() != (layer == LAYER_FILENAME)) {
+		printf("FAILED, expected %s, got %s\n", layer == LAYER_FILENAME? "true" : "false", encoder->get_subframe_threads()? "true" : "false");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing get_total_samples_estimate()... ");
 	if(encoder->get_total_samples_estimate() != streaminfo_.data.stream_info.total_samples) {
 #ifdef _MSC_VER
@@ -549,5 +732,10 @@ bool test_encoders()
 		is_ogg = true;
 	}
 
+#ifndef FLAC__NO_THREADS
+	if(!test_threaded_output_())
+		return false;
+#endif
+
 	return true;
 }
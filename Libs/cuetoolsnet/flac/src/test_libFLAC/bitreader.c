@@ -0,0 +1,307 @@
+/* test_libFLAC - Unit tester for libFLAC
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008  Josh Coalson
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "FLAC/assert.h"
+#include "private/bitreader.h" /* from the libFLAC private include area */
+#include "private/bitwriter.h"
+#include "private/cpu.h"
+#include "private/crc.h"
+#include "bitreader.h"
+#include <stdio.h>
+#include <string.h> /* for memcmp() */
+
+/* adjust for compilers that can't understand using LLU suffix for uint64_t literals */
+#ifdef _MSC_VER
+#define FLAC__U64L(x) x
+#else
+#define FLAC__U64L(x) x##LLU
+#endif
+
+/*
+ * The stream is written with the bitwriter and read back through the
+ * read callback in chunks of various sizes, so that values straddle the
+ * reader's word boundaries and its partial tail word in every possible
+ * way, whatever the word size libFLAC was built with.
+ */
+
+#define NUM_RICE_PARAMETERS 15
+#define NUM_RICE_VALS 300
+#define NUM_BYTES 37
+
+typedef FLAC__bool (*rice_block_reader)(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter);
+
+static const unsigned rice_parameters_[NUM_RICE_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 7, 8, 11, 14, 15, 16, 23, 29, 30 };
+static FLAC__int32 rice_vals_[NUM_RICE_VALS];
+static FLAC__byte bytes_[NUM_BYTES];
+
+static const FLAC__byte *stream_;
+static size_t stream_bytes_, stream_pos_, chunk_size_;
+
+static FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	size_t n = chunk_size_;
+	(void)client_data;
+	if(n > *bytes)
+		n = *bytes;
+	if(n > stream_bytes_ - stream_pos_)
+		n = stream_bytes_ - stream_pos_;
+	if(n == 0)
+		return false;
+	memcpy(buffer, stream_ + stream_pos_, n);
+	stream_pos_ += n;
+	*bytes = n;
+	return true;
+}
+
+static FLAC__int32 rice_val_(unsigned i, unsigned parameter)
+{
+	/* mostly values that fit the parameter, with a few long unary runs */
+	FLAC__uint32 x = (i + 1) * 2654435761u;
+	FLAC__int32 limit = parameter < 20? (FLAC__int32)1 << (parameter + 2) : 1 << 22;
+	FLAC__int32 v = (FLAC__int32)(x % (FLAC__uint32)(2 * limit)) - limit;
+	if(i % 37 == 5)
+		v = (FLAC__int32)(x % 1000u) * (parameter < 20? (1 << parameter) : 1 << 20) + (FLAC__int32)(x % 3u);
+	if(i % 61 == 7)
+		v = -v - 1;
+	return v;
+}
+
+static FLAC__bool write_stream_(FLAC__BitWriter *bw)
+{
+	unsigned i, j;
+
+	for(i = 1; i <= 32; i++) {
+		if(!FLAC__bitwriter_write_raw_uint32(bw, 0xdeadbeef >> (32-i), i))
+			return false;
+	}
+	for(j = 0; j < NUM_RICE_PARAMETERS; j++) {
+		for(i = 0; i < NUM_RICE_VALS; i++)
+			rice_vals_[i] = rice_val_(i, rice_parameters_[j]);
+		if(!FLAC__bitwriter_write_rice_signed_block(bw, rice_vals_, NUM_RICE_VALS, rice_parameters_[j]))
+			return false;
+		if(!FLAC__bitwriter_write_raw_uint32(bw, j, 5))
+			return false;
+	}
+	if(!FLAC__bitwriter_write_unary_unsigned(bw, 100))
+		return false;
+	if(!FLAC__bitwriter_write_rice_signed(bw, -12345, 3))
+		return false;
+	if(!FLAC__bitwriter_write_utf8_uint32(bw, 0x7fffffff))
+		return false;
+	if(!FLAC__bitwriter_write_utf8_uint64(bw, FLAC__U64L(0xfffffffff)))
+		return false;
+	if(!FLAC__bitwriter_zero_pad_to_byte_boundary(bw))
+		return false;
+	for(i = 0; i < NUM_BYTES; i++)
+		bytes_[i] = (FLAC__byte)(i * 7 + 3);
+	if(!FLAC__bitwriter_write_byte_block(bw, bytes_, NUM_BYTES))
+		return false;
+	if(!FLAC__bitwriter_write_raw_uint64(bw, FLAC__U64L(0xaaaaaaaadeadbeef), 64))
+		return false;
+	return FLAC__bitwriter_write_raw_uint32(bw, 0xace, 16);
+}
+
+static FLAC__bool read_stream_(FLAC__BitReader *br, rice_block_reader read_rice_block)
+{
+	int vals[NUM_RICE_VALS];
+	FLAC__byte raw[16], block[NUM_BYTES];
+	unsigned i, j, rawlen, u;
+	int v;
+	FLAC__uint32 x;
+	FLAC__uint64 xx;
+
+	FLAC__bitreader_reset_read_crc16(br, 0);
+	for(i = 1; i <= 32; i++) {
+		if(!FLAC__bitreader_read_raw_uint32(br, &x, i) || x != 0xdeadbeef >> (32-i)) {
+			printf("FAILED raw_uint32 of %u bits\n", i);
+			return false;
+		}
+	}
+	for(j = 0; j < NUM_RICE_PARAMETERS; j++) {
+		if(!read_rice_block(br, vals, NUM_RICE_VALS, rice_parameters_[j])) {
+			printf("FAILED rice block read, parameter %u\n", rice_parameters_[j]);
+			return false;
+		}
+		for(i = 0; i < NUM_RICE_VALS; i++) {
+			if(vals[i] != rice_val_(i, rice_parameters_[j])) {
+				printf("FAILED rice block value #%u, parameter %u: %d != %d\n", i, rice_parameters_[j], vals[i], rice_val_(i, rice_parameters_[j]));
+				return false;
+			}
+		}
+		if(!FLAC__bitreader_read_raw_uint32(br, &x, 5) || x != j) {
+			printf("FAILED raw_uint32 after rice block, parameter %u\n", rice_parameters_[j]);
+			return false;
+		}
+	}
+	if(!FLAC__bitreader_read_unary_unsigned(br, &u) || u != 100) {
+		printf("FAILED unary\n");
+		return false;
+	}
+	if(!FLAC__bitreader_read_rice_signed(br, &v, 3) || v != -12345) {
+		printf("FAILED rice_signed\n");
+		return false;
+	}
+	rawlen = 0;
+	if(!FLAC__bitreader_read_utf8_uint32(br, &x, raw, &rawlen) || x != 0x7fffffff) {
+		printf("FAILED utf8_uint32\n");
+		return false;
+	}
+	rawlen = 0;
+	if(!FLAC__bitreader_read_utf8_uint64(br, &xx, raw, &rawlen) || xx != FLAC__U64L(0xfffffffff)) {
+		printf("FAILED utf8_uint64\n");
+		return false;
+	}
+	if(!FLAC__bitreader_is_consumed_byte_aligned(br)) {
+		if(!FLAC__bitreader_read_raw_uint32(br, &x, FLAC__bitreader_bits_left_for_byte_alignment(br)) || x != 0) {
+			printf("FAILED zero padding\n");
+			return false;
+		}
+	}
+	/* the byte block is read without CRC, so the CRC is checked up to here */
+	if(FLAC__bitreader_get_read_crc16(br) != FLAC__crc16(stream_, (unsigned)stream_pos_ - FLAC__bitreader_get_input_bits_unconsumed(br) / 8)) {
+		printf("FAILED CRC-16\n");
+		return false;
+	}
+	if(!FLAC__bitreader_read_byte_block_aligned_no_crc(br, block, NUM_BYTES) || memcmp(block, bytes_, NUM_BYTES) != 0) {
+		printf("FAILED byte_block_aligned_no_crc\n");
+		return false;
+	}
+	if(!FLAC__bitreader_read_raw_uint64(br, &xx, 64) || xx != FLAC__U64L(0xaaaaaaaadeadbeef)) {
+		printf("FAILED raw_uint64\n");
+		return false;
+	}
+	if(!FLAC__bitreader_read_raw_uint32(br, &x, 16) || x != 0xace) {
+		printf("FAILED raw_uint32 at end\n");
+		return false;
+	}
+	if(FLAC__bitreader_get_input_bits_unconsumed(br) != 0) {
+		printf("FAILED, %u bits left over\n", FLAC__bitreader_get_input_bits_unconsumed(br));
+		return false;
+	}
+	return true;
+}
+
+static FLAC__bool test_reader_(const char *name, rice_block_reader read_rice_block, FLAC__CPUInfo cpuinfo)
+{
+	static const size_t chunk_sizes[] = { 1, 2, 3, 5, 7, 8, 13, 64, 1000, 1u << 20 };
+	FLAC__BitReader *br;
+	unsigned i;
+
+	for(i = 0; i < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); i++) {
+		printf("testing read back with %s rice block reader, %u-byte reads... ", name, (unsigned)chunk_sizes[i]);
+		br = FLAC__bitreader_new();
+		if(0 == br) {
+			printf("FAILED, returned NULL\n");
+			return false;
+		}
+		if(!FLAC__bitreader_init(br, cpuinfo, read_callback_, /*client_data=*/0)) {
+			printf("FAILED init\n");
+			FLAC__bitreader_delete(br);
+			return false;
+		}
+		stream_pos_ = 0;
+		chunk_size_ = chunk_sizes[i];
+		if(!read_stream_(br, read_rice_block)) {
+			FLAC__bitreader_dump(br, stdout);
+			FLAC__bitreader_delete(br);
+			return false;
+		}
+		FLAC__bitreader_delete(br);
+		printf("OK\n");
+	}
+	return true;
+}
+
+FLAC__bool test_bitreader(void)
+{
+	FLAC__BitWriter *bw;
+	FLAC__BitReader *br;
+	FLAC__CPUInfo cpuinfo;
+	FLAC__bool ok;
+
+	printf("\n+++ libFLAC unit test: bitreader\n\n");
+
+	/*
+	 * test new -> init -> clear -> delete
+	 */
+	FLAC__cpu_info(&cpuinfo);
+
+	printf("testing new... ");
+	br = FLAC__bitreader_new();
+	if(0 == br) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing init... ");
+	ok = FLAC__bitreader_init(br, cpuinfo, read_callback_, /*client_data=*/0);
+	printf("%s\n", ok?"OK":"FAILED");
+	if(!ok)
+		return false;
+
+	printf("testing clear... ");
+	ok = FLAC__bitreader_clear(br);
+	printf("%s\n", ok?"OK":"FAILED");
+	if(!ok)
+		return false;
+
+	printf("testing delete... ");
+	FLAC__bitreader_delete(br);
+	printf("OK\n");
+
+	/*
+	 * write a stream to read back
+	 */
+	printf("testing writing test stream... ");
+	bw = FLAC__bitwriter_new();
+	if(0 == bw) {
+		printf("FAILED, returned NULL\n");
+		return false;
+	}
+	if(!FLAC__bitwriter_init(bw) || !write_stream_(bw) || !FLAC__bitwriter_get_buffer(bw, &stream_, &stream_bytes_)) {
+		printf("FAILED\n");
+		FLAC__bitwriter_delete(bw);
+		return false;
+	}
+	printf("OK, %u bytes\n", (unsigned)stream_bytes_);
+
+	ok = test_reader_("generic", FLAC__bitreader_read_rice_signed_block, cpuinfo);
+#ifndef FLAC__NO_ASM
+#if defined FLAC__CPU_IA32 && defined FLAC__HAS_NASM
+	if(ok && cpuinfo.use_asm && cpuinfo.data.ia32.bswap)
+		ok = test_reader_("ia32 bswap", FLAC__bitreader_read_rice_signed_block_asm_ia32_bswap, cpuinfo);
+#endif
+#if defined FLAC__CPU_IA64 && defined FLAC__BMI2_SUPPORTED
+	if(ok && cpuinfo.use_asm && cpuinfo.data.ia64.bmi2)
+		ok = test_reader_("BMI2", FLAC__bitreader_read_rice_signed_block_intrin_bmi2, cpuinfo);
+#endif
+#endif
+
+	FLAC__bitwriter_release_buffer(bw);
+	FLAC__bitwriter_delete(bw);
+	if(!ok)
+		return false;
+
+	printf("\nPASSED!\n");
+	return true;
+}
@@ -38,7 +38,11 @@
  * the definition here to get at the internals.  Make sure this is kept up
  * to date with what is in ../libFLAC/bitwriter.c
  */
+#if defined FLAC__CPU_IA64
+typedef FLAC__uint64 bwword;
+#else
 typedef FLAC__uint32 bwword;
+#endif
 
 struct FLAC__BitWriter {
 	bwword *buffer;
@@ -56,7 +60,9 @@ FLAC__bool test_bitwriter(void)
 	FLAC__BitWriter *bw;
 	FLAC__bool ok;
 	unsigned i, j;
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	static bwword test_pattern1[3] = { FLAC__U64L(0xa8aaaaaabeaaf0aa), FLAC__U64L(0xdbeaadaaaaaa0a30), 0x00eeface };
+#elif WORDS_BIGENDIAN
 	static bwword test_pattern1[5] = { 0xaaf0aabe, 0xaaaaaaa8, 0x300aaaaa, 0xaaadeadb, 0x00eeface };
 #else
 	static bwword test_pattern1[5] = { 0xbeaaf0aa, 0xa8aaaaaa, 0xaaaa0a30, 0xdbeaadaa, 0x00eeface };
@@ -179,7 +185,11 @@ FLAC__bool test_bitwriter(void)
 		FLAC__bitwriter_dump(bw, stdout);
 		return false;
 	}
+#if defined FLAC__CPU_IA64
+	words = 2;
+#else
 	words = 4;
+#endif
 	bits = 24;
 	if(bw->words != words) {
 		printf("FAILED byte count %u != %u\n", bw->words, words);
@@ -197,7 +207,7 @@ FLAC__bool test_bitwriter(void)
 		return false;
 	}
 	if((bw->accum & 0x00ffffff) != test_pattern1[words]) {
-		printf("FAILED pattern match (bw->accum=%08X != %08X)\n", bw->accum&0x00ffffff, test_pattern1[words]);
+		printf("FAILED pattern match (bw->accum=%08X != %08X)\n", (unsigned)(bw->accum&0x00ffffff), (unsigned)test_pattern1[words]);
 		FLAC__bitwriter_dump(bw, stdout);
 		return false;
 	}
@@ -230,7 +240,7 @@ FLAC__bool test_bitwriter(void)
 		return false;
 	}
 	if((bw->accum & 0x3fffffff) != test_pattern1[words]) {
-		printf("FAILED pattern match (bw->accum=%08X != %08X)\n", bw->accum&0x3fffffff, test_pattern1[words]);
+		printf("FAILED pattern match (bw->accum=%08X != %08X)\n", (unsigned)(bw->accum&0x3fffffff), (unsigned)test_pattern1[words]);
 		FLAC__bitwriter_dump(bw, stdout);
 		return false;
 	}
@@ -300,7 +310,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x00010000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x00010000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 32 && (bw->accum & 0xffffffff) == 0xF0908080;
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xF0908080;
 #else
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0x808090F0;
@@ -314,7 +326,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x001FFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x001FFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 32 && (bw->accum & 0xffffffff) == 0xF7BFBFBF;
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xF7BFBFBF;
 #else
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xBFBFBFF7;
@@ -328,7 +342,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x00200000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x00200000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 40 && (bw->accum & FLAC__U64L(0xffffffffff)) == FLAC__U64L(0xF888808080);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xF8888080 && (bw->accum & 0xff) == 0x80;
 #else
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0x808088F8 && (bw->accum & 0xff) == 0x80;
@@ -342,7 +358,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x03FFFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x03FFFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 40 && (bw->accum & FLAC__U64L(0xffffffffff)) == FLAC__U64L(0xFBBFBFBFBF);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xFBBFBFBF && (bw->accum & 0xff) == 0xBF;
 #else
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xBFBFBFFB && (bw->accum & 0xff) == 0xBF;
@@ -356,7 +374,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x04000000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x04000000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 48 && (bw->accum & FLAC__U64L(0xffffffffffff)) == FLAC__U64L(0xFC8480808080);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xFC848080 && (bw->accum & 0xffff) == 0x8080;
 #else
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0x808084FC && (bw->accum & 0xffff) == 0x8080;
@@ -370,7 +390,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint32(0x7FFFFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint32(bw, 0x7FFFFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 48 && (bw->accum & FLAC__U64L(0xffffffffffff)) == FLAC__U64L(0xFDBFBFBFBFBF);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xFDBFBFBF && (bw->accum & 0xffff) == 0xBFBF;
 #else
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xBFBFBFFD && (bw->accum & 0xffff) == 0xBFBF;
@@ -444,7 +466,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000000010000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x0000000000010000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 32 && (bw->accum & 0xffffffff) == 0xF0908080;
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xF0908080;
 #else
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0x808090F0;
@@ -458,7 +482,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x00000000001FFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x00000000001FFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 32 && (bw->accum & 0xffffffff) == 0xF7BFBFBF;
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xF7BFBFBF;
 #else
 	ok = TOTAL_BITS(bw) == 32 && bw->buffer[0] == 0xBFBFBFF7;
@@ -472,7 +498,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000000200000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x0000000000200000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 40 && (bw->accum & FLAC__U64L(0xffffffffff)) == FLAC__U64L(0xF888808080);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xF8888080 && (bw->accum & 0xff) == 0x80;
 #else
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0x808088F8 && (bw->accum & 0xff) == 0x80;
@@ -486,7 +514,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000003FFFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x0000000003FFFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 40 && (bw->accum & FLAC__U64L(0xffffffffff)) == FLAC__U64L(0xFBBFBFBFBF);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xFBBFBFBF && (bw->accum & 0xff) == 0xBF;
 #else
 	ok = TOTAL_BITS(bw) == 40 && bw->buffer[0] == 0xBFBFBFFB && (bw->accum & 0xff) == 0xBF;
@@ -500,7 +530,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000004000000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x0000000004000000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 48 && (bw->accum & FLAC__U64L(0xffffffffffff)) == FLAC__U64L(0xFC8480808080);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xFC848080 && (bw->accum & 0xffff) == 0x8080;
 #else
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0x808084FC && (bw->accum & 0xffff) == 0x8080;
@@ -514,7 +546,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x000000007FFFFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x000000007FFFFFFF);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 48 && (bw->accum & FLAC__U64L(0xffffffffffff)) == FLAC__U64L(0xFDBFBFBFBFBF);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xFDBFBFBF && (bw->accum & 0xffff) == 0xBFBF;
 #else
 	ok = TOTAL_BITS(bw) == 48 && bw->buffer[0] == 0xBFBFBFFD && (bw->accum & 0xffff) == 0xBFBF;
@@ -528,7 +562,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000080000000)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, 0x0000000080000000);
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 56 && (bw->accum & FLAC__U64L(0xffffffffffffff)) == FLAC__U64L(0xFE828080808080);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 56 && bw->buffer[0] == 0xFE828080 && (bw->accum & 0xffffff) == 0x808080;
 #else
 	ok = TOTAL_BITS(bw) == 56 && bw->buffer[0] == 0x808082FE && (bw->accum & 0xffffff) == 0x808080;
@@ -542,7 +578,9 @@ FLAC__bool test_bitwriter(void)
 	printf("testing utf8_uint64(0x0000000FFFFFFFFF)... ");
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_utf8_uint64(bw, FLAC__U64L(0x0000000FFFFFFFFF));
-#if WORDS_BIGENDIAN
+#if defined FLAC__CPU_IA64
+	ok = TOTAL_BITS(bw) == 56 && (bw->accum & FLAC__U64L(0xffffffffffffff)) == FLAC__U64L(0xFEBFBFBFBFBFBF);
+#elif WORDS_BIGENDIAN
 	ok = TOTAL_BITS(bw) == 56 && bw->buffer[0] == 0xFEBFBFBF && (bw->accum & 0xffffff) == 0xBFBFBF;
 #else
 	ok = TOTAL_BITS(bw) == 56 && bw->buffer[0] == 0xBFBFBFFE && (bw->accum & 0xffffff) == 0xBFBFBF;
@@ -557,12 +595,15 @@ FLAC__bool test_bitwriter(void)
 	FLAC__bitwriter_clear(bw);
 	FLAC__bitwriter_write_raw_uint32(bw, 0x5, 4);
 	j = bw->capacity;
-	for(i = 0; i < j; i++)
+	/* a whole buffer's worth of 32-bit writes (two per word with 64-bit words) on top of the 4 bits */
+	for(i = 0; i < j * (unsigned)sizeof(bwword) / 4; i++)
 		FLAC__bitwriter_write_raw_uint32(bw, 0xaaaaaaaa, 32);
-#if WORDS_BIGENDIAN
-	ok = TOTAL_BITS(bw) == i*32+4 && bw->buffer[0] == 0x5aaaaaaa && (bw->accum & 0xf) == 0xa;
+#if defined FLAC__CPU_IA64
+	ok = bw->capacity > j && TOTAL_BITS(bw) == i*32+4 && bw->buffer[0] == FLAC__U64L(0xaaaaaaaaaaaaaa5a) && (bw->accum & 0xf) == 0xa;
+#elif WORDS_BIGENDIAN
+	ok = bw->capacity > j && TOTAL_BITS(bw) == i*32+4 && bw->buffer[0] == 0x5aaaaaaa && (bw->accum & 0xf) == 0xa;
 #else
-	ok = TOTAL_BITS(bw) == i*32+4 && bw->buffer[0] == 0xaaaaaa5a && (bw->accum & 0xf) == 0xa;
+	ok = bw->capacity > j && TOTAL_BITS(bw) == i*32+4 && bw->buffer[0] == 0xaaaaaa5a && (bw->accum & 0xf) == 0xa;
 #endif
 	printf("%s\n", ok?"OK":"FAILED");
 	if(!ok) {
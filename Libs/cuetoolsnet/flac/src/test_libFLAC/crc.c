@@ -0,0 +1,134 @@
+/* test_libFLAC - Unit tester for libFLAC
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008  Josh Coalson
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h" /* from the libFLAC private include area */
+#include "private/crc.h"
+#include "crc.h"
+#include <stdio.h>
+
+/*
+ * The table-driven routines are checked against a bit-at-a-time reference
+ * for every length up to a few hundred bytes, at every alignment, and with
+ * a nonzero starting CRC, so that all the slice and fold boundaries and
+ * the tails are covered.
+ */
+
+#define NUM_BYTES 1100
+#define MAX_ALIGN 16
+
+typedef unsigned (*crc16_block_function)(const FLAC__byte *data, unsigned len, unsigned crc);
+
+static FLAC__byte data_[NUM_BYTES + MAX_ALIGN];
+
+static unsigned crc8_reference_(const FLAC__byte *data, unsigned len)
+{
+	unsigned crc = 0, i;
+
+	while(len--) {
+		crc ^= *data++;
+		for(i = 0; i < 8; i++)
+			crc = (crc & 0x80)? ((crc << 1) ^ 0x07) & 0xff : crc << 1;
+	}
+	return crc;
+}
+
+static unsigned crc16_reference_(const FLAC__byte *data, unsigned len, unsigned crc)
+{
+	unsigned i;
+
+	while(len--) {
+		crc ^= (unsigned)*data++ << 8;
+		for(i = 0; i < 8; i++)
+			crc = (crc & 0x8000)? ((crc << 1) ^ 0x8005) & 0xffff : crc << 1;
+	}
+	return crc;
+}
+
+static FLAC__bool test_crc16_block_(const char *name, crc16_block_function crc16_block)
+{
+	static const unsigned seeds[] = { 0, 1, 0x8005, 0xffff };
+	unsigned align, len, s, ref, crc;
+
+	printf("testing %s CRC-16 block update... ", name);
+	for(align = 0; align < MAX_ALIGN; align++) {
+		for(len = 0; len + align <= NUM_BYTES; len += (len < 300? 1 : 37)) {
+			for(s = 0; s < sizeof(seeds)/sizeof(seeds[0]); s++) {
+				ref = crc16_reference_(data_ + align, len, seeds[s]);
+				crc = crc16_block(data_ + align, len, seeds[s]);
+				if(crc != ref) {
+					printf("FAILED, align=%u len=%u seed=0x%04x: got 0x%04x, expected 0x%04x\n", align, len, seeds[s], crc, ref);
+					return false;
+				}
+			}
+		}
+	}
+	printf("OK\n");
+	return true;
+}
+
+FLAC__bool test_crc(void)
+{
+	FLAC__CPUInfo cpuinfo;
+	FLAC__uint32 x = 1;
+	unsigned i, len;
+
+	printf("\n+++ libFLAC unit test: crc\n\n");
+
+	FLAC__cpu_info(&cpuinfo);
+
+	for(i = 0; i < sizeof(data_); i++) {
+		x = x * 1103515245u + 12345u;
+		data_[i] = (FLAC__byte)(x >> 23);
+	}
+
+	printf("testing FLAC__crc8()... ");
+	for(len = 0; len <= 64; len++) {
+		if(FLAC__crc8(data_, len) != crc8_reference_(data_, len)) {
+			printf("FAILED, len=%u\n", len);
+			return false;
+		}
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__crc16()... ");
+	for(len = 0; len <= NUM_BYTES; len++) {
+		if(FLAC__crc16(data_ + 1, len) != crc16_reference_(data_ + 1, len, 0)) {
+			printf("FAILED, len=%u\n", len);
+			return false;
+		}
+	}
+	printf("OK\n");
+
+	if(!test_crc16_block_("generic", FLAC__crc16_update_block))
+		return false;
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_IA64 && defined FLAC__PCLMUL_SUPPORTED
+	if(cpuinfo.use_asm && cpuinfo.data.ia64.sse41 && cpuinfo.data.ia64.pclmul) {
+		if(!test_crc16_block_("PCLMUL", FLAC__crc16_update_block_intrin_pclmul))
+			return false;
+	}
+#else
+	(void)cpuinfo;
+#endif
+
+	printf("\nPASSED!\n");
+	return true;
+}
@@ -33,6 +33,7 @@
 #include "decoders.h"
 #include "FLAC/assert.h"
 #include "FLAC/stream_decoder.h"
+#include "FLAC/stream_encoder.h"
 #include "share/grabbag.h"
 #include "test_libs_common/file_utils_flac.h"
 #include "test_libs_common/metadata_utils.h"
@@ -63,6 +64,12 @@ static FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, ap
 static FLAC__StreamMetadata *expected_metadata_sequence_[9];
 static unsigned num_expected_;
 static off_t flacfilesize_;
+/* decode with worker threads where libFLAC has them, to cover the threaded paths */
+#ifdef FLAC__NO_THREADS
+static const unsigned num_threads_ = 1;
+#else
+static const unsigned num_threads_ = 2;
+#endif
 
 static const char *flacfilename(FLAC__bool is_ogg)
 {
@@ -382,6 +389,342 @@ static FLAC__bool stream_decoder_test_respond_(FLAC__StreamDecoder *decoder, Str
 	return true;
 }
 
+#ifndef FLAC__NO_THREADS
+/*
+ * The threaded decoder must hand the client exactly what the serial one
+ * does: the same samples in the same frames, the same errors, and the same
+ * MD5 verdict.  A stream several runs long is encoded into memory, then
+ * decoded both ways as is and with damaged frames, which make the workers
+ * give up and the rest of the stream go through the serial fallback.
+ */
+
+#define THREADED_NUM_THREADS 4
+#define THREADED_CHANNELS 2
+/* noisy enough that the stream is a few times the run size of the threaded decoder */
+#define THREADED_SAMPLES (1200 * 1024)
+#define THREADED_MAX_FRAMES 2048
+#define THREADED_MAX_ERRORS 16
+
+typedef enum {
+	DAMAGE_NONE = 0,
+	DAMAGE_FRAME_BODY, /* a flipped byte inside a frame: CRC-16 mismatch */
+	DAMAGE_FRAME_HEADER, /* a broken sync code: the frame is lost */
+	DAMAGE_TRUNCATED /* the stream ends in the middle of a frame */
+} Damage;
+
+static const char * const DamageString[] = {
+	"intact",
+	"damaged frame body",
+	"damaged frame header",
+	"truncated"
+};
+
+typedef struct {
+	FLAC__byte *data;
+	size_t size, capacity, pos;
+	size_t frame_offsets[THREADED_MAX_FRAMES];
+	unsigned num_frames;
+} memory_stream_struct;
+
+typedef struct {
+	const FLAC__byte *data;
+	size_t size, pos;
+	FLAC__int32 *output; /* interleaved */
+	size_t output_samples;
+	FLAC__uint64 next_sample;
+	FLAC__bool out_of_order;
+	FLAC__bool process_ok; /* what FLAC__stream_decoder_process_until_end_of_stream() returned */
+	FLAC__StreamDecoderErrorStatus errors[THREADED_MAX_ERRORS];
+	unsigned num_errors;
+} memory_decoder_client_data_struct;
+
+static FLAC__int32 threaded_input_[THREADED_SAMPLES * THREADED_CHANNELS];
+
+static FLAC__StreamEncoderWriteStatus memory_write_callback_(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder, (void)current_frame;
+	if(stream->pos + bytes > stream->capacity) {
+		size_t capacity = stream->capacity? stream->capacity : 65536;
+		FLAC__byte *data;
+		while(stream->pos + bytes > capacity)
+			capacity *= 2;
+		if(0 == (data = (FLAC__byte*)realloc(stream->data, capacity)))
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		stream->data = data;
+		stream->capacity = capacity;
+	}
+	/* each frame comes in a single write */
+	if(samples > 0 && stream->num_frames < THREADED_MAX_FRAMES)
+		stream->frame_offsets[stream->num_frames++] = stream->pos;
+	memcpy(stream->data + stream->pos, buffer, bytes);
+	stream->pos += bytes;
+	if(stream->pos > stream->size)
+		stream->size = stream->pos;
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static FLAC__StreamEncoderSeekStatus memory_seek_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder;
+	if(absolute_byte_offset > stream->size)
+		return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	stream->pos = (size_t)absolute_byte_offset;
+	return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamEncoderTellStatus memory_tell_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder;
+	*absolute_byte_offset = (FLAC__uint64)stream->pos;
+	return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+}
+
+static FLAC__bool encode_threaded_input_(memory_stream_struct *stream)
+{
+	FLAC__StreamEncoder *encoder;
+	FLAC__uint32 seed = 0x2468ace0;
+	unsigned i;
+	FLAC__bool ok = true;
+
+	for(i = 0; i < THREADED_SAMPLES * THREADED_CHANNELS; i++) {
+		seed = seed * 1664525 + 1013904223;
+		threaded_input_[i] = (FLAC__int32)(seed >> 16) - 32768;
+	}
+
+	memset(stream, 0, sizeof(*stream));
+
+	if(0 == (encoder = FLAC__stream_encoder_new()))
+		return die_("FLAC__stream_encoder_new() returned NULL");
+
+	ok &= FLAC__stream_encoder_set_channels(encoder, THREADED_CHANNELS);
+	ok &= FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+	ok &= FLAC__stream_encoder_set_sample_rate(encoder, 44100);
+	ok &= FLAC__stream_encoder_set_compression_level(encoder, 0);
+	ok &= FLAC__stream_encoder_set_total_samples_estimate(encoder, THREADED_SAMPLES);
+	if(ok)
+		ok = FLAC__stream_encoder_init_stream(encoder, memory_write_callback_, memory_seek_callback_, memory_tell_callback_, /*metadata_callback=*/0, stream) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+	if(ok)
+		ok = FLAC__stream_encoder_process_interleaved(encoder, threaded_input_, THREADED_SAMPLES);
+	if(ok)
+		ok = FLAC__stream_encoder_finish(encoder);
+	FLAC__stream_encoder_delete(encoder);
+
+	if(!ok) {
+		free(stream->data);
+		return die_("encoding the stream for the threaded decoder tests failed");
+	}
+	return true;
+}
+
+static FLAC__StreamDecoderReadStatus memory_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	if(dcd->pos >= dcd->size) {
+		*bytes = 0;
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+	if(*bytes > dcd->size - dcd->pos)
+		*bytes = dcd->size - dcd->pos;
+	memcpy(buffer, dcd->data + dcd->pos, *bytes);
+	dcd->pos += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderSeekStatus memory_decoder_seek_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	if(absolute_byte_offset > dcd->size)
+		return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+	dcd->pos = (size_t)absolute_byte_offset;
+	return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamDecoderTellStatus memory_decoder_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	*absolute_byte_offset = (FLAC__uint64)dcd->pos;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus memory_decoder_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	*stream_length = (FLAC__uint64)dcd->size;
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool memory_decoder_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	return dcd->pos >= dcd->size;
+}
+
+static FLAC__StreamDecoderWriteStatus memory_decoder_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	unsigned i, channel;
+	(void)decoder;
+
+	/* a frame may be dropped, but never written twice or out of order */
+	if(frame->header.number_type != FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER || frame->header.number.sample_number < dcd->next_sample)
+		dcd->out_of_order = true;
+	dcd->next_sample = frame->header.number.sample_number + frame->header.blocksize;
+
+	if(frame->header.channels != THREADED_CHANNELS || dcd->output_samples + frame->header.blocksize > THREADED_SAMPLES)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	for(i = 0; i < frame->header.blocksize; i++)
+		for(channel = 0; channel < THREADED_CHANNELS; channel++)
+			dcd->output[(dcd->output_samples + i) * THREADED_CHANNELS + channel] = buffer[channel][i];
+	dcd->output_samples += frame->header.blocksize;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void memory_decoder_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	memory_decoder_client_data_struct *dcd = (memory_decoder_client_data_struct*)client_data;
+	(void)decoder;
+	if(dcd->num_errors < THREADED_MAX_ERRORS)
+		dcd->errors[dcd->num_errors] = status;
+	dcd->num_errors++;
+}
+
+/* decodes the whole stream; *md5_ok is the result of FLAC__stream_decoder_finish() */
+static FLAC__bool decode_from_memory_(memory_decoder_client_data_struct *dcd, const FLAC__byte *data, size_t size, unsigned num_threads, FLAC__bool *md5_ok)
+{
+	FLAC__StreamDecoder *decoder;
+	FLAC__bool ok = true;
+
+	memset(dcd, 0, sizeof(*dcd));
+	dcd->data = data;
+	dcd->size = size;
+	if(0 == (dcd->output = (FLAC__int32*)malloc(sizeof(FLAC__int32) * THREADED_SAMPLES * THREADED_CHANNELS)))
+		return die_("out of memory");
+
+	if(0 == (decoder = FLAC__stream_decoder_new())) {
+		free(dcd->output);
+		return die_("FLAC__stream_decoder_new() returned NULL");
+	}
+
+	ok &= FLAC__stream_decoder_set_md5_checking(decoder, true);
+	ok &= FLAC__stream_decoder_set_num_threads(decoder, num_threads);
+	if(ok)
+		ok = FLAC__stream_decoder_init_stream(decoder, memory_read_callback_, memory_decoder_seek_callback_, memory_decoder_tell_callback_, memory_decoder_length_callback_, memory_decoder_eof_callback_, memory_decoder_write_callback_, /*metadata_callback=*/0, memory_decoder_error_callback_, dcd) == FLAC__STREAM_DECODER_INIT_STATUS_OK;
+	/* a stream cut off in a frame makes this return false even though the state is END_OF_STREAM */
+	if(ok) {
+		dcd->process_ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
+		ok = FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM;
+	}
+	if(!ok) {
+		die_s_("decoding failed", decoder);
+		FLAC__stream_decoder_delete(decoder);
+		free(dcd->output);
+		return false;
+	}
+	*md5_ok = FLAC__stream_decoder_finish(decoder);
+	FLAC__stream_decoder_delete(decoder);
+	return true;
+}
+
+static FLAC__bool test_threaded_decode_(const memory_stream_struct *stream, Damage damage)
+{
+	memory_decoder_client_data_struct serial, threaded;
+	FLAC__byte *data;
+	size_t size = stream->size;
+	/* well past the first run, so the workers have written frames before they give up */
+	const size_t offset = stream->frame_offsets[stream->num_frames * 2 / 3];
+	FLAC__bool serial_md5_ok, threaded_md5_ok, ok;
+
+	printf("testing %u threads against 1 thread, %s stream... ", THREADED_NUM_THREADS, DamageString[damage]);
+
+	if(0 == (data = (FLAC__byte*)malloc(stream->size)))
+		return die_("out of memory");
+	memcpy(data, stream->data, stream->size);
+	switch(damage) {
+		case DAMAGE_NONE:
+			break;
+		case DAMAGE_FRAME_BODY:
+			data[offset + 100] ^= 0x5a;
+			break;
+		case DAMAGE_FRAME_HEADER:
+			data[offset] = 0;
+			break;
+		case DAMAGE_TRUNCATED:
+			size = offset + 100;
+			break;
+	}
+
+	if(!decode_from_memory_(&serial, data, size, 1, &serial_md5_ok)) {
+		free(data);
+		return false;
+	}
+	if(!decode_from_memory_(&threaded, data, size, THREADED_NUM_THREADS, &threaded_md5_ok)) {
+		free(serial.output);
+		free(data);
+		return false;
+	}
+
+	ok = false;
+	if(serial.out_of_order || threaded.out_of_order)
+		printf("FAILED, frames were written out of order\n");
+	else if(serial.process_ok != threaded.process_ok)
+		printf("FAILED, FLAC__stream_decoder_process_until_end_of_stream() returned %s with %u threads, %s with 1 thread\n", threaded.process_ok? "true" : "false", THREADED_NUM_THREADS, serial.process_ok? "true" : "false");
+	else if(serial.output_samples != threaded.output_samples)
+		printf("FAILED, %u threads wrote %u samples, 1 thread wrote %u\n", THREADED_NUM_THREADS, (unsigned)threaded.output_samples, (unsigned)serial.output_samples);
+	else if(0 != memcmp(serial.output, threaded.output, sizeof(FLAC__int32) * serial.output_samples * THREADED_CHANNELS))
+		printf("FAILED, %u threads wrote different samples than 1 thread\n", THREADED_NUM_THREADS);
+	else if(serial.num_errors != threaded.num_errors || 0 != memcmp(serial.errors, threaded.errors, sizeof(serial.errors[0]) * (serial.num_errors < THREADED_MAX_ERRORS? serial.num_errors : THREADED_MAX_ERRORS)))
+		printf("FAILED, %u threads reported %u errors, 1 thread reported %u, or they differ\n", THREADED_NUM_THREADS, threaded.num_errors, serial.num_errors);
+	else if(serial_md5_ok != threaded_md5_ok)
+		printf("FAILED, the MD5 check of %u threads returned %s, of 1 thread %s\n", THREADED_NUM_THREADS, threaded_md5_ok? "true" : "false", serial_md5_ok? "true" : "false");
+	else if(damage == DAMAGE_NONE && (!serial.process_ok || !serial_md5_ok || serial.num_errors > 0 || serial.output_samples != THREADED_SAMPLES || 0 != memcmp(serial.output, threaded_input_, sizeof(threaded_input_))))
+		printf("FAILED, the intact stream did not decode to the input\n");
+	else if(damage != DAMAGE_NONE && serial_md5_ok)
+		printf("FAILED, the MD5 check passed on a damaged stream\n");
+	else if(damage != DAMAGE_NONE && damage != DAMAGE_TRUNCATED && serial.num_errors == 0)
+		printf("FAILED, no error was reported for the damaged frame\n");
+	else
+		ok = true;
+
+	free(serial.output);
+	free(threaded.output);
+	free(data);
+	if(!ok)
+		return false;
+	printf("OK\n");
+	return true;
+}
+
+static FLAC__bool test_threaded_decoder_(void)
+{
+	memory_stream_struct stream;
+	unsigned damage;
+
+	printf("\n+++ libFLAC unit test: FLAC__StreamDecoder (%u threads against 1 thread)\n\n", THREADED_NUM_THREADS);
+
+	if(!encode_threaded_input_(&stream))
+		return false;
+
+	for(damage = DAMAGE_NONE; damage <= DAMAGE_TRUNCATED; damage++) {
+		if(!test_threaded_decode_(&stream, (Damage)damage)) {
+			free(stream.data);
+			return false;
+		}
+	}
+
+	free(stream.data);
+	printf("\nPASSED!\n");
+	return true;
+}
+#endif
+
 static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 {
 	FLAC__StreamDecoder *decoder;
@@ -469,6 +812,11 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_decoder_set_num_threads()... ");
+	if(!FLAC__stream_decoder_set_num_threads(decoder, num_threads_))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening %sFLAC file... ", is_ogg? "Ogg ":"");
 		decoder_client_data.file = fopen(flacfilename(is_ogg), "rb");
@@ -527,6 +875,13 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_decoder_get_num_threads()... ");
+	if(FLAC__stream_decoder_get_num_threads(decoder) != num_threads_) {
+		printf("FAILED, expected %u, got %u\n", num_threads_, FLAC__stream_decoder_get_num_threads(decoder));
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_decoder_process_until_end_of_metadata()... ");
 	if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
 		return die_s_("returned false", decoder);
@@ -1044,5 +1399,10 @@ FLAC__bool test_decoders(void)
 		is_ogg = true;
 	}
 
+#ifndef FLAC__NO_THREADS
+	if(!test_threaded_decoder_())
+		return false;
+#endif
+
 	return true;
 }
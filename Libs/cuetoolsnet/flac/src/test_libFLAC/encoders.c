@@ -48,6 +48,12 @@ static const char * const LayerString[] = {
 static FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, application2_, vorbiscomment_, cuesheet_, picture_, unknown_;
 static FLAC__StreamMetadata *metadata_sequence_[] = { &vorbiscomment_, &padding_, &seektable_, &application1_, &application2_, &cuesheet_, &picture_, &unknown_ };
 static const unsigned num_metadata_ = sizeof(metadata_sequence_) / sizeof(metadata_sequence_[0]);
+/* encode with worker threads where libFLAC has them, to cover the threaded paths */
+#ifdef FLAC__NO_THREADS
+static const unsigned num_threads_ = 1;
+#else
+static const unsigned num_threads_ = 2;
+#endif
 
 static const char *flacfilename(FLAC__bool is_ogg)
 {
@@ -148,6 +154,306 @@ static void stream_encoder_progress_callback_(const FLAC__StreamEncoder *encoder
 	(void)encoder, (void)bytes_written, (void)samples_written, (void)frames_written, (void)total_frames_estimate, (void)client_data;
 }
 
+#ifndef FLAC__NO_THREADS
+/*
+ * The threaded encoder must write exactly what the single-threaded one
+ * does, so the same input is encoded into memory both ways and the two
+ * streams (including the STREAMINFO rewritten on finish) are compared.
+ * Both the frame threads and the subframe threads are checked.
+ */
+
+#define THREADED_NUM_THREADS 4
+#define THREADED_CHANNELS 2
+/* enough for a few blocks per thread at every compression level, plus a short last block */
+#define THREADED_SAMPLES (4 * THREADED_NUM_THREADS * 4608 + 1234)
+
+typedef struct {
+	FLAC__byte *data;
+	size_t size, capacity, pos;
+} memory_stream_struct;
+
+static FLAC__int32 threaded_input_[THREADED_SAMPLES * THREADED_CHANNELS];
+
+static void init_threaded_input_(void)
+{
+	FLAC__uint32 seed = 0x12345678;
+	unsigned i, ch;
+
+	/* a slow sweep plus noise, with a silent stretch and a full-scale stretch so the frames differ */
+	for(i = 0; i < THREADED_SAMPLES; i++) {
+		for(ch = 0; ch < THREADED_CHANNELS; ch++) {
+			FLAC__int32 x;
+			seed = seed * 1664525 + 1013904223;
+			x = (FLAC__int32)((i * (i + 1 + 7 * ch) / 64) & 0x3fff) - 0x2000 + ((FLAC__int32)(seed >> 16) & 0xff) - 0x80;
+			if(i >= 3 * 4608 && i < 5 * 4608)
+				x = 0;
+			else if(i >= 9 * 4608 && i < 10 * 4608)
+				x = (FLAC__int32)(seed >> 16) - 32768;
+			threaded_input_[i * THREADED_CHANNELS + ch] = x;
+		}
+	}
+}
+
+static FLAC__StreamEncoderWriteStatus memory_write_callback_(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder, (void)samples, (void)current_frame;
+	if(stream->pos + bytes > stream->capacity) {
+		size_t capacity = stream->capacity? stream->capacity : 65536;
+		FLAC__byte *data;
+		while(stream->pos + bytes > capacity)
+			capacity *= 2;
+		if(0 == (data = (FLAC__byte*)realloc(stream->data, capacity)))
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		stream->data = data;
+		stream->capacity = capacity;
+	}
+	memcpy(stream->data + stream->pos, buffer, bytes);
+	stream->pos += bytes;
+	if(stream->pos > stream->size)
+		stream->size = stream->pos;
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static FLAC__StreamEncoderSeekStatus memory_seek_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder;
+	if(absolute_byte_offset > stream->size)
+		return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	stream->pos = (size_t)absolute_byte_offset;
+	return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamEncoderTellStatus memory_tell_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	memory_stream_struct *stream = (memory_stream_struct*)client_data;
+	(void)encoder;
+	*absolute_byte_offset = (FLAC__uint64)stream->pos;
+	return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+}
+
+static FLAC__bool encode_to_memory_(memory_stream_struct *stream, unsigned level, unsigned num_threads, FLAC__bool subframe_threads, FLAC__bool verify)
+{
+	/* odd chunk sizes, so blocks are handed to the workers from partly filled and overfull buffers */
+	static const unsigned chunks[] = { 1, 1000, 4095, 4097, 9000, 3, 17000 };
+	FLAC__StreamEncoder *encoder;
+	unsigned i, n;
+	FLAC__bool ok = true;
+
+	memset(stream, 0, sizeof(*stream));
+
+	if(0 == (encoder = FLAC__stream_encoder_new()))
+		return die_("FLAC__stream_encoder_new() returned NULL");
+
+	ok &= FLAC__stream_encoder_set_verify(encoder, verify);
+	ok &= FLAC__stream_encoder_set_channels(encoder, THREADED_CHANNELS);
+	ok &= FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+	ok &= FLAC__stream_encoder_set_sample_rate(encoder, 44100);
+	ok &= FLAC__stream_encoder_set_compression_level(encoder, level);
+	ok &= FLAC__stream_encoder_set_total_samples_estimate(encoder, THREADED_SAMPLES);
+	ok &= FLAC__stream_encoder_set_num_threads(encoder, num_threads);
+	ok &= FLAC__stream_encoder_set_subframe_threads(encoder, subframe_threads);
+	if(!ok) {
+		FLAC__stream_encoder_delete(encoder);
+		return die_("setting up the encoder failed");
+	}
+
+	if(FLAC__stream_encoder_init_stream(encoder, memory_write_callback_, memory_seek_callback_, memory_tell_callback_, /*metadata_callback=*/0, stream) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		FLAC__stream_encoder_delete(encoder);
+		return die_("FLAC__stream_encoder_init_stream() failed");
+	}
+
+	for(i = 0, n = 0; ok && i < THREADED_SAMPLES; i += n, n++) {
+		n = chunks[n % (sizeof(chunks) / sizeof(chunks[0]))];
+		if(n > THREADED_SAMPLES - i)
+			n = THREADED_SAMPLES - i;
+		ok = FLAC__stream_encoder_process_interleaved(encoder, threaded_input_ + i * THREADED_CHANNELS, n);
+	}
+	if(ok)
+		ok = FLAC__stream_encoder_finish(encoder);
+	if(!ok)
+		die_s_("encoding failed", encoder);
+
+	FLAC__stream_encoder_delete(encoder);
+	return ok;
+}
+
+static FLAC__bool test_threaded_output_(void)
+{
+	static const unsigned levels[] = { 1, 5, 8 };
+	memory_stream_struct serial, threaded;
+	unsigned l, subframe_threads, verify;
+
+	printf("\n+++ libFLAC unit test: FLAC__StreamEncoder (%u threads against 1 thread)\n\n", THREADED_NUM_THREADS);
+
+	init_threaded_input_();
+
+	for(subframe_threads = 0; subframe_threads <= 1; subframe_threads++) {
+		for(l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+			for(verify = 0; verify <= 1; verify++) {
+				FLAC__bool ok;
+
+				printf("testing %s threads, compression level %u%s... ", subframe_threads? "subframe" : "frame", levels[l], verify? " with verify" : "");
+				if(!encode_to_memory_(&serial, levels[l], 1, false, verify))
+					return false;
+				if(!encode_to_memory_(&threaded, levels[l], THREADED_NUM_THREADS, subframe_threads, verify)) {
+					free(serial.data);
+					return false;
+				}
+				ok = serial.size == threaded.size && 0 == memcmp(serial.data, threaded.data, serial.size);
+				if(!ok)
+					printf("FAILED, %u threads wrote %u bytes that differ from the %u written by 1 thread\n", THREADED_NUM_THREADS, (unsigned)threaded.size, (unsigned)serial.size);
+				free(serial.data);
+				free(threaded.data);
+				if(!ok)
+					return false;
+				printf("OK\n");
+			}
+		}
+	}
+
+	printf("\nPASSED!\n");
+	return true;
+}
+
+/*
+ * A frame whose second channel is a constant too big for 16 bits is coded
+ * as a constant subframe that decodes to the truncated value, so verify
+ * must catch it.  With threads the mismatch is found on the verify thread
+ * after the process() call that finished the frame has returned; it has
+ * to come back from a later call or from finish(), with the same error
+ * stats as the single-threaded encoder reports.  The threaded encoder is
+ * also deleted straight after a failed process(), with blocks still out
+ * with its workers, which is the teardown an application does on error.
+ */
+
+#define MISMATCH_BLOCKSIZE 4096
+#define MISMATCH_FRAME 7
+#define MISMATCH_VALUE 0x12345
+
+typedef struct {
+	FLAC__bool ok;       /* whether every call succeeded */
+	unsigned failed_at;  /* the samples fed in when process() failed, or THREADED_SAMPLES if it was finish() */
+	FLAC__StreamEncoderState state;
+	FLAC__uint64 absolute_sample;
+	unsigned frame_number, channel, sample;
+	FLAC__int32 expected, got;
+} mismatch_result_struct;
+
+static FLAC__bool encode_mismatch_(mismatch_result_struct *result, unsigned level, unsigned num_threads, FLAC__bool subframe_threads, FLAC__bool finish)
+{
+	memory_stream_struct stream;
+	FLAC__StreamEncoder *encoder;
+	unsigned i, n;
+	FLAC__bool ok = true;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(result, 0, sizeof(*result));
+
+	if(0 == (encoder = FLAC__stream_encoder_new()))
+		return die_("FLAC__stream_encoder_new() returned NULL");
+
+	ok &= FLAC__stream_encoder_set_verify(encoder, true);
+	ok &= FLAC__stream_encoder_set_channels(encoder, THREADED_CHANNELS);
+	ok &= FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+	ok &= FLAC__stream_encoder_set_sample_rate(encoder, 44100);
+	ok &= FLAC__stream_encoder_set_compression_level(encoder, level);
+	/* independent channels, so the bad one can only be coded as a constant */
+	ok &= FLAC__stream_encoder_set_do_mid_side_stereo(encoder, false);
+	ok &= FLAC__stream_encoder_set_loose_mid_side_stereo(encoder, false);
+	ok &= FLAC__stream_encoder_set_blocksize(encoder, MISMATCH_BLOCKSIZE);
+	ok &= FLAC__stream_encoder_set_num_threads(encoder, num_threads);
+	ok &= FLAC__stream_encoder_set_subframe_threads(encoder, subframe_threads);
+	if(!ok) {
+		FLAC__stream_encoder_delete(encoder);
+		return die_("setting up the encoder failed");
+	}
+
+	if(FLAC__stream_encoder_init_stream(encoder, memory_write_callback_, memory_seek_callback_, memory_tell_callback_, /*metadata_callback=*/0, &stream) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		FLAC__stream_encoder_delete(encoder);
+		return die_("FLAC__stream_encoder_init_stream() failed");
+	}
+
+	for(i = 0; ok && i < THREADED_SAMPLES; i += n) {
+		n = 1000;
+		if(n > THREADED_SAMPLES - i)
+			n = THREADED_SAMPLES - i;
+		if(!(ok = FLAC__stream_encoder_process_interleaved(encoder, threaded_input_ + i * THREADED_CHANNELS, n))) {
+			result->failed_at = i + n;
+			result->state = FLAC__stream_encoder_get_state(encoder); /* finish() clears it */
+		}
+	}
+	if(ok || finish) {
+		if(!FLAC__stream_encoder_finish(encoder) && ok) {
+			ok = false;
+			result->failed_at = THREADED_SAMPLES;
+			result->state = FLAC__stream_encoder_get_state(encoder);
+		}
+		FLAC__stream_encoder_get_verify_decoder_error_stats(encoder, &result->absolute_sample, &result->frame_number, &result->channel, &result->sample, &result->expected, &result->got);
+	}
+	result->ok = ok;
+
+	FLAC__stream_encoder_delete(encoder);
+	free(stream.data);
+	return true;
+}
+
+static FLAC__bool test_threaded_verify_mismatch_(void)
+{
+	static const unsigned levels[] = { 1, 8 };
+	const unsigned first_bad = MISMATCH_FRAME * MISMATCH_BLOCKSIZE;
+	mismatch_result_struct serial, threaded, deleted;
+	unsigned i, l, subframe_threads;
+	FLAC__bool ok = true;
+
+	printf("\n+++ libFLAC unit test: FLAC__StreamEncoder (verify mismatch with %u threads)\n\n", THREADED_NUM_THREADS);
+
+	init_threaded_input_();
+	for(i = first_bad; i < first_bad + MISMATCH_BLOCKSIZE; i++)
+		threaded_input_[i * THREADED_CHANNELS + 1] = MISMATCH_VALUE;
+
+	for(subframe_threads = 0; ok && subframe_threads <= 1; subframe_threads++) {
+		for(l = 0; ok && l < sizeof(levels) / sizeof(levels[0]); l++) {
+			printf("testing %s threads, compression level %u... ", subframe_threads? "subframe" : "frame", levels[l]);
+			if(!encode_mismatch_(&serial, levels[l], 1, false, /*finish=*/true) || !encode_mismatch_(&threaded, levels[l], THREADED_NUM_THREADS, subframe_threads, /*finish=*/true) || !encode_mismatch_(&deleted, levels[l], THREADED_NUM_THREADS, subframe_threads, /*finish=*/false))
+				return false;
+			if(serial.ok || serial.state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA) {
+				printf("FAILED, 1 thread gave %s\n", serial.ok? "no error" : FLAC__StreamEncoderStateString[serial.state]);
+				ok = false;
+			}
+			else if(serial.absolute_sample != first_bad || serial.frame_number != MISMATCH_FRAME || serial.channel != 1 || serial.sample != 0 || serial.expected != MISMATCH_VALUE || serial.got != (FLAC__int16)MISMATCH_VALUE) {
+				printf("FAILED, 1 thread reported sample %u frame %u channel %u offset %u, %d for %d\n", (unsigned)serial.absolute_sample, serial.frame_number, serial.channel, serial.sample, serial.got, serial.expected);
+				ok = false;
+			}
+			else if(threaded.ok || threaded.state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA) {
+				printf("FAILED, %u threads gave %s\n", THREADED_NUM_THREADS, threaded.ok? "no error" : FLAC__StreamEncoderStateString[threaded.state]);
+				ok = false;
+			}
+			else if(threaded.failed_at <= first_bad + MISMATCH_BLOCKSIZE) {
+				printf("FAILED, %u threads failed after only %u samples\n", THREADED_NUM_THREADS, threaded.failed_at);
+				ok = false;
+			}
+			else if(threaded.absolute_sample != serial.absolute_sample || threaded.frame_number != serial.frame_number || threaded.channel != serial.channel || threaded.sample != serial.sample || threaded.expected != serial.expected || threaded.got != serial.got) {
+				printf("FAILED, %u threads reported sample %u frame %u channel %u offset %u, %d for %d\n", THREADED_NUM_THREADS, (unsigned)threaded.absolute_sample, threaded.frame_number, threaded.channel, threaded.sample, threaded.got, threaded.expected);
+				ok = false;
+			}
+			else if(deleted.ok || deleted.state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA) {
+				printf("FAILED, %u threads deleted after the error gave %s\n", THREADED_NUM_THREADS, deleted.ok? "no error" : FLAC__StreamEncoderStateString[deleted.state]);
+				ok = false;
+			}
+			else
+				printf("OK, from %s\n", threaded.failed_at == THREADED_SAMPLES? "finish()" : "a later process()");
+		}
+	}
+
+	init_threaded_input_();
+	if(ok)
+		printf("\nPASSED!\n");
+	return ok;
+}
+#endif
+
 static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 {
 	FLAC__StreamEncoder *encoder;
@@ -263,6 +569,17 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_set_num_threads()... ");
+	if(!FLAC__stream_encoder_set_num_threads(encoder, num_threads_))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	/* the last layer asks for subframe threads instead of frame threads */
+	printf("testing FLAC__stream_encoder_set_subframe_threads()... ");
+	if(!FLAC__stream_encoder_set_subframe_threads(encoder, layer == LAYER_FILENAME))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_set_total_samples_estimate()... ");
 	if(!FLAC__stream_encoder_set_total_samples_estimate(encoder, streaminfo_.data.stream_info.total_samples))
 		return die_s_("returned false", encoder);
@@ -447,6 +764,20 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_get_num_threads()... ");
+	if(FLAC__stream_encoder_get_num_threads(encoder) != num_threads_) {
+		printf("FAILED, expected %u, got %u\n", num_threads_, FLAC__stream_encoder_get_num_threads(encoder));
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_get_subframe_threads()... ");
+	if(FLAC__stream_encoder_get_subframe_threads(encoder) != (layer == LAYER_FILENAME)) {
+		printf("FAILED, expected %s, got %s\n", layer == LAYER_FILENAME? "true" : "false", FLAC__stream_encoder_get_subframe_threads(encoder)? "true" : "false");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_encoder_get_total_samples_estimate()... ");
 	if(FLAC__stream_encoder_get_total_samples_estimate(encoder) != streaminfo_.data.stream_info.total_samples) {
 #ifdef _MSC_VER
@@ -517,5 +848,13 @@ FLAC__bool test_encoders(void)
 		is_ogg = true;
 	}
 
+#ifndef FLAC__NO_THREADS
+	if(!test_threaded_output_())
+		return false;
+
+	if(!test_threaded_verify_mismatch_())
+		return false;
+#endif
+
 	return true;
 }
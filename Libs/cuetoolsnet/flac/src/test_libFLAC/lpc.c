@@ -0,0 +1,197 @@
+/* test_libFLAC - Unit tester for libFLAC
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008  Josh Coalson
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/cpu.h" /* from the libFLAC private include area */
+#include "private/lpc.h"
+#include "lpc.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The SSE4.1 and AVX2 residual and restore routines are checked against
+ * the C versions for every order, every quantization level, lengths around
+ * the vector widths, and every alignment of the signal.  The restore
+ * routines fall back to C below order 12, so running all orders also
+ * covers that switch.  The signal is 16 bits for the 32-bit routines and
+ * 24 bits for the 64-bit ones, and the coefficients are as large as they
+ * can be without the prediction overflowing 32 bits, as in the encoder.
+ */
+
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_IA64 && !defined FLAC__INTEGER_ONLY_LIBRARY && (defined FLAC__SSE4_1_SUPPORTED || defined FLAC__AVX2_SUPPORTED)
+
+#define MAX_DATA_LEN 1155
+#define MAX_ALIGN 4
+
+typedef void (*residual_function)(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[]);
+typedef void (*restore_function)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+
+static const unsigned data_lens_[] = { 1, 2, 3, 4, 5, 7, 8, 9, 11, 12, 13, 15, 16, 17, 31, 32, 33, 100, 1152, MAX_DATA_LEN };
+
+static FLAC__int32 signal_[FLAC__MAX_LPC_ORDER + MAX_ALIGN + MAX_DATA_LEN];
+static FLAC__int32 restored_[FLAC__MAX_LPC_ORDER + MAX_ALIGN + MAX_DATA_LEN];
+static FLAC__int32 residual_[MAX_ALIGN + MAX_DATA_LEN];
+static FLAC__int32 reference_[MAX_ALIGN + MAX_DATA_LEN];
+static FLAC__uint32 random_state_ = 1;
+
+static FLAC__int32 random_(FLAC__int32 limit)
+{
+	random_state_ = random_state_ * 1103515245u + 12345u;
+	return (FLAC__int32)((random_state_ >> 1) % (2 * (FLAC__uint32)limit + 1)) - limit;
+}
+
+/* a wandering signal of 'bits' bits, with some full-scale samples thrown in */
+static void init_signal_(unsigned bits)
+{
+	const FLAC__int32 limit = (1 << (bits - 1)) - 1;
+	FLAC__int32 x = 0;
+	unsigned i;
+
+	for(i = 0; i < sizeof(signal_) / sizeof(signal_[0]); i++) {
+		x += random_(limit / 64);
+		if(x > limit)
+			x = limit;
+		else if(x < -limit)
+			x = -limit;
+		signal_[i] = (i % 97 == 0)? ((i & 1)? limit : -limit) : x;
+	}
+}
+
+/* 15-bit coefficients, or smaller where the (shifted) sum of 'order' products with 'bits'-bit samples could pass 30 bits */
+static void init_coefficients_(FLAC__int32 qlp_coeff[], unsigned order, unsigned bits, int lp_quantization, FLAC__bool wide)
+{
+	const FLAC__int64 max_sum = (FLAC__int64)1 << (wide? 30 + lp_quantization : 30);
+	FLAC__int32 limit = (1 << 14) - 1;
+	unsigned j;
+
+	if((FLAC__int64)limit * order << (bits - 1) > max_sum)
+		limit = (FLAC__int32)(max_sum / ((FLAC__int64)order << (bits - 1)));
+	for(j = 0; j < order; j++)
+		qlp_coeff[j] = (j & 3) == 3? (j & 4? limit : -limit) : random_(limit);
+}
+
+static FLAC__bool test_residual_(const char *name, residual_function residual, residual_function reference, FLAC__bool wide)
+{
+	FLAC__int32 qlp_coeff[FLAC__MAX_LPC_ORDER];
+	const unsigned bits = wide? 24 : 16;
+	unsigned order, align, n, data_len;
+	int lp_quantization;
+
+	printf("testing %s residual... ", name);
+	init_signal_(bits);
+	for(order = 1; order <= FLAC__MAX_LPC_ORDER; order++) {
+		for(lp_quantization = 0; lp_quantization <= 15; lp_quantization += (order & 1)? 1 : 5) {
+			init_coefficients_(qlp_coeff, order, bits, lp_quantization, wide);
+			for(align = 0; align < MAX_ALIGN; align++) {
+				const FLAC__int32 *data = signal_ + FLAC__MAX_LPC_ORDER + align;
+				for(n = 0; n < sizeof(data_lens_) / sizeof(data_lens_[0]); n++) {
+					data_len = data_lens_[n];
+					reference(data, data_len, qlp_coeff, order, lp_quantization, reference_);
+					memset(residual_, 0x55, sizeof(residual_));
+					residual(data, data_len, qlp_coeff, order, lp_quantization, residual_ + align);
+					if(memcmp(residual_ + align, reference_, sizeof(FLAC__int32) * data_len) || residual_[align + data_len] != 0x55555555) {
+						printf("FAILED, order=%u lp_quantization=%d align=%u data_len=%u\n", order, lp_quantization, align, data_len);
+						return false;
+					}
+				}
+			}
+		}
+	}
+	printf("OK\n");
+	return true;
+}
+
+static FLAC__bool test_restore_(const char *name, restore_function restore, residual_function compute_residual, FLAC__bool wide)
+{
+	FLAC__int32 qlp_coeff[FLAC__MAX_LPC_ORDER];
+	const unsigned bits = wide? 24 : 16;
+	unsigned order, align, n, data_len;
+	int lp_quantization;
+
+	printf("testing %s restore... ", name);
+	init_signal_(bits);
+	for(order = 1; order <= FLAC__MAX_LPC_ORDER; order++) {
+		for(lp_quantization = 0; lp_quantization <= 15; lp_quantization += (order & 1)? 1 : 5) {
+			init_coefficients_(qlp_coeff, order, bits, lp_quantization, wide);
+			for(align = 0; align < MAX_ALIGN; align++) {
+				const FLAC__int32 *data = signal_ + FLAC__MAX_LPC_ORDER + align;
+				for(n = 0; n < sizeof(data_lens_) / sizeof(data_lens_[0]); n++) {
+					data_len = data_lens_[n];
+					/* the C residual is restored exactly by the C restore, so the signal itself is the reference */
+					compute_residual(data, data_len, qlp_coeff, order, lp_quantization, residual_);
+					memset(restored_, 0x55, sizeof(restored_));
+					memcpy(restored_ + align, signal_ + align, sizeof(FLAC__int32) * FLAC__MAX_LPC_ORDER);
+					restore(residual_, data_len, qlp_coeff, order, lp_quantization, restored_ + FLAC__MAX_LPC_ORDER + align);
+					if(memcmp(restored_ + FLAC__MAX_LPC_ORDER + align, data, sizeof(FLAC__int32) * data_len) || restored_[FLAC__MAX_LPC_ORDER + align + data_len] != 0x55555555) {
+						printf("FAILED, order=%u lp_quantization=%d align=%u data_len=%u\n", order, lp_quantization, align, data_len);
+						return false;
+					}
+				}
+			}
+		}
+	}
+	printf("OK\n");
+	return true;
+}
+#endif
+
+FLAC__bool test_lpc(void)
+{
+	FLAC__CPUInfo cpuinfo;
+
+	printf("\n+++ libFLAC unit test: lpc\n\n");
+
+	FLAC__cpu_info(&cpuinfo);
+
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_IA64 && !defined FLAC__INTEGER_ONLY_LIBRARY && (defined FLAC__SSE4_1_SUPPORTED || defined FLAC__AVX2_SUPPORTED)
+	/* the C restore must give back the signal, or the inputs are no good */
+	if(!test_restore_("C", FLAC__lpc_restore_signal, FLAC__lpc_compute_residual_from_qlp_coefficients, false))
+		return false;
+	if(!test_restore_("C wide", FLAC__lpc_restore_signal_wide, FLAC__lpc_compute_residual_from_qlp_coefficients_wide, true))
+		return false;
+#  ifdef FLAC__SSE4_1_SUPPORTED
+	if(cpuinfo.use_asm && cpuinfo.data.ia64.sse41) {
+		if(!test_residual_("SSE4.1", FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41, FLAC__lpc_compute_residual_from_qlp_coefficients, false))
+			return false;
+		if(!test_residual_("SSE4.1 wide", FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_sse41, FLAC__lpc_compute_residual_from_qlp_coefficients_wide, true))
+			return false;
+		if(!test_restore_("SSE4.1", FLAC__lpc_restore_signal_intrin_sse41, FLAC__lpc_compute_residual_from_qlp_coefficients, false))
+			return false;
+	}
+#  endif
+#  ifdef FLAC__AVX2_SUPPORTED
+	if(cpuinfo.use_asm && cpuinfo.data.ia64.avx2) {
+		if(!test_residual_("AVX2", FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_avx2, FLAC__lpc_compute_residual_from_qlp_coefficients, false))
+			return false;
+		if(!test_residual_("AVX2 wide", FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2, FLAC__lpc_compute_residual_from_qlp_coefficients_wide, true))
+			return false;
+		if(!test_restore_("AVX2 wide", FLAC__lpc_restore_signal_wide_intrin_avx2, FLAC__lpc_compute_residual_from_qlp_coefficients_wide, true))
+			return false;
+	}
+#  endif
+#else
+	(void)cpuinfo;
+	printf("no SSE4.1 or AVX2 routines in this build\n");
+#endif
+
+	printf("\nPASSED!\n");
+	return true;
+}
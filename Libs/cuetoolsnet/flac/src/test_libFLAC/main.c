@@ -20,10 +20,14 @@
 #  include <config.h>
 #endif
 
+#include "bitreader.h"
 #include "bitwriter.h"
+#include "crc.h"
 #include "decoders.h"
 #include "encoders.h"
 #include "format.h"
+#include "lpc.h"
+#include "md5.h"
 #include "metadata.h"
 
 int main(int argc, char *argv[])
@@ -33,6 +37,18 @@ int main(int argc, char *argv[])
 	if(!test_bitwriter())
 		return 1;
 
+	if(!test_bitreader())
+		return 1;
+
+	if(!test_crc())
+		return 1;
+
+	if(!test_lpc())
+		return 1;
+
+	if(!test_md5())
+		return 1;
+
 	if(!test_format())
 		return 1;
 
@@ -0,0 +1,142 @@
+/* test_libFLAC - Unit tester for libFLAC
+ * Copyright (C) 2000,2001,2002,2003,2004,2005,2006,2007,2008  Josh Coalson
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "private/md5.h" /* from the libFLAC private include area */
+#include "md5.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * 16- and 24-bit stereo are packed with SSE2 on x86-64, four samples at a
+ * time with the rest done byte by byte.  The digest of every such signal
+ * is checked against the digest of the same bytes fed in as 4 or 6
+ * channels of 8-bit samples, which only ever goes through the generic
+ * byte-by-byte code.  The signal is fed in whole and in odd-sized pieces,
+ * with and without the hashing thread.
+ */
+
+#define MAX_SAMPLES 4613
+
+static const unsigned sample_counts_[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 17, 1153, MAX_SAMPLES };
+static const unsigned piece_sizes_[] = { 1, 3, 2, 5, 7, 6, 13, 1021 };
+
+static FLAC__int32 signal_[2][MAX_SAMPLES];
+static FLAC__int32 bytes_[6][MAX_SAMPLES];
+static FLAC__uint32 random_state_ = 1;
+
+static FLAC__uint32 random_(void)
+{
+	random_state_ = random_state_ * 1103515245u + 12345u;
+	return random_state_ >> 1;
+}
+
+/* a full-scale noise signal of 'bits' bits, and its little-endian bytes as separate channels */
+static void init_signal_(unsigned bits)
+{
+	const FLAC__int32 limit = (1 << (bits - 1)) - 1;
+	unsigned channel, sample, byte;
+
+	for(sample = 0; sample < MAX_SAMPLES; sample++) {
+		for(channel = 0; channel < 2; channel++) {
+			FLAC__int32 x = (FLAC__int32)(random_() % (2 * (FLAC__uint32)limit + 2)) - limit - 1;
+			if(sample % 61 == channel)
+				x = (sample & 2)? limit : -limit - 1;
+			signal_[channel][sample] = x;
+			for(byte = 0; byte < bits / 8; byte++)
+				bytes_[channel * (bits / 8) + byte][sample] = (x >> (8 * byte)) & 0xff;
+		}
+	}
+}
+
+static FLAC__bool accumulate_(FLAC__MD5Context *ctx, FLAC__int32 (*signal)[MAX_SAMPLES], unsigned channels, unsigned samples, unsigned bytes_per_sample, FLAC__bool in_pieces)
+{
+	const FLAC__int32 *pieces[6];
+	unsigned channel, sample, piece, i;
+
+	for(sample = 0, i = 0; sample < samples; sample += piece, i++) {
+		piece = in_pieces? piece_sizes_[i % (sizeof(piece_sizes_) / sizeof(piece_sizes_[0]))] : samples;
+		if(piece > samples - sample)
+			piece = samples - sample;
+		for(channel = 0; channel < channels; channel++)
+			pieces[channel] = signal[channel] + sample;
+		if(!FLAC__MD5Accumulate(ctx, pieces, channels, piece, bytes_per_sample))
+			return false;
+	}
+	return true;
+}
+
+static FLAC__bool test_stereo_(unsigned bits)
+{
+	const unsigned bytes_per_sample = bits / 8;
+	FLAC__MD5Context ctx;
+	FLAC__byte reference[16], digest[16];
+	unsigned i;
+	int use_thread, in_pieces;
+
+	printf("testing %u-bit stereo... ", bits);
+
+	init_signal_(bits);
+	memset(&ctx, 0, sizeof(ctx)); /* FLAC__MD5Init() looks for a running thread */
+
+	for(i = 0; i < sizeof(sample_counts_) / sizeof(sample_counts_[0]); i++) {
+		const unsigned samples = sample_counts_[i];
+
+		FLAC__MD5Init(&ctx);
+		if(!accumulate_(&ctx, bytes_, 2 * bytes_per_sample, samples, 1, false)) {
+			printf("FAILED, FLAC__MD5Accumulate() returned false\n");
+			return false;
+		}
+		FLAC__MD5Final(reference, &ctx);
+
+		for(use_thread = 0; use_thread <= 1; use_thread++) {
+			for(in_pieces = 0; in_pieces <= 1; in_pieces++) {
+				FLAC__MD5Init(&ctx);
+				FLAC__MD5UseThread(&ctx, use_thread);
+				if(!accumulate_(&ctx, signal_, 2, samples, bytes_per_sample, in_pieces)) {
+					printf("FAILED, FLAC__MD5Accumulate() returned false\n");
+					return false;
+				}
+				FLAC__MD5Final(digest, &ctx);
+				if(memcmp(digest, reference, sizeof(digest))) {
+					printf("FAILED, samples=%u use_thread=%d in_pieces=%d\n", samples, use_thread, in_pieces);
+					return false;
+				}
+			}
+		}
+	}
+
+	printf("OK\n");
+	return true;
+}
+
+FLAC__bool test_md5(void)
+{
+	printf("\n+++ libFLAC unit test: md5\n\n");
+
+	if(!test_stereo_(16))
+		return false;
+	if(!test_stereo_(24))
+		return false;
+
+	printf("\nPASSED!\n");
+	return true;
+}
@@ -89,10 +89,18 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\bitreader.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\bitwriter.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\crc.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\decoders.c
 # End Source File
 # Begin Source File
@@ -105,10 +113,18 @@ SOURCE=.\format.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\lpc.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\main.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\md5.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\metadata.c
 # End Source File
 # Begin Source File
@@ -125,10 +141,18 @@ SOURCE=.\metadata_object.c
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=.\bitreader.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\bitwriter.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\crc.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\decoders.h
 # End Source File
 # Begin Source File
@@ -141,6 +165,14 @@ SOURCE=.\format.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lpc.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\md5.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\metadata.h
 # End Source File
 # End Group
@@ -28,9 +28,10 @@
  */
 
 #pragma once
-#include <windows.h>
-#include "TTACommon.h"
+#include <string.h>
+#include "ttacommon.h"
 #include "TTAError.h"
+#include "TTAIO.h"
 #include "crc32.h"
 
 namespace TTALib 
@@ -38,44 +39,74 @@ namespace TTALib
 	class BitReader
 	{
 	protected:	
-		HANDLE hInFile;
+		TTAInput *io;
 
-		unsigned char bit_buffer[BIT_BUFFER_SIZE + 8];
-		unsigned char *bit_buffer_end;
+		// staging buffer, NULL when the input is directly addressable
+		unsigned char *bit_buffer;
+		const unsigned char *bit_buffer_end;
+		const unsigned char *stream_start;
 
-		unsigned long frame_crc32;
-		unsigned long bit_count;
-		unsigned long bit_cache;
-		unsigned char *bitpos;
+		uint32 frame_crc32;
+		uint32 bit_count;
+		uint32 bit_cache;
+		const unsigned char *bitpos;
 
-		unsigned long *st;
-		unsigned long next_frame_pos;
+		uint32 *st;
+		uint32 next_frame_pos;
+
+		void FillBitBuffer ()
+		{
+			// mapped data is never refilled, running off its end means
+			// the stream is truncated
+			if (!bit_buffer)
+				throw TTAException (READ_ERROR);
+
+			input_byte_count += io->Read (bit_buffer, BIT_BUFFER_SIZE);
+			bitpos = bit_buffer;
+		}
+
+		void MapFrames ()
+		{
+			uint32 len;
+
+			bitpos = io->GetData (&len);
+			bit_buffer_end = bitpos + len;
+			input_byte_count = bitpos - stream_start;
+		}
 
 	public:
-		BitReader(HANDLE fd) :
-			frame_crc32(0xFFFFFFFFUL), hInFile (fd),
-			bit_count(0), bit_cache(0), bit_buffer_end(bit_buffer + BIT_BUFFER_SIZE),
-			bitpos(bit_buffer_end), input_byte_count (0)
-		{			
+		BitReader(TTAInput *input) :
+			io (input), bit_buffer (NULL), frame_crc32(0xFFFFFFFFUL),
+			bit_count(0), bit_cache(0), input_byte_count (0)
+		{
+			uint32 len;
+
+			if ((stream_start = io->GetData (&len)) == NULL) {
+				bit_buffer = new unsigned char[BIT_BUFFER_SIZE + 8];
+				bit_buffer_end = bit_buffer + BIT_BUFFER_SIZE;
+			} else bit_buffer_end = stream_start + len;
+			bitpos = bit_buffer_end;
 		}
 
-		virtual ~BitReader(void) {}
+		virtual ~BitReader(void)
+		{
+			if (bit_buffer)
+				delete [] bit_buffer;
+		}
 
 		virtual void GetHeader (TTAHeader *ttahdr)
 		{
-			unsigned long result, checksum;
+			uint32 checksum;
 
-			if (!ReadFile(hInFile, ttahdr, sizeof(TTAHeader), &result, NULL) ||
-				result != sizeof (TTAHeader))
-			{
+			if (io->Read (ttahdr, sizeof(TTAHeader)) != sizeof (TTAHeader))
 				throw TTAException (READ_ERROR);
-			} else input_byte_count += sizeof(*ttahdr);
+			else input_byte_count += sizeof(*ttahdr);
 
 			// check for supported formats
 			if (ENDSWAP_INT32(ttahdr->TTAid) != TTA1_SIGN) 
 				throw TTAException (FORMAT_ERROR);
 
-			checksum = crc32((unsigned char *) ttahdr, sizeof(TTAHeader) - sizeof(long));
+			checksum = crc32((unsigned char *) ttahdr, sizeof(TTAHeader) - sizeof(uint32));
 			if (checksum != ttahdr->CRC32) 
 				throw TTAException (FILE_ERROR);
 
@@ -86,38 +117,35 @@ namespace TTALib
 			ttahdr->DataLength = ENDSWAP_INT32(ttahdr->DataLength);
 		}
 
-		virtual bool GetSeekTable (unsigned long *seek_table, long st_size)
+		virtual bool GetSeekTable (uint32 *seek_table, int32 st_size)
 		{
-			unsigned long result, checksum;
+			uint32 checksum;
 			bool st_state = false;
 		
-			if (!ReadFile(hInFile, seek_table, st_size * sizeof(long), &result, NULL) ||
-				result != st_size * sizeof(long))
+			if (io->Read (seek_table, st_size * sizeof(uint32)) != st_size * sizeof(uint32))
 				throw TTAException (READ_ERROR);
-			else input_byte_count += st_size * sizeof(long);
+			else input_byte_count += st_size * sizeof(uint32);
 
-			checksum = crc32((unsigned char *) seek_table, (st_size - 1) * sizeof(long));
+			checksum = crc32((unsigned char *) seek_table, (st_size - 1) * sizeof(uint32));
 			if (checksum == ENDSWAP_INT32(seek_table[st_size - 1]))
 				st_state = true;
 
 			for (st = seek_table; st < (seek_table + st_size); st++)
 				*st = ENDSWAP_INT32(*st);
 						
-			next_frame_pos = SetFilePointer (hInFile, 0, NULL, FILE_CURRENT);
+			next_frame_pos = io->GetPosition ();
 			st = seek_table;
 
+			if (!bit_buffer)
+				MapFrames ();
+
 			return st_state;
 		}
 
-		virtual void GetBinary(unsigned long *value, unsigned long bits) {
+		virtual void GetBinary(uint32 *value, uint32 bits) {
 			while (bit_count < bits) {
-				if (bitpos == bit_buffer_end) {
-					unsigned long result;			 
-					if (!ReadFile (hInFile, bit_buffer, BIT_BUFFER_SIZE, &result, NULL))
-						throw TTAException (READ_ERROR);
-					input_byte_count += result;
-					bitpos = bit_buffer;
-				}
+				if (bitpos == bit_buffer_end)
+					FillBitBuffer ();
 
 				UPDATE_CRC32(*bitpos, frame_crc32);
 				bit_cache |= *bitpos << bit_count;
@@ -131,18 +159,13 @@ namespace TTALib
 			bit_cache &= bit_mask[bit_count];
 		}
 
-		virtual void GetUnary(unsigned long *value) 
+		virtual void GetUnary(uint32 *value) 
 		{
 			*value = 0;
 
 			while (!(bit_cache ^ bit_mask[bit_count])) {
-				if (bitpos == bit_buffer_end) {
-					unsigned long result;			 
-					if (!ReadFile (hInFile, bit_buffer, BIT_BUFFER_SIZE, &result, NULL)) 
-						throw TTAException (READ_ERROR);
-					input_byte_count += result;
-					bitpos = bit_buffer;
-				}
+				if (bitpos == bit_buffer_end)
+					FillBitBuffer ();
 
 				*value += bit_count;
 				bit_cache = *bitpos++;
@@ -162,38 +185,43 @@ namespace TTALib
 
 		virtual int Done ()
 		{
-			unsigned long crc32, rbytes, result;
+			uint32 crc32, rbytes, result;
 			frame_crc32 ^= 0xFFFFFFFFUL;
 
 	  		next_frame_pos += *st++;
 
 			rbytes = bit_buffer_end - bitpos;
-			if (rbytes < sizeof(long)) {
-				CopyMemory(bit_buffer, bitpos, 4);
-				if (!ReadFile(hInFile, bit_buffer + rbytes,
-					BIT_BUFFER_SIZE - rbytes, &result, NULL))
+			if (rbytes < sizeof(uint32)) {
+				if (!bit_buffer)
 					throw TTAException (READ_ERROR);
-				input_byte_count += result;
+				memcpy(bit_buffer, bitpos, 4);
+				input_byte_count += io->Read (bit_buffer + rbytes,
+					BIT_BUFFER_SIZE - rbytes);
 				bitpos = bit_buffer;
 			}
 
-			CopyMemory(&crc32, bitpos, 4);
+			memcpy(&crc32, bitpos, 4);
 			crc32 = ENDSWAP_INT32(crc32);
-			bitpos += sizeof(long);
+			bitpos += sizeof(uint32);
 			result = (crc32 != frame_crc32);
 
 			bit_cache = bit_count = 0;
 			frame_crc32 = 0xFFFFFFFFUL;
 
+			if (!bit_buffer)
+				input_byte_count = bitpos - stream_start;
+
 			return result;
 		}
 
 		virtual void SkipFrame ()
 		{
-			SetFilePointer(hInFile, next_frame_pos, NULL, FILE_BEGIN);
-			bitpos = bit_buffer_end;
+			io->SetPosition (next_frame_pos);
+			if (!bit_buffer)
+				MapFrames ();
+			else bitpos = bit_buffer_end;
 		}
 
-		unsigned long input_byte_count;
+		uint32 input_byte_count;
 	};
 };
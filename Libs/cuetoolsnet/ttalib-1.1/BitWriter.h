@@ -28,9 +28,10 @@
  */
 
 #pragma once
-#include <windows.h>
-#include "TTACommon.h"
+#include <string.h>
+#include "ttacommon.h"
 #include "TTAError.h"
+#include "TTAIO.h"
 #include "crc32.h"
 
 namespace TTALib 
@@ -38,36 +39,48 @@ namespace TTALib
 	class BitWriter
 	{
 	protected:
-		HANDLE hOutFile;
-		unsigned long start_offset;
+		TTAOutput *io;
+		uint32 start_offset;
 
-		unsigned char bit_buffer[BIT_BUFFER_SIZE + 8];
+		unsigned char *bit_buffer;
 		unsigned char *bit_buffer_end;
-		unsigned long frame_crc32;
-		unsigned long bit_count;
-		unsigned long bit_cache;
+		uint32 frame_crc32;
+		uint32 bit_count;
+		uint32 bit_cache;
 		unsigned char *bitpos;
-		unsigned long lastpos;
+		uint32 lastpos;
+
+		void FlushBitBuffer ()
+		{
+			if (io->Write (bit_buffer, BIT_BUFFER_SIZE) != BIT_BUFFER_SIZE) 
+				throw TTAException (WRITE_ERROR);
+
+			output_byte_count += BIT_BUFFER_SIZE;
+			bitpos = bit_buffer;
+		}
 
 	public:
-		unsigned long output_byte_count;
+		uint32 output_byte_count;
 
-		BitWriter(HANDLE fd, unsigned long offset) :
+		BitWriter(TTAOutput *output, uint32 offset) :
+			io (output), start_offset(offset),
 			frame_crc32(0xFFFFFFFFUL),
-			start_offset(offset), hOutFile (fd),
 			bit_count(0), bit_cache(0),
-			bitpos (bit_buffer), lastpos (0), output_byte_count (0),
-			bit_buffer_end (bit_buffer + BIT_BUFFER_SIZE)
+			lastpos (0), output_byte_count (0)
 		{
-	  		SetFilePointer (hOutFile, start_offset, NULL, FILE_BEGIN);
+			bit_buffer = new unsigned char[BIT_BUFFER_SIZE + 8];
+			bit_buffer_end = bit_buffer + BIT_BUFFER_SIZE;
+			bitpos = bit_buffer;
+	  		io->SetPosition (start_offset);
 		}
 
-		virtual ~BitWriter(void) {}
+		virtual ~BitWriter(void)
+		{
+			delete [] bit_buffer;
+		}
 
 		virtual void PutHeader (TTAHeader ttahdr)
 		{
-			unsigned long result;
-
 			ttahdr.TTAid = ENDSWAP_INT32(TTA1_SIGN);
 			ttahdr.AudioFormat = ENDSWAP_INT16(ttahdr.AudioFormat); 
 			ttahdr.NumChannels = ENDSWAP_INT16(ttahdr.NumChannels);
@@ -75,56 +88,40 @@ namespace TTALib
 			ttahdr.SampleRate = ENDSWAP_INT32(ttahdr.SampleRate);
 			ttahdr.DataLength = ENDSWAP_INT32(ttahdr.DataLength);
 			ttahdr.CRC32 = crc32((unsigned char *) &ttahdr,
-				sizeof(TTAHeader) - sizeof(long));
+				sizeof(TTAHeader) - sizeof(uint32));
 			ttahdr.CRC32 = ENDSWAP_INT32(ttahdr.CRC32);
 
 			// write TTA header
-			if (!WriteFile(hOutFile, &ttahdr, sizeof(TTAHeader), &result, NULL) ||
-				result != sizeof (TTAHeader))
-			{
-				CloseHandle (hOutFile);
+			if (io->Write (&ttahdr, sizeof(TTAHeader)) != sizeof (TTAHeader))
 				throw TTAException (WRITE_ERROR);
-			}
 	
 			lastpos = (output_byte_count += sizeof(TTAHeader));
 		}
 
-		virtual void PutSeekTable (unsigned long *seek_table, long st_size)
+		virtual void PutSeekTable (uint32 *seek_table, int32 st_size)
 		{
-			unsigned long result;
-			unsigned long *st;
+			uint32 *st;
 
-			if (SetFilePointer (hOutFile, 0, NULL, FILE_CURRENT) != start_offset + sizeof(TTAHeader))
-				SetFilePointer (hOutFile, start_offset + sizeof(TTAHeader), NULL,  FILE_BEGIN);
+			if (io->GetPosition () != start_offset + sizeof(TTAHeader))
+				io->SetPosition (start_offset + sizeof(TTAHeader));
 			else
-				lastpos = (output_byte_count += st_size * sizeof(long));
+				lastpos = (output_byte_count += st_size * sizeof(uint32));
 			
 			for (st = seek_table; st < (seek_table + st_size - 1); st++)
 				*st = ENDSWAP_INT32(*st);
 			seek_table[st_size - 1] = crc32((unsigned char *) seek_table, 
-				(st_size - 1) * sizeof(long));
+				(st_size - 1) * sizeof(uint32));
 			seek_table[st_size - 1] = ENDSWAP_INT32(seek_table[st_size - 1]);
 
-			if (!WriteFile(hOutFile, seek_table, st_size * sizeof(long), &result, NULL) ||
-				result != st_size * sizeof(long))
-			{
-				CloseHandle (hOutFile);
+			if (io->Write (seek_table, st_size * sizeof(uint32)) != st_size * sizeof(uint32))
 				throw TTAException (WRITE_ERROR);
-			}
 		}
 
-		virtual void PutBinary(unsigned long value, unsigned long bits) 
+		virtual void PutBinary(uint32 value, uint32 bits) 
 		{
 			while (bit_count >= 8) {
-				if (bitpos == bit_buffer_end) {
-					unsigned long result;
-					if (!WriteFile (hOutFile, bit_buffer, BIT_BUFFER_SIZE, &result, NULL) ||
-						result != BIT_BUFFER_SIZE) 
-						throw TTAException (WRITE_ERROR);
-						
-					output_byte_count += result;
-					bitpos = bit_buffer;
-				}
+				if (bitpos == bit_buffer_end)
+					FlushBitBuffer ();
 
 				*bitpos = (unsigned char) (bit_cache & 0xFF);
 				UPDATE_CRC32(*bitpos, frame_crc32);
@@ -137,19 +134,12 @@ namespace TTALib
 			bit_count += bits;
 		}
 
-		virtual void PutUnary(unsigned long value) 
+		virtual void PutUnary(uint32 value) 
 		{
 			do {
 				while (bit_count >= 8) {
-					if (bitpos == bit_buffer_end) {
-						unsigned long result;
-						if (!WriteFile (hOutFile, bit_buffer, BIT_BUFFER_SIZE, &result, NULL) ||
-							result != BIT_BUFFER_SIZE) 
-							throw TTAException (WRITE_ERROR);								  
-  
-						output_byte_count += result;
-						bitpos = bit_buffer;
-					}
+					if (bitpos == bit_buffer_end)
+						FlushBitBuffer ();
 
 					*bitpos = (unsigned char) (bit_cache & 0xFF);
 					UPDATE_CRC32(*bitpos, frame_crc32);
@@ -172,7 +162,7 @@ namespace TTALib
 
 		virtual int Done() 
 		{
-			unsigned long res, bytes_to_write;
+			uint32 res, bytes_to_write;
 
 			while (bit_count) {
 				*bitpos = (unsigned char) (bit_cache & 0xFF);
@@ -184,11 +174,10 @@ namespace TTALib
 
 			frame_crc32 ^= 0xFFFFFFFFUL;
 			frame_crc32 = ENDSWAP_INT32(frame_crc32);
-			CopyMemory(bitpos, &frame_crc32, 4);
-			bytes_to_write = bitpos + sizeof(long) - bit_buffer;
+			memcpy(bitpos, &frame_crc32, 4);
+			bytes_to_write = bitpos + sizeof(uint32) - bit_buffer;
 			
-			if (!WriteFile(hOutFile, bit_buffer, bytes_to_write, &res, NULL) || 
-				res != bytes_to_write)
+			if ((res = io->Write (bit_buffer, bytes_to_write)) != bytes_to_write)
 				throw TTAException (WRITE_ERROR);
 
 			output_byte_count += res;
@@ -2,4 +2,4 @@
 // TTALib.pch will be the pre-compiled header
 // stdafx.obj will contain the pre-compiled type information
 
-#include "stdafx.h"
+#include "Stdafx.h"
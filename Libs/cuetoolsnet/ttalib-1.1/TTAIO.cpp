@@ -0,0 +1,199 @@
+/*
+ * TTAIO.cpp
+ *
+ * Description: File and memory-mapped byte stream backends
+ *
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * aint with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Please see the file COPYING in this directory for full copyright
+ * information.
+ */
+
+#include "Stdafx.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+#include "TTAIO.h"
+
+namespace TTALib
+{
+	/************************** file input ******************************/
+
+	TTAFileInput::TTAFileInput (TTA_FILE fd) : hFile (fd)
+	{
+#ifndef _WIN32
+		off_t cur = lseek (hFile, 0, SEEK_CUR);
+		pos = (cur < 0) ? 0 : (uint32) cur;
+#endif
+	}
+
+	uint32 TTAFileInput::Read (void *buf, uint32 len)
+	{
+#ifdef _WIN32
+		DWORD result;
+
+		if (!ReadFile (hFile, buf, len, &result, NULL))
+			throw TTAException (READ_ERROR);
+		return result;
+#else
+		ssize_t result;
+
+		do result = pread (hFile, buf, len, pos);
+		while (result < 0 && errno == EINTR);
+		if (result < 0)
+			throw TTAException (READ_ERROR);
+		pos += (uint32) result;
+		return (uint32) result;
+#endif
+	}
+
+	uint32 TTAFileInput::GetPosition ()
+	{
+#ifdef _WIN32
+		return SetFilePointer (hFile, 0, NULL, FILE_CURRENT);
+#else
+		return pos;
+#endif
+	}
+
+	void TTAFileInput::SetPosition (uint32 newpos)
+	{
+#ifdef _WIN32
+		SetFilePointer (hFile, newpos, NULL, FILE_BEGIN);
+#else
+		pos = newpos;
+#endif
+	}
+
+	/************************** file output *****************************/
+
+	TTAFileOutput::TTAFileOutput (TTA_FILE fd) : hFile (fd)
+	{
+#ifndef _WIN32
+		off_t cur = lseek (hFile, 0, SEEK_CUR);
+		pos = (cur < 0) ? 0 : (uint32) cur;
+#endif
+	}
+
+	uint32 TTAFileOutput::Write (const void *buf, uint32 len)
+	{
+#ifdef _WIN32
+		DWORD result;
+
+		if (!WriteFile (hFile, buf, len, &result, NULL))
+			throw TTAException (WRITE_ERROR);
+		return result;
+#else
+		const unsigned char *src = (const unsigned char *) buf;
+		uint32 written = 0;
+
+		// pwrite may stop short, e.g. when interrupted by a signal
+		while (written < len) {
+			ssize_t result = pwrite (hFile, src + written, len - written, pos);
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result <= 0)
+				throw TTAException (WRITE_ERROR);
+			written += (uint32) result;
+			pos += (uint32) result;
+		}
+		return written;
+#endif
+	}
+
+	uint32 TTAFileOutput::GetPosition ()
+	{
+#ifdef _WIN32
+		return SetFilePointer (hFile, 0, NULL, FILE_CURRENT);
+#else
+		return pos;
+#endif
+	}
+
+	void TTAFileOutput::SetPosition (uint32 newpos)
+	{
+#ifdef _WIN32
+		SetFilePointer (hFile, newpos, NULL, FILE_BEGIN);
+#else
+		pos = newpos;
+#endif
+	}
+
+	/************************** mapped input ****************************/
+
+	TTAMappedInput::TTAMappedInput (TTA_FILE fd)
+	{
+#ifdef _WIN32
+		DWORD size_hi;
+
+		hMapping = NULL;
+		pos = SetFilePointer (fd, 0, NULL, FILE_CURRENT);
+		size = GetFileSize (fd, &size_hi);
+		if (size == INVALID_FILE_SIZE && GetLastError () != NO_ERROR)
+			throw TTAException (READ_ERROR);
+		if (size_hi)
+			throw TTAException (FORMAT_ERROR);
+		if (!size)
+			return;
+
+		if (!(hMapping = CreateFileMapping (fd, NULL, PAGE_READONLY, 0, 0, NULL)))
+			throw TTAException (READ_ERROR);
+		if (!(buffer = (const unsigned char *) MapViewOfFile (hMapping, FILE_MAP_READ, 0, 0, 0))) {
+			CloseHandle (hMapping);
+			throw TTAException (READ_ERROR);
+		}
+#else
+		struct stat st;
+		off_t cur;
+		void *map;
+
+		if (fstat (fd, &st) < 0 || (cur = lseek (fd, 0, SEEK_CUR)) < 0)
+			throw TTAException (READ_ERROR);
+		if ((uint64) st.st_size > 0xFFFFFFFFUL)
+			throw TTAException (FORMAT_ERROR);
+		size = (uint32) st.st_size;
+		pos = (uint32) cur;
+		if (!size)
+			return;
+
+		if ((map = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+			throw TTAException (READ_ERROR);
+		madvise (map, size, MADV_SEQUENTIAL);
+		buffer = (const unsigned char *) map;
+#endif
+	}
+
+	TTAMappedInput::~TTAMappedInput (void)
+	{
+#ifdef _WIN32
+		if (buffer)
+			UnmapViewOfFile (buffer);
+		if (hMapping)
+			CloseHandle (hMapping);
+#else
+		if (buffer)
+			munmap ((void *) buffer, size);
+#endif
+	}
+};
@@ -0,0 +1,199 @@
+/*
+ * TTAIO.h
+ *
+ * Description: Byte stream backends used by the bit reader and writer
+ *
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * aint with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Please see the file COPYING in this directory for full copyright
+ * information.
+ */
+
+#pragma once
+#include <string.h>
+#include "ttacommon.h"
+#include "TTAError.h"
+
+#ifdef _WIN32
+	typedef void *TTA_FILE;		// HANDLE, without pulling in windows.h
+	#define TTA_INVALID_FILE	((TTA_FILE) -1)
+#else
+	typedef int TTA_FILE;
+	#define TTA_INVALID_FILE	(-1)
+#endif
+
+namespace TTALib
+{
+	// Byte source for BitReader. Backends that keep the whole stream
+	// addressable return it from GetData, and the bit reader then decodes
+	// straight out of that memory instead of staging it through Read.
+	class TTAInput
+	{
+	public:
+		virtual ~TTAInput(void) {}
+
+		// returns the number of bytes read, 0 at the end of the input
+		virtual uint32 Read (void *buf, uint32 len) = 0;
+		virtual uint32 GetPosition () = 0;
+		virtual void SetPosition (uint32 pos) = 0;
+
+		// returns the bytes from the current position to the end of the
+		// input, or NULL if they are only reachable through Read
+		virtual const unsigned char *GetData (uint32 *len)
+		{
+			*len = 0;
+			return NULL;
+		}
+	};
+
+	// Byte sink for BitWriter
+	class TTAOutput
+	{
+	public:
+		virtual ~TTAOutput(void) {}
+
+		// returns the number of bytes written
+		virtual uint32 Write (const void *buf, uint32 len) = 0;
+		virtual uint32 GetPosition () = 0;
+		virtual void SetPosition (uint32 pos) = 0;
+	};
+
+	// Reads from a caller-supplied buffer, which must outlive the input
+	class TTAMemoryInput : public TTAInput
+	{
+	protected:
+		const unsigned char *buffer;
+		uint32 size, pos;
+
+		TTAMemoryInput () : buffer (NULL), size (0), pos (0) {}
+
+	public:
+		TTAMemoryInput (const void *data, uint32 len) :
+			buffer ((const unsigned char *) data), size (len), pos (0)
+		{
+		}
+
+		virtual uint32 Read (void *buf, uint32 len)
+		{
+			if (len > size - pos)
+				len = size - pos;
+			memcpy (buf, buffer + pos, len);
+			pos += len;
+			return len;
+		}
+
+		virtual uint32 GetPosition () { return pos; }
+
+		virtual void SetPosition (uint32 newpos)
+		{
+			if (newpos > size)
+				throw TTAException (READ_ERROR);
+			pos = newpos;
+		}
+
+		virtual const unsigned char *GetData (uint32 *len)
+		{
+			*len = size - pos;
+			return buffer + pos;
+		}
+	};
+
+	// Writes into a caller-supplied buffer of fixed capacity
+	class TTAMemoryOutput : public TTAOutput
+	{
+		unsigned char *buffer;
+		uint32 capacity, size, pos;
+
+	public:
+		TTAMemoryOutput (void *data, uint32 len) :
+			buffer ((unsigned char *) data), capacity (len), size (0), pos (0)
+		{
+		}
+
+		virtual uint32 Write (const void *buf, uint32 len)
+		{
+			if (len > capacity - pos)
+				len = capacity - pos;
+			memcpy (buffer + pos, buf, len);
+			pos += len;
+			if (pos > size)
+				size = pos;
+			return len;
+		}
+
+		virtual uint32 GetPosition () { return pos; }
+
+		virtual void SetPosition (uint32 newpos)
+		{
+			if (newpos > capacity)
+				throw TTAException (WRITE_ERROR);
+			pos = newpos;
+		}
+
+		// number of bytes produced so far
+		uint32 GetSize () const { return size; }
+	};
+
+	// Reads through an open file: ReadFile on Win32, pread elsewhere.
+	// The file is not closed by the input.
+	class TTAFileInput : public TTAInput
+	{
+		TTA_FILE hFile;
+#ifndef _WIN32
+		uint32 pos;
+#endif
+
+	public:
+		TTAFileInput (TTA_FILE fd);
+
+		virtual uint32 Read (void *buf, uint32 len);
+		virtual uint32 GetPosition ();
+		virtual void SetPosition (uint32 newpos);
+	};
+
+	// Writes through an open file: WriteFile on Win32, pwrite elsewhere.
+	// The file is not closed by the output.
+	class TTAFileOutput : public TTAOutput
+	{
+		TTA_FILE hFile;
+#ifndef _WIN32
+		uint32 pos;
+#endif
+
+	public:
+		TTAFileOutput (TTA_FILE fd);
+
+		virtual uint32 Write (const void *buf, uint32 len);
+		virtual uint32 GetPosition ();
+		virtual void SetPosition (uint32 newpos);
+	};
+
+	// Maps the whole file read-only. Positions are absolute file offsets,
+	// starting at the current file position. The file is not closed by the
+	// input, but must stay open while it is in use.
+	class TTAMappedInput : public TTAMemoryInput
+	{
+#ifdef _WIN32
+		void *hMapping;
+#endif
+
+	public:
+		TTAMappedInput (TTA_FILE fd);
+		virtual ~TTAMappedInput (void);
+	};
+};
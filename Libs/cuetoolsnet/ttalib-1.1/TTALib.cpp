@@ -27,14 +27,14 @@
  * information.
  */
 
-#include "stdafx.h"
+#include "Stdafx.h"
 #include <windows.h>
 
 #include "TTALib.h"
 #include "ttacommon.h"
 #include "filters3.h"
-#include "ttawriter.h"
-#include "ttareader.h"
+#include "TTAWriter.h"
+#include "TTAReader.h"
 #include "WavFile.h"
 #include "TTAError.h"
 #include "TTATester.h"
@@ -124,7 +124,7 @@ TTALib::TTAEncoder::~TTAEncoder()
 		CloseHandle (hFile);
 }
 
-bool TTALib::TTAEncoder::CompressBlock (long *buf, long bufLen)
+bool TTALib::TTAEncoder::CompressBlock (int32 *buf, int32 bufLen)
 {
 	return writer->CompressBlock (buf, bufLen);
 }
@@ -195,6 +195,12 @@ TTALib::TTADecoder::TTADecoder (HANDLE hInFile)
 	reader = new TTAReader(hInFile);
 }
 
+TTALib::TTADecoder::TTADecoder (TTAInput *input)
+	: hFile(INVALID_HANDLE_VALUE)
+{
+	reader = new TTAReader(input);
+}
+
 TTALib::TTADecoder::~TTADecoder()
 {
 	if (reader)
@@ -203,7 +209,7 @@ TTALib::TTADecoder::~TTADecoder()
 		CloseHandle (hFile);
 }
 
-long TTALib::TTADecoder::GetBlock (long **buf)
+long TTALib::TTADecoder::GetBlock (int32 **buf)
 {
 	return reader->GetBlock (buf);
 }
@@ -241,28 +247,6 @@ long TTALib::TTADecoder::GetDataLength ()
 	return reader->ttahdr.DataLength;
 }
 
-// ************************* basic functions *****************************
-
-void rice_init(adapt *rice, unsigned long k0, unsigned long k1)
-{
-	rice->k0 = k0;
-	rice->k1 = k1;
-	rice->sum0 = shift_16[k0];
-	rice->sum1 = shift_16[k1];
-}
-
-void encoder_init(encoder *tta, long nch, long byte_size) 
-{
-	long *fset = flt_set[byte_size - 1];
-	long i;
-
-	for (i = 0; i < nch; i++) {
-		filter_init(&tta[i].fst, fset[0], fset[1]);
-		rice_init(&tta[i].rice, 10, 10);
-		tta[i].last = 0;
-	}
-}
-
 TTALib::TTAError TTALib::CopyId3Header (HANDLE hInFile, HANDLE hOutFile, bool CopyID3v2Tag)
 {
 	struct {
@@ -318,7 +302,7 @@ TTALib::TTAError TTALib::Wav2TTA (const char *infile, const char *outfile,
 	HANDLE hInFile, hOutFile;
 	unsigned long data_size, byte_size, data_len, framelen, is_float;
 	unsigned long offset = 0;
-	long *data = NULL;	
+	int32 *data = NULL;	
 	TTALib::TTAEncoder *encoder;
 	TTALib::TTAError err;
 	TTALib::WaveFile wav;
@@ -388,12 +372,12 @@ TTALib::TTAError TTALib::Wav2TTA (const char *infile, const char *outfile,
     
 	err = TTALib::TTA_NO_ERROR;
 	try {
-		data = new long [(wav.wave_hdr.NumChannels << is_float) * framelen * sizeof(long)];
+		data = new int32 [(wav.wave_hdr.NumChannels << is_float) * framelen * sizeof(int32)];
 
 		encoder = new TTALib::TTAEncoder (hOutFile, true, 
 		wav.wave_hdr.AudioFormat, wav.wave_hdr.NumChannels, wav.wave_hdr.BitsPerSample,
 		wav.wave_hdr.SampleRate, data_len);
-		unsigned long len;
+		uint32 len;
 		for (;;)
 		{
 			len = framelen * wav.wave_hdr.NumChannels;
@@ -439,8 +423,8 @@ TTALib::TTAError TTALib::TTA2Wav (const char *infile, const char *outfile,
 					bool CopyID3v2Tag, TTACALLBACK TTACallback, void *uParam)
 {
 	HANDLE hInFile, hOutFile;
-	long *buf;
-	unsigned long byte_size, data_size, buflen;
+	int32 *buf;
+	uint32 byte_size, data_size, buflen;
 	TTALib::TTADecoder *decoder;
 	TTALib::TTAError err;
 	TTALib::WaveFile wav;
@@ -530,10 +514,11 @@ TTALib::TTAError TTALib::TTATest (const char *infile,
 		return err;
 	}
 
+	TTAFileInput input (hFile);
 	tester = NULL;
 	try 
 	{
-		tester  = new TTATester(hFile);
+		tester  = new TTATester(&input);
 
 		tester->GetHeader (&ttahdr);
 		while (tester->TestFrame())
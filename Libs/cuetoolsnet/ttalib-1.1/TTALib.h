@@ -82,7 +82,7 @@ namespace TTALib
 
 		~TTAEncoder();
 		
-		bool CompressBlock (long *buf, long bufLen);
+		bool CompressBlock (int32 *buf, int32 bufLen);
 
 		TTAStat GetStat ();
 	};
@@ -96,9 +96,10 @@ namespace TTALib
 	public:
 		TTADecoder (const char *filename);
 		TTADecoder (HANDLE hInFile);
+		TTADecoder (TTAInput *input);
 		~TTADecoder();
 
-		long GetBlock (long **buf);
+		long GetBlock (int32 **buf);
 
 		long GetAudioFormat ();
 		long GetNumChannels ();
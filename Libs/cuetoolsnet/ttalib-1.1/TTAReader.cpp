@@ -27,25 +27,41 @@
  * information.
  */
 
-#include "stdafx.h"
+#include "Stdafx.h"
+#include <stdlib.h>
 #include "BitReader.h"
 #include "TTAReader.h"
 #include "filters3.h"
 
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TTA_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace TTALib 
 {
-	TTAReader::TTAReader (HANDLE fd) : hInFile(fd)  
+	TTAReader::TTAReader (TTA_FILE fd) : io (new TTAFileInput (fd)), io_owned (true)
+	{
+		Init ();
+	}
+
+	TTAReader::TTAReader (TTAInput *input) : io (input), io_owned (false)
+	{
+		Init ();
+	}
+
+	void TTAReader::Init ()
 	{
-		unsigned long data_size;
+		uint32 data_size;
 		int st_size;
 
 		// clear statistics
 		output_byte_count = 0;
-		bitReader = new BitReader (hInFile);
+		bitReader = new BitReader (io);
 		bitReader->GetHeader (&ttahdr);
 
 		byte_size = (ttahdr.BitsPerSample + 7) / 8;
-		framelen = (long) (FRAME_TIME * ttahdr.SampleRate);
+		framelen = (int32) (FRAME_TIME * ttahdr.SampleRate);
 		is_float = (ttahdr.AudioFormat == WAVE_FORMAT_IEEE_FLOAT);
 		num_chan = ttahdr.NumChannels << is_float;
 		data_size = ttahdr.DataLength * byte_size * ttahdr.NumChannels;
@@ -56,10 +72,20 @@ namespace TTALib
 		st_state = 0;
 
 		enc = tta = new encoder[num_chan];
-		seek_table = new unsigned long[st_size];
-		data = new long[framelen * num_chan];
+		seek_table = new uint32[st_size];
+		data = new int32[framelen * num_chan];
 		st_state = bitReader->GetSeekTable (seek_table, st_size);
 		encoder_init(tta, num_chan, byte_size);
+
+		if (is_float)
+			SelectDecoder<4, true> ();
+		else switch (byte_size)
+		{
+		case 1: SelectDecoder<1, false> (); break;
+		case 2: SelectDecoder<2, false> (); break;
+		case 3: SelectDecoder<3, false> (); break;
+		default: SelectDecoder<4, false> (); break;
+		}
 	}
 
 	TTAReader::~TTAReader ()
@@ -68,12 +94,26 @@ namespace TTALib
 		delete [] tta;
 		delete [] data;
 		delete bitReader;
+		if (io_owned)
+			delete io;
 	}
 
-	long TTAReader::GetBlock (long **buf)
+	int32 TTAReader::GetBlock (int32 **buf)
 	{
-		long *p, value;
-		unsigned long  unary, binary, depth, k;
+		*buf = data;
+		return GetBlock (data);
+	}
+
+	int32 TTAReader::GetFrameLength ()
+	{
+		if (!fframes)
+			return 0;
+		return (fframes == 1 && lastlen) ? lastlen : framelen;
+	}
+
+	int32 TTAReader::GetBlock (int32 *buf)
+	{
+		int32 len;
 
 		if (!fframes--)
 			return 0;
@@ -82,94 +122,178 @@ namespace TTALib
 
 		encoder_init(tta, num_chan, byte_size);
 
-		for (p = data; p < data + framelen * num_chan; p++) {
-			fltst *fst = &enc->fst;
-			adapt *rice = &enc->rice;
-			long *last = &enc->last;
+		len = (this->*decode_frame) (buf);
 
-			// decode Rice unsigned
-			bitReader->GetUnary(&unary);
-
-			switch (unary) 
+		if (bitReader->Done ()) // CRC error
+		{
+			if (st_state)
 			{
-			case 0: depth = 0; k = rice->k0; break;
-			default:
-				depth = 1; k = rice->k1;
-				unary--;
-			}
+				bitReader->SkipFrame ();
+				memset(buf, 0, num_chan * framelen * sizeof(int32));
+			} 
+			else throw TTAException (FILE_ERROR);
+		}			
 
-			if (k) {
-				bitReader->GetBinary(&binary, k);
-				value = (unary << k) + binary;
-			} else value = unary;
+		input_byte_count = bitReader->input_byte_count;
+		output_byte_count += len * byte_size;  
 
-			switch (depth) 
-			{
-			case 1: 
-				rice->sum1 += value - (rice->sum1 >> 4);
-				if (rice->k1 > 0 && rice->sum1 < shift_16[rice->k1])
-					rice->k1--;
-				else if (rice->sum1 > shift_16[rice->k1 + 1])
-					rice->k1++;
-				value += bit_shift[rice->k0];
-			default:
+		return len / num_chan;
+	}
+
+	// inter-channel decorrelation, undone for each group of num_chan samples
+	template <int NUM_CHAN>
+	static void decorrelate (int32 *p, int32 *end, int32 nch)
+	{
+		if (NUM_CHAN) nch = NUM_CHAN;
+
+		for (p += nch - 1; p < end; p += nch) {
+			int32 *r = p - 1;
+			for (*p += *r/2; r > p - nch; r--)
+				*r = *(r + 1) - *r;
+		}
+	}
+
+	template <>
+	void decorrelate<2> (int32 *p, int32 *end, int32)
+	{
+#ifdef TTA_SSE2
+		const __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+
+		// two stereo samples per step: R += L/2, L = R - L
+		for (; p + 4 <= end; p += 4) {
+			__m128i x = _mm_loadu_si128((__m128i *) p);
+			__m128i h = _mm_srai_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 31)), 1);
+			__m128i y = _mm_add_epi32(x, _mm_and_si128(_mm_slli_si128(h, 4), odd));
+			__m128i l = _mm_sub_epi32(_mm_srli_si128(y, 4), x);
+			_mm_storeu_si128((__m128i *) p,
+				_mm_or_si128(_mm_and_si128(y, odd), _mm_andnot_si128(odd, l)));
+		}
+#endif
+		for (; p < end; p += 2) {
+			p[1] += p[0]/2;
+			p[0] = p[1] - p[0];
+		}
+	}
+
+	// reassembles IEEE float samples from the (exponent, mantissa) pairs
+	// they are coded as; the result goes into the first value of the pair
+	static void combine_float (int32 *p, int32 *end)
+	{
+#ifdef TTA_SSE2
+		const __m128i even = _mm_set_epi32(0, -1, 0, -1);
+		const __m128i sign = _mm_set1_epi32(0x80000000);
+		const __m128i bias = _mm_set1_epi32(0x3F80);
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; p + 4 <= end; p += 4) {
+			__m128i x = _mm_loadu_si128((__m128i *) p);
+			__m128i lo = _mm_srli_si128(x, 4);
+			__m128i s = _mm_srai_epi32(lo, 31);
+			__m128i data_lo = _mm_sub_epi32(_mm_sub_epi32(_mm_xor_si128(lo, s), s), _mm_set1_epi32(1));
+			__m128i data_hi = _mm_add_epi32(x, _mm_andnot_si128(
+				_mm_cmpeq_epi32(_mm_or_si128(x, data_lo), zero), bias));
+			__m128i r = _mm_and_si128(data_lo, _mm_set1_epi32(0xFFFF));
+
+			// SWAP16: reverse the low 16 bits
+			r = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 1), _mm_set1_epi32(0x5555)),
+				_mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x5555)), 1));
+			r = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 2), _mm_set1_epi32(0x3333)),
+				_mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x3333)), 2));
+			r = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 4), _mm_set1_epi32(0x0F0F)),
+				_mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x0F0F)), 4));
+			r = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 8), _mm_set1_epi32(0x00FF)),
+				_mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x00FF)), 8));
+
+			r = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(data_hi, 16), r), _mm_and_si128(lo, sign));
+			_mm_storeu_si128((__m128i *) p,
+				_mm_or_si128(_mm_and_si128(r, even), _mm_andnot_si128(even, x)));
+		}
+#endif
+		for (; p < end; p += 2) {
+			uint32 negative = p[1] & 0x80000000;
+			uint32 data_hi = p[0];
+			uint32 data_lo = abs(p[1]) - 1;
+
+			data_hi += (data_hi || data_lo) ? 0x3F80 : 0;
+			p[0] = (data_hi << 16) | SWAP16(data_lo) | negative;
+		}
+	}
+
+	// Decodes one frame; specialized on the sample size, on the number of
+	// coded channels (0 for any) and on the float flag, so that the inner
+	// loop carries no per-sample format checks. Channel decorrelation and
+	// float reassembly run as separate passes over the whole frame.
+	template <int BYTE_SIZE, int NUM_CHAN, bool IS_FLOAT>
+	int32 TTAReader::DecodeFrame (int32 *buf)
+	{
+		const int32 nch = NUM_CHAN ? NUM_CHAN : num_chan;
+		int32 *p, *end = buf + framelen * nch, value;
+		uint32  unary, binary, depth, k;
+
+		for (p = buf; p < end; ) {
+			for (enc = tta; enc < tta + nch; enc++, p++) {
+				adapt *rice = &enc->rice;
+
+				// decode Rice unsigned
+				bitReader->BitReader::GetUnary(&unary);
+
+				if (unary) {
+					depth = 1; k = rice->k1;
+					unary--;
+				} else {
+					depth = 0; k = rice->k0;
+				}
+
+				if (k) {
+					bitReader->BitReader::GetBinary(&binary, k);
+					value = (unary << k) + binary;
+				} else value = unary;
+
+				if (depth) {
+					rice->sum1 += value - (rice->sum1 >> 4);
+					if (rice->k1 > 0 && rice->sum1 < shift_16[rice->k1])
+						rice->k1--;
+					else if (rice->sum1 > shift_16[rice->k1 + 1])
+						rice->k1++;
+					value += bit_shift[rice->k0];
+				}
 				rice->sum0 += value - (rice->sum0 >> 4);
 				if (rice->k0 > 0 && rice->sum0 < shift_16[rice->k0])
 					rice->k0--;
 				else if (rice->sum0 > shift_16[rice->k0 + 1])
 					rice->k0++;
-			}
 
-			*p = DEC(value);
+				*p = DEC(value);
 
-			// decompress stage 1: adaptive hybrid filter
-			hybrid_filter(fst, p, 0);
+				// decompress stage 1: adaptive hybrid filter
+				hybrid_filter(&enc->fst, p, 0);
 
-			// decompress stage 2: fixed order 1 prediction
-			switch (byte_size) 
-			{
-			case 1: *p += PREDICTOR1(*last, 4); break;	// bps 8
-			case 2: *p += PREDICTOR1(*last, 5); break;	// bps 16
-			case 3: *p += PREDICTOR1(*last, 5); break;	// bps 24
-			case 4: *p += *last; break;		// bps 32
-			} *last = *p;
-
-			// combine data
-			if (is_float && ((p - data) & 1)) {
-				unsigned long negative = *p & 0x80000000;
-				unsigned long data_hi = *(p - 1);
-				unsigned long data_lo = abs(*p) - 1;
-
-				data_hi += (data_hi || data_lo) ? 0x3F80 : 0;
-				*(p - 1) = (data_hi << 16) | SWAP16(data_lo) | negative;
-			}
-
-			if (enc < tta + num_chan - 1) enc++;
-			else {
-				if (!is_float && num_chan > 1) {
-					long *r = p - 1;
-					for (*p += *r/2; r > p - num_chan; r--)
-						*r = *(r + 1) - *r;
-				}
-				enc = tta;
+				// decompress stage 2: fixed order 1 prediction
+				if (BYTE_SIZE == 1) *p += PREDICTOR1(enc->last, 4);	// bps 8
+				else if (BYTE_SIZE == 4) *p += enc->last;		// bps 32
+				else *p += PREDICTOR1(enc->last, 5);			// bps 16, 24
+				enc->last = *p;
 			}
 		}
+		enc = tta;
 
-		if (bitReader->Done ()) // CRC error
-		{
-			if (st_state)
-			{
-				bitReader->SkipFrame ();
-				ZeroMemory(data, num_chan * framelen * sizeof(long));
-			} 
-			else throw TTAException (FILE_ERROR);
-		}			
+		if (IS_FLOAT)
+			combine_float (buf, end);
+		else if (NUM_CHAN != 1 && nch > 1)
+			decorrelate<NUM_CHAN> (buf, end, nch);
 
-		*buf = data;
-
-		input_byte_count = bitReader->input_byte_count;
-		output_byte_count += (p - data) * byte_size;  
+		return (int32) (end - buf);
+	}
 
-		return (p - data) / num_chan;
+	template <int BYTE_SIZE, bool IS_FLOAT>
+	void TTAReader::SelectDecoder ()
+	{
+		switch (num_chan >> IS_FLOAT)
+		{
+		case 1: decode_frame = &TTAReader::DecodeFrame<BYTE_SIZE, 1 << IS_FLOAT, IS_FLOAT>; break;
+		case 2: decode_frame = &TTAReader::DecodeFrame<BYTE_SIZE, 2 << IS_FLOAT, IS_FLOAT>; break;
+		case 6: decode_frame = &TTAReader::DecodeFrame<BYTE_SIZE, 6 << IS_FLOAT, IS_FLOAT>; break;
+		default: decode_frame = &TTAReader::DecodeFrame<BYTE_SIZE, 0, IS_FLOAT>; break;
+		}
 	}
 };
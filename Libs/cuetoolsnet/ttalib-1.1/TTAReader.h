@@ -30,6 +30,7 @@
 #pragma once
 
 #include "ttacommon.h"
+#include "TTAIO.h"
 
 #define WAVE_FORMAT_PCM	1
 #define WAVE_FORMAT_IEEE_FLOAT 3
@@ -40,24 +41,40 @@ namespace TTALib
 
 	class TTAReader
 	{
-		HANDLE hInFile;
-		long *data;
-		unsigned long offset, is_float, framelen, lastlen;
-		unsigned long fframes, byte_size, num_chan;
-		unsigned long *seek_table;
+		TTAInput *io;
+		bool io_owned;
+		int32 *data;
+		uint32 offset, is_float, framelen, lastlen;
+		uint32 fframes, byte_size, num_chan;
+		uint32 *seek_table;
 		bool st_state;
 		encoder *tta, *enc;		
 
 		BitReader *bitReader;
+		int32 (TTAReader::*decode_frame) (int32 *buf);
+
+		void Init ();
+		template <int BYTE_SIZE, bool IS_FLOAT> void SelectDecoder ();
+		template <int BYTE_SIZE, int NUM_CHAN, bool IS_FLOAT> int32 DecodeFrame (int32 *buf);
 
 	public:
-		TTAReader (HANDLE fd);
+		// reads through the file with TTAFileInput
+		TTAReader (TTA_FILE fd);
+		// reads from any backend, the input is not deleted by the reader
+		TTAReader (TTAInput *input);
 		~TTAReader ();
 
-		unsigned long input_byte_count;
-		unsigned long output_byte_count;
+		uint32 input_byte_count;
+		uint32 output_byte_count;
 		TTAHeader ttahdr;
 
-		long GetBlock (long **buf);
+		// decodes the next frame into the reader's own buffer
+		int32 GetBlock (int32 **buf);
+		// decodes the next frame straight into buf, which must hold
+		// GetFrameLength () samples of every channel (two values per
+		// channel for IEEE float); returns the number of samples decoded
+		int32 GetBlock (int32 *buf);
+		// number of samples in the next frame, 0 at the end of the stream
+		int32 GetFrameLength ();
 	};
 }
@@ -1,5 +1,5 @@
 #pragma once
-#include "bitreader.h"
+#include "BitReader.h"
 
 namespace TTALib 
 {
@@ -8,12 +8,12 @@ namespace TTALib
 		public BitReader
 	{
 		unsigned char *data;
-		unsigned long *seek_table, *fst;
-		long fframes;
+		uint32 *seek_table, *fst;
+		int32 fframes;
 	public:
 
-		TTATester(HANDLE hFile) 
-			: BitReader(hFile), data(NULL), seek_table(NULL), fframes(-1)
+		TTATester(TTAInput *input) 
+			: BitReader(input), data(NULL), seek_table(NULL), fframes(-1)
 		{		
 		}
 
@@ -29,15 +29,15 @@ namespace TTALib
 		{
 			BitReader::GetHeader (ttahdr);
 
-			long framelen  = (long) (FRAME_TIME * ttahdr->SampleRate);
-			long framesize =  framelen * ttahdr->NumChannels * 
+			int32 framelen  = (int32) (FRAME_TIME * ttahdr->SampleRate);
+			int32 framesize =  framelen * ttahdr->NumChannels * 
 					(ttahdr->BitsPerSample + 7) / 8 + 4;
 
-			long lastlen = ttahdr->DataLength % framelen;
+			int32 lastlen = ttahdr->DataLength % framelen;
 			fframes = ttahdr->DataLength / framelen + (lastlen ? 1 : 0);
 
 			data = new unsigned char[framesize];
-			seek_table = new unsigned long[fframes + 1];
+			seek_table = new uint32[fframes + 1];
 
 			if (!GetSeekTable (seek_table, fframes + 1))
 				throw TTAException (FILE_ERROR);
@@ -47,17 +47,16 @@ namespace TTALib
 
 		virtual bool TestFrame ()
 		{
-			unsigned long frame_crc32, result;
+			uint32 frame_crc32, result;
 
 			if (fst >= seek_table + fframes)
 				return false;
 
-			if (!ReadFile(hInFile, data, *fst, &result, NULL) ||
-				result != *fst)
+			if ((result = io->Read (data, *fst)) != *fst)
 				throw TTAException (READ_ERROR);
 			else input_byte_count += result;
 
-			CopyMemory(&frame_crc32, data + (result - 4), 4);		
+			memcpy(&frame_crc32, data + (result - 4), 4);		
 			if (crc32(data, *fst - 4) != ENDSWAP_INT32(frame_crc32))
 				throw TTAException (FILE_ERROR);
 			
@@ -27,7 +27,7 @@
  * information.
  */
 
-#include "stdafx.h"
+#include "Stdafx.h"
 #include "BitWriter.h"
 #include "TTAError.h"
 #include "TTAWriter.h"
@@ -35,10 +35,25 @@
 
 namespace TTALib 
 {
-	TTAWriter::TTAWriter (HANDLE fd, long offset, unsigned short AudioFormat, 
+	TTAWriter::TTAWriter (TTA_FILE fd, int32 offset, unsigned short AudioFormat, 
 		unsigned short NumChannels,	unsigned short BitsPerSample,
-		unsigned long SampleRate, unsigned long DataLength) 
-		: hOutFile (fd)
+		uint32 SampleRate, uint32 DataLength) 
+		: io (new TTAFileOutput (fd)), io_owned (true)
+	{
+		Init (offset, AudioFormat, NumChannels, BitsPerSample, SampleRate, DataLength);
+	}
+
+	TTAWriter::TTAWriter (TTAOutput *output, int32 offset, unsigned short AudioFormat, 
+		unsigned short NumChannels,	unsigned short BitsPerSample,
+		uint32 SampleRate, uint32 DataLength) 
+		: io (output), io_owned (false)
+	{
+		Init (offset, AudioFormat, NumChannels, BitsPerSample, SampleRate, DataLength);
+	}
+
+	void TTAWriter::Init (int32 offset, unsigned short AudioFormat, 
+		unsigned short NumChannels,	unsigned short BitsPerSample,
+		uint32 SampleRate, uint32 DataLength) 
 	{			
 		ttahdr.AudioFormat = AudioFormat;
 		ttahdr.NumChannels = NumChannels;
@@ -57,7 +72,7 @@ namespace TTALib
 			(!is_float && ttahdr.BitsPerSample == MAX_BPS)) 
 			throw TTAException (FORMAT_ERROR);
 
-		framelen = (long) (FRAME_TIME * ttahdr.SampleRate);
+		framelen = (int32) (FRAME_TIME * ttahdr.SampleRate);
 		num_chan = ttahdr.NumChannels << is_float;
 		byte_size = (ttahdr.BitsPerSample + 7) / 8;
 
@@ -69,10 +84,10 @@ namespace TTALib
 		st_size = (fframes + 1);
 
 		// grab some space for an encoder buffers
-		st = seek_table = new unsigned long[st_size];
+		st = seek_table = new uint32[st_size];
 		enc = tta = new encoder[num_chan];			
 
-		bitWriter = new BitWriter (hOutFile, offset);
+		bitWriter = new BitWriter (io, offset);
 		bitWriter->PutHeader (ttahdr);
 		bitWriter->PutSeekTable (seek_table, st_size);
 
@@ -90,23 +105,25 @@ namespace TTALib
 
 		delete [] seek_table;
 		delete [] tta;			
+		if (io_owned)
+			delete io;
 	};
 
-	bool TTAWriter::CompressBlock (long *data, long data_len)
+	bool TTAWriter::CompressBlock (int32 *data, int32 data_len)
 	{
-		long *p, tmp, prev;
-		unsigned long value, k, unary, binary;
-		long len;			
+		int32 *p, tmp, prev;
+		uint32 value, k, unary, binary;
+		int32 len;			
 		bool ret = false;
 
-		if (data_len > (long)(max_bytes - input_byte_count))
-			data_len = (long) (max_bytes - input_byte_count); 
+		if (data_len > (int32)(max_bytes - input_byte_count))
+			data_len = (int32) (max_bytes - input_byte_count); 
 		
 		input_byte_count += (num_chan * byte_size * data_len) >> is_float;
 
 		while (data_len > 0 && fframes >= 0)
 		{
-			if (data_len < (long)(framelen - data_pos))
+			if (data_len < (int32)(framelen - data_pos))
 				len = data_len;
 			else
 				len = framelen - data_pos;
@@ -116,7 +133,7 @@ namespace TTALib
 			{
 				fltst *fst = &enc->fst;
 				adapt *rice = &enc->rice;
-				long *last = &enc->last;
+				int32 *last = &enc->last;
 
 				// transform data
 				if (!is_float) {
@@ -124,10 +141,10 @@ namespace TTALib
 						*p = prev = *(p + 1) - *p;
 					else *p -= prev / 2;
 				} else if (!((p - data) & 1)) {
-					unsigned long t = *p;
-					unsigned long negative = (t & 0x80000000) ? -1 : 1;
-					unsigned long data_hi = (t & 0x7FFF0000) >> 16;
-					unsigned long data_lo = (t & 0x0000FFFF);
+					uint32 t = *p;
+					uint32 negative = (t & 0x80000000) ? -1 : 1;
+					uint32 data_hi = (t & 0x7FFF0000) >> 16;
+					uint32 data_lo = (t & 0x0000FFFF);
 
 					*p = (data_hi || data_lo) ? (data_hi - 0x3F80) : 0;
 					*(p + 1) = (SWAP16(data_lo) + 1) * negative;
@@ -28,7 +28,8 @@
  */
 
 #pragma once
-#include "TTACommon.h"
+#include "ttacommon.h"
+#include "TTAIO.h"
 
 #define WAVE_FORMAT_PCM	1
 #define WAVE_FORMAT_IEEE_FLOAT 3
@@ -39,24 +40,34 @@ namespace TTALib
 
 	class TTAWriter
 	{
-		HANDLE hOutFile;
+		TTAOutput *io;
+		bool io_owned;
 		TTAHeader ttahdr;
 		BitWriter *bitWriter;
-		unsigned long *seek_table, st_size, *st;
-		unsigned long offset, is_float, framelen, lastlen;
-		unsigned long fframes, byte_size, num_chan;
-		unsigned long data_pos, max_bytes;
+		uint32 *seek_table, st_size, *st;
+		uint32 offset, is_float, framelen, lastlen;
+		uint32 fframes, byte_size, num_chan;
+		uint32 data_pos, max_bytes;
 		encoder *tta, *enc;
 
+		void Init (int32 offset, unsigned short AudioFormat, 
+		unsigned short NumChannels,	unsigned short BitsPerSample,
+		uint32 SampleRate, uint32 DataLength);
+
 	public:
-		TTAWriter (HANDLE fd, long offset, unsigned short AudioFormat, 
+		// writes through the file with TTAFileOutput
+		TTAWriter (TTA_FILE fd, int32 offset, unsigned short AudioFormat, 
+		unsigned short NumChannels,	unsigned short BitsPerSample,
+		uint32 SampleRate, uint32 DataLength);
+		// writes to any backend, the output is not deleted by the writer
+		TTAWriter (TTAOutput *output, int32 offset, unsigned short AudioFormat, 
 		unsigned short NumChannels,	unsigned short BitsPerSample,
-		unsigned long SampleRate, unsigned long DataLength);
+		uint32 SampleRate, uint32 DataLength);
 		~TTAWriter ();
 
-		unsigned long input_byte_count;
-		unsigned long output_byte_count;
+		uint32 input_byte_count;
+		uint32 output_byte_count;
 
-		bool CompressBlock (long *data, long data_len);
+		bool CompressBlock (int32 *data, int32 data_len);
 	};
 }
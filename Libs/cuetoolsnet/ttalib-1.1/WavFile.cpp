@@ -27,53 +27,80 @@
  * information.
  */
 
-#include "stdafx.h"
+#include "Stdafx.h"
+#include <stdlib.h>
+#ifdef _WIN32
 #include <windows.h>
-#include "TTACommon.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ttacommon.h"
 #include "TTAError.h"
 #include "WavFile.h"
 
 /************************** WAV functions ******************************/
 
-TTALib::WaveFile::WaveFile () : fd (INVALID_HANDLE_VALUE)
+static void CloseFile (TTA_FILE fd)
+{
+#ifdef _WIN32
+	CloseHandle (fd);
+#else
+	close (fd);
+#endif
+}
+
+TTALib::WaveFile::WaveFile () : in (NULL), out (NULL), fd (TTA_INVALID_FILE)
 {
 }
 
 TTALib::WaveFile::~WaveFile () 
 {
-	if (fd != INVALID_HANDLE_VALUE) 
-		CloseHandle (fd);
+	delete in;
+	delete out;
+	if (fd != TTA_INVALID_FILE) 
+		CloseFile (fd);
 }
 
-HANDLE TTALib::WaveFile::Create (const char *filename)
+TTA_FILE TTALib::WaveFile::Create (const char *filename)
 {
 	errNo = TTALib::TTA_NO_ERROR;
-	if ((fd = CreateFile (filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
-			FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+#ifdef _WIN32
+	fd = CreateFile (filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+	fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+#endif
+	if (fd == TTA_INVALID_FILE)
 	{
 		errNo = TTALib::OPEN_ERROR;
-		return INVALID_HANDLE_VALUE;
+		return TTA_INVALID_FILE;
 	}
+	out = new TTAFileOutput (fd);
 	return fd;
 }
 
-HANDLE TTALib::WaveFile::Open (const char *filename)
+TTA_FILE TTALib::WaveFile::Open (const char *filename)
 {
 	errNo = TTALib::TTA_NO_ERROR;
-	if ((fd = CreateFile (filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-				FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+#ifdef _WIN32
+	fd = CreateFile (filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+	fd = open (filename, O_RDONLY);
+#endif
+	if (fd == TTA_INVALID_FILE)
 		errNo = TTALib::OPEN_ERROR;
+	else in = new TTAFileInput (fd);
 	return fd;
 }
 
 bool TTALib::WaveFile::ReadHeaders ()
 {
-	unsigned long result;
-
 	// Read WAVE header	
-	if (!ReadFile(fd, &wave_hdr, sizeof(wave_hdr), &result, NULL)) 
+	if (in->Read (&wave_hdr, sizeof(wave_hdr)) != sizeof(wave_hdr)) 
 	{
-		CloseHandle (fd);
+		Close ();
 		errNo = TTALib::READ_ERROR;
 		return false;
 	}
@@ -92,27 +119,22 @@ bool TTALib::WaveFile::ReadHeaders ()
 
 	// skip extra format bytes
 	if (wave_hdr.Subchunk1Size > 16) {
-		SetFilePointer (fd, wave_hdr.Subchunk1Size - 16, NULL, FILE_CURRENT);
+		in->SetPosition (in->GetPosition () + wave_hdr.Subchunk1Size - 16);
 	}
 
 	// skip unsupported chunks
-	while (ReadFile(fd, &subchunk_hdr, sizeof(subchunk_hdr), &result, NULL) &&
+	while (in->Read (&subchunk_hdr, sizeof(subchunk_hdr)) == sizeof(subchunk_hdr) &&
 		subchunk_hdr.SubchunkID != ENDSWAP_INT32(data_SIGN)) {
-		char chunk_id[5];
-
 		subchunk_hdr.SubchunkSize = ENDSWAP_INT32(subchunk_hdr.SubchunkSize);
 		subchunk_hdr.SubchunkID = ENDSWAP_INT32(subchunk_hdr.SubchunkID);
 
 		if (subchunk_hdr.SubchunkSize & 0x80000000UL) {
-			CloseHandle (fd);
+			Close ();
 			errNo = TTALib::FILE_ERROR;
 			return false;
 		}
 
-		CopyMemory(chunk_id, &subchunk_hdr.SubchunkID, 4);
-		chunk_id[4] = 0;
-
-		SetFilePointer(fd, subchunk_hdr.SubchunkSize, NULL, FILE_CURRENT);
+		in->SetPosition (in->GetPosition () + subchunk_hdr.SubchunkSize);
 	}
 	subchunk_hdr.SubchunkSize = ENDSWAP_INT32(subchunk_hdr.SubchunkSize);
 	return true;
@@ -120,8 +142,6 @@ bool TTALib::WaveFile::ReadHeaders ()
 
 bool TTALib::WaveFile::WriteHeaders ()
 {
-	unsigned long result;
-
 	errNo = TTALib::TTA_NO_ERROR;
 	wave_hdr.ChunkID = ENDSWAP_INT32(RIFF_SIGN);
 	wave_hdr.ChunkSize = ENDSWAP_INT32(wave_hdr.ChunkSize);
@@ -138,15 +158,13 @@ bool TTALib::WaveFile::WriteHeaders ()
 	subchunk_hdr.SubchunkSize = ENDSWAP_INT32(subchunk_hdr.SubchunkSize);
 
 	// write WAVE header
-	if (!WriteFile(fd, &wave_hdr, sizeof(wave_hdr), &result, NULL) ||
-		result != sizeof(wave_hdr))
+	if (out->Write (&wave_hdr, sizeof(wave_hdr)) != sizeof(wave_hdr))
 	{
 		errNo = TTALib::WRITE_ERROR;
 		return false;
 	}
 	// write Subchunk header
-	if (!WriteFile(fd, &subchunk_hdr, sizeof(subchunk_hdr), &result, NULL) || 
-		result != sizeof(subchunk_hdr))
+	if (out->Write (&subchunk_hdr, sizeof(subchunk_hdr)) != sizeof(subchunk_hdr))
 	{
 		errNo = TTALib::WRITE_ERROR;
 		return false;
@@ -154,11 +172,11 @@ bool TTALib::WaveFile::WriteHeaders ()
 	return true;
 }
 
-bool TTALib::WaveFile::Read(long *data, long byte_size, unsigned long *len)
+bool TTALib::WaveFile::Read(int32 *data, int32 byte_size, uint32 *len)
 {
-    unsigned long res;
+    uint32 res;
     unsigned char *buffer, *src;
-	long *dst = data;
+	int32 *dst = data;
 
 	errNo = TTALib::TTA_NO_ERROR;
 	if (!(src = buffer = (unsigned char *)calloc(*len, byte_size)))
@@ -167,15 +185,20 @@ bool TTALib::WaveFile::Read(long *data, long byte_size, unsigned long *len)
 		return false;
 	}
 
-	if (!ReadFile (fd, buffer, *len * byte_size, &res, NULL))
+	try
 	{
+		res = in->Read (buffer, *len * byte_size);
+	}
+	catch (TTALib::TTAException)
+	{
+		free(buffer);
 		errNo = TTALib::READ_ERROR;
 		return false;
 	}
 
 	switch (byte_size) {
 	case 1: for (; src < buffer + res; dst++)
-				*dst = (signed long) *src++ - 0x80;
+				*dst = (int32) *src++ - 0x80;
 			break;
 	case 2: for (; src < buffer + res; dst++) {
 				*dst = (unsigned char) *src++;
@@ -203,11 +226,11 @@ bool TTALib::WaveFile::Read(long *data, long byte_size, unsigned long *len)
     return true;
 }
 
-bool TTALib::WaveFile::Write(long *data, long byte_size, long num_chan, unsigned long *len)
+bool TTALib::WaveFile::Write(int32 *data, int32 byte_size, int32 num_chan, uint32 *len)
 {
-    unsigned long res;
+    uint32 res;
     unsigned char *buffer, *dst;
-	long *src = data;
+	int32 *src = data;
 
 	errNo = TTALib::TTA_NO_ERROR;
 	if (!(dst = buffer = (unsigned char *)calloc(*len * num_chan, byte_size)))
@@ -240,9 +263,17 @@ bool TTALib::WaveFile::Write(long *data, long byte_size, long num_chan, unsigned
 			break;
     }
 	
-    if (!WriteFile (fd, buffer, *len * num_chan * byte_size, &res, NULL) 
-		|| res != *len * num_chan * byte_size)
+	try
+	{
+		res = out->Write (buffer, *len * num_chan * byte_size);
+	}
+	catch (TTALib::TTAException)
 	{
+		res = 0;
+	}
+	if (res != *len * num_chan * byte_size)
+	{
+		free(buffer);
 		errNo = TTALib::WRITE_ERROR;
 		return false;
 	}
@@ -261,6 +292,11 @@ TTALib::TTAError TTALib::WaveFile::GetErrNo () const
 void TTALib::WaveFile::Close ()
 {
 	errNo = TTALib::TTA_NO_ERROR;
-	CloseHandle (fd);
-	fd = INVALID_HANDLE_VALUE;
+	delete in;
+	delete out;
+	in = NULL;
+	out = NULL;
+	if (fd != TTA_INVALID_FILE)
+		CloseFile (fd);
+	fd = TTA_INVALID_FILE;
 }
@@ -28,6 +28,8 @@
  */
 
 #pragma once
+#include "TTAIO.h"
+
 #define RIFF_SIGN		0x46464952
 #define WAVE_SIGN		0x45564157
 #define fmt_SIGN		0x20746D66
@@ -45,39 +47,41 @@ namespace TTALib
 	class DllExport WaveFile 
 	{
 		TTAError errNo;
+		TTAInput *in;
+		TTAOutput *out;
 		
 	public:
-		HANDLE fd;
+		TTA_FILE fd;
 		struct {
-			unsigned long ChunkID;
-			unsigned long ChunkSize;
-			unsigned long Format;
-			unsigned long Subchunk1ID;
-			unsigned long Subchunk1Size;
-			unsigned short AudioFormat;
-			unsigned short NumChannels;
-			unsigned long SampleRate;
-			unsigned long ByteRate;
-			unsigned short BlockAlign;
-			unsigned short BitsPerSample;
-		} wave_hdr;
+			uint32 ChunkID;
+			uint32 ChunkSize;
+			uint32 Format;
+			uint32 Subchunk1ID;
+			uint32 Subchunk1Size;
+			uint16 AudioFormat;
+			uint16 NumChannels;
+			uint32 SampleRate;
+			uint32 ByteRate;
+			uint16 BlockAlign;
+			uint16 BitsPerSample;
+		} __ATTRIBUTE_PACKED__ wave_hdr;
 		struct {
-			unsigned long SubchunkID;
-			unsigned long SubchunkSize;
-		} subchunk_hdr;	
+			uint32 SubchunkID;
+			uint32 SubchunkSize;
+		} __ATTRIBUTE_PACKED__ subchunk_hdr;	
 
 
 		WaveFile ();
 		~WaveFile ();
 
-		HANDLE Create (const char *filename);
-		HANDLE Open (const char *filename);
+		TTA_FILE Create (const char *filename);
+		TTA_FILE Open (const char *filename);
 		
 		bool ReadHeaders ();
-		bool Read(long *data, long byte_size, unsigned long *len);
+		bool Read(int32 *data, int32 byte_size, uint32 *len);
 		
 		bool WriteHeaders ();
-		bool Write(long *data, long byte_size, long num_chan, unsigned long *len);
+		bool Write(int32 *data, int32 byte_size, int32 num_chan, uint32 *len);
 
 		void Close ();
 	
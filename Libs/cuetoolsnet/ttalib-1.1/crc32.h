@@ -31,7 +31,7 @@
 #ifndef CRC32_H
 #define CRC32_H
 
-const unsigned long crc32_table[256] = {
+const uint32 crc32_table[256] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba,
 	0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
 	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
@@ -101,10 +101,10 @@ const unsigned long crc32_table[256] = {
 #define UPDATE_CRC32(x, crc) crc = \
 	(((crc>>8) & 0x00FFFFFF) ^ crc32_table[(crc^x) & 0xFF])
 
-static unsigned long 
-crc32 (unsigned char *buffer, unsigned long len) {
-	unsigned long	i;
-	unsigned long	crc = 0xFFFFFFFF;
+static uint32 
+crc32 (const unsigned char *buffer, uint32 len) {
+	uint32	i;
+	uint32	crc = 0xFFFFFFFF;
 
 	for (i = 0; i < len; i++) UPDATE_CRC32(buffer[i], crc);
 
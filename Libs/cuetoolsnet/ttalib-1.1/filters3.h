@@ -29,12 +29,12 @@
  */
 
 ///////// Filter Settings //////////
-static long flt_set [4][2] = {
+static int32 flt_set [4][2] = {
 	{10,1}, {9,1}, {10,1}, {12,0}
 };
 
 static __inline void
-memshl (register long *pA, register long *pB) {
+memshl (register int32 *pA, register int32 *pB) {
 	*pA++ = *pB++;
 	*pA++ = *pB++;
 	*pA++ = *pB++;
@@ -46,11 +46,11 @@ memshl (register long *pA, register long *pB) {
 }
 
 __inline void
-hybrid_filter (fltst *fs, long *in, long mode) {
-	register long *pA = fs->dl;
-	register long *pB = fs->qm;
-	register long *pM = fs->dx;
-	register long sum = fs->round;
+hybrid_filter (fltst *fs, int32 *in, int32 mode) {
+	register int32 *pA = fs->dl;
+	register int32 *pB = fs->qm;
+	register int32 *pM = fs->dx;
+	register int32 sum = fs->round;
 
 	if (!fs->error) {
 		sum += *pA++ * *pB, pB++;
@@ -107,7 +107,7 @@ hybrid_filter (fltst *fs, long *in, long mode) {
 }
 
 __inline void
-filter_init (fltst *fs, long shift, long mode) {
+filter_init (fltst *fs, int32 shift, int32 mode) {
 	memset (fs, 0, sizeof(fltst));
 	fs->shift = shift;
 	fs->round = 1 << (shift - 1);
@@ -0,0 +1,55 @@
+/*
+ * ttacommon.cpp
+ *
+ * Description: TTA codec state shared by the encoder and decoder
+ *
+ * Copyright (c) 2004 Alexander Djourik. All rights reserved.
+ * Copyright (c) 2004 Pavel Zhilin. All rights reserved.
+ *
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * aint with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Please see the file COPYING in this directory for full copyright
+ * information.
+ */
+
+#include "Stdafx.h"
+#include <string.h>
+#include "ttacommon.h"
+#include "filters3.h"
+
+// ************************* basic functions *****************************
+
+void rice_init(adapt *rice, uint32 k0, uint32 k1)
+{
+	rice->k0 = k0;
+	rice->k1 = k1;
+	rice->sum0 = shift_16[k0];
+	rice->sum1 = shift_16[k1];
+}
+
+void encoder_init(encoder *tta, int32 nch, int32 byte_size) 
+{
+	int32 *fset = flt_set[byte_size - 1];
+	int32 i;
+
+	for (i = 0; i < nch; i++) {
+		filter_init(&tta[i].fst, fset[0], fset[1]);
+		rice_init(&tta[i].rice, 10, 10);
+		tta[i].last = 0;
+	}
+}
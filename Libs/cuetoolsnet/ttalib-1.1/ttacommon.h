@@ -68,12 +68,17 @@
 	#pragma pack(1)
 	#define __ATTRIBUTE_PACKED__
 	typedef unsigned __int64 uint64;
+	typedef long int32;
+	typedef unsigned long uint32;
 #else
 	#define __ATTRIBUTE_PACKED__	__attribute__((packed))
 	typedef unsigned long long uint64;
+	typedef int int32;
+	typedef unsigned int uint32;
 #endif
+typedef unsigned short uint16;
 
-#define PREDICTOR1(x, k)	((long)((((uint64)x << k) - x) >> k))
+#define PREDICTOR1(x, k)	((int32)((((uint64)x << k) - x) >> k))
 
 #define ENC(x)  (((x)>0)?((x)<<1)-1:(-(x)<<1))
 #define DEC(x)  (((x)&1)?(++(x)>>1):(-(x)>>1))
@@ -81,42 +86,42 @@
 // basics structures definitions
 struct adapt
 {
-	unsigned long k0;
-	unsigned long k1;
-	unsigned long sum0;
-	unsigned long sum1;
+	uint32 k0;
+	uint32 k1;
+	uint32 sum0;
+	uint32 sum1;
 };
 
 struct fltst 
 {
-	long shift;
-	long round;
-	long error;
-	long mutex;
-	long qm[MAX_ORDER];
-	long dx[MAX_ORDER];
-	long dl[MAX_ORDER];
+	int32 shift;
+	int32 round;
+	int32 error;
+	int32 mutex;
+	int32 qm[MAX_ORDER];
+	int32 dx[MAX_ORDER];
+	int32 dl[MAX_ORDER];
 };
 
 struct encoder 
 {
 	fltst fst;
 	adapt rice;
-	long last;
+	int32 last;
 };
 
 struct TTAHeader {
-	unsigned long TTAid;
-	unsigned short AudioFormat;
-	unsigned short NumChannels;
-	unsigned short BitsPerSample;
-	unsigned long SampleRate;
-	unsigned long DataLength;
-	unsigned long CRC32;
-};
+	uint32 TTAid;
+	uint16 AudioFormat;
+	uint16 NumChannels;
+	uint16 BitsPerSample;
+	uint32 SampleRate;
+	uint32 DataLength;
+	uint32 CRC32;
+} __ATTRIBUTE_PACKED__;
 
 // ****************** static variables and structures *******************
-static const unsigned long bit_mask[] = {
+static const uint32 bit_mask[] = {
     0x00000000, 0x00000001, 0x00000003, 0x00000007,
     0x0000000f, 0x0000001f, 0x0000003f, 0x0000007f,
     0x000000ff, 0x000001ff, 0x000003ff, 0x000007ff,
@@ -127,7 +132,7 @@ static const unsigned long bit_mask[] = {
     0x0fffffff, 0x1fffffff, 0x3fffffff, 0x7fffffff,
     0xffffffff
 };
-static const unsigned long bit_shift[] = {
+static const uint32 bit_shift[] = {
     0x00000001, 0x00000002, 0x00000004, 0x00000008,
     0x00000010, 0x00000020, 0x00000040, 0x00000080,
     0x00000100, 0x00000200, 0x00000400, 0x00000800,
@@ -139,9 +144,9 @@ static const unsigned long bit_shift[] = {
     0x80000000, 0x80000000, 0x80000000, 0x80000000,
     0x80000000, 0x80000000, 0x80000000, 0x80000000
 };
-static  const unsigned long *shift_16 = bit_shift + 4;
+static  const uint32 *shift_16 = bit_shift + 4;
 
-void rice_init(adapt *rice, unsigned long k0, unsigned long k1);
-void encoder_init(encoder *tta, long nch, long byte_size);
+void rice_init(adapt *rice, uint32 k0, uint32 k1);
+void encoder_init(encoder *tta, int32 nch, int32 byte_size);
 
 #endif // TTACOMMON_H_
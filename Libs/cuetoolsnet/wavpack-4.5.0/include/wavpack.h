@@ -167,6 +167,12 @@ typedef struct {
     uchar md5_checksum [16], md5_read;
     int num_tag_strings;
     char **tag_strings;
+
+    // Added after 4.50.0, so this struct is larger than the one in the stock
+    // library: code built against the older header must be rebuilt, and the
+    // struct should be cleared (memset to zero) before it is filled in.
+
+    int worker_threads;
 } WavpackConfig;
 
 #define CONFIG_HYBRID_FLAG      8       // hybrid mode
@@ -187,6 +193,7 @@ typedef struct {
 #define CONFIG_SKIP_WVX         0x4000000 // no wvx stream w/ floats & big ints
 #define CONFIG_MD5_CHECKSUM     0x8000000 // store MD5 signature
 #define CONFIG_MERGE_BLOCKS     0x10000000 // merge blocks of equal redundancy (for lossyWAV)
+#define CONFIG_SERIAL_BLOCKS    0x20000000 // pack blocks in order (worker threads only search, never stored)
 #define CONFIG_OPTIMIZE_MONO    0x80000000 // optimize for mono streams posing as stereo
 
 ////////////// Callbacks used for reading & writing WavPack streams //////////
@@ -227,6 +234,9 @@ WavpackContext *WavpackOpenFileInput (const wchar_t *infilename, char *error, in
 #define OPEN_STREAMING  0x20    // "streaming" mode blindly unpacks blocks
                                 // w/o regard to header file position info
 #define OPEN_EDIT_TAGS  0x40    // allow editing of tags
+#define OPEN_SEEK_INDEX 0x80    // seek through an index of the block positions
+#define OPEN_THREADS_SHFT 27    // number of worker threads to decode with
+#define OPEN_THREADS_MASK 0x78000000 // (0-15, 0 or 1 decodes on the calling thread)
 
 int WavpackGetMode (WavpackContext *wpc);
 
@@ -262,6 +272,8 @@ int WavpackGetChannelMask (WavpackContext *wpc);
 int WavpackGetReducedChannels (WavpackContext *wpc);
 int WavpackGetFloatNormExp (WavpackContext *wpc);
 int WavpackGetMD5Sum (WavpackContext *wpc, uchar data [16]);
+uint32_t WavpackGetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size);
+int WavpackSetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size);
 uint32_t WavpackGetWrapperBytes (WavpackContext *wpc);
 uchar *WavpackGetWrapperData (WavpackContext *wpc);
 void WavpackFreeWrapper (WavpackContext *wpc);
@@ -0,0 +1,753 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2006 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// decorr_sse.c
+
+// This module contains SSE4.1 and AVX2 versions of the stereo decorrelation
+// passes used by unpack_samples() and pack_samples() for lower resolution
+// data (<= 16-bit, where the simple apply_weight_i() macro is exact). They are
+// selected at run time through the table returned by get_decorr_funcs()
+// (which is NULL if the processor or the compiler can't run them) and give
+// exactly the same samples, weights and history as the C versions.
+//
+// Just putting the left and right channels in two lanes doesn't help much,
+// because every sample still has to wait for the weight update of the one
+// before it. So the passes are run in groups instead: the group's passes
+// each get two lanes and pass N runs one sample behind pass N - 1, which
+// makes the output of one pass the input of the next at the following step.
+// This gives 4 independent lanes with SSE4.1 and 8 with AVX2 at the same
+// latency per step. All the positive terms can be grouped this way (terms
+// 1-8 look back at their own history, 17 and 18 extrapolate from it). The
+// negative terms mix the channels so they still go through the C code.
+//
+// A decoder pass that couldn't be grouped has another option for terms 2-8:
+// the weight update for a sample only depends on the residual and on the
+// sample "term" positions back, so for a run of "term" samples all the inputs
+// of the weight updates are known before any of them are decoded. The weights
+// for the run are then just a running sum of the updates, so SSE4.1 decodes
+// two stereo samples at once and AVX2 four. The encoder can't do this because
+// its weight updates depend on its outputs.
+//
+// The table also has versions of log2buffer() (see words.c), which the extra
+// modes of the encoder spend much of their time in. The bit count of each
+// sample comes from the exponent of its conversion to float (exact because
+// the value is shifted down to 24 bits first) and the fraction bits give the
+// index into log2_table[]. The table lookups are still done one at a time,
+// but everything else is done for 4 (SSE4.1) or 8 (AVX2) samples at once.
+
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#ifdef OPT_SSE
+
+#if defined (_MSC_VER) && _MSC_VER < 1700
+#include <smmintrin.h>
+#define NO_AVX2
+#else
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#if defined (__GNUC__) || defined (__clang__)
+#define TARGET_SSE41 __attribute__ ((target ("sse4.1")))
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+extern const uchar log2_table [];
+
+// terms that can be run in a group (see above)
+
+#define GROUP_TERM(term) (((term) >= 1 && (term) <= MAX_TERM) || (term) == 17 || (term) == 18)
+
+///////////////////////////// helper functions ///////////////////////////////
+
+// Return apply_weight_i() for each lane
+
+TARGET_SSE41 static __m128i apply_weight_sse (__m128i weight, __m128i sample)
+{
+    return _mm_srai_epi32 (_mm_add_epi32 (_mm_mullo_epi32 (weight, sample), _mm_set1_epi32 (512)), 10);
+}
+
+// Return the amount update_weight() would add to each lane's weight given
+// the source and result values (delta if they have the same sign, -delta if
+// they don't and zero if either one is zero).
+
+TARGET_SSE41 static __m128i weight_step_sse (__m128i delta, __m128i source, __m128i result)
+{
+    __m128i zero = _mm_setzero_si128 (), sign = _mm_srai_epi32 (_mm_xor_si128 (source, result), 31);
+    __m128i either = _mm_or_si128 (_mm_cmpeq_epi32 (source, zero), _mm_cmpeq_epi32 (result, zero));
+
+    return _mm_andnot_si128 (either, _mm_sub_epi32 (_mm_xor_si128 (delta, sign), sign));
+}
+
+#define load_pair(ptr) _mm_loadl_epi64 ((__m128i *) (ptr))
+#define store_pair(ptr,value) _mm_storel_epi64 ((__m128i *) (ptr), value)
+
+// A group of passes keeps the last MAX_TERM values that each pass looks back
+// at (its outputs when decoding and its inputs when encoding) in a ring that
+// is indexed by step. Because pass N runs N samples behind, sample "x" of pass
+// N is in lanes N*2 and N*2+1 of ring [(x + N) & (MAX_TERM - 1)]. These copy a
+// pass's history (samples -MAX_TERM to -1) into the ring before the group and
+// back out of it afterwards (samples sample_count-MAX_TERM to sample_count-1),
+// in the format the C version would have left it.
+
+static void get_group_history (struct decorr_pass *dpp, int x, int32_t *pair)
+{
+    if (dpp->term > MAX_TERM) {
+        pair [0] = x == -1 ? dpp->samples_A [0] : x == -2 ? dpp->samples_A [1] : 0;
+        pair [1] = x == -1 ? dpp->samples_B [0] : x == -2 ? dpp->samples_B [1] : 0;
+    }
+    else {
+        pair [0] = dpp->samples_A [(x + MAX_TERM + dpp->term) & (MAX_TERM - 1)];
+        pair [1] = dpp->samples_B [(x + MAX_TERM + dpp->term) & (MAX_TERM - 1)];
+    }
+}
+
+// The decoder leaves the history of terms 1-8 where its sample_count & 7
+// rotation will find it (see unpack_samples()) while the encoder leaves it in
+// the "normalized" positions.
+
+static void put_group_history (struct decorr_pass *dpp, int x, int32_t *pair, int32_t sample_count, int pack)
+{
+    if (dpp->term > MAX_TERM) {
+        if (x >= sample_count - 2) {
+            dpp->samples_A [sample_count - 1 - x] = pair [0];
+            dpp->samples_B [sample_count - 1 - x] = pair [1];
+        }
+    }
+    else {
+        int k = (x + MAX_TERM + dpp->term - (pack ? sample_count : 0)) & (MAX_TERM - 1);
+
+        dpp->samples_A [k] = pair [0];
+        dpp->samples_B [k] = pair [1];
+    }
+}
+
+// Count the passes (up to max_passes) that can be run as one group
+
+static int count_group_terms (struct decorr_pass *dpp, int num_passes, int max_passes)
+{
+    int count = 0;
+
+    while (count < num_passes && count < max_passes && GROUP_TERM (dpp [count].term))
+        count++;
+
+    return count;
+}
+
+//////////////////////////////// SSE4.1 passes ///////////////////////////////
+
+// Run two passes (one behind the other) over the buffer, decoding or
+// encoding depending on "pack". For 17 and 18 the sample is extrapolated
+// from the last two history values (diff is 1 or 1/2 of their difference).
+
+TARGET_SSE41 static void stereo_group_sse41 (struct decorr_pass **passes, int32_t *buffer, int32_t sample_count, int pack)
+{
+    union { __m128i v; int32_t i [4]; } ring [MAX_TERM], temp;
+    __m128i weight, delta, sel_18, sel_ext, sel_1, in, out, sam, diff, step, active, prev1, prev2;
+    int t0 = passes [0]->term > MAX_TERM ? 1 : passes [0]->term;
+    int t1 = passes [1]->term > MAX_TERM ? 1 : passes [1]->term;
+    int32_t s, x;
+    int j;
+
+    weight = _mm_set_epi32 (passes [1]->weight_B, passes [1]->weight_A, passes [0]->weight_B, passes [0]->weight_A);
+    delta = _mm_set_epi32 (passes [1]->delta, passes [1]->delta, passes [0]->delta, passes [0]->delta);
+    sel_18 = _mm_set_epi32 (-(passes [1]->term == 18), -(passes [1]->term == 18), -(passes [0]->term == 18), -(passes [0]->term == 18));
+    sel_ext = _mm_set_epi32 (-(passes [1]->term > MAX_TERM), -(passes [1]->term > MAX_TERM), -(passes [0]->term > MAX_TERM), -(passes [0]->term > MAX_TERM));
+    sel_1 = _mm_set_epi32 (-(t1 == 1), -(t1 == 1), -(t0 == 1), -(t0 == 1));
+    out = _mm_setzero_si128 ();
+
+    for (s = -MAX_TERM; s < 1; ++s)
+        for (j = 0; j < 2; ++j)
+            if (s - j >= -MAX_TERM && s - j < 0)
+                get_group_history (passes [j], s - j, ring [s & (MAX_TERM - 1)].i + j * 2);
+
+    // the last two ring entries are also kept in registers (prev1 and prev2)
+    // because that's what the terms 1, 17 and 18 need right away
+
+    prev1 = ring [MAX_TERM - 1].v;
+    prev2 = ring [MAX_TERM - 2].v;
+
+    for (s = 0; s <= sample_count; ++s) {
+        in = _mm_unpacklo_epi64 (s < sample_count ? load_pair (buffer + s * 2) : _mm_setzero_si128 (), out);
+        sam = _mm_blend_epi16 (ring [(s - t0) & (MAX_TERM - 1)].v, ring [(s - t1) & (MAX_TERM - 1)].v, 0xf0);
+        sam = _mm_blendv_epi8 (sam, prev1, sel_1);
+        diff = _mm_sub_epi32 (prev1, prev2);
+        diff = _mm_blendv_epi8 (diff, _mm_srai_epi32 (diff, 1), sel_18);
+        sam = _mm_add_epi32 (sam, _mm_and_si128 (diff, sel_ext));
+        prev2 = prev1;
+
+        if (pack) {
+            out = _mm_sub_epi32 (in, apply_weight_sse (weight, sam));
+            step = weight_step_sse (delta, sam, out);
+        }
+        else {
+            out = _mm_add_epi32 (in, apply_weight_sse (weight, sam));
+            step = weight_step_sse (delta, sam, in);
+        }
+
+        if (s < 1 || s >= sample_count) {
+            active = _mm_set_epi32 (-(s >= 1), -(s >= 1), -(s < sample_count), -(s < sample_count));
+            step = _mm_and_si128 (step, active);
+            prev1 = _mm_blendv_epi8 (ring [s & (MAX_TERM - 1)].v, pack ? in : out, active);
+        }
+        else
+            prev1 = pack ? in : out;
+
+        ring [s & (MAX_TERM - 1)].v = prev1;
+
+        weight = _mm_add_epi32 (weight, step);
+
+        if (s >= 1)
+            store_pair (buffer + (s - 1) * 2, _mm_srli_si128 (out, 8));
+    }
+
+    for (x = sample_count - MAX_TERM; x < sample_count; ++x)
+        for (j = 0; j < 2; ++j)
+            put_group_history (passes [j], x, ring [(x + j) & (MAX_TERM - 1)].i + j * 2, sample_count, pack);
+
+    temp.v = weight;
+
+    for (j = 0; j < 2; ++j) {
+        passes [j]->weight_A = temp.i [j * 2];
+        passes [j]->weight_B = temp.i [j * 2 + 1];
+    }
+}
+
+// Decode a single pass with a term of 2-8 in runs of two samples (see the
+// top of the file). The history values are loaded as separate pairs when
+// they straddle two of the stores of the previous run.
+
+TARGET_SSE41 static void stereo_batch_sse41 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count)
+{
+    __m128i delta = _mm_set1_epi32 (dpp->delta), weight_AB, sam, left_right, step;
+    int32_t *bptr = buffer, *eptr = buffer + (sample_count * 2), i;
+    int m, k;
+
+    // the first "term" samples come from the history (exactly as in C)
+
+    for (m = 0, k = dpp->term & (MAX_TERM - 1); bptr < eptr && m < dpp->term; bptr += 2) {
+        int32_t sam;
+
+        sam = dpp->samples_A [m];
+        dpp->samples_A [k] = apply_weight_i (dpp->weight_A, sam) + bptr [0];
+        update_weight (dpp->weight_A, dpp->delta, sam, bptr [0]);
+        bptr [0] = dpp->samples_A [k];
+
+        sam = dpp->samples_B [m];
+        dpp->samples_B [k] = apply_weight_i (dpp->weight_B, sam) + bptr [1];
+        update_weight (dpp->weight_B, dpp->delta, sam, bptr [1]);
+        bptr [1] = dpp->samples_B [k];
+
+        m++;
+        k = (k + 1) & (MAX_TERM - 1);
+    }
+
+    // after that every sample is "term" samples back in the buffer
+
+    weight_AB = _mm_set_epi32 (dpp->weight_B, dpp->weight_A, dpp->weight_B, dpp->weight_A);
+
+    for (; bptr + 4 <= eptr; bptr += 4) {
+        if (dpp->term & 1)
+            sam = _mm_unpacklo_epi64 (load_pair (bptr - dpp->term * 2), load_pair (bptr - dpp->term * 2 + 2));
+        else
+            sam = _mm_loadu_si128 ((__m128i *) (bptr - dpp->term * 2));
+
+        left_right = _mm_loadu_si128 ((__m128i *) bptr);
+        step = weight_step_sse (delta, sam, left_right);
+        weight_AB = _mm_add_epi32 (weight_AB, _mm_slli_si128 (step, 8));
+        _mm_storeu_si128 ((__m128i *) bptr, _mm_add_epi32 (apply_weight_sse (weight_AB, sam), left_right));
+        weight_AB = _mm_shuffle_epi32 (_mm_add_epi32 (weight_AB, step), _MM_SHUFFLE (3, 2, 3, 2));
+    }
+
+    if (bptr < eptr) {
+        sam = load_pair (bptr - dpp->term * 2);
+        left_right = load_pair (bptr);
+        store_pair (bptr, _mm_add_epi32 (apply_weight_sse (weight_AB, sam), left_right));
+        weight_AB = _mm_add_epi32 (weight_AB, weight_step_sse (delta, sam, left_right));
+    }
+
+    dpp->weight_A = _mm_cvtsi128_si32 (weight_AB);
+    dpp->weight_B = _mm_extract_epi32 (weight_AB, 1);
+
+    // leave the history where the C version would have left it
+
+    for (i = sample_count > MAX_TERM ? sample_count - MAX_TERM : dpp->term; i < sample_count; ++i) {
+        dpp->samples_A [(dpp->term + i) & (MAX_TERM - 1)] = buffer [i * 2];
+        dpp->samples_B [(dpp->term + i) & (MAX_TERM - 1)] = buffer [i * 2 + 1];
+    }
+}
+
+// These are the SSE4.1 entries of the dispatch table. They take as many of
+// the passes starting at dpp as they can and return how many that was (zero
+// means the first pass has to be done in C).
+
+// Pairs of 17 and 18 are left to the fused C passes in unpack.c, which
+// measured as fast as a two-pass group (there's no batching to be had).
+
+TARGET_SSE41 static int unpack_stereo_passes_sse41 (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    if (count_group_terms (dpp, num_passes, 2) == 2 && (dpp [0].term <= MAX_TERM || dpp [1].term <= MAX_TERM)) {
+        struct decorr_pass *passes [2];
+
+        passes [0] = dpp;
+        passes [1] = dpp + 1;
+        stereo_group_sse41 (passes, buffer, sample_count, FALSE);
+        return 2;
+    }
+    else if (dpp->term >= 2 && dpp->term <= MAX_TERM) {
+        stereo_batch_sse41 (dpp, buffer, sample_count);
+        return 1;
+    }
+
+    return 0;
+}
+
+TARGET_SSE41 static int pack_stereo_passes_sse41 (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    if (count_group_terms (dpp, num_passes, 2) == 2) {
+        struct decorr_pass *passes [2];
+
+        passes [0] = dpp;
+        passes [1] = dpp + 1;
+        stereo_group_sse41 (passes, buffer, sample_count, TRUE);
+        return 2;
+    }
+
+    return 0;
+}
+
+// SSE4.1 version of log2buffer(). The number of samples must be a multiple
+// of 4. Like the C version, this returns -1 if a value of 256 or more has a
+// log2 of limit or more (and limit isn't zero).
+
+TARGET_SSE41 static uint32_t log2buffer_sse41 (int32_t *samples, uint32_t num_samples, int limit)
+{
+    __m128i zero = _mm_setzero_si128 (), sum = zero, lim = _mm_set1_epi32 (limit);
+    int32_t index [4];
+    uint32_t lanes [4];
+
+    for (; num_samples; samples += 4, num_samples -= 4) {
+        __m128i value = _mm_abs_epi32 (_mm_loadu_si128 ((__m128i *) samples));
+        __m128i high, small, bits, dbits, log;
+
+        value = _mm_add_epi32 (value, _mm_srli_epi32 (value, 9));
+        high = _mm_srli_epi32 (value, 8);
+        small = _mm_cmpeq_epi32 (_mm_srli_epi32 (value, 24), zero);
+        bits = _mm_castps_si128 (_mm_cvtepi32_ps (_mm_blendv_epi8 (high, value, small)));
+        dbits = _mm_max_epi32 (_mm_sub_epi32 (_mm_srli_epi32 (bits, 23), _mm_set1_epi32 (126)), zero);
+        dbits = _mm_add_epi32 (dbits, _mm_andnot_si128 (small, _mm_set1_epi32 (8)));
+        _mm_storeu_si128 ((__m128i *) index, _mm_and_si128 (_mm_srli_epi32 (bits, 15), _mm_set1_epi32 (0xff)));
+
+        log = _mm_add_epi32 (_mm_slli_epi32 (dbits, 8),
+            _mm_setr_epi32 (log2_table [index [0]], log2_table [index [1]], log2_table [index [2]], log2_table [index [3]]));
+
+        sum = _mm_add_epi32 (sum, log);
+
+        if (limit) {
+            __m128i over = _mm_andnot_si128 (_mm_cmpeq_epi32 (high, zero),
+                _mm_or_si128 (_mm_cmpgt_epi32 (log, lim), _mm_cmpeq_epi32 (log, lim)));
+
+            if (!_mm_testz_si128 (over, over))
+                return (uint32_t) -1;
+        }
+    }
+
+    _mm_storeu_si128 ((__m128i *) lanes, sum);
+    return lanes [0] + lanes [1] + lanes [2] + lanes [3];
+}
+
+///////////////////////////////// AVX2 passes ////////////////////////////////
+
+#ifndef NO_AVX2
+
+// AVX2 version of stereo_group_sse41() that runs four passes, each one
+// sample behind the one before it. Shorter groups are padded with passes
+// that don't change anything (term 1 with zero weights and delta).
+
+TARGET_AVX2 static void stereo_group_avx2 (struct decorr_pass **passes, int32_t *buffer, int32_t sample_count, int pack)
+{
+    union { __m256i v; int32_t i [8]; } ring [MAX_TERM], temp;
+    __m256i weight, delta, sel_18, sel_ext, sel_1, in, out, sam, diff, step, active, prev1, prev2, zero = _mm256_setzero_si256 ();
+    int t [4], j;
+    int32_t s, x;
+
+    for (j = 0; j < 4; ++j) {
+        t [j] = passes [j]->term > MAX_TERM ? 1 : passes [j]->term;
+        temp.i [j * 2] = passes [j]->term == 18 ? -1 : 0;
+        temp.i [j * 2 + 1] = temp.i [j * 2];
+    }
+
+    sel_18 = temp.v;
+
+    for (j = 0; j < 4; ++j)
+        temp.i [j * 2] = temp.i [j * 2 + 1] = passes [j]->term > MAX_TERM ? -1 : 0;
+
+    sel_ext = temp.v;
+
+    for (j = 0; j < 4; ++j)
+        temp.i [j * 2] = temp.i [j * 2 + 1] = t [j] == 1 ? -1 : 0;
+
+    sel_1 = temp.v;
+
+    for (j = 0; j < 4; ++j)
+        temp.i [j * 2] = temp.i [j * 2 + 1] = passes [j]->delta;
+
+    delta = temp.v;
+
+    for (j = 0; j < 4; ++j) {
+        temp.i [j * 2] = passes [j]->weight_A;
+        temp.i [j * 2 + 1] = passes [j]->weight_B;
+    }
+
+    weight = temp.v;
+    out = zero;
+
+    for (s = -MAX_TERM; s < 3; ++s)
+        for (j = 0; j < 4; ++j)
+            if (s - j >= -MAX_TERM && s - j < 0)
+                get_group_history (passes [j], s - j, ring [s & (MAX_TERM - 1)].i + j * 2);
+
+    prev1 = ring [MAX_TERM - 1].v;
+    prev2 = ring [MAX_TERM - 2].v;
+
+    for (s = 0; s < sample_count + 3; ++s) {
+        in = _mm256_permute4x64_epi64 (out, _MM_SHUFFLE (2, 1, 0, 0));
+        in = _mm256_blend_epi32 (in, _mm256_castsi128_si256 (s < sample_count ? load_pair (buffer + s * 2) : _mm_setzero_si128 ()), 0x03);
+
+        sam = _mm256_blend_epi32 (ring [(s - t [0]) & (MAX_TERM - 1)].v, ring [(s - t [1]) & (MAX_TERM - 1)].v, 0x0c);
+        sam = _mm256_blend_epi32 (sam, ring [(s - t [2]) & (MAX_TERM - 1)].v, 0x30);
+        sam = _mm256_blend_epi32 (sam, ring [(s - t [3]) & (MAX_TERM - 1)].v, 0xc0);
+        sam = _mm256_blendv_epi8 (sam, prev1, sel_1);
+        diff = _mm256_sub_epi32 (prev1, prev2);
+        diff = _mm256_blendv_epi8 (diff, _mm256_srai_epi32 (diff, 1), sel_18);
+        sam = _mm256_add_epi32 (sam, _mm256_and_si256 (diff, sel_ext));
+        prev2 = prev1;
+
+        out = _mm256_srai_epi32 (_mm256_add_epi32 (_mm256_mullo_epi32 (weight, sam), _mm256_set1_epi32 (512)), 10);
+        out = pack ? _mm256_sub_epi32 (in, out) : _mm256_add_epi32 (in, out);
+
+        diff = pack ? out : in;
+        step = _mm256_srai_epi32 (_mm256_xor_si256 (sam, diff), 31);
+        step = _mm256_sub_epi32 (_mm256_xor_si256 (delta, step), step);
+        step = _mm256_andnot_si256 (_mm256_or_si256 (_mm256_cmpeq_epi32 (sam, zero), _mm256_cmpeq_epi32 (diff, zero)), step);
+
+        if (s < 3 || s >= sample_count) {
+            for (j = 0; j < 4; ++j)
+                temp.i [j * 2] = temp.i [j * 2 + 1] = (s >= j && s - j < sample_count) ? -1 : 0;
+
+            active = temp.v;
+            step = _mm256_and_si256 (step, active);
+            prev1 = _mm256_blendv_epi8 (ring [s & (MAX_TERM - 1)].v, pack ? in : out, active);
+        }
+        else
+            prev1 = pack ? in : out;
+
+        ring [s & (MAX_TERM - 1)].v = prev1;
+
+        weight = _mm256_add_epi32 (weight, step);
+
+        if (s >= 3)
+            store_pair (buffer + (s - 3) * 2, _mm_srli_si128 (_mm256_extracti128_si256 (out, 1), 8));
+    }
+
+    for (x = sample_count - MAX_TERM; x < sample_count; ++x)
+        for (j = 0; j < 4; ++j)
+            put_group_history (passes [j], x, ring [(x + j) & (MAX_TERM - 1)].i + j * 2, sample_count, pack);
+
+    temp.v = weight;
+
+    for (j = 0; j < 4; ++j) {
+        passes [j]->weight_A = temp.i [j * 2];
+        passes [j]->weight_B = temp.i [j * 2 + 1];
+    }
+}
+
+// AVX2 version of stereo_batch_sse41() that decodes runs of four samples for
+// terms 4, 6 and 8 (the other terms would have to load their history across
+// the stores of the previous run, so they are left to SSE4.1).
+
+TARGET_AVX2 static void stereo_batch_avx2 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count)
+{
+    __m256i delta, weight_AB, zero;
+    int32_t *bptr, *eptr, i;
+
+    if ((dpp->term & 1) || dpp->term < 4 || sample_count < 16) {
+        stereo_batch_sse41 (dpp, buffer, sample_count);
+        return;
+    }
+
+    // decode the first "term" samples (from the history) with SSE4.1, which
+    // also leaves the weights in dpp
+
+    stereo_batch_sse41 (dpp, buffer, dpp->term);
+    delta = _mm256_set1_epi32 (dpp->delta);
+    weight_AB = _mm256_set_epi32 (dpp->weight_B, dpp->weight_A, dpp->weight_B, dpp->weight_A,
+        dpp->weight_B, dpp->weight_A, dpp->weight_B, dpp->weight_A);
+    zero = _mm256_setzero_si256 ();
+    eptr = buffer + (sample_count * 2);
+
+    for (bptr = buffer + dpp->term * 2; bptr + 8 <= eptr; bptr += 8) {
+        __m256i sam, left_right = _mm256_loadu_si256 ((__m256i *) bptr), sign, either, step, sum;
+
+        if (dpp->term == 6)
+            sam = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((__m128i *) (bptr - 12))),
+                _mm_loadu_si128 ((__m128i *) (bptr - 8)), 1);
+        else
+            sam = _mm256_loadu_si256 ((__m256i *) (bptr - dpp->term * 2));
+
+        sign = _mm256_srai_epi32 (_mm256_xor_si256 (sam, left_right), 31);
+        either = _mm256_or_si256 (_mm256_cmpeq_epi32 (sam, zero), _mm256_cmpeq_epi32 (left_right, zero));
+        step = _mm256_andnot_si256 (either, _mm256_sub_epi32 (_mm256_xor_si256 (delta, sign), sign));
+
+        // running sum of the weight steps (one stereo pair per 64 bits)
+
+        sum = _mm256_add_epi32 (step, _mm256_blend_epi32 (_mm256_permute4x64_epi64 (step, _MM_SHUFFLE (2, 1, 0, 0)), zero, 0x03));
+        sum = _mm256_add_epi32 (sum, _mm256_permute2x128_si256 (sum, sum, 0x08));
+        weight_AB = _mm256_add_epi32 (weight_AB, _mm256_sub_epi32 (sum, step));
+
+        _mm256_storeu_si256 ((__m256i *) bptr, _mm256_add_epi32 (_mm256_srai_epi32 (_mm256_add_epi32 (
+            _mm256_mullo_epi32 (weight_AB, sam), _mm256_set1_epi32 (512)), 10), left_right));
+
+        weight_AB = _mm256_permute4x64_epi64 (_mm256_add_epi32 (weight_AB, step), _MM_SHUFFLE (3, 3, 3, 3));
+    }
+
+    // the rest is done one sample at a time, as in C
+
+    dpp->weight_A = _mm256_cvtsi256_si32 (weight_AB);
+    dpp->weight_B = _mm256_extract_epi32 (weight_AB, 1);
+
+    for (; bptr < eptr; bptr += 2) {
+        int32_t sam, tmp;
+
+        sam = bptr [-dpp->term * 2];
+        bptr [0] = apply_weight_i (dpp->weight_A, sam) + (tmp = bptr [0]);
+        update_weight (dpp->weight_A, dpp->delta, sam, tmp);
+
+        sam = bptr [-dpp->term * 2 + 1];
+        bptr [1] = apply_weight_i (dpp->weight_B, sam) + (tmp = bptr [1]);
+        update_weight (dpp->weight_B, dpp->delta, sam, tmp);
+    }
+
+    for (i = sample_count - MAX_TERM; i < sample_count; ++i) {
+        dpp->samples_A [(dpp->term + i) & (MAX_TERM - 1)] = buffer [i * 2];
+        dpp->samples_B [(dpp->term + i) & (MAX_TERM - 1)] = buffer [i * 2 + 1];
+    }
+}
+
+// These are the AVX2 entries of the dispatch table (see the SSE4.1 ones).
+// Groups of two passes are still faster with SSE4.1 (the 128-bit shuffles
+// have less latency), so AVX2 is only used for groups of three or four.
+
+static int avx2_group (struct decorr_pass *dpp, int count, int32_t *buffer, int32_t sample_count, int pack)
+{
+    struct decorr_pass *passes [4], dummy;
+    int j;
+
+    CLEAR (dummy);
+    dummy.term = 1;
+
+    for (j = 0; j < 4; ++j)
+        passes [j] = j < count ? dpp + j : &dummy;
+
+    if (count == 2)
+        stereo_group_sse41 (passes, buffer, sample_count, pack);
+    else
+        stereo_group_avx2 (passes, buffer, sample_count, pack);
+
+    return count;
+}
+
+static int unpack_stereo_passes_avx2 (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    int count = count_group_terms (dpp, num_passes, 4);
+
+    if (count >= 2)
+        return avx2_group (dpp, count, buffer, sample_count, FALSE);
+    else if (dpp->term >= 2 && dpp->term <= MAX_TERM) {
+        stereo_batch_avx2 (dpp, buffer, sample_count);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int pack_stereo_passes_avx2 (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    int count = count_group_terms (dpp, num_passes, 4);
+
+    return count >= 2 ? avx2_group (dpp, count, buffer, sample_count, TRUE) : 0;
+}
+
+// AVX2 version of log2buffer_sse41(), the number of samples must be a
+// multiple of 8.
+
+TARGET_AVX2 static uint32_t log2buffer_avx2 (int32_t *samples, uint32_t num_samples, int limit)
+{
+    __m256i zero = _mm256_setzero_si256 (), sum = zero, lim = _mm256_set1_epi32 (limit);
+    int32_t index [8];
+    uint32_t lanes [8];
+
+    for (; num_samples; samples += 8, num_samples -= 8) {
+        __m256i value = _mm256_abs_epi32 (_mm256_loadu_si256 ((__m256i *) samples));
+        __m256i high, small, bits, dbits, log;
+
+        value = _mm256_add_epi32 (value, _mm256_srli_epi32 (value, 9));
+        high = _mm256_srli_epi32 (value, 8);
+        small = _mm256_cmpeq_epi32 (_mm256_srli_epi32 (value, 24), zero);
+        bits = _mm256_castps_si256 (_mm256_cvtepi32_ps (_mm256_blendv_epi8 (high, value, small)));
+        dbits = _mm256_max_epi32 (_mm256_sub_epi32 (_mm256_srli_epi32 (bits, 23), _mm256_set1_epi32 (126)), zero);
+        dbits = _mm256_add_epi32 (dbits, _mm256_andnot_si256 (small, _mm256_set1_epi32 (8)));
+        _mm256_storeu_si256 ((__m256i *) index, _mm256_and_si256 (_mm256_srli_epi32 (bits, 15), _mm256_set1_epi32 (0xff)));
+
+        log = _mm256_add_epi32 (_mm256_slli_epi32 (dbits, 8),
+            _mm256_setr_epi32 (log2_table [index [0]], log2_table [index [1]], log2_table [index [2]], log2_table [index [3]],
+                               log2_table [index [4]], log2_table [index [5]], log2_table [index [6]], log2_table [index [7]]));
+
+        sum = _mm256_add_epi32 (sum, log);
+
+        if (limit) {
+            __m256i over = _mm256_andnot_si256 (_mm256_cmpeq_epi32 (high, zero),
+                _mm256_or_si256 (_mm256_cmpgt_epi32 (log, lim), _mm256_cmpeq_epi32 (log, lim)));
+
+            if (!_mm256_testz_si256 (over, over))
+                return (uint32_t) -1;
+        }
+    }
+
+    _mm256_storeu_si256 ((__m256i *) lanes, sum);
+    return lanes [0] + lanes [1] + lanes [2] + lanes [3] + lanes [4] + lanes [5] + lanes [6] + lanes [7];
+}
+
+#endif
+
+////////////////////////////// CPU dispatching ///////////////////////////////
+
+static const WavpackDecorrFuncs sse41_funcs = {
+    unpack_stereo_passes_sse41, pack_stereo_passes_sse41, log2buffer_sse41
+};
+
+#ifndef NO_AVX2
+static const WavpackDecorrFuncs avx2_funcs = {
+    unpack_stereo_passes_avx2, pack_stereo_passes_avx2, log2buffer_avx2
+};
+#endif
+
+static void get_cpuid (int leaf, int regs [4])
+{
+#ifdef _MSC_VER
+    __cpuidex (regs, leaf, 0);
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (__get_cpuid_max (0, NULL) >= (unsigned int) leaf)
+        __cpuid_count (leaf, 0, eax, ebx, ecx, edx);
+
+    regs [0] = eax; regs [1] = ebx; regs [2] = ecx; regs [3] = edx;
+#endif
+}
+
+// Return the highest level of the table this processor can run (0 for none,
+// DECORR_FUNCS_SSE41 or DECORR_FUNCS_AVX2). AVX2 also needs the OS to save
+// the YMM registers, which is what the XGETBV check is for.
+
+static int detect_decorr_level (void)
+{
+    int level = 0, regs [4];
+
+    get_cpuid (0, regs);
+
+    if (regs [0] >= 1) {
+        get_cpuid (1, regs);
+
+        if (regs [2] & (1 << 19))               // SSE4.1
+            level = DECORR_FUNCS_SSE41;
+
+#ifndef NO_AVX2
+        if ((regs [2] & (1 << 27)) && (regs [2] & (1 << 28))) {    // OSXSAVE and AVX
+            unsigned int xcr0;
+#ifdef _MSC_VER
+            xcr0 = (unsigned int) _xgetbv (0);
+#else
+            __asm__ ("xgetbv" : "=a" (xcr0) : "c" (0) : "%edx");
+#endif
+            get_cpuid (0, regs);
+
+            if ((xcr0 & 6) == 6 && regs [0] >= 7) {
+                get_cpuid (7, regs);
+
+                if (regs [1] & (1 << 5))        // AVX2
+                    level = DECORR_FUNCS_AVX2;
+            }
+        }
+#endif
+    }
+
+    return level;
+}
+
+// Return the level detected on the first call. The detected level is kept
+// with 1 added so that zero can mean "not checked yet". The worker threads can
+// get here at the same time, but they would all store the same complete value,
+// so all that's needed is that the load and the store are single (atomic)
+// operations.
+
+#if defined (__GNUC__) || defined (__clang__)
+#define load_level(ptr) __atomic_load_n (ptr, __ATOMIC_ACQUIRE)
+#define store_level(ptr,value) __atomic_store_n (ptr, value, __ATOMIC_RELEASE)
+#else
+#define load_level(ptr) (*(ptr))                // aligned and volatile (MSVC)
+#define store_level(ptr,value) (*(ptr) = (value))
+#endif
+
+static int get_decorr_level (void)
+{
+    static volatile long decorr_level;
+    long level = load_level (&decorr_level);
+
+    if (!level)
+        store_level (&decorr_level, level = detect_decorr_level () + 1);
+
+    return (int) level - 1;
+}
+
+// Return the functions for the requested level (DECORR_FUNCS_SSE41 or
+// DECORR_FUNCS_AVX2), or NULL if this processor (or the compiler) can't run
+// them. This lets the levels be tested against each other and the C code.
+
+const WavpackDecorrFuncs *get_decorr_funcs_level (int level)
+{
+    if (level > get_decorr_level ())
+        return NULL;
+
+#ifndef NO_AVX2
+    if (level == DECORR_FUNCS_AVX2)
+        return &avx2_funcs;
+#endif
+
+    return level == DECORR_FUNCS_SSE41 ? &sse41_funcs : NULL;
+}
+
+// Return the best decorrelation functions for this processor, or NULL if it
+// (or the compiler) can't run any of them.
+
+const WavpackDecorrFuncs *get_decorr_funcs (void)
+{
+    return get_decorr_funcs_level (get_decorr_level ());
+}
+
+#endif
@@ -35,12 +35,37 @@ int32_t dump_alloc (void);
 //////////////////////////////// local tables ///////////////////////////////
 
 typedef struct {
-    int32_t *sampleptrs [MAX_NTERMS+2];
+    int32_t *sampleptrs [MAX_NTERMS+2], *searchptrs [SEARCH_BUFFERS];
     struct decorr_pass dps [MAX_NTERMS];
     int nterms, log_limit, gt16bit;
     uint32_t best_bits;
 } WavpackExtraInfo;
 
+// With search workers (see workers.c) the candidates of a search step are
+// evaluated at once as separate jobs. Each job works on its own copy of the
+// WavpackExtraInfo and writes its own output buffer (one of searchptrs [], or
+// the normal output buffer for the last candidate) and results slot. The
+// results are then taken in the original order, so the choices and the data
+// left in info are exactly those of the serial search.
+
+typedef struct {
+    WavpackExtraInfo *info;
+    WavpackStream *wps;
+    int32_t *samples, *outsamples [22];
+    int depth, delta, num_jobs, terms [22];
+    struct decorr_pass dps [22];
+    uint32_t bits [22];
+} SearchJobs;
+
+typedef struct {
+    WavpackExtraInfo *info;
+    WavpackStream *wps;
+    int32_t *outsamples [8];
+    int num_jobs, deltas [8];
+    struct decorr_pass dps [8] [MAX_NTERMS];
+    uint32_t bits [8];
+} DeltaJobs;
+
 #ifdef OPT_MMX
 
 static void decorr_stereo_pass (int32_t *in_samples, int32_t *out_samples, int32_t num_samples, struct decorr_pass *dpp, int dir)
@@ -806,12 +831,34 @@ static int log2overhead (int first_term, int num_terms)
 #endif
 }
 
+// Evaluate one term of a recurse_stereo() step (as a search job).
+
+static void recurse_stereo_job (void *data, int job)
+{
+    SearchJobs *jobs = data;
+    WavpackExtraInfo info = *jobs->info;
+    int32_t num_samples = jobs->wps->wphdr.block_samples;
+    uint32_t bits;
+
+    info.dps [jobs->depth].term = jobs->terms [job];
+    info.dps [jobs->depth].delta = jobs->delta;
+    decorr_stereo_buffer (&info, jobs->samples, jobs->outsamples [job], num_samples, jobs->depth);
+    bits = log2buffer (jobs->outsamples [job], num_samples * 2, info.log_limit);
+
+    if (bits != (uint32_t) -1)
+        bits += log2overhead (info.dps [0].term, jobs->depth + 1);
+
+    jobs->dps [job] = info.dps [jobs->depth];
+    jobs->bits [job] = bits;
+}
+
 static void recurse_stereo (WavpackContext *wpc, WavpackExtraInfo *info, int depth, int delta, uint32_t input_bits)
 {
     WavpackStream *wps = wpc->streams [wpc->current_stream];
     int term, branches = ((wpc->config.extra_flags & EXTRA_BRANCHES) >> 6) - depth;
     int32_t *samples, *outsamples;
     uint32_t term_bits [22], bits;
+    SearchJobs jobs;
 
     if (branches < 1 || depth + 1 == info->nterms)
         branches = 1;
@@ -819,6 +866,12 @@ static void recurse_stereo (WavpackContext *wpc, WavpackExtraInfo *info, int dep
     CLEAR (term_bits);
     samples = info->sampleptrs [depth];
     outsamples = info->sampleptrs [depth + 1];
+    jobs.info = info;
+    jobs.wps = wps;
+    jobs.samples = samples;
+    jobs.depth = depth;
+    jobs.delta = delta;
+    jobs.num_jobs = 0;
 
     for (term = -3; term <= 18; ++term) {
         if (!term || (term > 8 && term < 17))
@@ -834,6 +887,11 @@ static void recurse_stereo (WavpackContext *wpc, WavpackExtraInfo *info, int dep
         if ((wpc->config.flags & CONFIG_FAST_FLAG) && (term > 4 && term < 17))
             continue;
 
+        if (wpc->search_workers) {
+            jobs.terms [jobs.num_jobs++] = term;
+            continue;
+        }
+
         info->dps [depth].term = term;
         info->dps [depth].delta = delta;
         decorr_stereo_buffer (info, samples, outsamples, wps->wphdr.block_samples, depth);
@@ -852,6 +910,32 @@ static void recurse_stereo (WavpackContext *wpc, WavpackExtraInfo *info, int dep
         term_bits [term + 3] = bits;
     }
 
+    if (jobs.num_jobs) {
+        int best_job = -1, j;
+
+        for (j = 0; j < jobs.num_jobs; ++j)
+            jobs.outsamples [j] = (j == jobs.num_jobs - 1) ? outsamples : info->searchptrs [j];
+
+        run_search_jobs (wpc, recurse_stereo_job, &jobs, jobs.num_jobs);
+
+        for (j = 0; j < jobs.num_jobs; ++j) {
+            if (jobs.bits [j] < info->best_bits) {
+                info->best_bits = jobs.bits [j];
+                CLEAR (wps->decorr_passes);
+                memcpy (wps->decorr_passes, info->dps, sizeof (info->dps [0]) * depth);
+                wps->decorr_passes [depth] = jobs.dps [j];
+                best_job = j;
+            }
+
+            term_bits [jobs.terms [j] + 3] = jobs.bits [j];
+        }
+
+        if (best_job >= 0)
+            memcpy (info->sampleptrs [info->nterms + 1], jobs.outsamples [best_job], wps->wphdr.block_samples * 8);
+
+        info->dps [depth] = jobs.dps [jobs.num_jobs - 1];
+    }
+
     while (depth + 1 < info->nterms && branches--) {
         uint32_t local_best_bits = input_bits;
         int best_term = 0, i;
@@ -879,6 +963,103 @@ static void recurse_stereo (WavpackContext *wpc, WavpackExtraInfo *info, int dep
     }
 }
 
+// Run the current terms over the whole block with one delta value (as a
+// search job). The passes ping-pong between the job's two search buffers.
+
+static void delta_stereo_job (void *data, int job)
+{
+    DeltaJobs *jobs = data;
+    WavpackExtraInfo info = *jobs->info;
+    WavpackStream *wps = jobs->wps;
+    int32_t *inptr = info.sampleptrs [0], *outptr = inptr;
+    int i;
+
+    for (i = 0; i < info.nterms && wps->decorr_passes [i].term; ++i) {
+        outptr = info.searchptrs [job * 2 + (i & 1)];
+        info.dps [i].term = wps->decorr_passes [i].term;
+        info.dps [i].delta = jobs->deltas [job];
+        decorr_stereo_buffer (&info, inptr, outptr, wps->wphdr.block_samples, i);
+        inptr = outptr;
+    }
+
+    jobs->bits [job] = log2buffer (outptr, wps->wphdr.block_samples * 2, info.log_limit);
+
+    if (jobs->bits [job] != (uint32_t) -1)
+        jobs->bits [job] += log2overhead (wps->decorr_passes [0].term, i);
+
+    memcpy (jobs->dps [job], info.dps, sizeof (info.dps));
+    jobs->outsamples [job] = outptr;
+}
+
+// This is the threaded version of delta_stereo(). Every delta that it might
+// try is evaluated at once (they only depend on the terms, which don't change
+// here), then the serial walk is replayed over the results. The passes for the
+// last delta that the serial version would have tried are rerun at the end to
+// leave the same data in info.
+
+static void delta_stereo_threaded (WavpackContext *wpc, WavpackExtraInfo *info, int delta)
+{
+    WavpackStream *wps = wpc->streams [wpc->current_stream];
+    int lower = FALSE, best_job = -1, last_d = -1, nterms, d, j, i;
+    DeltaJobs jobs;
+
+    jobs.info = info;
+    jobs.wps = wps;
+    jobs.num_jobs = 0;
+
+    for (d = 0; d <= 7; ++d)
+        if (d != delta && (d || !(wps->wphdr.flags & HYBRID_FLAG)))
+            jobs.deltas [jobs.num_jobs++] = d;
+
+    run_search_jobs (wpc, delta_stereo_job, &jobs, jobs.num_jobs);
+
+    for (nterms = 0; nterms < info->nterms && wps->decorr_passes [nterms].term; ++nterms);
+
+    for (d = delta - 1; d >= 0; --d) {
+        if (!d && (wps->wphdr.flags & HYBRID_FLAG))
+            break;
+
+        for (j = 0; jobs.deltas [j] != d; ++j);
+
+        last_d = d;
+
+        if (jobs.bits [j] < info->best_bits) {
+            lower = TRUE;
+            info->best_bits = jobs.bits [j];
+            best_job = j;
+        }
+        else
+            break;
+    }
+
+    for (d = delta + 1; !lower && d <= 7; ++d) {
+        for (j = 0; jobs.deltas [j] != d; ++j);
+
+        last_d = d;
+
+        if (jobs.bits [j] < info->best_bits) {
+            info->best_bits = jobs.bits [j];
+            best_job = j;
+        }
+        else
+            break;
+    }
+
+    if (best_job >= 0)
+        memcpy (info->sampleptrs [info->nterms + 1], jobs.outsamples [best_job], wps->wphdr.block_samples * 8);
+
+    for (i = 0; last_d >= 0 && i < nterms; ++i) {
+        info->dps [i].term = wps->decorr_passes [i].term;
+        info->dps [i].delta = last_d;
+        decorr_stereo_buffer (info, info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, i);
+    }
+
+    if (best_job >= 0) {
+        CLEAR (wps->decorr_passes);
+        memcpy (wps->decorr_passes, jobs.dps [best_job], sizeof (jobs.dps [0] [0]) * nterms);
+    }
+}
+
 static void delta_stereo (WavpackContext *wpc, WavpackExtraInfo *info)
 {
     WavpackStream *wps = wpc->streams [wpc->current_stream];
@@ -891,6 +1072,11 @@ static void delta_stereo (WavpackContext *wpc, WavpackExtraInfo *info)
     else
         return;
 
+    if (wpc->search_workers) {
+        delta_stereo_threaded (wpc, info, delta);
+        return;
+    }
+
     for (d = delta - 1; d >= 0; --d) {
         int i;
 
@@ -1020,7 +1206,11 @@ static void analyze_stereo (WavpackContext *wpc, int32_t *samples, int do_sample
     info.nterms = wps->num_terms;
 
     for (i = 0; i < info.nterms + 2; ++i)
-        info.sampleptrs [i] = malloc (wps->wphdr.block_samples * 8);
+        info.sampleptrs [i] = scratch_buffer (wpc, SCRATCH_SAMPLES + i, wps->wphdr.block_samples * 8);
+
+    for (i = 0; i < SEARCH_BUFFERS; ++i)
+        info.searchptrs [i] = wpc->search_workers ?
+            scratch_buffer (wpc, SCRATCH_SEARCH + i, wps->wphdr.block_samples * 8) : NULL;
 
     memcpy (info.dps, wps->decorr_passes, sizeof (info.dps));
     memcpy (info.sampleptrs [0], samples, wps->wphdr.block_samples * 8);
@@ -1062,9 +1252,6 @@ static void analyze_stereo (WavpackContext *wpc, int32_t *samples, int do_sample
             break;
 
     wps->num_terms = i;
-
-    for (i = 0; i < info.nterms + 2; ++i)
-        free (info.sampleptrs [i]);
 }
 
 static void stereo_add_noise (WavpackStream *wps, int32_t *lptr, int32_t *rptr)
@@ -1166,9 +1353,9 @@ void execute_stereo (WavpackContext *wpc, int32_t *samples, int no_history, int
     }
 
     CLEAR (save_decorr_passes);
-    temp_buffer [0] = malloc (buf_size);
-    temp_buffer [1] = malloc (buf_size);
-    best_buffer = malloc (buf_size);
+    temp_buffer [0] = scratch_buffer (wpc, SCRATCH_TEMP, buf_size);
+    temp_buffer [1] = scratch_buffer (wpc, SCRATCH_TEMP + 1, buf_size);
+    best_buffer = scratch_buffer (wpc, SCRATCH_BEST, buf_size);
 
     if (wps->num_passes > 1 && (wps->wphdr.flags & HYBRID_FLAG)) {
         CLEAR (temp_decorr_pass);
@@ -1188,7 +1375,7 @@ void execute_stereo (WavpackContext *wpc, int32_t *samples, int no_history, int
             num_samples > 2048 ? 2048 : num_samples, &temp_decorr_pass, -1);
 
         decorr_stereo_pass (temp_buffer [0], temp_buffer [1], num_samples, &temp_decorr_pass, 1);
-        noisy_buffer = malloc (buf_size);
+        noisy_buffer = scratch_buffer (wpc, SCRATCH_NOISY, buf_size);
         memcpy (noisy_buffer, samples, buf_size);
         stereo_add_noise (wps, noisy_buffer, temp_buffer [1]);
         no_history = 1;
@@ -1223,7 +1410,7 @@ void execute_stereo (WavpackContext *wpc, int32_t *samples, int no_history, int
                 if (!js_buffer) {
                     int32_t *lptr, cnt = num_samples;
 
-                    lptr = js_buffer = malloc (buf_size);
+                    lptr = js_buffer = scratch_buffer (wpc, SCRATCH_JS, buf_size);
                     memcpy (js_buffer, noisy_buffer ? noisy_buffer : samples, buf_size);
 
                     while (cnt--) {
@@ -1316,16 +1503,6 @@ void execute_stereo (WavpackContext *wpc, int32_t *samples, int no_history, int
         scan_word (wps, best_buffer, num_samples, -1);
     }
 
-    if (noisy_buffer)
-        free (noisy_buffer);
-
-    if (js_buffer)
-        free (js_buffer);
-
-    free (temp_buffer [1]);
-    free (temp_buffer [0]);
-    free (best_buffer);
-
 #ifdef EXTRA_DUMP
     if (1) {
         char string [256], substring [20];
@@ -256,6 +256,9 @@ int write_metadata_block (WavpackContext *wpc)
     char *block_buff, *block_ptr;
     WavpackHeader *wphdr;
 
+    if (!pack_workers_drain (wpc))
+        return FALSE;
+
     if (wpc->metacount) {
         int metacount = wpc->metacount, block_size = sizeof (WavpackHeader);
         WavpackMetadata *wpmdp = wpc->metadata;
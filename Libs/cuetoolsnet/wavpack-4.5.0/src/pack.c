@@ -1150,6 +1150,37 @@ void pack_init (WavpackContext *wpc)
     init_words (wps);
 }
 
+// Return the scratch buffer in the specified slot (see SCRATCH_OUTBUFF, etc.)
+// with room for at least "size" bytes. These are the per-block work areas of
+// the encoder; they belong to the context and are reused for every block
+// instead of being allocated and freed each time, so a slot is allocated
+// again only when a longer block needs more room. Contents are not kept.
+
+void *scratch_buffer (WavpackContext *wpc, int slot, uint32_t size)
+{
+    if (wpc->scratch_bytes [slot] < size) {
+        if (wpc->scratch [slot])
+            free (wpc->scratch [slot]);
+
+        wpc->scratch [slot] = malloc (size);
+        wpc->scratch_bytes [slot] = wpc->scratch [slot] ? size : 0;
+    }
+
+    return wpc->scratch [slot];
+}
+
+void free_scratch (WavpackContext *wpc)
+{
+    int slot;
+
+    for (slot = 0; slot < NUM_SCRATCH; ++slot)
+        if (wpc->scratch [slot]) {
+            free (wpc->scratch [slot]);
+            wpc->scratch [slot] = NULL;
+            wpc->scratch_bytes [slot] = 0;
+        }
+}
+
 // Allocate room for and copy the decorrelation terms from the decorr_passes
 // array into the specified metadata structure. Both the actual term id and
 // the delta are packed into single characters.
@@ -1368,17 +1399,20 @@ void write_channel_info (WavpackContext *wpc, WavpackMetadata *wpmd)
 // metadata structure. Currently, we just store the upper 3 bytes of
 // config.flags and only in the first block of audio data. Note that this is
 // for informational purposes not required for playback or decoding (like
-// whether high or fast mode was specified).
+// whether high or fast mode was specified). CONFIG_SERIAL_BLOCKS only tells
+// this library how to use its threads, so it is never stored (newer versions
+// of WavPack use that bit in the file for something else).
 
 void write_config_info (WavpackContext *wpc, WavpackMetadata *wpmd)
 {
+    uint32_t flags = wpc->config.flags & ~CONFIG_SERIAL_BLOCKS;
     char *byteptr;
 
     byteptr = wpmd->data = malloc (4);
     wpmd->id = ID_CONFIG_BLOCK;
-    *byteptr++ = (char) (wpc->config.flags >> 8);
-    *byteptr++ = (char) (wpc->config.flags >> 16);
-    *byteptr++ = (char) (wpc->config.flags >> 24);
+    *byteptr++ = (char) (flags >> 8);
+    *byteptr++ = (char) (flags >> 16);
+    *byteptr++ = (char) (flags >> 24);
 
     if (wpc->config.flags & CONFIG_EXTRA_MODE)
         *byteptr++ = (char) wpc->config.xmode;
@@ -2131,7 +2165,9 @@ static int pack_samples (WavpackContext *wpc, int32_t *buffer)
     //////////////////// handle the lossless stereo mode //////////////////////
 
     else if (!(flags & HYBRID_FLAG) && !(flags & MONO_DATA)) {
+        const WavpackDecorrFuncs *decorr_funcs = get_decorr_funcs ();
         int32_t *eptr = buffer + (sample_count * 2);
+        int done;
 
         if (!wps->num_passes) {
             if (flags & JOINT_STEREO)
@@ -2139,7 +2175,12 @@ static int pack_samples (WavpackContext *wpc, int32_t *buffer)
                     bptr [1] += ((bptr [0] -= bptr [1]) >> 1);
 
             for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount-- ; dpp++)
-                if (((flags & MAG_MASK) >> MAG_LSB) >= 16 || dpp->delta != 2)
+                if (((flags & MAG_MASK) >> MAG_LSB) < 16 && decorr_funcs &&
+                    (done = decorr_funcs->pack_stereo_passes (dpp, tcount + 1, buffer, sample_count))) {
+                        tcount -= done - 1;
+                        dpp += done - 1;
+                }
+                else if (((flags & MAG_MASK) >> MAG_LSB) >= 16 || dpp->delta != 2)
                     decorr_stereo_pass (dpp, buffer, sample_count);
                 else
                     decorr_stereo_pass_id2 (dpp, buffer, sample_count);
@@ -2937,6 +2978,13 @@ static void decorr_stereo_pass (struct decorr_pass *dpp, int32_t *buffer, int32_
 // CALC_NOISE bit was set in the WavPack header. The peak noise can also be //
 // returned if desired. See wavpack.c for the calculations required to      //
 // convert this into decibels of noise below full scale.                    //
+//                                                                          //
+// With worker threads the noise of each block is added in when the block   //
+// is written, so both values cover every block once WavpackFlushSamples()  //
+// has returned. They match a serial encode only as closely as the blocks   //
+// do: each worker continues from the state of its own previous block (see  //
+// workers.c), so in hybrid mode the blocks and their noise depend slightly //
+// on the number of workers.                                                //
 //////////////////////////////////////////////////////////////////////////////
 
 double WavpackGetEncodedNoise (WavpackContext *wpc, double *peak)
@@ -550,7 +550,9 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
     /////////////// handle lossless or hybrid lossy stereo data ///////////////
 
     else if (!wps->block2buff && !(flags & MONO_DATA)) {
+        const WavpackDecorrFuncs *decorr_funcs = get_decorr_funcs ();
         int32_t *eptr = buffer + (sample_count * 2);
+        int done;
 
         if (flags & HYBRID_FLAG) {
             i = sample_count;
@@ -569,6 +571,10 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
         for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
             if (((flags & MAG_MASK) >> MAG_LSB) >= 16)
                 decorr_stereo_pass (dpp, buffer, sample_count);
+            else if (decorr_funcs && (done = decorr_funcs->unpack_stereo_passes (dpp, tcount + 1, buffer, sample_count))) {
+                tcount -= done - 1;
+                dpp += done - 1;
+            }
             else if (tcount && dpp [0].term == 17 && dpp [1].term == 17) {
                 decorr_stereo_pass_1717 (dpp, buffer, sample_count);
                 tcount--;
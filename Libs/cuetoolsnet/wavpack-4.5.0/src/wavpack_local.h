@@ -178,6 +178,31 @@ typedef struct {
 #define MAX_STREAM_VERS     0x410       // highest stream version we'll decode or encode
 #define CUR_STREAM_VERS     0x407       // stream version we are [normally] writing now
 
+//////////////////////////// WavPack Seek Index ///////////////////////////////
+
+// This is the optional index of block positions used to seek directly to the
+// block containing a sample (see OPEN_SEEK_INDEX). There is one entry for
+// each initial block that contains audio, with "block_index" as stored in
+// the file and "file2pos" set to -1 if the .wvc block was not found. When
+// saved (in little-endian format) the entries are preceded by the header so
+// that an index can be checked against the files it was built from.
+
+typedef struct {
+    uint32_t block_index, filepos, file2pos;
+} WavpackIndexEntry;
+
+#define WavpackIndexEntryFormat "LLL"
+
+typedef struct {
+    char ckID [4];
+    uint32_t ckSize;
+    uint32_t version, num_entries, filelen, file2len, total_samples, initial_index;
+} WavpackIndexHeader;
+
+#define WavpackIndexHeaderFormat "4LLLLLLL"
+
+#define INDEX_VERSION       1           // seek index version we read and write
+
 
 //////////////////////////// WavPack Metadata /////////////////////////////////
 
@@ -231,6 +256,12 @@ typedef struct {
     uchar md5_checksum [16], md5_read;
     int num_tag_strings;
     char **tag_strings;
+
+    // Added after 4.50.0, so this struct is larger than the one in the stock
+    // library: code built against the older header must be rebuilt, and the
+    // struct should be cleared (memset to zero) before it is filled in.
+
+    int worker_threads;
 } WavpackConfig;
 
 #define CONFIG_BYTES_STORED     3       // 1-4 bytes/sample
@@ -258,6 +289,7 @@ typedef struct {
 #define CONFIG_SKIP_WVX         0x4000000 // no wvx stream w/ floats & big ints
 #define CONFIG_MD5_CHECKSUM     0x8000000 // compute & store MD5 signature
 #define CONFIG_MERGE_BLOCKS     0x10000000 // merge blocks of equal redundancy (for lossyWAV)
+#define CONFIG_SERIAL_BLOCKS    0x20000000 // pack blocks in order (worker threads only search, never stored)
 #define CONFIG_OPTIMIZE_MONO    0x80000000 // optimize for mono streams posing as stereo
 
 /*
@@ -314,6 +346,20 @@ typedef struct bs {
 #define MAX_STREAMS 8
 #define MAX_NTERMS 16
 #define MAX_TERM 8
+#define SEARCH_BUFFERS 16
+
+// slots of the scratch buffers kept by the context for packing (see
+// scratch_buffer() in pack.c)
+
+#define SCRATCH_OUTBUFF     0                           // pack_streams() output
+#define SCRATCH_OUT2BUFF    1
+#define SCRATCH_TEMP        2                           // execute_mono/stereo() temp_buffer [2]
+#define SCRATCH_BEST        4
+#define SCRATCH_NOISY       5
+#define SCRATCH_JS          6
+#define SCRATCH_SAMPLES     7                           // analyze_mono/stereo() sampleptrs []
+#define SCRATCH_SEARCH      (SCRATCH_SAMPLES + MAX_NTERMS + 2)  // and searchptrs []
+#define NUM_SCRATCH         (SCRATCH_SEARCH + SEARCH_BUFFERS)
 
 struct decorr_pass {
     int term, delta, weight_A, weight_B;
@@ -420,7 +466,14 @@ typedef struct {
 
     int current_stream, num_streams, stream_version;
     WavpackStream *streams [MAX_STREAMS];
-    void *stream3;
+    void *stream3, *workers, *search_workers, *unpack_workers;
+
+    WavpackIndexEntry *seek_index;
+    uint32_t num_index_entries;
+    wchar_t *index_filename;
+
+    void *scratch [NUM_SCRATCH];
+    uint32_t scratch_bytes [NUM_SCRATCH];
 
     char error_message [80];
 } WavpackContext;
@@ -555,8 +608,67 @@ void native_to_little_endian (void *data, char *format);
 
 void pack_init (WavpackContext *wpc);
 int pack_block (WavpackContext *wpc, int32_t *buffer);
+void *scratch_buffer (WavpackContext *wpc, int slot, uint32_t size);
+void free_scratch (WavpackContext *wpc);
 double WavpackGetEncodedNoise (WavpackContext *wpc, double *peak);
 
+// wputils.c
+
+void free_streams (WavpackContext *wpc);
+int read_next_frame (WavpackContext *wpc, WavpackContext *fwpc, uint32_t sample_index);
+
+// workers.c
+
+#if !defined(NO_WORKER_THREADS) && !defined(NO_UNPACK)
+void unpack_workers_init (WavpackContext *wpc, int num_workers);
+uint32_t unpack_workers_samples (WavpackContext *wpc, int32_t *buffer, uint32_t samples);
+void unpack_workers_reset (WavpackContext *wpc);
+void unpack_workers_free (WavpackContext *wpc);
+#else
+#define unpack_workers_init(wpc, num_workers)
+#define unpack_workers_samples(wpc, buffer, samples) 0
+#define unpack_workers_reset(wpc)
+#define unpack_workers_free(wpc)
+#endif
+
+#ifndef NO_WORKER_THREADS
+void pack_workers_init (WavpackContext *wpc);
+int pack_workers_block (WavpackContext *wpc, uint32_t block_samples);
+int pack_workers_drain (WavpackContext *wpc);
+void pack_workers_free (WavpackContext *wpc);
+void run_search_jobs (WavpackContext *wpc, void (*job_func) (void *data, int job), void *job_data, int num_jobs);
+#else
+#define pack_workers_init(wpc)
+#define pack_workers_block(wpc, block_samples) FALSE
+#define pack_workers_drain(wpc) TRUE
+#define pack_workers_free(wpc)
+#define run_search_jobs(wpc, job_func, job_data, num_jobs) \
+    { int job_; for (job_ = 0; job_ < (num_jobs); ++job_) (job_func) (job_data, job_); }
+#endif
+
+// decorr_sse.c
+
+#if !defined(NO_SSE) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define OPT_SSE
+#endif
+
+typedef struct {
+    int (*unpack_stereo_passes) (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count);
+    int (*pack_stereo_passes) (struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count);
+    uint32_t (*log2buffer) (int32_t *samples, uint32_t num_samples, int limit);
+} WavpackDecorrFuncs;
+
+#define DECORR_FUNCS_SSE41  1
+#define DECORR_FUNCS_AVX2   2
+
+#ifdef OPT_SSE
+const WavpackDecorrFuncs *get_decorr_funcs (void);
+const WavpackDecorrFuncs *get_decorr_funcs_level (int level);
+#else
+#define get_decorr_funcs() ((const WavpackDecorrFuncs *) NULL)
+#define get_decorr_funcs_level(level) ((const WavpackDecorrFuncs *) NULL)
+#endif
+
 // unpack.c
 
 int unpack_init (WavpackContext *wpc);
@@ -648,6 +760,9 @@ WavpackContext *WavpackOpenFileInput (const wchar_t *infilename, char *error, in
 #define OPEN_STREAMING  0x20    // "streaming" mode blindly unpacks blocks
                                 // w/o regard to header file position info
 #define OPEN_EDIT_TAGS  0x40    // allow editing of tags
+#define OPEN_SEEK_INDEX 0x80    // seek through an index of the block positions
+#define OPEN_THREADS_SHFT 27    // number of worker threads to decode with
+#define OPEN_THREADS_MASK 0x78000000 // (0-15, 0 or 1 decodes on the calling thread)
 
 int WavpackGetMode (WavpackContext *wpc);
 
@@ -683,6 +798,8 @@ int WavpackGetChannelMask (WavpackContext *wpc);
 int WavpackGetReducedChannels (WavpackContext *wpc);
 int WavpackGetFloatNormExp (WavpackContext *wpc);
 int WavpackGetMD5Sum (WavpackContext *wpc, uchar data [16]);
+uint32_t WavpackGetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size);
+int WavpackSetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size);
 uint32_t WavpackGetWrapperBytes (WavpackContext *wpc);
 uchar *WavpackGetWrapperData (WavpackContext *wpc);
 void WavpackFreeWrapper (WavpackContext *wpc);
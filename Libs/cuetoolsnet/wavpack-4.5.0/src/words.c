@@ -28,6 +28,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 #ifdef DEBUG_ALLOC
 #define malloc malloc_db
 #define realloc realloc_db
@@ -67,6 +71,11 @@ int32_t dump_alloc (void);
 #define INC_MED2() (c->median [2] += ((c->median [2] + DIV2) / DIV2) * 5)
 #define DEC_MED2() (c->median [2] -= ((c->median [2] + (DIV2-2)) / DIV2) * 2)
 
+// the amounts added and subtracted by the macros above
+
+#define MED_INC(median, div) ((((median) + (div)) / (div)) * 5)
+#define MED_DEC(median, div) ((((median) + ((div)-2)) / (div)) * 2)
+
 #define count_bits(av) ( \
  (av) < (1 << 8) ? nbits_table [av] : \
   ( \
@@ -75,6 +84,25 @@ int32_t dump_alloc (void);
   ) \
 )
 
+// count_ones() returns the number of ones at the bottom of a 64-bit value (at
+// most 63) and count_bits_nz() is count_bits() for non-zero values. These are
+// single instructions where the compiler has them; otherwise count_ones() uses
+// ones_count_table[] below 8 bits at a time.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define count_ones(value) __builtin_ctzll (~(value) | ((uint64_t) 1 << 63))
+#define count_bits_nz(av) (32 - __builtin_clz (av))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define count_ones(value) count_ones_x64 (value)
+#define count_bits_nz(av) count_bits_msc (av)
+#elif defined(_MSC_VER)
+#define count_ones(value) count_ones_x86 (value)
+#define count_bits_nz(av) count_bits_msc (av)
+#else
+#define count_ones(value) count_ones_table (value)
+#define count_bits_nz(av) count_bits (av)
+#endif
+
 ///////////////////////////// local table storage ////////////////////////////
 
 const uint32_t bitset [] = {
@@ -118,7 +146,7 @@ const char nbits_table [] = {
     8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8      // 240 - 255
 };
 
-static const uchar log2_table [] = {
+const uchar log2_table [] = {
     0x00, 0x01, 0x03, 0x04, 0x06, 0x07, 0x09, 0x0a, 0x0b, 0x0d, 0x0e, 0x10, 0x11, 0x12, 0x14, 0x15,
     0x16, 0x18, 0x19, 0x1a, 0x1c, 0x1d, 0x1e, 0x20, 0x21, 0x22, 0x24, 0x25, 0x26, 0x28, 0x29, 0x2a,
     0x2c, 0x2d, 0x2e, 0x2f, 0x31, 0x32, 0x33, 0x34, 0x36, 0x37, 0x38, 0x39, 0x3b, 0x3c, 0x3d, 0x3e,
@@ -1145,156 +1173,327 @@ int32_t FASTCALL get_word (WavpackStream *wps, int chan, int32_t *correction)
     return sign ? ~mid : mid;
 }
 
+// get_words_lossless() reads the "wvbits" Bitstream through this 64-bit
+// window, which is refilled 7 or 8 bytes at a time (rather than a byte or a
+// short at a time like the getbit() and getbits() macros) and lets the ones
+// of a unary code be counted in one step. The window is opened at the current
+// position of the Bitstream and closed back into it before returning, so the
+// Bitstream itself (and everything else that reads it) is unchanged. This is
+// all local to this module so that the compiler can keep it in registers.
+
+typedef struct {
+    uchar *buf;
+    uint32_t index, length;
+    uint64_t sr;
+    int bc;
+} WideBitstream;
+
+// Refill the window one byte at a time so that it holds at least 57 bits;
+// bits past the end of the buffer are read as zeros. This is used near the end
+// of the buffer and where the 8-byte load of wbs_fill() can't be used.
+
+static void wbs_fill_end (WideBitstream *wbs)
+{
+    while (wbs->bc <= 56) {
+        if (wbs->index < wbs->length)
+            wbs->sr |= (uint64_t) wbs->buf [wbs->index] << wbs->bc;
+
+        wbs->index++;
+        wbs->bc += 8;
+    }
+}
+
+// Refill the window so that it holds at least 56 bits. The bits above "bc"
+// may already hold some of the following data, which is fine because they're
+// always overwritten with the same values.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define wbs_fill(wbs) { \
+    if ((wbs)->index + 8 <= (wbs)->length) { \
+        uint64_t next64; \
+        memcpy (&next64, (wbs)->buf + (wbs)->index, 8); \
+        (wbs)->sr |= next64 << (wbs)->bc; \
+        (wbs)->index += (63 - (wbs)->bc) >> 3; \
+        (wbs)->bc |= 56; \
+    } \
+    else \
+        wbs_fill_end (wbs); \
+}
+#else
+#define wbs_fill(wbs) wbs_fill_end (wbs)
+#endif
+
+// Open the window at the current position of the specified Bitstream. If it
+// has already run out of data the window is placed at the end of the buffer.
+
+static void wbs_open (WideBitstream *wbs, Bitstream *bs)
+{
+    int unit_bits = sizeof (*(bs->ptr)) * 8;
+    uint32_t pos;
+
+    wbs->buf = (uchar *) bs->buf;
+    wbs->length = (uint32_t)(bs->end - bs->buf) * sizeof (*(bs->ptr));
+
+    if (bs->error || bs->ptr + 1 < bs->buf || bs->ptr >= bs->end)
+        pos = wbs->length * 8;
+    else
+        pos = (uint32_t)(bs->ptr + 1 - bs->buf) * unit_bits - bs->bc;
+
+    wbs->index = pos >> 3;
+    wbs->sr = wbs->bc = 0;
+    wbs_fill (wbs);
+    wbs->sr >>= pos & 7;
+    wbs->bc -= pos & 7;
+}
+
+// Close the window, leaving the Bitstream at the bit following the last one
+// read. Reading past the end of the data is flagged as an error like it would
+// be by the getbit() and getbits() macros.
+
+static void wbs_close (WideBitstream *wbs, Bitstream *bs)
+{
+    int unit_bits = sizeof (*(bs->ptr)) * 8;
+    uint32_t pos = wbs->index * 8 - wbs->bc, units;
+
+    if (pos > wbs->length * 8) {
+        bs->ptr = bs->end - 1;
+        bs->sr = bs->bc = 0;
+        bs->error = 1;
+        return;
+    }
+
+    units = (pos + unit_bits - 1) / unit_bits;
+    bs->ptr = bs->buf + units - 1;
+    bs->bc = units * unit_bits - pos;
+    bs->sr = bs->bc ? *(bs->ptr) >> (unit_bits - bs->bc) : 0;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// (count_ones() and count_bits_nz() are compiler builtins)
+
+#elif defined(_MSC_VER)
+
+static int count_bits_msc (uint32_t av)
+{
+    unsigned long index;
+
+    _BitScanReverse (&index, av);
+    return index + 1;
+}
+
+#ifdef _M_X64
+
+static int count_ones_x64 (uint64_t value)
+{
+    unsigned long index;
+
+    _BitScanForward64 (&index, ~value | ((uint64_t) 1 << 63));
+    return index;
+}
+
+#else
+
+static int count_ones_x86 (uint64_t value)
+{
+    unsigned long index;
+
+    if (_BitScanForward (&index, ~(uint32_t) value))
+        return index;
+
+    _BitScanForward (&index, ~(uint32_t)(value >> 32) | 0x80000000);
+    return index + 32;
+}
+
+#endif
+
+#else
+
+static int count_ones_table (uint64_t value)
+{
+    int ones = 0;
+
+    while ((value & 0xff) == 0xff && ones < 56) {
+        value >>= 8;
+        ones += 8;
+    }
+
+    ones += ones_count_table [value & 0xff];
+    return ones < 63 ? ones : 63;
+}
+
+#endif
+
+// Read the code that's used for the length of a run of zeros and for unary
+// codes that reach LIMIT_ONES: a unary bit count followed by that many bits
+// (less the implied MSB). Returns FALSE if the code isn't valid (33 ones).
+
+static int wbs_read_count (WideBitstream *wbs, uint32_t *value)
+{
+    int cbits;
+
+    if (wbs->bc < 34)
+        wbs_fill (wbs);
+
+    if ((cbits = count_ones (wbs->sr)) > 32) {
+        wbs->sr >>= 33;
+        wbs->bc -= 33;
+        return FALSE;
+    }
+
+    wbs->sr >>= cbits + 1;
+    wbs->bc -= cbits + 1;
+
+    if (cbits < 2)
+        *value = cbits;
+    else {
+        if (wbs->bc < cbits - 1)
+            wbs_fill (wbs);
+
+        *value = ((uint32_t) wbs->sr & bitmask [cbits - 1]) | bitset [cbits - 1];
+        wbs->sr >>= cbits - 1;
+        wbs->bc -= cbits - 1;
+    }
+
+    return TRUE;
+}
+
 // This is an optimized version of get_word() that is used for lossless only
 // (error_limit == 0). Also, rather than obtaining a single sample, it can be
-// used to obtain an entire buffer of either mono or stereo samples.
+// used to obtain an entire buffer of either mono or stereo samples. The bits
+// are read through a WideBitstream, and because the ones count of each sample
+// is essentially random most of the choices that depend on it are made with
+// arithmetic instead of branches.
 
 int32_t get_words_lossless (WavpackStream *wps, int32_t *buffer, int32_t nsamples)
 {
-    struct entropy_data *c = wps->w.c;
-    uint32_t ones_count, low, high;
-    Bitstream *bs = &wps->wvbits;
+    uint32_t flags = wps->wphdr.flags;
+    struct words_data w = wps->w;
+    struct entropy_data *c = w.c;
+    uint32_t ones_count, low, high, code, med0, med1, med2, mask0, mask1, mask2;
+    WideBitstream wbs;
     int32_t csamples;
+    int bitcount;
 
-    if (!(wps->wphdr.flags & MONO_DATA))
+    if (!(flags & MONO_DATA))
         nsamples *= 2;
 
-    for (csamples = 0; csamples < nsamples; ++csamples) {
-        if (!(wps->wphdr.flags & MONO_DATA))
-            c = wps->w.c + (csamples & 1);
+    wbs_open (&wbs, &wps->wvbits);
 
-        if (wps->w.c [0].median [0] < 2 && !wps->w.holding_zero && !wps->w.holding_one && wps->w.c [1].median [0] < 2) {
-            uint32_t mask;
-            int cbits;
+    for (csamples = 0; csamples < nsamples; ++csamples) {
+        if (!(flags & MONO_DATA))
+            c = w.c + (csamples & 1);
 
-            if (wps->w.zeros_acc) {
-                if (--wps->w.zeros_acc) {
+        if (w.c [0].median [0] < 2 && !w.holding_zero && !w.holding_one && w.c [1].median [0] < 2) {
+            if (w.zeros_acc) {
+                if (--w.zeros_acc) {
                     *buffer++ = 0;
                     continue;
                 }
             }
             else {
-                for (cbits = 0; cbits < 33 && getbit (bs); ++cbits);
-
-                if (cbits == 33)
+                if (!wbs_read_count (&wbs, &code))
                     break;
 
-                if (cbits < 2)
-                    wps->w.zeros_acc = cbits;
-                else {
-                    for (mask = 1, wps->w.zeros_acc = 0; --cbits; mask <<= 1)
-                        if (getbit (bs))
-                            wps->w.zeros_acc |= mask;
-
-                    wps->w.zeros_acc |= mask;
-                }
-
-                if (wps->w.zeros_acc) {
-                    CLEAR (wps->w.c [0].median);
-                    CLEAR (wps->w.c [1].median);
+                if ((w.zeros_acc = code)) {
+                    CLEAR (w.c [0].median);
+                    CLEAR (w.c [1].median);
                     *buffer++ = 0;
                     continue;
                 }
             }
         }
 
-        if (wps->w.holding_zero)
-            ones_count = wps->w.holding_zero = 0;
-        else {
-            int next8;
+        // With at least LIMIT_ONES + 1 bits in the window, a unary code shorter
+        // than LIMIT_ONES (almost all of them) is read with a single count.
+        // A held zero uses up no bits and gives a ones count of zero.
 
-            if (bs->bc < 8) {
-                if (++(bs->ptr) == bs->end)
-                    bs->wrap (bs);
+        if (wbs.bc < LIMIT_ONES + 1)
+            wbs_fill (&wbs);
 
-                next8 = (bs->sr |= *(bs->ptr) << bs->bc) & 0xff;
-                bs->bc += sizeof (*(bs->ptr)) * 8;
-            }
-            else
-                next8 = bs->sr & 0xff;
+        if ((ones_count = count_ones (wbs.sr)) < LIMIT_ONES || w.holding_zero) {
+            bitcount = w.holding_zero ? 0 : ones_count + 1;
+            wbs.sr >>= bitcount;
+            wbs.bc -= bitcount;
+        }
+        else {
+            if (ones_count > LIMIT_ONES)
+                break;
 
-            if (next8 == 0xff) {
-                bs->bc -= 8;
-                bs->sr >>= 8;
+            wbs.sr >>= LIMIT_ONES + 1;
+            wbs.bc -= LIMIT_ONES + 1;
 
-                for (ones_count = 8; ones_count < (LIMIT_ONES + 1) && getbit (bs); ++ones_count);
+            if (!wbs_read_count (&wbs, &ones_count))
+                break;
 
-                if (ones_count == (LIMIT_ONES + 1))
-                    break;
+            ones_count += LIMIT_ONES;
+        }
 
-                if (ones_count == LIMIT_ONES) {
-                    uint32_t mask;
-                    int cbits;
+        if (w.holding_zero)
+            ones_count = w.holding_zero = 0;
+        else {
+            code = ones_count & 1;
+            ones_count = (ones_count >> 1) + w.holding_one;
+            w.holding_one = code;
+            w.holding_zero = ~code & 1;
+        }
 
-                    for (cbits = 0; cbits < 33 && getbit (bs); ++cbits);
+        // Find the range of the value for this ones count (and update the
+        // medians that it covers), which is:
+        //   0: 0 to med0 - 1
+        //   1: med0 to med0 + med1 - 1
+        //   2 or more: med0 + med1 + (ones_count - 2) * med2 plus 0 to med2 - 1
+        // The masks are all ones for the cases that apply and zero otherwise.
 
-                    if (cbits == 33)
-                        break;
+        med0 = GET_MED (0);
+        med1 = GET_MED (1);
+        med2 = GET_MED (2);
 
-                    if (cbits < 2)
-                        ones_count = cbits;
-                    else {
-                        for (mask = 1, ones_count = 0; --cbits; mask <<= 1)
-                            if (getbit (bs))
-                                ones_count |= mask;
+        mask0 = (uint32_t) 0 - (ones_count > 0);
+        mask1 = (uint32_t) 0 - (ones_count > 1);
+        mask2 = (uint32_t) 0 - (ones_count > 2);
 
-                        ones_count |= mask;
-                    }
+        c->median [0] += (MED_INC (c->median [0], DIV0) & mask0) - (MED_DEC (c->median [0], DIV0) & ~mask0);
+        c->median [1] += (MED_INC (c->median [1], DIV1) & mask1) - (MED_DEC (c->median [1], DIV1) & (mask0 ^ mask1));
+        c->median [2] += (MED_INC (c->median [2], DIV2) & mask2) - (MED_DEC (c->median [2], DIV2) & (mask1 ^ mask2));
 
-                    ones_count += LIMIT_ONES;
-                }
-            }
-            else {
-                bs->bc -= (ones_count = ones_count_table [next8]) + 1;
-                bs->sr >>= ones_count + 1;
-            }
+        low = (med0 & mask0) + ((med1 + (ones_count - 2) * med2) & mask1);
+        high = (med0 & ~mask0) + (med1 & (mask0 ^ mask1)) + (med2 & mask1) - 1;
 
-            if (wps->w.holding_one) {
-                wps->w.holding_one = ones_count & 1;
-                ones_count = (ones_count >> 1) + 1;
-            }
-            else {
-                wps->w.holding_one = ones_count & 1;
-                ones_count >>= 1;
-            }
+        // this is read_code() (for the range 0 to "high") followed by the sign
+        // bit, which is at most 33 bits
 
-            wps->w.holding_zero = ~wps->w.holding_one & 1;
-        }
+        if (wbs.bc < 33)
+            wbs_fill (&wbs);
 
-        if (ones_count == 0) {
-            low = 0;
-            high = GET_MED (0) - 1;
-            DEC_MED0 ();
+        if (high < 2) {
+            code = high & (uint32_t) wbs.sr;
+            bitcount = high;
         }
         else {
-            low = GET_MED (0);
-            INC_MED0 ();
+            uint32_t extras, extra_bit;
 
-            if (ones_count == 1) {
-                high = low + GET_MED (1) - 1;
-                DEC_MED1 ();
-            }
-            else {
-                low += GET_MED (1);
-                INC_MED1 ();
+            bitcount = count_bits_nz (high);
+            extras = (uint32_t)(((uint64_t) 1 << bitcount) - high - 1);
+            code = (uint32_t) wbs.sr & (((uint32_t) 1 << (bitcount - 1)) - 1);
+            extra_bit = code >= extras;
 
-                if (ones_count == 2) {
-                    high = low + GET_MED (2) - 1;
-                    DEC_MED2 ();
-                }
-                else {
-                    low += (ones_count - 2) * GET_MED (2);
-                    high = low + GET_MED (2) - 1;
-                    INC_MED2 ();
-                }
-            }
+            // codes from "extras" up take one more bit, as in read_code()
+
+            code += (code - extras + ((uint32_t)(wbs.sr >> (bitcount - 1)) & 1)) & ((uint32_t) 0 - extra_bit);
+            bitcount += extra_bit - 1;
         }
 
-        low += read_code (bs, high - low);
-        *buffer++ = (getbit (bs)) ? ~low : low;
+        low += code;
+        *buffer++ = (wbs.sr >> bitcount) & 1 ? ~low : low;
+        wbs.sr >>= bitcount + 1;
+        wbs.bc -= bitcount + 1;
     }
 
-    return (wps->wphdr.flags & MONO_DATA) ? csamples : (csamples / 2);
+    wbs_close (&wbs, &wps->wvbits);
+    wps->w = w;
+    return (flags & MONO_DATA) ? csamples : (csamples / 2);
 }
 
 // Read a single unsigned value from the specified bitstream with a value
@@ -1379,13 +1578,28 @@ static int FASTCALL mylog2 (uint32_t avalue)
 // This function scans a buffer of longs and accumulates the total log2 value
 // of all the samples. This is useful for determining maximum compression
 // because the bitstream storage required for entropy coding is proportional
-// to the base 2 log of the samples.
+// to the base 2 log of the samples. If the processor can do it, most of the
+// buffer is scanned by the SSE4.1 or AVX2 version (see decorr_sse.c), which
+// gives exactly the same result.
 
 uint32_t log2buffer (int32_t *samples, uint32_t num_samples, int limit)
 {
+    const WavpackDecorrFuncs *funcs = get_decorr_funcs ();
     uint32_t result = 0, avalue;
     int dbits;
 
+    if (funcs && funcs->log2buffer && num_samples >= 8) {
+        uint32_t count = num_samples & ~7;
+
+        result = funcs->log2buffer (samples, count, limit);
+
+        if (limit && result == (uint32_t) -1)
+            return result;
+
+        samples += count;
+        num_samples -= count;
+    }
+
     while (num_samples--) {
         avalue = abs (*samples++);
 
@@ -0,0 +1,1251 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2006 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// workers.c
+
+// This module implements the threaded packing modes that are selected with
+// config->worker_threads, and the threaded decoding selected with the
+// OPEN_THREADS_MASK bits of the open flags. Every WavPack block carries its own decorrelation
+// terms, weights, sample history and entropy variables, so a decoder never
+// needs the state left over from the previous block. That lets several
+// blocks be packed at once: each worker owns a forked copy of the context and
+// its streams and always continues from the state of the last block *it*
+// packed (block N is started from the state at the end of block N - workers).
+// Blocks are handed out round-robin and written in order by the calling
+// thread, so the output depends only on the number of workers and never on
+// thread timing. The only things that can't be forked this way are dynamic
+// noise shaping and block merging (both may shorten a block based on the
+// audio, which moves the start of the next block), so those configurations
+// are always packed serially.
+
+// When blocks are packed serially (because of the above, or because the
+// application asked for it with CONFIG_SERIAL_BLOCKS) the threads go to the
+// "extra" mode instead, where extra1.c and extra2.c use them to evaluate the
+// decorrelation candidates of each search step at the same time. That search
+// picks exactly what the serial search would, so the output is unchanged.
+
+// Decoding uses the same property the other way around: unpack_init() sets
+// up everything a block needs from its own metadata, so the blocks following
+// the current position can be read ahead by the calling thread (which is the
+// only one that touches the reader) and unpacked by the workers, one frame
+// (the blocks of all the streams for one run of samples) per worker.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#ifndef NO_WORKER_THREADS
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef DEBUG_ALLOC
+#define malloc malloc_db
+#define realloc realloc_db
+#define free free_db
+void *malloc_db (uint32_t size);
+void *realloc_db (void *ptr, uint32_t size);
+void free_db (void *ptr);
+int32_t dump_alloc (void);
+#endif
+
+#define MAX_WORKER_THREADS 64
+
+///////////////////////////// thread primitives //////////////////////////////
+
+// These are just enough to hand work to a thread and wait for it to come
+// back: an auto-reset event, a lock and a joinable thread.
+
+#ifdef WIN32
+
+typedef HANDLE worker_event;
+typedef HANDLE worker_thread;
+typedef CRITICAL_SECTION worker_lock;
+typedef DWORD (WINAPI *worker_func) (LPVOID param);
+
+static int event_init (worker_event *event)
+{
+    return (*event = CreateEvent (NULL, FALSE, FALSE, NULL)) != NULL;
+}
+
+static void event_signal (worker_event *event)
+{
+    SetEvent (*event);
+}
+
+static void event_wait (worker_event *event)
+{
+    WaitForSingleObject (*event, INFINITE);
+}
+
+static void event_free (worker_event *event)
+{
+    CloseHandle (*event);
+}
+
+static void lock_init (worker_lock *lock)
+{
+    InitializeCriticalSection (lock);
+}
+
+static void lock_enter (worker_lock *lock)
+{
+    EnterCriticalSection (lock);
+}
+
+static void lock_leave (worker_lock *lock)
+{
+    LeaveCriticalSection (lock);
+}
+
+static void lock_free (worker_lock *lock)
+{
+    DeleteCriticalSection (lock);
+}
+
+static int thread_start (worker_thread *thread, worker_func func, void *param)
+{
+    return (*thread = CreateThread (NULL, 0, func, param, 0, NULL)) != NULL;
+}
+
+static void thread_join (worker_thread *thread)
+{
+    WaitForSingleObject (*thread, INFINITE);
+    CloseHandle (*thread);
+}
+
+#else
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int signaled;
+} worker_event;
+
+typedef pthread_t worker_thread;
+typedef pthread_mutex_t worker_lock;
+typedef void *(*worker_func) (void *param);
+
+static int event_init (worker_event *event)
+{
+    event->signaled = FALSE;
+
+    if (pthread_mutex_init (&event->mutex, NULL))
+        return FALSE;
+
+    if (pthread_cond_init (&event->cond, NULL)) {
+        pthread_mutex_destroy (&event->mutex);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void event_signal (worker_event *event)
+{
+    pthread_mutex_lock (&event->mutex);
+    event->signaled = TRUE;
+    pthread_cond_signal (&event->cond);
+    pthread_mutex_unlock (&event->mutex);
+}
+
+static void event_wait (worker_event *event)
+{
+    pthread_mutex_lock (&event->mutex);
+
+    while (!event->signaled)
+        pthread_cond_wait (&event->cond, &event->mutex);
+
+    event->signaled = FALSE;
+    pthread_mutex_unlock (&event->mutex);
+}
+
+static void event_free (worker_event *event)
+{
+    pthread_cond_destroy (&event->cond);
+    pthread_mutex_destroy (&event->mutex);
+}
+
+static void lock_init (worker_lock *lock)
+{
+    pthread_mutex_init (lock, NULL);
+}
+
+static void lock_enter (worker_lock *lock)
+{
+    pthread_mutex_lock (lock);
+}
+
+static void lock_leave (worker_lock *lock)
+{
+    pthread_mutex_unlock (lock);
+}
+
+static void lock_free (worker_lock *lock)
+{
+    pthread_mutex_destroy (lock);
+}
+
+static int thread_start (worker_thread *thread, worker_func func, void *param)
+{
+    return !pthread_create (thread, NULL, func, param);
+}
+
+static void thread_join (worker_thread *thread)
+{
+    pthread_join (*thread, NULL);
+}
+
+#endif
+
+#ifndef NO_PACK
+
+//////////////////////////// worker structures ///////////////////////////////
+
+typedef struct {
+    WavpackContext wpc;                         // forked context (owns its own streams)
+    uchar *outbuff, *out2buff;                  // one max_blocksize slice per stream
+    int busy, result, quit, running;
+    worker_event start, done;
+    worker_thread thread;
+} PackWorker;
+
+typedef struct {
+    int num_workers, next_worker;
+    uint32_t max_blocksize;
+    PackWorker *workers;
+} PackWorkers;
+
+// Pack every stream of the block that was handed to this worker into its
+// own output buffers. This is the body of pack_streams() minus the writing,
+// which is left to the calling thread so that blocks come out in order.
+
+static int pack_worker_streams (PackWorker *worker, uint32_t max_blocksize)
+{
+    WavpackContext *wpc = &worker->wpc;
+    int result = TRUE;
+
+    for (wpc->current_stream = 0; wpc->streams [wpc->current_stream]; wpc->current_stream++) {
+        WavpackStream *wps = wpc->streams [wpc->current_stream];
+        uchar *outbuff = worker->outbuff + wpc->current_stream * max_blocksize;
+        uint32_t flags = wps->wphdr.flags;
+
+        flags &= ~MAG_MASK;
+        flags += (1 << MAG_LSB) * ((flags & BYTES_STORED) * 8 + 7);
+
+        wps->wphdr.block_index = wps->sample_index;
+        wps->wphdr.flags = flags;
+        wps->blockbuff = outbuff;
+        wps->blockend = outbuff + max_blocksize;
+
+        if (worker->out2buff) {
+            wps->block2buff = worker->out2buff + wpc->current_stream * max_blocksize;
+            wps->block2end = wps->block2buff + max_blocksize;
+        }
+
+        result = pack_block (wpc, wps->sample_buffer);
+        wps->blockbuff = wps->block2buff = NULL;
+
+        if (!result) {
+            strcpy (wpc->error_message, "output buffer overflowed!");
+            break;
+        }
+    }
+
+    wpc->current_stream = 0;
+    return result;
+}
+
+#ifdef WIN32
+static DWORD WINAPI pack_worker_thread (LPVOID param)
+#else
+static void *pack_worker_thread (void *param)
+#endif
+{
+    PackWorker *worker = param;
+    PackWorkers *pw = worker->wpc.workers;
+
+    while (1) {
+        event_wait (&worker->start);
+
+        if (worker->quit)
+            break;
+
+        worker->result = pack_worker_streams (worker, pw->max_blocksize);
+        event_signal (&worker->done);
+    }
+
+    return 0;
+}
+
+// Wait for the worker to finish its block and send the results to the
+// "blockout" function, one stream at a time (.wv block, then .wvc block)
+// exactly as pack_streams() does.
+
+static int write_worker_blocks (WavpackContext *wpc, PackWorker *worker)
+{
+    PackWorkers *pw = wpc->workers;
+    uint32_t bcount;
+    int si;
+
+    event_wait (&worker->done);
+    worker->busy = FALSE;
+
+    if (worker->wpc.lossy_blocks)
+        wpc->lossy_blocks = TRUE;
+
+    if (!worker->result) {
+        strcpy (wpc->error_message, worker->wpc.error_message);
+        return FALSE;
+    }
+
+    for (si = 0; si < wpc->num_streams; ++si) {
+        uchar *outbuff = worker->outbuff + si * pw->max_blocksize;
+        WavpackStream *wps = wpc->streams [si], *worker_wps = worker->wpc.streams [si];
+
+        // move the block's noise to the caller's stream (for WavpackGetEncodedNoise())
+
+        wps->dc.noise_sum += worker_wps->dc.noise_sum;
+        worker_wps->dc.noise_sum = 0.0;
+
+        if (worker_wps->dc.noise_max > wps->dc.noise_max)
+            wps->dc.noise_max = worker_wps->dc.noise_max;
+
+        bcount = ((WavpackHeader *) outbuff)->ckSize + 8;
+        native_to_little_endian ((WavpackHeader *) outbuff, WavpackHeaderFormat);
+
+        if (!wpc->blockout (wpc->wv_out, outbuff, bcount)) {
+            strcpy (wpc->error_message, "can't write WavPack data, disk probably full!");
+            return FALSE;
+        }
+
+        wpc->filelen += bcount;
+
+        if (worker->out2buff) {
+            uchar *out2buff = worker->out2buff + si * pw->max_blocksize;
+
+            bcount = ((WavpackHeader *) out2buff)->ckSize + 8;
+            native_to_little_endian ((WavpackHeader *) out2buff, WavpackHeaderFormat);
+
+            if (!wpc->blockout (wpc->wvc_out, out2buff, bcount)) {
+                strcpy (wpc->error_message, "can't write WavPack data, disk probably full!");
+                return FALSE;
+            }
+
+            wpc->file2len += bcount;
+        }
+    }
+
+    return TRUE;
+}
+
+static void free_worker (PackWorker *worker)
+{
+    int si;
+
+    if (worker->running) {
+        if (worker->busy)
+            event_wait (&worker->done);
+
+        worker->quit = TRUE;
+        event_signal (&worker->start);
+        thread_join (&worker->thread);
+        event_free (&worker->start);
+        event_free (&worker->done);
+    }
+
+    for (si = 0; si < MAX_STREAMS && worker->wpc.streams [si]; ++si) {
+        if (worker->wpc.streams [si]->sample_buffer)
+            free (worker->wpc.streams [si]->sample_buffer);
+
+        free (worker->wpc.streams [si]);
+    }
+
+    if (worker->wpc.metadata) {
+        while (worker->wpc.metacount)
+            free_metadata (worker->wpc.metadata + --worker->wpc.metacount);
+
+        free (worker->wpc.metadata);
+    }
+
+    free_scratch (&worker->wpc);
+
+    if (worker->outbuff)
+        free (worker->outbuff);
+
+    if (worker->out2buff)
+        free (worker->out2buff);
+}
+
+// Fork the initialized context into the requested number of workers and start
+// their threads. A return of FALSE means that nothing was started.
+
+static int start_pack_workers (WavpackContext *wpc, int num_workers)
+{
+    PackWorkers *pw;
+    int wi, si;
+
+    pw = malloc (sizeof (PackWorkers));
+
+    if (!pw)
+        return FALSE;
+
+    CLEAR (*pw);
+    pw->num_workers = num_workers;
+
+    if ((pw->workers = malloc (num_workers * sizeof (PackWorker))) != NULL)
+        memset (pw->workers, 0, num_workers * sizeof (PackWorker));
+
+    if ((wpc->config.flags & CONFIG_FLOAT_DATA) && !(wpc->config.flags & CONFIG_SKIP_WVX))
+        pw->max_blocksize = wpc->max_samples * 16 + 4096;
+    else
+        pw->max_blocksize = wpc->max_samples * 10 + 4096;
+
+    pw->max_blocksize = (pw->max_blocksize + 15) & ~15;    // keep every stream's header aligned
+
+    for (wi = 0; pw->workers && wi < num_workers; ++wi) {
+        PackWorker *worker = pw->workers + wi;
+        int ok;
+
+        worker->wpc = *wpc;
+        worker->wpc.metadata = NULL;
+        worker->wpc.metacount = 0;
+        worker->wpc.metabytes = 0;
+        worker->wpc.workers = pw;
+        CLEAR (worker->wpc.scratch);
+        CLEAR (worker->wpc.scratch_bytes);
+
+        for (si = 0; si < MAX_STREAMS; ++si)
+            worker->wpc.streams [si] = NULL;
+
+        for (si = 0, ok = TRUE; ok && si < wpc->num_streams; ++si) {
+            WavpackStream *wps = malloc (sizeof (WavpackStream));
+
+            if ((worker->wpc.streams [si] = wps) != NULL) {
+                *wps = *wpc->streams [si];
+                wps->dc.shaping_data = NULL;
+                wps->dc.noise_sum = 0.0;
+                wps->sample_buffer = malloc (wpc->max_samples * (wps->wphdr.flags & MONO_FLAG ? 4 : 8));
+                ok = wps->sample_buffer != NULL;
+            }
+            else
+                ok = FALSE;
+        }
+
+        worker->outbuff = malloc (pw->max_blocksize * wpc->num_streams);
+
+        if (wpc->wvc_flag)
+            worker->out2buff = malloc (pw->max_blocksize * wpc->num_streams);
+
+        if (!ok || !worker->outbuff || (wpc->wvc_flag && !worker->out2buff))
+            break;
+
+        if (!event_init (&worker->start))
+            break;
+
+        if (!event_init (&worker->done)) {
+            event_free (&worker->start);
+            break;
+        }
+
+        if (!(worker->running = thread_start (&worker->thread, pack_worker_thread, worker))) {
+            event_free (&worker->start);
+            event_free (&worker->done);
+            break;
+        }
+    }
+
+    if (!pw->workers || wi < num_workers) {
+        if (pw->workers) {
+            while (wi >= 0)
+                free_worker (pw->workers + wi--);
+
+            free (pw->workers);
+        }
+
+        free (pw);
+        return FALSE;
+    }
+
+    wpc->workers = pw;
+    return TRUE;
+}
+
+/////////////////////////// extra mode search pool ///////////////////////////
+
+// The search pool runs batches of independent jobs. The calling thread takes
+// jobs too, so a pool for "n" threads only starts n - 1 of its own. Jobs are
+// claimed in index order, but they may finish in any order, so each job must
+// write its results to its own slot.
+
+typedef struct {
+    void *pool;
+    worker_event start;
+    worker_thread thread;
+    int running;
+} SearchThread;
+
+typedef struct {
+    int num_threads;
+    SearchThread *threads;
+    worker_event done;
+    worker_lock lock;
+    void (*job_func) (void *data, int job);
+    void *job_data;
+    int num_jobs, next_job, jobs_done, quit;
+} SearchWorkers;
+
+static void run_jobs (SearchWorkers *sw)
+{
+    void (*job_func) (void *data, int job);
+    void *job_data;
+    int job;
+
+    while (1) {
+        lock_enter (&sw->lock);
+        job = (sw->next_job < sw->num_jobs) ? sw->next_job++ : -1;
+        job_func = sw->job_func;
+        job_data = sw->job_data;
+        lock_leave (&sw->lock);
+
+        if (job < 0)
+            break;
+
+        job_func (job_data, job);
+
+        lock_enter (&sw->lock);
+
+        if (++sw->jobs_done == sw->num_jobs)
+            event_signal (&sw->done);
+
+        lock_leave (&sw->lock);
+    }
+}
+
+#ifdef WIN32
+static DWORD WINAPI search_worker_thread (LPVOID param)
+#else
+static void *search_worker_thread (void *param)
+#endif
+{
+    SearchThread *thread = param;
+    SearchWorkers *sw = thread->pool;
+
+    while (1) {
+        event_wait (&thread->start);
+
+        if (sw->quit)
+            break;
+
+        run_jobs (sw);
+    }
+
+    return 0;
+}
+
+static void free_search_workers (SearchWorkers *sw)
+{
+    int ti;
+
+    sw->quit = TRUE;
+
+    for (ti = 0; ti < sw->num_threads; ++ti)
+        if (sw->threads [ti].running) {
+            event_signal (&sw->threads [ti].start);
+            thread_join (&sw->threads [ti].thread);
+            event_free (&sw->threads [ti].start);
+        }
+
+    event_free (&sw->done);
+    lock_free (&sw->lock);
+    free (sw->threads);
+    free (sw);
+}
+
+static void start_search_workers (WavpackContext *wpc, int num_workers)
+{
+    SearchWorkers *sw = malloc (sizeof (SearchWorkers));
+    int ti;
+
+    if (!sw)
+        return;
+
+    CLEAR (*sw);
+    sw->num_threads = num_workers - 1;
+
+    if ((sw->threads = malloc (sw->num_threads * sizeof (SearchThread))) == NULL) {
+        free (sw);
+        return;
+    }
+
+    memset (sw->threads, 0, sw->num_threads * sizeof (SearchThread));
+
+    if (!event_init (&sw->done)) {
+        free (sw->threads);
+        free (sw);
+        return;
+    }
+
+    lock_init (&sw->lock);
+
+    for (ti = 0; ti < sw->num_threads; ++ti) {
+        SearchThread *thread = sw->threads + ti;
+
+        thread->pool = sw;
+
+        if (!event_init (&thread->start))
+            break;
+
+        if (!(thread->running = thread_start (&thread->thread, search_worker_thread, thread))) {
+            event_free (&thread->start);
+            break;
+        }
+    }
+
+    if (ti < sw->num_threads) {
+        free_search_workers (sw);
+        return;
+    }
+
+    wpc->search_workers = sw;
+}
+
+// Run jobs 0 to num_jobs - 1 and return when they have all finished. Without
+// a search pool they are simply run here, in order.
+
+void run_search_jobs (WavpackContext *wpc, void (*job_func) (void *data, int job), void *job_data, int num_jobs)
+{
+    SearchWorkers *sw = wpc->search_workers;
+    int ti;
+
+    if (!sw) {
+        for (ti = 0; ti < num_jobs; ++ti)
+            job_func (job_data, ti);
+
+        return;
+    }
+
+    if (num_jobs < 1)
+        return;
+
+    lock_enter (&sw->lock);
+    sw->job_func = job_func;
+    sw->job_data = job_data;
+    sw->num_jobs = num_jobs;
+    sw->next_job = sw->jobs_done = 0;
+    lock_leave (&sw->lock);
+
+    for (ti = 0; ti < sw->num_threads; ++ti)
+        event_signal (&sw->threads [ti].start);
+
+    run_jobs (sw);
+    event_wait (&sw->done);
+}
+
+/////////////////////////////// entry points ////////////////////////////////
+
+// Start whichever kind of workers config->worker_threads asks for. This is
+// called at the end of WavpackPackInit() (after pack_init() has set up each
+// stream) and silently leaves the context in the serial mode if anything
+// fails here.
+
+void pack_workers_init (WavpackContext *wpc)
+{
+    int num_workers = wpc->config.worker_threads;
+
+    if (num_workers > MAX_WORKER_THREADS)
+        num_workers = MAX_WORKER_THREADS;
+
+    if (num_workers < 2 || wpc->workers || wpc->search_workers)
+        return;
+
+    if (!(wpc->config.flags & CONFIG_SERIAL_BLOCKS) && !wpc->block_boundary &&
+        !(wpc->config.flags & CONFIG_DYNAMIC_SHAPING) && start_pack_workers (wpc, num_workers))
+            return;
+
+    if (wpc->config.flags & CONFIG_EXTRA_MODE)
+        start_search_workers (wpc, num_workers);
+}
+
+// Hand the next "block_samples" samples of every stream to the next worker in
+// line. If that worker is still holding an earlier block then that block is
+// the oldest one outstanding, so it is written first. This takes the place of
+// pack_streams() when the context has workers.
+
+int pack_workers_block (WavpackContext *wpc, uint32_t block_samples)
+{
+    PackWorkers *pw = wpc->workers;
+    PackWorker *worker = pw->workers + pw->next_worker;
+    int si;
+
+    if (worker->busy && !write_worker_blocks (wpc, worker))
+        return FALSE;
+
+    for (si = 0; si < wpc->num_streams; ++si) {
+        WavpackStream *wps = wpc->streams [si], *worker_wps = worker->wpc.streams [si];
+        int chans = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
+
+        memcpy (worker_wps->sample_buffer, wps->sample_buffer, block_samples * sizeof (int32_t) * chans);
+        worker_wps->wphdr.block_samples = block_samples;
+        worker_wps->sample_index = wps->sample_index;
+        wps->sample_index += block_samples;
+
+        if (wpc->acc_samples != block_samples)
+            memmove (wps->sample_buffer, wps->sample_buffer + block_samples * chans,
+                (wpc->acc_samples - block_samples) * sizeof (int32_t) * chans);
+    }
+
+    // any pending metadata (like the RIFF header) goes into the first block
+    // packed from here on, so it travels with this block to its worker
+
+    if (wpc->metacount) {
+        worker->wpc.metadata = wpc->metadata;
+        worker->wpc.metacount = wpc->metacount;
+        worker->wpc.metabytes = wpc->metabytes;
+        wpc->metadata = NULL;
+        wpc->metacount = 0;
+        wpc->metabytes = 0;
+    }
+
+    wpc->ave_block_samples = (wpc->ave_block_samples * 0x7 + block_samples + 0x4) >> 3;
+    wpc->acc_samples -= block_samples;
+    worker->wpc.ave_block_samples = wpc->ave_block_samples;
+    worker->busy = TRUE;
+    event_signal (&worker->start);
+
+    pw->next_worker = (pw->next_worker + 1) % pw->num_workers;
+    wpc->current_stream = 0;
+    return TRUE;
+}
+
+// Write every block still being packed, oldest first. This must be done
+// before anything else is sent to the "blockout" function.
+
+int pack_workers_drain (WavpackContext *wpc)
+{
+    PackWorkers *pw = wpc->workers;
+    int wi, result = TRUE;
+
+    if (!pw)
+        return TRUE;
+
+    for (wi = 0; wi < pw->num_workers; ++wi) {
+        PackWorker *worker = pw->workers + (pw->next_worker + wi) % pw->num_workers;
+
+        if (worker->busy && result)
+            result = write_worker_blocks (wpc, worker);
+    }
+
+    return result;
+}
+
+// Stop the worker threads and free everything they own. Any blocks that
+// were not drained are discarded.
+
+void pack_workers_free (WavpackContext *wpc)
+{
+    PackWorkers *pw = wpc->workers;
+    int wi;
+
+    if (wpc->search_workers) {
+        free_search_workers (wpc->search_workers);
+        wpc->search_workers = NULL;
+    }
+
+    if (!pw)
+        return;
+
+    for (wi = 0; wi < pw->num_workers; ++wi)
+        free_worker (pw->workers + wi);
+
+    free (pw->workers);
+    free (pw);
+    wpc->workers = NULL;
+}
+
+#endif
+
+#ifndef NO_UNPACK
+
+///////////////////////////// unpack worker pool /////////////////////////////
+
+// Each worker holds one frame, which the calling thread reads into the
+// worker's copy of the context before starting it. The worker then unpacks
+// all the samples of the frame at once. Frames are handed out and returned in
+// file order, so while the caller is taking samples from the oldest frame the
+// others are being unpacked. Whatever unpacking a frame changes in the context
+// (errors, lossy blocks, wrapper data, the MD5 sum) is moved to the caller's
+// context only when the caller gets to that frame, which is when it would have
+// happened without the workers.
+
+typedef struct {
+    WavpackContext wpc;                         // copy of the context that owns the frame's streams
+    int32_t *samples, *temp_buffer;             // the unpacked frame and one stream's worth
+    uint32_t max_samples;                       // frame size the buffers are allocated for
+    int frame_ok, started, unpack_errors, crc_result, quit, running;
+    worker_event start, done;
+    worker_thread thread;
+} UnpackWorker;
+
+typedef struct {
+    int num_workers, first_worker, num_busy, num_chans, active, at_end;
+    uint32_t next_index;                        // where the caller will be after the frames read
+    UnpackWorker *workers;
+} UnpackWorkers;
+
+// Unpack the frame held by this worker into worker->samples, interleaving
+// the streams of a multichannel frame the way WavpackUnpackSamples() does.
+
+static void unpack_worker_frame (UnpackWorker *worker)
+{
+    WavpackContext *wpc = &worker->wpc;
+    WavpackStream *wps = wpc->streams [wpc->current_stream = 0];
+    uint32_t block_samples = wps->wphdr.block_samples, samcnt;
+    int num_channels = wpc->config.num_channels, offset = 0;
+    int32_t *src, *dst;
+
+    worker->unpack_errors = worker->crc_result = 0;
+
+    if (!block_samples || wpc->reduced_channels || (wps->wphdr.flags & FINAL_BLOCK)) {
+        if (!unpack_init (wpc))
+            worker->unpack_errors++;
+
+        if (block_samples) {
+            unpack_samples (wpc, worker->samples, block_samples);
+            worker->crc_result = check_crc_error (wpc);
+        }
+
+        return;
+    }
+
+    for (; wpc->current_stream < wpc->num_streams; wpc->current_stream++) {
+        wps = wpc->streams [wpc->current_stream];
+
+        if (!unpack_init (wpc))
+            worker->unpack_errors++;
+
+        unpack_samples (wpc, src = worker->temp_buffer, block_samples);
+        samcnt = block_samples;
+        dst = worker->samples + offset;
+
+        if (wps->wphdr.flags & MONO_FLAG) {
+            while (samcnt--) {
+                dst [0] = *src++;
+                dst += num_channels;
+            }
+
+            offset++;
+        }
+        else if (offset == num_channels - 1) {
+            while (samcnt--) {
+                dst [0] = src [0];
+                dst += num_channels;
+                src += 2;
+            }
+
+            worker->unpack_errors++;
+            offset++;
+        }
+        else {
+            while (samcnt--) {
+                dst [0] = *src++;
+                dst [1] = *src++;
+                dst += num_channels;
+            }
+
+            offset += 2;
+        }
+    }
+
+    wpc->current_stream = 0;
+    worker->crc_result = check_crc_error (wpc);
+}
+
+#ifdef WIN32
+static DWORD WINAPI unpack_worker_thread (LPVOID param)
+#else
+static void *unpack_worker_thread (void *param)
+#endif
+{
+    UnpackWorker *worker = param;
+
+    while (1) {
+        event_wait (&worker->start);
+
+        if (worker->quit)
+            break;
+
+        unpack_worker_frame (worker);
+        event_signal (&worker->done);
+    }
+
+    return 0;
+}
+
+// Read the frames that follow into the idle workers (in order) and start
+// them, until every worker is busy or the end of the file has been reached.
+// A frame that can't be read (including the end of the file) still takes a
+// worker so that its errors are reported in order.
+
+static void start_unpack_frames (WavpackContext *wpc, UnpackWorkers *uw)
+{
+    while (!uw->at_end && uw->num_busy < uw->num_workers) {
+        UnpackWorker *worker = uw->workers + (uw->first_worker + uw->num_busy++) % uw->num_workers;
+        WavpackContext *fwpc = &worker->wpc;
+        WavpackStream *wps;
+
+        fwpc->crc_errors = 0;
+        fwpc->lossy_blocks = FALSE;
+        fwpc->config.md5_read = 0;
+        fwpc->error_message [0] = 0;
+
+        if (!read_next_frame (wpc, fwpc, uw->next_index)) {
+            worker->frame_ok = FALSE;
+            uw->at_end = TRUE;
+            break;
+        }
+
+        wps = fwpc->streams [0];
+
+        if (wps->wphdr.block_samples > worker->max_samples) {
+            if (worker->samples)
+                free (worker->samples);
+
+            if (worker->temp_buffer)
+                free (worker->temp_buffer);
+
+            worker->samples = malloc (wps->wphdr.block_samples * uw->num_chans * sizeof (int32_t));
+            worker->temp_buffer = malloc (wps->wphdr.block_samples * 2 * sizeof (int32_t));
+            worker->max_samples = wps->wphdr.block_samples;
+
+            if (!worker->samples || !worker->temp_buffer) {
+                strcpy (fwpc->error_message, "can't allocate memory");
+                worker->max_samples = 0;
+                worker->frame_ok = FALSE;
+                uw->at_end = TRUE;
+                break;
+            }
+        }
+
+        if (wps->wphdr.block_samples && wps->wphdr.block_index + wps->wphdr.block_samples > uw->next_index)
+            uw->next_index = wps->wphdr.block_index + wps->wphdr.block_samples;
+
+        worker->frame_ok = worker->started = TRUE;
+        event_signal (&worker->start);
+    }
+}
+
+// Release the oldest frame once the caller is done with it (or skips it).
+
+static void release_frame (UnpackWorkers *uw, UnpackWorker *worker)
+{
+    if (worker->started) {
+        event_wait (&worker->done);
+        worker->started = FALSE;
+    }
+
+    free_streams (&worker->wpc);
+
+    if (worker->wpc.wrapper_data) {
+        free (worker->wpc.wrapper_data);
+        worker->wpc.wrapper_data = NULL;
+        worker->wpc.wrapper_bytes = 0;
+    }
+
+    uw->first_worker = (uw->first_worker + 1) % uw->num_workers;
+    uw->num_busy--;
+}
+
+// The oldest frame has come up: wait for it to be unpacked and move what the
+// unpacking changed into the caller's context. A return of FALSE means that
+// the frame is not used (it's entirely before the current position).
+
+static int enter_frame (WavpackContext *wpc, UnpackWorker *worker)
+{
+    WavpackContext *fwpc = &worker->wpc;
+    WavpackStream *wps = wpc->streams [0], *fwps = fwpc->streams [0];
+
+    event_wait (&worker->done);
+    worker->started = FALSE;
+
+    wpc->filepos = fwpc->filepos;
+    wpc->file2pos = fwpc->file2pos;
+    wpc->crc_errors += fwpc->crc_errors;
+
+    if (wpc->open_flags & OPEN_STREAMING)
+        wps->sample_index = 0;
+
+    if (fwps->wphdr.block_samples && wps->sample_index >= fwps->wphdr.block_index + fwps->wphdr.block_samples)
+        return FALSE;
+
+    wpc->crc_errors += worker->unpack_errors;
+
+    if (fwpc->lossy_blocks)
+        wpc->lossy_blocks = TRUE;
+
+    if (fwpc->wrapper_bytes && wpc->wrapper_bytes < MAX_WRAPPER_BYTES) {
+        wpc->wrapper_data = realloc (wpc->wrapper_data, wpc->wrapper_bytes + fwpc->wrapper_bytes);
+        memcpy (wpc->wrapper_data + wpc->wrapper_bytes, fwpc->wrapper_data, fwpc->wrapper_bytes);
+        wpc->wrapper_bytes += fwpc->wrapper_bytes;
+    }
+
+    if (fwpc->config.md5_read) {
+        memcpy (wpc->config.md5_checksum, fwpc->config.md5_checksum, 16);
+        wpc->config.flags |= CONFIG_MD5_CHECKSUM;
+        wpc->config.md5_read = 1;
+    }
+
+    memcpy (&wps->wphdr, &fwps->wphdr, sizeof (WavpackHeader));
+
+    if (!wps->wphdr.block_samples)
+        return FALSE;
+
+    if (wps->sample_index > wps->wphdr.block_index)
+        wps->sample_index = wps->wphdr.block_index;
+
+    return TRUE;
+}
+
+static void free_unpack_worker (UnpackWorker *worker)
+{
+    if (worker->running) {
+        worker->quit = TRUE;
+        event_signal (&worker->start);
+        thread_join (&worker->thread);
+        event_free (&worker->start);
+        event_free (&worker->done);
+    }
+
+    if (worker->wpc.streams [0]) {
+        free_streams (&worker->wpc);
+        free (worker->wpc.streams [0]);
+    }
+
+    if (worker->samples)
+        free (worker->samples);
+
+    if (worker->temp_buffer)
+        free (worker->temp_buffer);
+}
+
+// Start the requested number of unpack workers, each with its own copy of the
+// just opened context. This is called at the end of WavpackOpenFileInputEx()
+// and silently leaves the context decoding on the calling thread if anything
+// fails here.
+
+void unpack_workers_init (WavpackContext *wpc, int num_workers)
+{
+    UnpackWorkers *uw;
+    int wi, si;
+
+    if (num_workers > MAX_WORKER_THREADS)
+        num_workers = MAX_WORKER_THREADS;
+
+    if (num_workers < 2 || wpc->unpack_workers || wpc->stream3)
+        return;
+
+    uw = malloc (sizeof (UnpackWorkers));
+
+    if (!uw)
+        return;
+
+    CLEAR (*uw);
+    uw->num_workers = num_workers;
+    uw->num_chans = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+
+    if (uw->num_chans < 2)
+        uw->num_chans = 2;
+
+    if ((uw->workers = malloc (num_workers * sizeof (UnpackWorker))) != NULL)
+        memset (uw->workers, 0, num_workers * sizeof (UnpackWorker));
+
+    for (wi = 0; uw->workers && wi < num_workers; ++wi) {
+        UnpackWorker *worker = uw->workers + wi;
+        WavpackContext *fwpc = &worker->wpc;
+
+        *fwpc = *wpc;
+        fwpc->wrapper_data = NULL;
+        fwpc->wrapper_bytes = 0;
+        fwpc->close_files = FALSE;
+        fwpc->num_streams = 0;
+        CLEAR (fwpc->m_tag);
+
+        for (si = 0; si < MAX_STREAMS; ++si)
+            fwpc->streams [si] = NULL;
+
+        if ((fwpc->streams [0] = malloc (sizeof (WavpackStream))) == NULL)
+            break;
+
+        CLEAR (*fwpc->streams [0]);
+        fwpc->num_streams = 1;
+
+        if (!event_init (&worker->start))
+            break;
+
+        if (!event_init (&worker->done)) {
+            event_free (&worker->start);
+            break;
+        }
+
+        if (!(worker->running = thread_start (&worker->thread, unpack_worker_thread, worker))) {
+            event_free (&worker->start);
+            event_free (&worker->done);
+            break;
+        }
+    }
+
+    if (!uw->workers || wi < num_workers) {
+        if (uw->workers) {
+            while (wi >= 0)
+                free_unpack_worker (uw->workers + wi--);
+
+            free (uw->workers);
+        }
+
+        free (uw);
+        return;
+    }
+
+    wpc->unpack_workers = uw;
+}
+
+// Unpack samples with the workers. This takes the place of the single
+// threaded loop in WavpackUnpackSamples() once the block that was read at
+// open (or by a seek) has been used up, and it follows that loop exactly:
+// gaps between blocks are filled with silence, overlapping blocks restart
+// at their beginning and the crc of a frame counts once it's fully returned.
+// The one thing it can't do is back the reader up into a frame that failed
+// its crc to look for a block hidden in it, because by then the reader has
+// moved on; the error is still counted.
+
+uint32_t unpack_workers_samples (WavpackContext *wpc, int32_t *buffer, uint32_t samples)
+{
+    UnpackWorkers *uw = wpc->unpack_workers;
+    WavpackStream *wps = wpc->streams [0];
+    int num_chans = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+    uint32_t samples_unpacked = 0, samples_to_unpack;
+
+    if (!uw->active) {
+        uw->next_index = wps->sample_index;
+        uw->at_end = FALSE;
+        uw->active = TRUE;
+    }
+
+    while (samples) {
+        UnpackWorker *worker = uw->workers + uw->first_worker;
+
+        start_unpack_frames (wpc, uw);
+
+        if (!uw->num_busy)
+            break;
+
+        if (!worker->frame_ok) {
+            wpc->crc_errors += worker->wpc.crc_errors;
+
+            if (worker->wpc.error_message [0])
+                strcpy (wpc->error_message, worker->wpc.error_message);
+
+            release_frame (uw, worker);
+            break;
+        }
+
+        if (worker->started && !enter_frame (wpc, worker)) {
+            release_frame (uw, worker);
+            continue;
+        }
+
+        if (wps->sample_index < wps->wphdr.block_index) {
+            samples_to_unpack = wps->wphdr.block_index - wps->sample_index;
+
+            if (samples_to_unpack > 262144) {
+                strcpy (wpc->error_message, "discontinuity found, aborting file!");
+                wps->wphdr.block_samples = 0;
+                wps->wphdr.ckSize = 24;
+                release_frame (uw, worker);
+                break;
+            }
+
+            if (samples_to_unpack > samples)
+                samples_to_unpack = samples;
+
+            memset (buffer, 0, samples_to_unpack * num_chans * sizeof (int32_t));
+            buffer += samples_to_unpack * num_chans;
+            wps->sample_index += samples_to_unpack;
+            samples_unpacked += samples_to_unpack;
+            samples -= samples_to_unpack;
+            continue;
+        }
+
+        samples_to_unpack = wps->wphdr.block_index + wps->wphdr.block_samples - wps->sample_index;
+
+        if (samples_to_unpack > samples)
+            samples_to_unpack = samples;
+
+        memcpy (buffer, worker->samples + (wps->sample_index - wps->wphdr.block_index) * num_chans,
+            samples_to_unpack * num_chans * sizeof (int32_t));
+
+        buffer += samples_to_unpack * num_chans;
+        wps->sample_index += samples_to_unpack;
+        samples_unpacked += samples_to_unpack;
+        samples -= samples_to_unpack;
+
+        if (wps->sample_index == wps->wphdr.block_index + wps->wphdr.block_samples) {
+            if (worker->crc_result)
+                wpc->crc_errors++;
+
+            release_frame (uw, worker);
+        }
+
+        if (wpc->total_samples != (uint32_t) -1 && wps->sample_index == wpc->total_samples)
+            break;
+    }
+
+    return samples_unpacked;
+}
+
+// Drop the frames that were read ahead (before a seek). The workers start
+// reading again from wherever the file is left by the next call to
+// unpack_workers_samples().
+
+void unpack_workers_reset (WavpackContext *wpc)
+{
+    UnpackWorkers *uw = wpc->unpack_workers;
+
+    while (uw->num_busy)
+        release_frame (uw, uw->workers + uw->first_worker);
+
+    uw->active = FALSE;
+}
+
+// Stop the unpack workers and free everything they own.
+
+void unpack_workers_free (WavpackContext *wpc)
+{
+    UnpackWorkers *uw = wpc->unpack_workers;
+    int wi;
+
+    if (!uw)
+        return;
+
+    unpack_workers_reset (wpc);
+
+    for (wi = 0; wi < uw->num_workers; ++wi)
+        free_unpack_worker (uw->workers + wi);
+
+    free (uw->workers);
+    free (uw);
+    wpc->unpack_workers = NULL;
+}
+
+#endif
+
+#endif
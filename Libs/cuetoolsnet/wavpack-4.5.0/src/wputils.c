@@ -51,8 +51,6 @@ void free_db (void *ptr);
 int32_t dump_alloc (void);
 #endif
 
-static void free_streams (WavpackContext *wpc);
-
 ///////////////////////////// local table storage ////////////////////////////
 
 static const uint32_t sample_rates [] = { 6000, 8000, 9600, 11025, 12000, 16000, 22050,
@@ -77,6 +75,11 @@ static int read_wvc_block (WavpackContext *wpc);
 
 #ifndef NO_USE_FSTREAMS
 
+#if !defined(NO_UNPACK) && !defined(NO_SEEKING)
+static void load_index_file (WavpackContext *wpc, const wchar_t *infilename);
+static void save_index_file (WavpackContext *wpc);
+#endif
+
 static int32_t read_bytes (void *id, void *data, int32_t bcount)
 {
     return (int32_t) fread (data, 1, bcount, (FILE*) id);
@@ -146,6 +149,11 @@ static WavpackStreamReader freader = {
 // OPEN_NORMALIZE:  normalize floating point data to +/- 1.0 (w/ offset exp)
 // OPEN_STREAMING:  blindly unpacks blocks w/o regard to header file position
 // OPEN_EDIT_TAGS:  allow editing of tags (file must be writable)
+// OPEN_SEEK_INDEX:  seek through an index of the block positions (built on
+//                   the first seek, or loaded from and saved to the file
+//                   name with an "i" appended, e.g. "file.wvi")
+// OPEN_THREADS_MASK:  decode with this many worker threads (shifted up by
+//                     OPEN_THREADS_SHFT, 0 or 1 decodes on the calling thread)
 
 // Version 4.2 of the WavPack library adds the OPEN_STREAMING flag. This is
 // essentially a "raw" mode where the library will simply decode any blocks
@@ -160,6 +168,24 @@ static WavpackStreamReader freader = {
 // (and again, decoding must start at the beginning of the block containing
 // the seek sample).
 
+// When more than one worker thread is requested (see OPEN_THREADS_MASK) the
+// calling thread reads the blocks following the current position ahead and
+// hands them to the workers to unpack, so that decoding a long file scales
+// with the number of cores. The samples returned (and the errors counted) are
+// those of a single threaded decode. The only difference is that each block
+// is unpacked whole, so a damaged block is muted from its start, just as it
+// is when the caller asks for a whole block at a time.
+
+// Without OPEN_SEEK_INDEX every seek outside the current block searches for
+// the block by reading headers at estimated positions in the file (and again
+// in the .wvc file), which takes many small reads. With it, the first such
+// seek reads all the block headers once and keeps their positions so that
+// this and all later seeks go directly to the right block. When the file is
+// opened here the index is also saved beside it and loaded on the next open
+// (an index that no longer matches the files is ignored). Applications that
+// use WavpackOpenFileInputEx() can do the same with WavpackGetSeekIndex()
+// and WavpackSetSeekIndex().
+
 WavpackContext *WavpackOpenFileInput (const wchar_t *infilename, char *error, int flags, int norm_offset)
 {
     const wchar_t *file_mode = (flags & OPEN_EDIT_TAGS) ? L"r+b" : L"rb";
@@ -197,12 +223,74 @@ WavpackContext *WavpackOpenFileInput (const wchar_t *infilename, char *error, in
         if (wvc_id)
             fclose (wvc_id);
     }
-    else
+    else {
         wpc->close_files = TRUE;
 
+#if !defined(NO_UNPACK) && !defined(NO_SEEKING)
+        if (wv_id != stdin && (flags & OPEN_SEEK_INDEX))
+            load_index_file (wpc, infilename);
+#endif
+    }
+
     return wpc;
 }
 
+#if !defined(NO_UNPACK) && !defined(NO_SEEKING)
+
+// Load the seek index saved beside the specified file, if there is one and
+// it matches the file. Otherwise the index file name is kept so that an
+// index built by a later seek can be saved there when the file is closed.
+
+static void load_index_file (WavpackContext *wpc, const wchar_t *infilename)
+{
+    wchar_t *index_filename = malloc ((wcslen (infilename) + 10) * sizeof(wchar_t));
+    FILE *index_id;
+
+    wcscpy (index_filename, infilename);
+    wcscat (index_filename, L"i");
+
+    if ((index_id = _wfopen (index_filename, L"rb")) != NULL) {
+        uint32_t index_size = get_length (index_id);
+        uchar *index_data = index_size ? malloc (index_size) : NULL;
+
+        if (index_data && fread (index_data, 1, index_size, index_id) == index_size &&
+            WavpackSetSeekIndex (wpc, index_data, index_size)) {
+                free (index_filename);
+                index_filename = NULL;
+        }
+
+        if (index_data)
+            free (index_data);
+
+        fclose (index_id);
+    }
+
+    wpc->index_filename = index_filename;
+}
+
+// Save the seek index to the file name kept by load_index_file(). Failure is
+// not an error here; the index will simply be built again next time.
+
+static void save_index_file (WavpackContext *wpc)
+{
+    uint32_t index_size = WavpackGetSeekIndex (wpc, NULL, 0);
+    uchar *index_data = index_size ? malloc (index_size) : NULL;
+    FILE *index_id;
+
+    if (index_data) {
+        WavpackGetSeekIndex (wpc, index_data, index_size);
+
+        if ((index_id = _wfopen (wpc->index_filename, L"wb")) != NULL) {
+            fwrite (index_data, 1, index_size, index_id);
+            fclose (index_id);
+        }
+
+        free (index_data);
+    }
+}
+
+#endif
+
 #endif
 
 // This function is identical to WavpackOpenFileInput() except that instead
@@ -343,6 +431,7 @@ WavpackContext *WavpackOpenFileInputEx (WavpackStreamReader *reader, void *wv_id
     if ((flags & OPEN_2CH_MAX) && !(wps->wphdr.flags & FINAL_BLOCK))
         wpc->reduced_channels = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
 
+    unpack_workers_init (wpc, (flags & OPEN_THREADS_MASK) >> OPEN_THREADS_SHFT);
     return wpc;
 }
 
@@ -476,6 +565,12 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
         return unpack_samples3 (wpc, buffer, samples);
 #endif
 
+    // once the block read at open (or by a seek) has been used up, the worker
+    // threads (if any) take over and deliver the rest of the file
+
+    if (wpc->unpack_workers && !wps->blockbuff)
+        return unpack_workers_samples (wpc, buffer, samples);
+
     while (samples) {
         if (!wps->wphdr.block_samples || !(wps->wphdr.flags & INITIAL_BLOCK) ||
             wps->sample_index >= wps->wphdr.block_index + wps->wphdr.block_samples) {
@@ -484,6 +579,12 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
                     break;
 
                 free_streams (wpc);
+
+                if (wpc->unpack_workers) {
+                    samples_unpacked += unpack_workers_samples (wpc, buffer, samples);
+                    break;
+                }
+
                 wpc->filepos = wpc->reader->get_pos (wpc->wv_in);
                 bcount = read_next_header (wpc->reader, wpc->wv_in, &wps->wphdr);
 
@@ -701,14 +802,17 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
 #ifndef NO_SEEKING
 
 static uint32_t find_sample (WavpackContext *wpc, void *infile, uint32_t header_pos, uint32_t sample);
+static int build_seek_index (WavpackContext *wpc);
+static int find_index_entry (WavpackContext *wpc, uint32_t sample);
 
 // Seek to the specifed sample index, returning TRUE on success. Note that
 // files generated with version 4.0 or newer will seek almost immediately.
 // Older files can take quite long if required to seek through unplayed
 // portions of the file, but will create a seek map so that reverse seeks
-// (or forward seeks to already scanned areas) will be very fast. After a
-// FALSE return the file should not be accessed again (other than to close
-// it); this is a fatal error.
+// (or forward seeks to already scanned areas) will be very fast. With a
+// seek index (see OPEN_SEEK_INDEX) the block is found without searching.
+// After a FALSE return the file should not be accessed again (other than to
+// close it); this is a fatal error.
 
 int WavpackSeekSample (WavpackContext *wpc, uint32_t sample)
 {
@@ -726,16 +830,26 @@ int WavpackSeekSample (WavpackContext *wpc, uint32_t sample)
         return seek_sample3 (wpc, sample);
 #endif
 
+    if (wpc->unpack_workers)
+        unpack_workers_reset (wpc);
+
     if (!wps->wphdr.block_samples || !(wps->wphdr.flags & INITIAL_BLOCK) || sample < wps->wphdr.block_index ||
         sample >= wps->wphdr.block_index + wps->wphdr.block_samples) {
 
             free_streams (wpc);
-            wpc->filepos = find_sample (wpc, wpc->wv_in, wpc->filepos, sample);
+
+            if (!wpc->seek_index && (wpc->open_flags & OPEN_SEEK_INDEX))
+                build_seek_index (wpc);
+
+            if (!wpc->seek_index || !find_index_entry (wpc, sample)) {
+                wpc->filepos = find_sample (wpc, wpc->wv_in, wpc->filepos, sample);
+                wpc->file2pos = (uint32_t) -1;
+            }
 
             if (wpc->filepos == (uint32_t) -1)
                 return FALSE;
 
-            if (wpc->wvc_flag) {
+            if (wpc->wvc_flag && wpc->file2pos == (uint32_t) -1) {
                 wpc->file2pos = find_sample (wpc, wpc->wvc_in, 0, sample);
 
                 if (wpc->file2pos == (uint32_t) -1)
@@ -854,6 +968,99 @@ int WavpackSeekSample (WavpackContext *wpc, uint32_t sample)
     return TRUE;
 }
 
+// Copy the seek index into "data" in the form that WavpackSetSeekIndex()
+// accepts, returning the number of bytes required. If "data" is NULL or
+// "size" is too small nothing is copied, so this can be called first to get
+// the size. Zero is returned if there is no index, which is only built by a
+// seek with OPEN_SEEK_INDEX (or loaded with WavpackSetSeekIndex()).
+
+uint32_t WavpackGetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size)
+{
+    WavpackIndexHeader ixhdr;
+    WavpackIndexEntry entry;
+    uint32_t bytes, i;
+
+    if (!wpc || !wpc->seek_index)
+        return 0;
+
+    bytes = sizeof (WavpackIndexHeader) + wpc->num_index_entries * sizeof (WavpackIndexEntry);
+
+    if (!data || size < bytes)
+        return bytes;
+
+    memcpy (ixhdr.ckID, "wvix", 4);
+    ixhdr.ckSize = bytes - 8;
+    ixhdr.version = INDEX_VERSION;
+    ixhdr.num_entries = wpc->num_index_entries;
+    ixhdr.filelen = wpc->filelen;
+    ixhdr.file2len = wpc->wvc_flag ? wpc->file2len : 0;
+    ixhdr.total_samples = wpc->total_samples;
+    ixhdr.initial_index = wpc->initial_index;
+    native_to_little_endian (&ixhdr, WavpackIndexHeaderFormat);
+    memcpy (data, &ixhdr, sizeof (WavpackIndexHeader));
+    data += sizeof (WavpackIndexHeader);
+
+    for (i = 0; i < wpc->num_index_entries; ++i) {
+        entry = wpc->seek_index [i];
+        native_to_little_endian (&entry, WavpackIndexEntryFormat);
+        memcpy (data, &entry, sizeof (WavpackIndexEntry));
+        data += sizeof (WavpackIndexEntry);
+    }
+
+    return bytes;
+}
+
+// Load a seek index previously obtained from WavpackGetSeekIndex() so that
+// seeks go directly to the right block without the index being built first.
+// The index is checked against the length(s) of the open file(s) and the
+// number of samples; if it does not match (or is damaged) FALSE is returned
+// and it is not used. Any index already present is replaced.
+
+int WavpackSetSeekIndex (WavpackContext *wpc, uchar *data, uint32_t size)
+{
+    WavpackIndexEntry *index;
+    WavpackIndexHeader ixhdr;
+    uint32_t i;
+
+    if (!wpc || wpc->stream3 || !data || size < sizeof (WavpackIndexHeader))
+        return FALSE;
+
+    memcpy (&ixhdr, data, sizeof (WavpackIndexHeader));
+    little_endian_to_native (&ixhdr, WavpackIndexHeaderFormat);
+    data += sizeof (WavpackIndexHeader);
+
+    if (strncmp (ixhdr.ckID, "wvix", 4) || ixhdr.version != INDEX_VERSION || !ixhdr.num_entries ||
+        ixhdr.num_entries > (size - sizeof (WavpackIndexHeader)) / sizeof (WavpackIndexEntry) ||
+        ixhdr.ckSize != sizeof (WavpackIndexHeader) - 8 + ixhdr.num_entries * sizeof (WavpackIndexEntry) ||
+        ixhdr.filelen != wpc->filelen || ixhdr.file2len != (wpc->wvc_flag ? wpc->file2len : 0) ||
+        ixhdr.total_samples != wpc->total_samples || ixhdr.initial_index != wpc->initial_index)
+            return FALSE;
+
+    index = malloc (ixhdr.num_entries * sizeof (WavpackIndexEntry));
+
+    if (!index)
+        return FALSE;
+
+    for (i = 0; i < ixhdr.num_entries; ++i) {
+        memcpy (index + i, data, sizeof (WavpackIndexEntry));
+        little_endian_to_native (index + i, WavpackIndexEntryFormat);
+        data += sizeof (WavpackIndexEntry);
+
+        if ((i && index [i].block_index <= index [i - 1].block_index) || index [i].filepos >= ixhdr.filelen ||
+            (index [i].file2pos != (uint32_t) -1 && index [i].file2pos >= ixhdr.file2len)) {
+                free (index);
+                return FALSE;
+        }
+    }
+
+    if (wpc->seek_index)
+        free (wpc->seek_index);
+
+    wpc->seek_index = index;
+    wpc->num_index_entries = ixhdr.num_entries;
+    return TRUE;
+}
+
 #endif
 
 #ifndef NO_TAGS
@@ -1169,12 +1376,19 @@ WavpackContext *WavpackOpenFileOutput (WavpackBlockOutput blockout, void *wv_id,
 // o CONFIG_OPTIMIZE_MONO       detect and optimize for mono files posing as
 //                               stereo (uses a more recent stream format that
 //                               is not compatible with decoders < 4.3)
+// o CONFIG_SERIAL_BLOCKS       don't pack blocks in parallel; worker threads
+//                               are then only used by the extra mode search,
+//                               which leaves the output identical to 1 thread
 
 // config->bitrate              hybrid bitrate in either bits/sample or kbps
 // config->shaping_weight       hybrid noise shaping coefficient override
 // config->block_samples        force samples per WavPack block (0 = use deflt)
 // config->float_norm_exp       select floating-point data (127 for +/-1.0)
 // config->xmode                extra mode processing value override
+// config->worker_threads       pack this many blocks at once on separate
+//                               threads (0 or 1 = pack on the calling thread)
+//                               or, where blocks must be packed in order,
+//                               use them for the extra mode search
 
 // If the number of samples to be written is known then it should be passed
 // here. If the duration is not known then pass -1. In the case that the size
@@ -1204,6 +1418,7 @@ int WavpackSetConfiguration (WavpackContext *wpc, WavpackConfig *config, uint32_
     wpc->config.bytes_per_sample = config->bytes_per_sample;
     wpc->config.block_samples = config->block_samples;
     wpc->config.flags = config->flags;
+    wpc->config.worker_threads = config->worker_threads;
 
     if (config->flags & CONFIG_VERY_HIGH_FLAG)
         wpc->config.flags |= CONFIG_HIGH_FLAG;
@@ -1367,6 +1582,7 @@ int WavpackPackInit (WavpackContext *wpc)
         pack_init (wpc);
     }
 
+    pack_workers_init (wpc);
     return TRUE;
 }
 
@@ -1459,6 +1675,9 @@ int WavpackFlushSamples (WavpackContext *wpc)
             return FALSE;
     }
 
+    if (!pack_workers_drain (wpc))
+        return FALSE;
+
     if (wpc->metacount)
         write_metadata_block (wpc);
 
@@ -1586,14 +1805,17 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples)
     uchar *outbuff, *outend, *out2buff, *out2end;
     int result = TRUE;
 
+    if (wpc->workers)
+        return pack_workers_block (wpc, block_samples);
+
     if ((wpc->config.flags & CONFIG_FLOAT_DATA) && !(wpc->config.flags & CONFIG_SKIP_WVX))
         max_blocksize = block_samples * 16 + 4096;
     else
         max_blocksize = block_samples * 10 + 4096;
 
-    out2buff = (wpc->wvc_flag) ? malloc (max_blocksize) : NULL;
+    out2buff = (wpc->wvc_flag) ? scratch_buffer (wpc, SCRATCH_OUT2BUFF, max_blocksize) : NULL;
     out2end = out2buff + max_blocksize;
-    outbuff = malloc (max_blocksize);
+    outbuff = scratch_buffer (wpc, SCRATCH_OUTBUFF, max_blocksize);
     outend = outbuff + max_blocksize;
 
     for (wpc->current_stream = 0; wpc->streams [wpc->current_stream]; wpc->current_stream++) {
@@ -1654,11 +1876,6 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples)
     wpc->current_stream = 0;
     wpc->ave_block_samples = (wpc->ave_block_samples * 0x7 + block_samples + 0x4) >> 3;
     wpc->acc_samples -= block_samples;
-    free (outbuff);
-
-    if (out2buff)
-        free (out2buff);
-
     return result;
 }
 
@@ -2098,11 +2315,31 @@ double WavpackGetInstantBitrate (WavpackContext *wpc)
 
 WavpackContext *WavpackCloseFile (WavpackContext *wpc)
 {
+#ifndef NO_PACK
+    pack_workers_free (wpc);
+    free_scratch (wpc);
+#endif
+
+    unpack_workers_free (wpc);
     free_streams (wpc);
 
     if (wpc->streams [0])
         free (wpc->streams [0]);
 
+#if !defined(NO_UNPACK) && !defined(NO_SEEKING)
+#ifndef NO_USE_FSTREAMS
+    if (wpc->index_filename) {
+        if (wpc->seek_index)
+            save_index_file (wpc);
+
+        free (wpc->index_filename);
+    }
+#endif
+
+    if (wpc->seek_index)
+        free (wpc->seek_index);
+#endif
+
 #if !defined(VER4_ONLY) && !defined(NO_UNPACK)
     if (wpc->stream3)
         free_stream3 (wpc);
@@ -2286,7 +2523,7 @@ int WavpackGetMD5Sum (WavpackContext *wpc, uchar data [16])
 // and free all additonal streams. This does not free the default stream ([0])
 // which is always kept around.
 
-static void free_streams (WavpackContext *wpc)
+void free_streams (WavpackContext *wpc)
 {
     int si = wpc->num_streams;
 
@@ -2625,6 +2862,109 @@ static int read_wvc_block (WavpackContext *wpc)
     }
 }
 
+#if !defined(NO_UNPACK) && !defined(NO_WORKER_THREADS)
+
+// Read the next frame (the blocks of every stream that hold one run of samples,
+// each with its correction block) from the files of "wpc" into the streams of
+// "fwpc", which is a worker's copy of "wpc". This is the reading that
+// WavpackUnpackSamples() does between blocks: blocks that don't start a frame
+// are skipped, a block holding only metadata is returned as a frame of its
+// own, and a block that doesn't start at "sample_index" (where the caller will
+// be when it gets to this frame) counts as an error. The file positions of the
+// frame are left in fwpc->filepos and fwpc->file2pos so that a seek can start
+// from it. FALSE is returned at the end of the file, or with a message in
+// fwpc->error_message if the frame can't be read.
+
+int read_next_frame (WavpackContext *wpc, WavpackContext *fwpc, uint32_t sample_index)
+{
+    WavpackStream *wps = fwpc->streams [fwpc->current_stream = 0];
+    uint32_t bcount;
+    int offset = 0;
+
+    while (1) {
+        if (wpc->wrapper_bytes >= MAX_WRAPPER_BYTES)
+            return FALSE;
+
+        free_streams (fwpc);
+        fwpc->filepos = wpc->reader->get_pos (wpc->wv_in);
+        bcount = read_next_header (wpc->reader, wpc->wv_in, &wps->wphdr);
+
+        if (bcount == (uint32_t) -1)
+            return FALSE;
+
+        if (wpc->open_flags & OPEN_STREAMING)
+            wps->wphdr.block_index = 0;
+        else
+            wps->wphdr.block_index -= wpc->initial_index;
+
+        fwpc->filepos += bcount;
+        wps->blockbuff = malloc (wps->wphdr.ckSize + 8);
+        memcpy (wps->blockbuff, &wps->wphdr, 32);
+
+        if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) !=
+            wps->wphdr.ckSize - 24) {
+                strcpy (fwpc->error_message, "can't read all of last block!");
+                return FALSE;
+        }
+
+        if (wps->wphdr.block_samples && !(wpc->open_flags & OPEN_STREAMING) &&
+            sample_index != wps->wphdr.block_index)
+                fwpc->crc_errors++;
+
+        if (wps->wphdr.block_samples && wpc->wvc_flag)
+            read_wvc_block (fwpc);
+
+        if (!wps->wphdr.block_samples || (wps->wphdr.flags & INITIAL_BLOCK))
+            break;
+    }
+
+    while (wps->wphdr.block_samples && !wpc->reduced_channels && !(wps->wphdr.flags & FINAL_BLOCK)) {
+        if (wps->wphdr.flags & MONO_FLAG)
+            offset++;
+        else
+            offset += (offset == wpc->config.num_channels - 1) ? 1 : 2;
+
+        if (offset == wpc->config.num_channels)
+            break;
+
+        if (fwpc->num_streams == MAX_STREAMS) {
+            strcpy (fwpc->error_message, "too many channels!");
+            return FALSE;
+        }
+
+        wps = fwpc->streams [fwpc->current_stream = fwpc->num_streams++] = malloc (sizeof (WavpackStream));
+        CLEAR (*wps);
+        bcount = read_next_header (wpc->reader, wpc->wv_in, &wps->wphdr);
+
+        if (bcount == (uint32_t) -1) {
+            strcpy (fwpc->error_message, "can't read all of last block!");
+            return FALSE;
+        }
+
+        if (wpc->open_flags & OPEN_STREAMING)
+            wps->wphdr.block_index = 0;
+        else
+            wps->wphdr.block_index -= wpc->initial_index;
+
+        wps->blockbuff = malloc (wps->wphdr.ckSize + 8);
+        memcpy (wps->blockbuff, &wps->wphdr, 32);
+
+        if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) !=
+            wps->wphdr.ckSize - 24) {
+                strcpy (fwpc->error_message, "can't read all of last block!");
+                return FALSE;
+        }
+
+        if (wpc->wvc_flag)
+            read_wvc_block (fwpc);
+    }
+
+    fwpc->current_stream = 0;
+    return TRUE;
+}
+
+#endif
+
 #ifndef NO_SEEKING
 
 // Find a valid WavPack header, searching either from the current file position
@@ -2761,6 +3101,124 @@ static uint32_t find_sample (WavpackContext *wpc, void *infile, uint32_t header_
     }
 }
 
+// Build the seek index by reading every block header in the file (and then
+// in the .wvc file) once, skipping over the audio data. This is only tried
+// once; if the file can't be indexed seeks simply go back to searching for
+// the block with find_sample(). The file positions are left undefined.
+
+static int build_seek_index (WavpackContext *wpc)
+{
+    uint32_t num_entries = 0, max_entries = 0, i = 0;
+    WavpackIndexEntry *index = NULL, *new_index;
+    WavpackHeader wphdr;
+
+    wpc->open_flags &= ~OPEN_SEEK_INDEX;
+
+    if (wpc->reader->set_pos_abs (wpc->wv_in, 0))
+        return FALSE;
+
+    while (read_next_header (wpc->reader, wpc->wv_in, &wphdr) != (uint32_t) -1) {
+        if (wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK)) {
+            if (num_entries && wphdr.block_index <= index [num_entries - 1].block_index) {
+                free (index);
+                return FALSE;
+            }
+
+            if (num_entries == max_entries) {
+                max_entries = max_entries ? max_entries * 2 : 1024;
+                new_index = realloc (index, max_entries * sizeof (WavpackIndexEntry));
+
+                if (!new_index) {
+                    free (index);
+                    return FALSE;
+                }
+
+                index = new_index;
+            }
+
+            index [num_entries].block_index = wphdr.block_index;
+            index [num_entries].filepos = wpc->reader->get_pos (wpc->wv_in) - sizeof (WavpackHeader);
+            index [num_entries++].file2pos = (uint32_t) -1;
+        }
+
+        if (wpc->reader->set_pos_rel (wpc->wv_in, wphdr.ckSize - 24, SEEK_CUR))
+            break;
+    }
+
+    if (!num_entries) {
+        if (index)
+            free (index);
+
+        return FALSE;
+    }
+
+    if (wpc->wvc_flag && !wpc->reader->set_pos_abs (wpc->wvc_in, 0))
+        while (read_next_header (wpc->reader, wpc->wvc_in, &wphdr) != (uint32_t) -1) {
+            if (wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK)) {
+                while (i < num_entries && index [i].block_index < wphdr.block_index)
+                    i++;
+
+                if (i < num_entries && index [i].block_index == wphdr.block_index)
+                    index [i].file2pos = wpc->reader->get_pos (wpc->wvc_in) - sizeof (WavpackHeader);
+            }
+
+            if (wpc->reader->set_pos_rel (wpc->wvc_in, wphdr.ckSize - 24, SEEK_CUR))
+                break;
+        }
+
+    wpc->seek_index = index;
+    wpc->num_index_entries = num_entries;
+    return TRUE;
+}
+
+// Find the block that contains the specified sample in the seek index and
+// set the file position(s) to it, returning FALSE if it's not there. The
+// header at that position is checked first, and if it is not the expected
+// block then the index does not belong to this file and is dropped.
+
+static int find_index_entry (WavpackContext *wpc, uint32_t sample)
+{
+    uint32_t low = 0, high = wpc->num_index_entries, mid;
+    WavpackIndexEntry *entry;
+    WavpackHeader wphdr;
+
+    sample += wpc->initial_index;
+
+    while (high - low > 1) {
+        mid = (low + high) >> 1;
+
+        if (wpc->seek_index [mid].block_index <= sample)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    entry = wpc->seek_index + low;
+
+    if (entry->block_index > sample)
+        return FALSE;
+
+    if (!wpc->reader->set_pos_abs (wpc->wv_in, entry->filepos) &&
+        wpc->reader->read_bytes (wpc->wv_in, &wphdr, sizeof (WavpackHeader)) == sizeof (WavpackHeader) &&
+        !strncmp (wphdr.ckID, "wvpk", 4)) {
+            little_endian_to_native (&wphdr, WavpackHeaderFormat);
+
+            if (wphdr.block_index == entry->block_index && wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK)) {
+                if (sample - wphdr.block_index >= wphdr.block_samples)
+                    return FALSE;
+
+                wpc->filepos = entry->filepos;
+                wpc->file2pos = entry->file2pos;
+                return TRUE;
+            }
+    }
+
+    free (wpc->seek_index);
+    wpc->seek_index = NULL;
+    wpc->num_index_entries = 0;
+    return FALSE;
+}
+
 #endif
 
 #ifndef NO_TAGS
@@ -0,0 +1,548 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2006 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// decorr_test.c
+
+// This program checks the SSE4.1 and AVX2 tables of decorr_sse.c against the
+// C code. Random runs of stereo decorrelation passes are packed and unpacked
+// both ways, and the samples, weights and history left behind must match
+// exactly. The log2buffer() versions must give the same sums, and fail the
+// same limits, as the C loop in words.c. Levels that the processor can't run
+// are skipped. It is built with
+// the library sources, for example with MinGW:
+//
+//   gcc -O2 -I../src -o decorr_test decorr_test.c ../src/*.c
+//
+// and returns 0 if everything matched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#define MAX_TEST_SAMPLES    5000
+#define MAX_TEST_PASSES     16
+
+extern const char nbits_table [];
+extern const uchar log2_table [];
+
+// the kinds of input every set of passes is run on
+
+enum { INPUT_RANDOM, INPUT_QUIET, INPUT_SINE, INPUT_EXTREMES, INPUT_ZERO, NUM_INPUTS };
+
+static const char *input_names [NUM_INPUTS] = { "random", "quiet", "sine", "extremes", "zero" };
+
+static uint32_t random_seed = 1;
+
+static int32_t get_random (void)
+{
+    // fixed sequence, so a failure can be reproduced
+
+    random_seed = random_seed * 1664525 + 1013904223;
+    return (int32_t) (random_seed >> 8);
+}
+
+// Fill the buffer with 16-bit stereo audio of the given kind (the SIMD
+// passes are only used for data of 16 bits or less).
+
+static void fill_input (int32_t *buffer, int32_t sample_count, int input)
+{
+    int32_t i, sine = 0, cosine = 12000;
+
+    for (i = 0; i < sample_count * 2; ++i)
+        switch (input) {
+            case INPUT_RANDOM:
+                buffer [i] = (int16_t) get_random ();
+                break;
+
+            case INPUT_QUIET:
+                buffer [i] = (get_random () % 7) - 3;
+                break;
+
+            case INPUT_SINE:
+                if (i & 1)
+                    buffer [i] = (sine >> 1) + (get_random () % 64);
+                else {
+                    sine += cosine >> 5;
+                    cosine -= sine >> 5;
+                    buffer [i] = sine;
+                }
+
+                break;
+
+            case INPUT_EXTREMES:
+                buffer [i] = (i & 2) ? 32767 : -32768;
+                break;
+
+            default:
+                buffer [i] = 0;
+                break;
+        }
+}
+
+// The C passes the table stands in for. These are the general passes from
+// pack.c and unpack.c, except that the positive terms use apply_weight_i()
+// like the lower resolution versions (decorr_stereo_pass_id2() and
+// decorr_stereo_pass_i()), which is what the SIMD code reproduces. The
+// negative terms are never taken by the table, so they are just as in C.
+
+static void pack_stereo_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count)
+{
+    int32_t *bptr, *eptr = buffer + (sample_count * 2);
+    int m, k;
+
+    switch (dpp->term) {
+        case 17: case 18:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam, tmp;
+
+                if (dpp->term == 17)
+                    sam = 2 * dpp->samples_A [0] - dpp->samples_A [1];
+                else
+                    sam = dpp->samples_A [0] + ((dpp->samples_A [0] - dpp->samples_A [1]) >> 1);
+
+                dpp->samples_A [1] = dpp->samples_A [0];
+                bptr [0] = tmp = (dpp->samples_A [0] = bptr [0]) - apply_weight_i (dpp->weight_A, sam);
+                update_weight (dpp->weight_A, dpp->delta, sam, tmp);
+
+                if (dpp->term == 17)
+                    sam = 2 * dpp->samples_B [0] - dpp->samples_B [1];
+                else
+                    sam = dpp->samples_B [0] + ((dpp->samples_B [0] - dpp->samples_B [1]) >> 1);
+
+                dpp->samples_B [1] = dpp->samples_B [0];
+                bptr [1] = tmp = (dpp->samples_B [0] = bptr [1]) - apply_weight_i (dpp->weight_B, sam);
+                update_weight (dpp->weight_B, dpp->delta, sam, tmp);
+            }
+
+            break;
+
+        default:
+            for (m = 0, k = dpp->term & (MAX_TERM - 1), bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam, tmp;
+
+                sam = dpp->samples_A [m];
+                bptr [0] = tmp = (dpp->samples_A [k] = bptr [0]) - apply_weight_i (dpp->weight_A, sam);
+                update_weight (dpp->weight_A, dpp->delta, sam, tmp);
+
+                sam = dpp->samples_B [m];
+                bptr [1] = tmp = (dpp->samples_B [k] = bptr [1]) - apply_weight_i (dpp->weight_B, sam);
+                update_weight (dpp->weight_B, dpp->delta, sam, tmp);
+
+                m = (m + 1) & (MAX_TERM - 1);
+                k = (k + 1) & (MAX_TERM - 1);
+            }
+
+            if (m) {
+                int32_t temp_A [MAX_TERM], temp_B [MAX_TERM];
+
+                memcpy (temp_A, dpp->samples_A, sizeof (dpp->samples_A));
+                memcpy (temp_B, dpp->samples_B, sizeof (dpp->samples_B));
+
+                for (k = 0; k < MAX_TERM; k++) {
+                    dpp->samples_A [k] = temp_A [m];
+                    dpp->samples_B [k] = temp_B [m];
+                    m = (m + 1) & (MAX_TERM - 1);
+                }
+            }
+
+            break;
+
+        case -1:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam_A, sam_B, tmp;
+
+                sam_A = dpp->samples_A [0];
+                bptr [0] = tmp = (sam_B = bptr [0]) - apply_weight (dpp->weight_A, sam_A);
+                update_weight_clip (dpp->weight_A, dpp->delta, sam_A, tmp);
+
+                bptr [1] = tmp = (dpp->samples_A [0] = bptr [1]) - apply_weight (dpp->weight_B, sam_B);
+                update_weight_clip (dpp->weight_B, dpp->delta, sam_B, tmp);
+            }
+
+            break;
+
+        case -2:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam_A, sam_B, tmp;
+
+                sam_B = dpp->samples_B [0];
+                bptr [1] = tmp = (sam_A = bptr [1]) - apply_weight (dpp->weight_B, sam_B);
+                update_weight_clip (dpp->weight_B, dpp->delta, sam_B, tmp);
+
+                bptr [0] = tmp = (dpp->samples_B [0] = bptr [0]) - apply_weight (dpp->weight_A, sam_A);
+                update_weight_clip (dpp->weight_A, dpp->delta, sam_A, tmp);
+            }
+
+            break;
+
+        case -3:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam_A, sam_B, tmp;
+
+                sam_A = dpp->samples_A [0];
+                sam_B = dpp->samples_B [0];
+
+                dpp->samples_A [0] = tmp = bptr [1];
+                bptr [1] = tmp -= apply_weight (dpp->weight_B, sam_B);
+                update_weight_clip (dpp->weight_B, dpp->delta, sam_B, tmp);
+
+                dpp->samples_B [0] = tmp = bptr [0];
+                bptr [0] = tmp -= apply_weight (dpp->weight_A, sam_A);
+                update_weight_clip (dpp->weight_A, dpp->delta, sam_A, tmp);
+            }
+
+            break;
+    }
+}
+
+static void unpack_stereo_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count)
+{
+    int32_t *bptr, *eptr = buffer + (sample_count * 2);
+    int m, k;
+
+    switch (dpp->term) {
+        case 17: case 18:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam, tmp;
+
+                if (dpp->term == 17)
+                    sam = 2 * dpp->samples_A [0] - dpp->samples_A [1];
+                else
+                    sam = dpp->samples_A [0] + ((dpp->samples_A [0] - dpp->samples_A [1]) >> 1);
+
+                dpp->samples_A [1] = dpp->samples_A [0];
+                bptr [0] = dpp->samples_A [0] = apply_weight_i (dpp->weight_A, sam) + (tmp = bptr [0]);
+                update_weight (dpp->weight_A, dpp->delta, sam, tmp);
+
+                if (dpp->term == 17)
+                    sam = 2 * dpp->samples_B [0] - dpp->samples_B [1];
+                else
+                    sam = dpp->samples_B [0] + ((dpp->samples_B [0] - dpp->samples_B [1]) >> 1);
+
+                dpp->samples_B [1] = dpp->samples_B [0];
+                bptr [1] = dpp->samples_B [0] = apply_weight_i (dpp->weight_B, sam) + (tmp = bptr [1]);
+                update_weight (dpp->weight_B, dpp->delta, sam, tmp);
+            }
+
+            break;
+
+        default:
+            for (m = 0, k = dpp->term & (MAX_TERM - 1), bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam;
+
+                sam = dpp->samples_A [m];
+                dpp->samples_A [k] = apply_weight_i (dpp->weight_A, sam) + bptr [0];
+                update_weight (dpp->weight_A, dpp->delta, sam, bptr [0]);
+                bptr [0] = dpp->samples_A [k];
+
+                sam = dpp->samples_B [m];
+                dpp->samples_B [k] = apply_weight_i (dpp->weight_B, sam) + bptr [1];
+                update_weight (dpp->weight_B, dpp->delta, sam, bptr [1]);
+                bptr [1] = dpp->samples_B [k];
+
+                m = (m + 1) & (MAX_TERM - 1);
+                k = (k + 1) & (MAX_TERM - 1);
+            }
+
+            break;
+
+        case -1:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam;
+
+                sam = bptr [0] + apply_weight (dpp->weight_A, dpp->samples_A [0]);
+                update_weight_clip (dpp->weight_A, dpp->delta, dpp->samples_A [0], bptr [0]);
+                bptr [0] = sam;
+                dpp->samples_A [0] = bptr [1] + apply_weight (dpp->weight_B, sam);
+                update_weight_clip (dpp->weight_B, dpp->delta, sam, bptr [1]);
+                bptr [1] = dpp->samples_A [0];
+            }
+
+            break;
+
+        case -2:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam;
+
+                sam = bptr [1] + apply_weight (dpp->weight_B, dpp->samples_B [0]);
+                update_weight_clip (dpp->weight_B, dpp->delta, dpp->samples_B [0], bptr [1]);
+                bptr [1] = sam;
+                dpp->samples_B [0] = bptr [0] + apply_weight (dpp->weight_A, sam);
+                update_weight_clip (dpp->weight_A, dpp->delta, sam, bptr [0]);
+                bptr [0] = dpp->samples_B [0];
+            }
+
+            break;
+
+        case -3:
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                int32_t sam_A, sam_B;
+
+                sam_A = bptr [0] + apply_weight (dpp->weight_A, dpp->samples_A [0]);
+                update_weight_clip (dpp->weight_A, dpp->delta, dpp->samples_A [0], bptr [0]);
+                sam_B = bptr [1] + apply_weight (dpp->weight_B, dpp->samples_B [0]);
+                update_weight_clip (dpp->weight_B, dpp->delta, dpp->samples_B [0], bptr [1]);
+                bptr [0] = dpp->samples_B [0] = sam_A;
+                bptr [1] = dpp->samples_A [0] = sam_B;
+            }
+
+            break;
+    }
+}
+
+// Run all the passes over the buffer the way pack_samples() does: the table
+// takes as many passes as it can and the C code does the rest. With no table
+// everything is done in C.
+
+static void pack_passes (const WavpackDecorrFuncs *funcs, struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    int tcount, done;
+
+    for (tcount = num_passes; tcount--; dpp++)
+        if (funcs && (done = funcs->pack_stereo_passes (dpp, tcount + 1, buffer, sample_count))) {
+            tcount -= done - 1;
+            dpp += done - 1;
+        }
+        else
+            pack_stereo_pass (dpp, buffer, sample_count);
+}
+
+// The decoder runs the passes in reverse order, so the table is handed the
+// passes reversed as well (which is how unpack_samples() stores them).
+
+static void unpack_passes (const WavpackDecorrFuncs *funcs, struct decorr_pass *dpp, int num_passes, int32_t *buffer, int32_t sample_count)
+{
+    int tcount, done;
+
+    for (tcount = num_passes; tcount--; dpp++)
+        if (funcs && (done = funcs->unpack_stereo_passes (dpp, tcount + 1, buffer, sample_count))) {
+            tcount -= done - 1;
+            dpp += done - 1;
+        }
+        else
+            unpack_stereo_pass (dpp, buffer, sample_count);
+}
+
+// Make up a set of passes like the ones the encoder uses (most of them the
+// positive terms the table can group, with a negative one now and then to
+// break the groups up) with random weights and history.
+
+static int make_passes (struct decorr_pass *dpp, int extremes)
+{
+    static const int terms [] = { 1, 2, 3, 4, 5, 6, 7, 8, 17, 18, 17, 18, -1, -2, -3 };
+    int num_passes = 1 + (get_random () & 0xffff) % MAX_TEST_PASSES, i, j;
+
+    memset (dpp, 0, sizeof (struct decorr_pass) * MAX_TEST_PASSES);
+
+    for (i = 0; i < num_passes; ++i) {
+        dpp [i].term = terms [(get_random () & 0xffff) % (sizeof (terms) / sizeof (terms [0]))];
+        dpp [i].delta = (get_random () & 0xffff) % 8;
+        dpp [i].weight_A = extremes ? 1024 : (get_random () % 2049) - 1024;
+        dpp [i].weight_B = extremes ? -1024 : (get_random () % 2049) - 1024;
+
+        for (j = 0; j < MAX_TERM; ++j) {
+            dpp [i].samples_A [j] = extremes ? 32767 : (int16_t) get_random ();
+            dpp [i].samples_B [j] = extremes ? -32768 : (int16_t) get_random ();
+        }
+    }
+
+    return num_passes;
+}
+
+// Run one test with the given table and return TRUE if it matched the C code
+
+static int run_test (const WavpackDecorrFuncs *funcs, int input, int32_t sample_count, int extremes)
+{
+    static int32_t original [MAX_TEST_SAMPLES * 2], c_buffer [MAX_TEST_SAMPLES * 2], simd_buffer [MAX_TEST_SAMPLES * 2];
+    struct decorr_pass start_passes [MAX_TEST_PASSES], c_passes [MAX_TEST_PASSES], simd_passes [MAX_TEST_PASSES];
+    int num_passes = make_passes (start_passes, extremes), i;
+
+    fill_input (original, sample_count, input);
+    memcpy (c_passes, start_passes, sizeof (start_passes));
+    memcpy (simd_passes, start_passes, sizeof (start_passes));
+    memcpy (c_buffer, original, sample_count * 8);
+    memcpy (simd_buffer, original, sample_count * 8);
+
+    // pack: the residuals and the state left in the passes must match
+
+    pack_passes (NULL, c_passes, num_passes, c_buffer, sample_count);
+    pack_passes (funcs, simd_passes, num_passes, simd_buffer, sample_count);
+
+    if (memcmp (c_buffer, simd_buffer, sample_count * 8) || memcmp (c_passes, simd_passes, sizeof (c_passes)))
+        return FALSE;
+
+    // unpack: decode the residuals from the starting state, which must give
+    // back the original samples (and the same state both ways)
+
+    for (i = 0; i < num_passes; ++i)
+        c_passes [i] = simd_passes [i] = start_passes [num_passes - 1 - i];
+
+    memcpy (simd_buffer, c_buffer, sample_count * 8);
+    unpack_passes (NULL, c_passes, num_passes, c_buffer, sample_count);
+    unpack_passes (funcs, simd_passes, num_passes, simd_buffer, sample_count);
+
+    return !memcmp (c_buffer, original, sample_count * 8) && !memcmp (simd_buffer, original, sample_count * 8) &&
+        !memcmp (c_passes, simd_passes, sizeof (struct decorr_pass) * num_passes);
+}
+
+// The C version of log2buffer() (the loop in words.c that handles whatever
+// the table doesn't)
+
+static uint32_t log2buffer_c (int32_t *samples, uint32_t num_samples, int limit)
+{
+    uint32_t result = 0, avalue;
+    int dbits;
+
+    while (num_samples--) {
+        avalue = abs (*samples++);
+
+        if ((avalue += avalue >> 9) < (1 << 8)) {
+            dbits = nbits_table [avalue];
+            result += (dbits << 8) + log2_table [(avalue << (9 - dbits)) & 0xff];
+        }
+        else {
+            if (avalue < (1L << 16))
+                dbits = nbits_table [avalue >> 8] + 8;
+            else if (avalue < (1L << 24))
+                dbits = nbits_table [avalue >> 16] + 16;
+            else
+                dbits = nbits_table [avalue >> 24] + 24;
+
+            result += dbits = (dbits << 8) + log2_table [(avalue >> (dbits - 9)) & 0xff];
+
+            if (limit && dbits >= limit)
+                return (uint32_t) -1;
+        }
+    }
+
+    return result;
+}
+
+// Fill the buffer for a log2buffer() test. Besides random values of various
+// sizes this has the values on both sides of every point where the C code
+// changes its shift (the "avalue >> 9" rounding moves those down a little,
+// so a range around each power of two is covered) and the largest values.
+
+static void fill_log2_input (int32_t *samples, uint32_t num_samples, int input)
+{
+    uint32_t i;
+
+    for (i = 0; i < num_samples; ++i)
+        switch (input) {
+            case 0:
+                samples [i] = get_random () >> (get_random () & 0x1f);
+                samples [i] = (get_random () & 1) ? -samples [i] : samples [i];
+                break;
+
+            case 1:
+                samples [i] = (int32_t) ((uint32_t) get_random () << 8 | (get_random () & 0xff));
+                break;
+
+            case 2: {
+                int32_t power = (int32_t) 1 << (i / 16 % 31), offset = (int32_t) (i % 16) - 8 - (power >> 9);
+
+                samples [i] = (i & 1) ? -(power + offset) : power + offset;
+                break;
+            }
+
+            case 3:
+                samples [i] = (i & 1) ? 0x7fffffff : (int32_t) 0x80000000;
+                samples [i] = (i & 2) ? samples [i] : (i & 4) ? 0x7f800000 : 0;
+                break;
+
+            default:
+                samples [i] = (get_random () % 512) - 256;
+                break;
+        }
+}
+
+// Check one log2buffer() table entry against the C code on every kind of
+// input, with no limit, with fixed limits and with limits of exactly the
+// largest log2 in the buffer and one more (the limit fails when it's
+// reached). The table only ever gets multiples of 8 samples; log2buffer()
+// itself (which does the rest in C) is checked with other counts.
+
+static int run_log2_tests (const char *level_name, const WavpackDecorrFuncs *funcs, int *tests)
+{
+    static const uint32_t sample_counts [] = { 8, 16, 24, 64, 1024, 4096 };
+    static int32_t samples [4096 + 7];
+    int limits [] = { 0, 0x800, 0x1000, 0x1800, 0x1f00, 0x2100, 0, 0 };
+    int num_limits = sizeof (limits) / sizeof (limits [0]), input, count, limit, failures = 0;
+
+    for (input = 0; input < 5; ++input)
+        for (count = 0; count < (int) (sizeof (sample_counts) / sizeof (sample_counts [0])); ++count) {
+            uint32_t max_log = 0, i;
+
+            fill_log2_input (samples, sample_counts [count] + 7, input);
+
+            for (i = 0; i < sample_counts [count]; ++i)
+                if (log2buffer_c (samples + i, 1, 0) > max_log)
+                    max_log = log2buffer_c (samples + i, 1, 0);
+
+            limits [num_limits - 2] = max_log;
+            limits [num_limits - 1] = max_log + 1;
+
+            for (limit = 0; limit < num_limits; ++limit) {
+                uint32_t num_samples = sample_counts [count];
+
+                (*tests) += 2;
+
+                if (funcs->log2buffer (samples, num_samples, limits [limit]) != log2buffer_c (samples, num_samples, limits [limit])) {
+                    printf ("FAILED: %s log2buffer, input %d, %u samples, limit 0x%x\n", level_name, input, num_samples, limits [limit]);
+                    failures++;
+                }
+
+                num_samples += 1 + (input + limit) % 7;
+
+                if (log2buffer (samples, num_samples, limits [limit]) != log2buffer_c (samples, num_samples, limits [limit])) {
+                    printf ("FAILED: log2buffer, input %d, %u samples, limit 0x%x\n", input, num_samples, limits [limit]);
+                    failures++;
+                }
+            }
+        }
+
+    return failures;
+}
+
+int main (void)
+{
+    // around the ring size (MAX_TERM), the batch sizes and a real block
+
+    static const int32_t sample_counts [] = { 1, 2, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 255, 4097, MAX_TEST_SAMPLES };
+    static const char *level_names [] = { NULL, "SSE4.1", "AVX2" };
+    int level, input, count, extremes, round, tests = 0, failures = 0;
+
+    for (level = DECORR_FUNCS_SSE41; level <= DECORR_FUNCS_AVX2; ++level) {
+        const WavpackDecorrFuncs *funcs = get_decorr_funcs_level (level);
+
+        if (!funcs) {
+            printf ("%s can't be run here, skipped\n", level_names [level]);
+            continue;
+        }
+
+        for (input = 0; input < NUM_INPUTS; ++input)
+            for (count = 0; count < (int) (sizeof (sample_counts) / sizeof (sample_counts [0])); ++count)
+                for (extremes = 0; extremes < 2; ++extremes)
+                    for (round = 0; round < 8; ++round) {
+                        tests++;
+
+                        if (!run_test (funcs, input, sample_counts [count], extremes)) {
+                            printf ("FAILED: %s, %s input, %d samples%s\n", level_names [level], input_names [input],
+                                sample_counts [count], extremes ? ", extreme weights and history" : "");
+                            failures++;
+                        }
+                    }
+
+        failures += run_log2_tests (level_names [level], funcs, &tests);
+    }
+
+    printf ("%d of %d tests passed\n", tests - failures, tests);
+    return failures ? 1 : 0;
+}